@@ -23,17 +23,21 @@
 #include "simplearg.h"
 #include "simplecmd.h"
 #include "simplestr.h"
+#include "simplesign.h"
 #include "impact.h"
 #include "config.h"
 
 #include <sys/types.h>
+#include <sys/socket.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <inttypes.h>
 #include <signal.h>
 #include <stdio.h>
 #include <errno.h>
+#include <time.h>
 
 /// Local command handler instance
 static simplecmd_t cmdd = NULL;
@@ -62,8 +66,14 @@ static simplepost_t httpd = NULL;
  */
 static bool __resolve_pid(simplearg_t args)
 {
-	if(args->options & SA_OPT_NEW)
+	if(args->options & SA_OPT_HANDOFF)
 	{
+		// We always take over from an existing instance, even when keeping a journal or index.
+		args->pid = simplecmd_find_inst(args->address, args->port, args->pid);
+	}
+	else if(args->options & SA_OPT_NEW || args->journal || args->index)
+	{
+		// An instance keeping a journal or index always serves its own files.
 		args->pid = 0;
 	}
 	else if(args->pid)
@@ -135,65 +145,100 @@ static bool __is_pid_valid(const simplearg_t args)
 /*!
  * \brief Print the list of accessible SimplePost instances.
  *
+ * \note The instances are described entirely from their registry records, so
+ * this function does not need to connect to any of them.
+ *
  * \return true if all instances were enumerated successfully, false if not
  */
 static bool __list_inst()
 {
 	simplecmd_list_t sclp; // List of SimplePost Command instances
-	char* address;         // Address of the server
-	unsigned short port;   // Port the server is listening on
-	char* version;         // Server's version
-	size_t failures = 0;   // Number of instances that we failed to query
+	size_t failures = 0;   // Number of instances that we failed to describe
 
 	simplecmd_list_inst(&sclp);
 	for(simplecmd_list_t p = sclp; p; p = p->next)
 	{
-		if(simplecmd_get_version(p->inst_pid, &version) == 0)
+		if(p->address == NULL || p->version == NULL || p->port == 0)
 		{
-			impact(0, "%s: Failed to get the version of the %s instance with PID %d\n",
+			impact(0, "%s: The %s instance with PID %d has not registered its ADDRESS, PORT, and version\n",
 				SP_MAIN_HEADER_NAMESPACE, SP_MAIN_DESCRIPTION,
 				p->inst_pid);
 			++failures;
 			continue;
 		}
 
-		if(simplecmd_get_address(p->inst_pid, &address) == 0)
-		{
-			impact(0, "%s: Failed to get the address of the %s instance with PID %d\n",
-				SP_MAIN_HEADER_NAMESPACE, SP_MAIN_DESCRIPTION,
-				p->inst_pid);
-			++failures;
-			free(version);
-			continue;
-		}
-
-		port = simplecmd_get_port(p->inst_pid);
-		if(port == 0)
-		{
-			impact(0, "%s: Failed to get the port of the %s instance with PID %d\n",
-				SP_MAIN_HEADER_NAMESPACE, SP_MAIN_DESCRIPTION,
-				p->inst_pid);
-			++failures;
-			free(address);
-			free(version);
-			continue;
-		}
-
 		printf("[PID %d] %s %s serving files on %s:%hu\n",
 			p->inst_pid,
-			SP_MAIN_DESCRIPTION, version,
-			address, port);
-		free(address);
-		free(version);
+			SP_MAIN_DESCRIPTION, p->version,
+			p->address, p->port);
 	}
 	simplecmd_list_free(sclp);
 
 	return (failures == 0);
 }
 
+/*!
+ * \brief State shared by __list_files() and __print_file()
+ */
+struct list_files_state
+{
+	/// PID of the instance whose files are being listed
+	pid_t pid;
+
+	/// Number of files we failed to print
+	size_t failures;
+};
+
+/*!
+ * \brief Print a file being served by another SimplePost instance.
+ *
+ * \param[in] file File being served
+ * \param[in] arg  Listing state (struct list_files_state)
+ *
+ * \return true to continue the listing
+ */
+static bool __print_file(simplepost_file_t file, void* arg)
+{
+	struct list_files_state* state = (struct list_files_state*) arg;
+	char count_buf[1024]; // COUNT string of the file being served
+	char expiry_buf[128]; // Expiry string of the file being served
+
+	if(simplestr_count_to_str(count_buf, sizeof(count_buf)/sizeof(count_buf[0]), file->count) == 0)
+	{
+		impact(0, "%s: Failed to convert the %s COUNT to a string\n",
+			SP_MAIN_HEADER_NAMESPACE,
+			file->file);
+		++(state->failures);
+		return true;
+	}
+
+	if(file->expires == 0)
+	{
+		printf("[PID %d] Serving %s on %s %s\n",
+			state->pid, file->file, file->url, count_buf);
+	}
+	else if(simplestr_expiry_to_str(expiry_buf, sizeof(expiry_buf)/sizeof(expiry_buf[0]), file->expires))
+	{
+		printf("[PID %d] Serving %s on %s %s %s\n",
+			state->pid, file->file, file->url, count_buf, expiry_buf);
+	}
+	else
+	{
+		impact(0, "%s: Failed to convert the %s expiry time to a string\n",
+			SP_MAIN_HEADER_NAMESPACE,
+			file->file);
+		++(state->failures);
+	}
+
+	return true;
+}
+
 /*!
  * \brief Print the list of files in the specified SimplePost instance.
  *
+ * \note Files are printed as they are received, so listing an instance
+ * serving a huge number of files does not require holding them all in memory.
+ *
  * \param[in] args Arguments passed to this program
  *
  * \return true if all files being served by the specified instance were
@@ -201,13 +246,12 @@ static bool __list_inst()
  */
 static bool __list_files(const simplearg_t args)
 {
-	simplepost_file_t files; // List of files being served by the server
-	ssize_t count;           // Number of files being served
-	char count_buf[1024];    // COUNT string of the file being served
-	size_t failures = 0;     // Number of files we failed to print
+	struct list_files_state state; // Listing state shared with __print_file()
 
-	count = simplecmd_get_files(args->pid, &files);
-	if(count < 0)
+	state.pid = args->pid;
+	state.failures = 0;
+
+	if(simplecmd_foreach_file(args->pid, args->match, &__print_file, &state) < 0)
 	{
 		impact(0, "%s: Failed to get the list of files being served by the %s instance with PID %d\n",
 			SP_MAIN_HEADER_NAMESPACE, SP_MAIN_DESCRIPTION,
@@ -215,24 +259,164 @@ static bool __list_files(const simplearg_t args)
 		return false;
 	}
 
-	for(simplepost_file_t p = files; p; p = p->next)
+	return (state.failures == 0);
+}
+
+/*!
+ * \brief Print an event from another SimplePost instance.
+ *
+ * \param[in] event Event published by the other instance
+ * \param[in] arg   PID of the other instance (pid_t*)
+ *
+ * \return true to keep receiving events
+ */
+static bool __print_event(simplepost_event_t event, void* arg)
+{
+	pid_t pid = *((pid_t*) arg); // PID of the instance publishing the event
+	char count_buf[1024];        // COUNT string of the file
+
+	if(event->dropped)
 	{
-		if(simplestr_count_to_str(count_buf, sizeof(count_buf)/sizeof(count_buf[0]), p->count) == 0)
-		{
-			impact(0, "%s: Failed to convert the %s COUNT to a string\n",
-				SP_MAIN_HEADER_NAMESPACE,
-				p->file);
-			++failures;
-			continue;
-		}
+		impact(0, "%s: Missed %zu events from the %s instance with PID %d\n",
+			SP_MAIN_HEADER_NAMESPACE,
+			event->dropped, SP_MAIN_DESCRIPTION, pid);
+	}
 
-		printf("[PID %d] Serving %s on %s %s\n",
-			args->pid, p->file, p->url, count_buf);
+	switch(event->type)
+	{
+		case SP_EVENT_FILE_ADDED:
+			if(simplestr_count_to_str(count_buf, sizeof(count_buf)/sizeof(count_buf[0]), event->count) == 0) count_buf[0] = '\0';
+			printf("[PID %d] %s %s %s %s\n",
+				pid, simplepost_event_name(event->type),
+				event->uri, event->file, count_buf);
+			break;
+
+		case SP_EVENT_DOWNLOAD_STARTED:
+		case SP_EVENT_DOWNLOAD_COMPLETED:
+		case SP_EVENT_DOWNLOAD_ABORTED:
+			printf("[PID %d] %s %s %s %zu bytes\n",
+				pid, simplepost_event_name(event->type),
+				event->uri, event->file, event->bytes);
+			break;
+
+		default:
+			printf("[PID %d] %s %s %s\n",
+				pid, simplepost_event_name(event->type),
+				event->uri, event->file);
+			break;
 	}
 
-	simplepost_file_free(files);
+	/* Whoever is reading these events probably wants them now, not when the
+	 * buffer happens to fill up.
+	 */
+	fflush(stdout);
 
-	return (failures == 0);
+	return true;
+}
+
+/*!
+ * \brief Print events from the specified SimplePost instance as they happen.
+ *
+ * \note This function does not return until the other instance shuts down.
+ *
+ * \param[in] args Arguments passed to this program
+ *
+ * \return true if we received events until the other instance shut down,
+ * false if we could not subscribe to its events
+ */
+static bool __list_events(const simplearg_t args)
+{
+	pid_t pid = args->pid; // PID of the instance to receive events from
+
+	if(simplecmd_subscribe(pid, &__print_event, &pid) == false)
+	{
+		impact(0, "%s: Failed to receive events from the %s instance with PID %d\n",
+			SP_MAIN_HEADER_NAMESPACE, SP_MAIN_DESCRIPTION,
+			pid);
+		return false;
+	}
+
+	return true;
+}
+
+/*!
+ * \brief Print how much of a file being served by another SimplePost instance
+ * is in the page cache.
+ *
+ * \param[in] file File being served
+ * \param[in] arg  PID of the other instance (pid_t*)
+ *
+ * \return true to continue the listing
+ */
+static bool __print_residency(simplepost_file_t file, void* arg)
+{
+	pid_t pid = *((pid_t*) arg); // PID of the instance serving the file
+	uint64_t resident;           // Number of bytes of the file in the page cache
+	uint64_t size;               // Size of the file
+
+	if(simplepost_get_residency(file->file, &resident, &size) == false)
+	{
+		printf("[PID %d] Page cache: %s unknown\n", pid, file->file);
+		return true;
+	}
+
+	printf("[PID %d] Page cache: %s %" PRIu64 " of %" PRIu64 " bytes (%.1f%%)\n",
+		pid, file->file, resident, size,
+		size ? (100.0 * resident) / size : 100.0);
+
+	return true;
+}
+
+/*!
+ * \brief Print the current status of the specified SimplePost instance.
+ *
+ * \note The page cache is shared by every process on this system, so how much
+ * of each file is cached is determined here rather than by the other instance.
+ *
+ * \param[in] args Arguments passed to this program
+ *
+ * \return true if the status was printed, false if it could not be retrieved
+ */
+static bool __list_status(const simplearg_t args)
+{
+	struct simplepost_status status; // Status of the other instance
+	size_t lookups;                  // Number of MIME type lookups
+
+	if(simplecmd_get_status(args->pid, &status) == false)
+	{
+		impact(0, "%s: Failed to get the status of the %s instance with PID %d\n",
+			SP_MAIN_HEADER_NAMESPACE, SP_MAIN_DESCRIPTION,
+			args->pid);
+		return false;
+	}
+
+	lookups = status.mime_hits + status.mime_misses;
+
+	printf("[PID %d] Uptime: %lu seconds\n", args->pid, status.uptime);
+	printf("[PID %d] Files: %zu (%zu unlimited, %zu downloads remaining on the rest)\n",
+		args->pid, status.files, status.files_unlimited, status.downloads_remaining);
+	if(status.files_indexed) printf("[PID %d] Indexed files: %zu\n", args->pid, status.files_indexed);
+	printf("[PID %d] Downloads: %zu started, %zu completed, %zu aborted\n",
+		args->pid, status.downloads_started, status.downloads_completed, status.downloads_aborted);
+	printf("[PID %d] Connections: %zu\n", args->pid, status.connections);
+	printf("[PID %d] Bytes sent: %" PRIu64 "\n", args->pid, status.bytes_sent);
+	printf("[PID %d] MIME type cache: %zu hits, %zu misses (%.1f%%)\n",
+		args->pid, status.mime_hits, status.mime_misses,
+		lookups ? (100.0 * status.mime_hits) / lookups : 0.0);
+	printf("[PID %d] File lookups: %zu (%zu pending), %.3f ms average, %.3f ms slowest\n",
+		args->pid, status.lookups, status.lookups_pending,
+		status.lookups ? status.lookup_time / 1000.0 / status.lookups : 0.0,
+		status.lookup_time_max / 1000.0);
+
+	if(simplecmd_foreach_file(args->pid, NULL, &__print_residency, &args->pid) < 0)
+	{
+		impact(0, "%s: Failed to get the list of files being served by the %s instance with PID %d\n",
+			SP_MAIN_HEADER_NAMESPACE, SP_MAIN_DESCRIPTION,
+			args->pid);
+		return false;
+	}
+
+	return true;
 }
 
 /*!
@@ -278,6 +462,82 @@ static bool __shutdown_inst(const simplearg_t args)
 	return true;
 }
 
+/*!
+ * \brief Stop serving the files on URIs matching a pattern from the specified
+ * SimplePost instance.
+ *
+ * \param[in] args Arguments passed to this program
+ *
+ * \return true if the files were purged successfully, false if not
+ */
+static bool __purge_files(const simplearg_t args)
+{
+	ssize_t count; // Number of files purged
+
+	count = simplecmd_purge_files(args->pid, args->purge);
+	if(count < 0)
+	{
+		impact(0, "%s: Failed to purge the files matching %s from the %s instance with PID %d\n",
+			SP_MAIN_HEADER_NAMESPACE,
+			args->purge, SP_MAIN_DESCRIPTION, args->pid);
+		return false;
+	}
+
+	impact(1, "%s: Purged %zd files matching %s from the %s instance with PID %d\n",
+		SP_MAIN_HEADER_NAMESPACE,
+		count, args->purge, SP_MAIN_DESCRIPTION, args->pid);
+
+	return true;
+}
+
+/*!
+ * \brief Print a signed link to a URI.
+ *
+ * \note No instance is needed to sign a link, only the key they check links
+ * with. The link is printed as a complete URL if the ADDRESS and PORT of the
+ * server are given, or as the URI with its query string if not.
+ *
+ * \param[in] args Arguments passed to this program
+ *
+ * \return true if the link was printed, false if not
+ */
+static bool __sign_uri(const simplearg_t args)
+{
+	simplesign_key_t key; // Key to sign the link with
+	uint64_t id;          // Identifier of the link
+	char link[4096];      // Signed link
+	char url[4096 + 64];  // URL of the signed link
+	bool ret = false;     // Was the link printed?
+
+	key = simplesign_key_init(args->sign_key);
+	if(key == NULL) return false;
+
+	if(simplesign_get_id(&id) == false) goto error;
+
+	if(simplesign_sign_uri(key, link, sizeof(link), args->sign, args->sign_count, time(NULL) + args->sign_ttl, id) == 0)
+	{
+		impact(0, "%s: Cannot sign the URI %s\n",
+			SP_MAIN_HEADER_NAMESPACE,
+			args->sign);
+		goto error;
+	}
+
+	if(args->address && args->port && simplestr_get_url(url, sizeof(url), NULL, args->address, args->port, link))
+	{
+		printf("%s\n", url);
+	}
+	else
+	{
+		printf("%s\n", link);
+	}
+	ret = true;
+
+error:
+	simplesign_key_free(key);
+
+	return ret;
+}
+
 /*!
  * \brief Add new files to be served to another SimplePost instance.
  *
@@ -336,7 +596,7 @@ static bool __add_to_other_inst(const simplearg_t args)
 
 	for(simplefile_t p = args->files; p; p = p->next)
 	{
-		if(simplecmd_set_file(args->pid, p->file, p->uri, p->count) == false)
+		if(simplecmd_set_file(args->pid, p->file, p->uri, p->count, p->expires) == false)
 		{
 			impact(0, "%s: Failed to add FILE %s to the %s instance with PID %d\n",
 				SP_MAIN_HEADER_NAMESPACE,
@@ -346,7 +606,7 @@ static bool __add_to_other_inst(const simplearg_t args)
 		else
 		{
 			if(simplestr_get_serving_str(buf, sizeof(buf)/sizeof(buf[0]),
-				p->file, address, port, p->uri, p->count) == 0)
+				p->file, address, port, p->uri, p->count, p->expires) == 0)
 			{
 				impact(0, "%s: Failed to construct the description string for %s\n",
 					SP_MAIN_HEADER_NAMESPACE,
@@ -364,6 +624,98 @@ static bool __add_to_other_inst(const simplearg_t args)
 	return (failures == 0);
 }
 
+/*!
+ * \brief Add the files to our SimplePost instance.
+ *
+ * \param[in] args    Arguments passed to this program
+ * \param[in] handoff Files handed off to us by another instance (may be NULL)
+ *
+ * \return true if all of the files are being served, false if not
+ */
+static bool __serve_files(const simplearg_t args, const simplepost_file_t handoff)
+{
+	size_t n = 0;         // Number of files to serve
+	const char** files;   // Names and paths of the files to serve
+	const char** uris;    // URIs of the files to serve
+	unsigned int* counts; // Number of times each file may be downloaded
+	time_t* expires;      // Times each file stops being served
+	bool ret;             // Were all of the files served?
+
+	for(simplepost_file_t p = handoff; p; p = p->next) ++n;
+	for(simplefile_t p = args->files; p; p = p->next) ++n;
+
+	files = (const char**) malloc(sizeof(char*) * n);
+	uris = (const char**) malloc(sizeof(char*) * n);
+	counts = (unsigned int*) malloc(sizeof(unsigned int) * n);
+	expires = (time_t*) malloc(sizeof(time_t) * n);
+	if(files == NULL || uris == NULL || counts == NULL || expires == NULL)
+	{
+		impact(0, "%s: %s: Failed to allocate memory for %zu files\n",
+			SP_MAIN_HEADER_NAMESPACE, SP_MAIN_HEADER_MEMORY_ALLOC,
+			n);
+		ret = false;
+		goto error;
+	}
+
+	// Our own FILEs come last, so that they take precedence on the same URI.
+	n = 0;
+	for(simplepost_file_t p = handoff; p; p = p->next, ++n)
+	{
+		files[n] = p->file;
+		uris[n] = p->uri;
+		counts[n] = p->count;
+		expires[n] = p->expires;
+	}
+	for(simplefile_t p = args->files; p; p = p->next, ++n)
+	{
+		files[n] = p->file;
+		uris[n] = p->uri;
+		counts[n] = p->count;
+		expires[n] = p->expires;
+	}
+
+	ret = (simplepost_serve_files(httpd, files, uris, counts, expires, NULL, n) == n);
+
+error:
+	free(files);
+	free(uris);
+	free(counts);
+	free(expires);
+
+	return ret;
+}
+
+/*!
+ * \brief Take over the HTTP server of another SimplePost instance.
+ *
+ * \note This is the callback for simplecmd_handoff(). The files handed off to
+ * us are served before we start accepting connections on the socket, so no
+ * client waiting on it is told a file is missing. Sockets passed to us by the
+ * service manager are adopted the same way, without any files handed off.
+ *
+ * \param[in] sock  Listening socket of the other instance
+ * \param[in] files Files the other instance was serving (may be NULL)
+ * \param[in] arg   Arguments passed to this program
+ *
+ * \return true if we are accepting connections on the socket, false if not
+ */
+static bool __adopt_httpd(int sock, simplepost_file_t files, void* arg)
+{
+	const simplearg_t args = (const simplearg_t) arg; // Arguments passed to this program
+
+	// The other instance has already committed its journal.
+	if(args->journal && simplepost_set_journal(httpd, args->journal) == false) goto error;
+	if(__serve_files(args, files) == false) goto error;
+	if(simplepost_bind_socket(httpd, sock) == 0) goto error;
+
+	return true;
+
+error:
+	close(sock);
+
+	return false;
+}
+
 /*!
  * \brief Add the files to our SimplePost instance and start the HTTP server.
  *
@@ -373,6 +725,8 @@ static bool __add_to_other_inst(const simplearg_t args)
  */
 static bool __start_httpd(const simplearg_t args)
 {
+	int sock; // Socket passed to us by the service manager
+
 	httpd = simplepost_init();
 	if(httpd == NULL)
 	{
@@ -382,16 +736,100 @@ static bool __start_httpd(const simplearg_t args)
 		return false;
 	}
 
+	simplepost_set_connection_limit(httpd, args->connection_limit);
+	simplepost_set_connection_timeout(httpd, args->connection_timeout);
+	simplepost_set_workers(httpd, args->workers);
+	simplepost_set_idle_timeout(httpd, args->idle_timeout);
+	if(args->resume_grace >= 0) simplepost_set_resume_grace(httpd, (unsigned int) args->resume_grace);
+	if(simplepost_set_affinity(httpd, args->cpus, (args->options & SA_OPT_NUMA) != 0) == false) return false;
+	if(simplepost_set_tcp_profile(httpd, args->tcp_profile) == false) return false;
+	if(simplepost_set_preload(httpd, (args->options & SA_OPT_PRELOAD) != 0) == false) return false;
+	if(simplepost_set_watch(httpd, (args->options & SA_OPT_WATCH) != 0, (args->options & SA_OPT_WATCH_PURGE) != 0) == false) return false;
+	if(simplepost_set_direct_threshold(httpd, (uint64_t) args->direct_threshold * 1024 * 1024) == false) return false;
+	if(args->sign_key && simplepost_set_sign_key(httpd, args->sign_key, args->sign_links, args->sign_table) == false) return false;
+
+	if(args->options & SA_OPT_HANDOFF)
+	{
+		if(args->index && simplepost_load_index(httpd, args->index) == false) return false;
+
+		impact(2, "%s: Taking over from the %s instance with PID %d ...\n",
+			SP_MAIN_HEADER_NAMESPACE, SP_MAIN_DESCRIPTION,
+			args->pid);
+		return simplecmd_handoff(args->pid, args->handoff_timeout, &__adopt_httpd, args);
+	}
+
+	/* The service manager starts us when a client connects to its socket, so
+	 * the files must be served before that client is accepted.
+	 */
+	sock = simplepost_get_activated_socket(AF_INET);
+	if(sock != -1)
+	{
+		if(args->index && simplepost_load_index(httpd, args->index) == false)
+		{
+			close(sock);
+			return false;
+		}
+		return __adopt_httpd(sock, NULL, args);
+	}
+
+	if(args->journal && simplepost_set_journal(httpd, args->journal) == false) return false;
+	if(args->index && simplepost_load_index(httpd, args->index) == false) return false;
+
 	if(simplepost_bind(httpd, args->address, args->port) == 0) return false;
+
+	return __serve_files(args, NULL);
+}
+
+/*!
+ * \brief Write an index of the files given to us.
+ *
+ * \param[in] args Arguments passed to this program
+ *
+ * \return true if the index was written, false if not
+ */
+static bool __write_index(const simplearg_t args)
+{
+	size_t n = 0;       // Number of files to index
+	const char** files; // Names and paths of the files to index
+	const char** uris;  // URIs of the files to index
+	bool ret = false;   // Was the index written?
+
 	for(simplefile_t p = args->files; p; p = p->next)
 	{
-		char* url; // URL of the file being served
+		if(p->count || p->expires)
+		{
+			impact(0, "%s: FILE %s cannot be indexed with a %s; files in an index are always served indefinitely\n",
+				SP_MAIN_HEADER_NAMESPACE,
+				p->file, p->count ? "COUNT" : "TTL or expiry time");
+			return false;
+		}
+		++n;
+	}
+
+	files = (const char**) malloc(sizeof(char*) * n);
+	uris = (const char**) malloc(sizeof(char*) * n);
+	if(files == NULL || uris == NULL)
+	{
+		impact(0, "%s: %s: Failed to allocate memory to index %zu files\n",
+			SP_MAIN_HEADER_NAMESPACE, SP_MAIN_HEADER_MEMORY_ALLOC,
+			n);
+		goto error;
+	}
 
-		if(simplepost_serve_file(httpd, &url, p->file, p->uri, p->count) == 0) return false;
-		free(url);
+	n = 0;
+	for(simplefile_t p = args->files; p; p = p->next, ++n)
+	{
+		files[n] = p->file;
+		uris[n] = p->uri;
 	}
 
-	return true;
+	ret = simplepost_write_index(args->write_index, files, uris, n);
+
+error:
+	free(files);
+	free(uris);
+
+	return ret;
 }
 
 /*!
@@ -408,13 +846,48 @@ static void __print_help()
 	printf("                           a random port will be chosen if this is not specified\n");
 	printf("      --pid=PID            act on the instance of this program with process identifier PID\n");
 	printf("                           by default the existing instance matching ADDRESS and PORT will be used if possible\n");
+	printf("      --config=FILE        read settings and files to serve from the configuration FILE\n");
+	printf("                           settings on the command line take precedence over the FILE\n");
+	printf("      --journal=FILE       restore the files being served from the journal FILE, and record changes to them in it\n");
+	printf("      --index=INDEX        serve the files in INDEX as well as any FILE\n");
+	printf("      --write-index=INDEX  write the FILEs to INDEX instead of serving them\n");
 	printf("      --new                act exclusively on the current instance of this program\n");
 	printf("                           this option and --pid are mutually exclusive\n");
+	printf("      --idle-timeout=SECONDS\n");
+	printf("                           shut down after SECONDS without any clients\n");
+	printf("      --resume-grace=SECONDS\n");
+	printf("                           give clients SECONDS to resume an interrupted download before it stops counting\n");
+	printf("                           (default 600, 0 = count each download as it starts)\n");
+	printf("      --workers=WORKERS    serve HTTP requests from WORKERS processes sharing PORT (default 1, maximum %d)\n", SA_WORKERS_MAX);
+	printf("      --cpus=LIST          serve HTTP requests only on the CPUs in LIST (such as 0-3,8)\n");
+	printf("      --numa               spread the WORKERS across NUMA nodes, keeping each on the CPUs of one node\n");
+	printf("      --tcp-profile=PROFILE\n");
+	printf("                           tune the sockets of the server for PROFILE\n");
+	printf("                           PROFILE=lan-bulk          few large downloads over a fast local network\n");
+	printf("                           PROFILE=many-small        many clients downloading small files\n");
+	printf("                           PROFILE=wan-high-latency  large downloads over long distances\n");
+	printf("      --preload            read each FILE into the page cache as it is added, unless it is served only once\n");
+	printf("      --watch[=purge]      notice when a FILE changes; with purge, stop serving a FILE once it is deleted\n");
+	printf("      --direct-threshold=MIB\n");
+	printf("                           read files of at least MIB mebibytes with O_DIRECT, bypassing the page cache\n");
+	printf("      --sign-key=FILE      serve files only on links signed with the key in FILE\n");
+	printf("      --sign-links=LINKS   count the downloads of up to LINKS signed links at once (default 1048576)\n");
+	printf("      --sign-table=FILE    count the downloads of signed links in FILE, across restarts and handoffs\n");
+	printf("      --sign=URI           print a link to URI signed with the key given by --sign-key\n");
+	printf("      --sign-count=COUNT   let the signed link be downloaded COUNT times (default %d, 0 = unlimited)\n", SA_SIGN_COUNT);
+	printf("      --sign-ttl=SECONDS   let the signed link work for SECONDS (default %d)\n", SA_SIGN_TTL);
+	printf("      --handoff[=SECONDS]  take over the HTTP server and files of the selected instance of this program\n");
+	printf("                           it may spend up to SECONDS (default %u, 0 = no limit) finishing its downloads\n", SA_HANDOFF_TIMEOUT);
 	printf("  -k, --kill               shut down the selected instance of this program\n");
+	printf("      --purge=PATTERN      stop serving every file whose URI matches the wildcard PATTERN on the selected instance\n");
 	printf("      --daemon             fork to the background and run as a system daemon\n");
 	printf("  -l, --list=LTYPE         list the requested LTYPE of information about an instance of this program\n");
 	printf("                           LTYPE=i,inst,instances    list all server instances that we can connect to\n");
 	printf("                           LTYPE=f,files             list all files being served by the selected server instance\n");
+	printf("                           LTYPE=e,events            print events from the selected server instance as they happen\n");
+	printf("                           LTYPE=s,status            print the status of the selected server instance\n");
+	printf("                                                     and how much of each file it serves is in the page cache\n");
+	printf("      --match=PATTERN      list only the files whose URIs match the wildcard PATTERN\n");
 	printf("  -q, --quiet              do not print anything to standard output or standard error\n");
 	printf("  -s, --no-messages        suppress all messages but critical errors\n");
 	printf("  -v, --verbose            print increasingly more messages\n");
@@ -423,11 +896,16 @@ static void __print_help()
 	printf("File Options:\n");
 	printf("  -c, --count=COUNT        serve the file COUNT times\n");
 	printf("                           by default FILE will be served until the server is shut down\n");
-	printf("  -u, --uri=URI            explicitly set the URI of the file\n\n");
+	printf("  -u, --uri=URI            explicitly set the URI of the file\n");
+	printf("  -t, --ttl=SECONDS        stop serving the file SECONDS from now\n");
+	printf("      --expires=TIME       stop serving the file at TIME (seconds since the Epoch)\n\n");
 	printf("Examples:\n");
 	printf("  %s --list=instances              List all available instances of this program\n", SP_MAIN_SHORT_NAME);
 	printf("  %s -p 80 -q -c 1 FILE            Serve FILE on port 80 one time.\n", SP_MAIN_SHORT_NAME);
 	printf("  %s --pid=99031 --count=2 FILE    Serve FILE twice on the instance of simplepost with the process identifier 99031.\n", SP_MAIN_SHORT_NAME);
+	printf("  %s -c 1 -t 3600 FILE             Serve FILE one time, but for no longer than an hour.\n", SP_MAIN_SHORT_NAME);
+	printf("  %s -p 80 --purge='/release-42/*' Stop serving everything under /release-42/ on port 80.\n", SP_MAIN_SHORT_NAME);
+	printf("  %s --sign-key=KEY --sign=/a.iso  Print a link to /a.iso which may be downloaded once in the next day.\n", SP_MAIN_SHORT_NAME);
 	printf("  %s FILE                          Serve FILE on a random port until SIGTERM is received.\n\n", SP_MAIN_SHORT_NAME);
 }
 
@@ -551,6 +1029,11 @@ int main(int argc, char* argv[])
 			__print_version();
 			goto no_error;
 		}
+		else if(args->actions & SA_ACT_SIGN)
+		{
+			if(__sign_uri(args)) goto no_error;
+			else goto error;
+		}
 		else if(args->actions & SA_ACT_LIST_INST)
 		{
 			if(__list_inst()) goto no_error;
@@ -563,6 +1046,20 @@ int main(int argc, char* argv[])
 			if(__list_files(args)) goto no_error;
 			else goto error;
 		}
+		else if(args->actions & SA_ACT_LIST_EVENTS)
+		{
+			if(__resolve_pid(args) == false) goto error;
+			if(__is_pid_valid(args) == false) goto error;
+			if(__list_events(args)) goto no_error;
+			else goto error;
+		}
+		else if(args->actions & SA_ACT_LIST_STATUS)
+		{
+			if(__resolve_pid(args) == false) goto error;
+			if(__is_pid_valid(args) == false) goto error;
+			if(__list_status(args)) goto no_error;
+			else goto error;
+		}
 		else if(args->actions & SA_ACT_SHUTDOWN)
 		{
 			if(__resolve_pid(args) == false) goto error;
@@ -570,6 +1067,13 @@ int main(int argc, char* argv[])
 			if(__shutdown_inst(args) == false) goto error;
 			goto no_error;
 		}
+		else if(args->actions & SA_ACT_PURGE)
+		{
+			if(__resolve_pid(args) == false) goto error;
+			if(__is_pid_valid(args) == false) goto error;
+			if(__purge_files(args)) goto no_error;
+			else goto error;
+		}
 		else
 		{
 			impact(0, "%s: BUG! Failed to handle action 0x%02X\n",
@@ -578,9 +1082,19 @@ int main(int argc, char* argv[])
 		}
 	}
 
+	if(args->write_index)
+	{
+		if(__write_index(args)) goto no_error;
+		else goto error;
+	}
+
 	if(__resolve_pid(args) == false) goto error;
 
-	if(args->pid)
+	if(args->options & SA_OPT_HANDOFF)
+	{
+		if(__is_pid_valid(args) == false) goto error;
+	}
+	else if(args->pid)
 	{
 		if(__add_to_other_inst(args)) goto no_error;
 		else goto error;
@@ -30,6 +30,8 @@
 #include <string.h>
 #include <getopt.h>
 #include <stdio.h>
+#include <errno.h>
+#include <time.h>
 
 /// Arguments namespace header
 #define SP_ARGS_HEADER_NAMESPACE      "SimplePost::Arguments"
@@ -40,6 +42,12 @@
 /// Invalid syntax error string
 #define SP_ARGS_HEADER_INVLAID_SYNTAX "Invalid Syntax"
 
+/// Configuration file error string
+#define SP_ARGS_HEADER_CONFIG         "Configuration File"
+
+/// Maximum length of a line in the configuration file
+#define SP_ARGS_CONFIG_LINE_MAX       (PATH_MAX * 2 + 64)
+
 /*!
  * \brief Process an option missing its required argument.
  *
@@ -185,7 +193,7 @@ static void __set_port(simplearg_t sap, const char* optstr, const char* arg)
  */
 static void __set_list(simplearg_t sap, const char* optstr, const char* arg)
 {
-	if(sap->actions & (SA_ACT_LIST_INST | SA_ACT_LIST_FILES))
+	if(sap->actions & (SA_ACT_LIST_INST | SA_ACT_LIST_FILES | SA_ACT_LIST_EVENTS | SA_ACT_LIST_STATUS))
 	{
 		impact(0, "%s: %s: LTYPE already set\n",
 			SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_INVLAID_OPTION);
@@ -225,6 +233,24 @@ static void __set_list(simplearg_t sap, const char* optstr, const char* arg)
 			sap->actions & SA_ACT_LIST_FILES);
 		#endif // DEBUG_ARG
 	}
+	else if(strcmp(arg, "e") == 0 || strcmp(arg, "events") == 0)
+	{
+		sap->actions |= SA_ACT_LIST_EVENTS;
+		#ifdef DEBUG_ARG
+		impact(1, "%s: Processed LTYPE: 0x%02X\n",
+			SP_ARGS_HEADER_NAMESPACE,
+			sap->actions & SA_ACT_LIST_EVENTS);
+		#endif // DEBUG_ARG
+	}
+	else if(strcmp(arg, "s") == 0 || strcmp(arg, "status") == 0)
+	{
+		sap->actions |= SA_ACT_LIST_STATUS;
+		#ifdef DEBUG_ARG
+		impact(1, "%s: Processed LTYPE: 0x%02X\n",
+			SP_ARGS_HEADER_NAMESPACE,
+			sap->actions & SA_ACT_LIST_STATUS);
+		#endif // DEBUG_ARG
+	}
 	else
 	{
 		impact(0, "%s: %s: Invalid LTYPE: %s\n",
@@ -324,6 +350,12 @@ static void __set_new(simplearg_t sap)
 			SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_INVLAID_OPTION);
 		sap->options |= SA_OPT_ERROR;
 	}
+	else if(sap->options & SA_OPT_HANDOFF)
+	{
+		impact(0, "%s: %s: The \"new\" and \"handoff\" options are mutually exclusive\n",
+			SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_INVLAID_OPTION);
+		sap->options |= SA_OPT_ERROR;
+	}
 	else
 	{
 		sap->options |= SA_OPT_NEW;
@@ -335,6 +367,234 @@ static void __set_new(simplearg_t sap)
 	}
 }
 
+/*!
+ * \brief Process the workers argument.
+ *
+ * \param[inout] sap Instance to act on
+ * \param[in] optstr String containing the workers option
+ * \param[in] arg    Argument string to process
+ */
+static void __set_workers(simplearg_t sap, const char* optstr, const char* arg)
+{
+	int i;
+
+	if(sap->workers)
+	{
+		impact(0, "%s: %s: workers argument may only be specified once\n",
+			SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_INVLAID_OPTION);
+		sap->options |= SA_OPT_ERROR;
+		return;
+	}
+
+	if(arg == NULL || arg[0] == '\0')
+	{
+		__set_missing(sap, optstr);
+		return;
+	}
+	else if(sscanf(arg, "%d", &i) != 1 || i < 1 || i > SA_WORKERS_MAX)
+	{
+		impact(0, "%s: %s: WORKERS must be an integer between 1 and %d: %s\n",
+			SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_INVLAID_OPTION,
+			SA_WORKERS_MAX, arg);
+		sap->options |= SA_OPT_ERROR;
+		return;
+	}
+
+	sap->workers = (unsigned int) i;
+	#ifdef DEBUG_ARG
+	impact(1, "%s: Processed workers argument: %u\n",
+		SP_ARGS_HEADER_NAMESPACE,
+		sap->workers);
+	#endif // DEBUG_ARG
+}
+
+/*!
+ * \brief Process the idle-timeout argument.
+ *
+ * \param[inout] sap Instance to act on
+ * \param[in] optstr String containing the idle-timeout option
+ * \param[in] arg    Argument string to process
+ */
+static void __set_idle_timeout(simplearg_t sap, const char* optstr, const char* arg)
+{
+	int i;
+
+	if(sap->idle_timeout)
+	{
+		impact(0, "%s: %s: idle-timeout argument may only be specified once\n",
+			SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_INVLAID_OPTION);
+		sap->options |= SA_OPT_ERROR;
+		return;
+	}
+
+	if(arg == NULL || arg[0] == '\0')
+	{
+		__set_missing(sap, optstr);
+		return;
+	}
+	else if(sscanf(arg, "%d", &i) != 1 || i < 1)
+	{
+		impact(0, "%s: %s: SECONDS must be a positive integer: %s\n",
+			SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_INVLAID_OPTION,
+			arg);
+		sap->options |= SA_OPT_ERROR;
+		return;
+	}
+
+	sap->idle_timeout = (unsigned int) i;
+	#ifdef DEBUG_ARG
+	impact(1, "%s: Processed idle-timeout argument: %u\n",
+		SP_ARGS_HEADER_NAMESPACE,
+		sap->idle_timeout);
+	#endif // DEBUG_ARG
+}
+
+/*!
+ * \brief Process the resume-grace argument.
+ *
+ * \param[inout] sap Instance to act on
+ * \param[in] optstr String containing the resume-grace option
+ * \param[in] arg    Argument string to process
+ */
+static void __set_resume_grace(simplearg_t sap, const char* optstr, const char* arg)
+{
+	int i;
+
+	if(sap->resume_grace >= 0)
+	{
+		impact(0, "%s: %s: resume-grace argument may only be specified once\n",
+			SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_INVLAID_OPTION);
+		sap->options |= SA_OPT_ERROR;
+		return;
+	}
+
+	if(arg == NULL || arg[0] == '\0')
+	{
+		__set_missing(sap, optstr);
+		return;
+	}
+	else if(sscanf(arg, "%d", &i) != 1 || i < 0)
+	{
+		impact(0, "%s: %s: SECONDS must be a non-negative integer: %s\n",
+			SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_INVLAID_OPTION,
+			arg);
+		sap->options |= SA_OPT_ERROR;
+		return;
+	}
+
+	sap->resume_grace = i;
+	#ifdef DEBUG_ARG
+	impact(1, "%s: Processed resume-grace argument: %d\n",
+		SP_ARGS_HEADER_NAMESPACE,
+		sap->resume_grace);
+	#endif // DEBUG_ARG
+}
+
+/*!
+ * \brief Process the direct-threshold argument.
+ *
+ * \param[inout] sap Instance to act on
+ * \param[in] optstr String containing the direct-threshold option
+ * \param[in] arg    Argument string to process
+ */
+static void __set_direct_threshold(simplearg_t sap, const char* optstr, const char* arg)
+{
+	int i;
+
+	if(sap->direct_threshold)
+	{
+		impact(0, "%s: %s: direct-threshold argument may only be specified once\n",
+			SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_INVLAID_OPTION);
+		sap->options |= SA_OPT_ERROR;
+		return;
+	}
+
+	if(arg == NULL || arg[0] == '\0')
+	{
+		__set_missing(sap, optstr);
+		return;
+	}
+	else if(sscanf(arg, "%d", &i) != 1 || i < 1)
+	{
+		impact(0, "%s: %s: MIB must be a positive integer: %s\n",
+			SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_INVLAID_OPTION,
+			arg);
+		sap->options |= SA_OPT_ERROR;
+		return;
+	}
+
+	sap->direct_threshold = (unsigned int) i;
+	#ifdef DEBUG_ARG
+	impact(1, "%s: Processed direct-threshold argument: %u\n",
+		SP_ARGS_HEADER_NAMESPACE,
+		sap->direct_threshold);
+	#endif // DEBUG_ARG
+}
+
+/*!
+ * \brief Process the handoff argument.
+ *
+ * \param[inout] sap Instance to act on
+ * \param[in] optstr String containing the handoff option
+ * \param[in] arg    Argument string to process (may be NULL)
+ */
+static void __set_handoff(simplearg_t sap, const char* optstr, const char* arg)
+{
+	if(sap->options & SA_OPT_HANDOFF)
+	{
+		impact(0, "%s: %s: handoff argument may only be specified once\n",
+			SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_INVLAID_OPTION);
+		sap->options |= SA_OPT_ERROR;
+		return;
+	}
+
+	if(sap->options & SA_OPT_NEW)
+	{
+		impact(0, "%s: %s: The \"new\" and \"handoff\" options are mutually exclusive\n",
+			SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_INVLAID_OPTION);
+		sap->options |= SA_OPT_ERROR;
+		return;
+	}
+
+	if(sap->actions & SA_ACT_SHUTDOWN)
+	{
+		impact(0, "%s: %s: The \"handoff\" and \"kill\" options are mutually exclusive\n",
+			SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_INVLAID_OPTION);
+		sap->options |= SA_OPT_ERROR;
+		return;
+	}
+
+	if(arg == NULL)
+	{
+		sap->handoff_timeout = SA_HANDOFF_TIMEOUT;
+	}
+	else
+	{
+		int i;
+		if(arg[0] == '\0')
+		{
+			__set_missing(sap, optstr);
+			return;
+		}
+		else if(sscanf(arg, "%d", &i) != 1 || i < 0)
+		{
+			impact(0, "%s: %s: SECONDS must be a positive integer: %s\n",
+				SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_INVLAID_OPTION,
+				arg);
+			sap->options |= SA_OPT_ERROR;
+			return;
+		}
+		sap->handoff_timeout = (unsigned int) i;
+	}
+
+	sap->options |= SA_OPT_HANDOFF;
+	#ifdef DEBUG_ARG
+	impact(1, "%s: Processed handoff argument: %u\n",
+		SP_ARGS_HEADER_NAMESPACE,
+		sap->handoff_timeout);
+	#endif // DEBUG_ARG
+}
+
 /*!
  * \brief Process the kill argument.
  *
@@ -354,6 +614,12 @@ static void __set_shutdown(simplearg_t sap)
 			SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_INVLAID_OPTION);
 		sap->options |= SA_OPT_ERROR;
 	}
+	else if(sap->options & SA_OPT_HANDOFF)
+	{
+		impact(0, "%s: %s: The \"handoff\" and \"kill\" options are mutually exclusive\n",
+			SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_INVLAID_OPTION);
+		sap->options |= SA_OPT_ERROR;
+	}
 	else
 	{
 		sap->actions |= SA_ACT_SHUTDOWN;
@@ -490,6 +756,375 @@ static void __set_version(simplearg_t sap)
 	#endif // DEBUG_ARG
 }
 
+/*!
+ * \brief Process an argument naming a file.
+ *
+ * \param[inout] sap Instance to act on
+ * \param[in] optstr String containing the option
+ * \param[in] arg    Argument string to process
+ * \param[out] path  Name and path of the file to set
+ * \param[in] what   Description of the file (for messages)
+ */
+static void __set_path(simplearg_t sap, const char* optstr, const char* arg, char** path, const char* what)
+{
+	if(*path)
+	{
+		impact(0, "%s: %s: The %s is already specified\n",
+			SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_INVLAID_OPTION,
+			what);
+		sap->options |= SA_OPT_ERROR;
+		return;
+	}
+
+	if(arg == NULL)
+	{
+		impact(0, "%s:%d: BUG! No %s given to process\n",
+			__PRETTY_FUNCTION__, __LINE__,
+			what);
+		sap->options |= SA_OPT_ERROR;
+		return;
+	}
+
+	if(arg[0] == '-')
+	{
+		__set_missing(sap, optstr);
+		return;
+	}
+
+	*path = (char*) malloc(sizeof(char) * (strlen(arg) + 1));
+	if(*path == NULL)
+	{
+		impact(0, "%s: %s: Failed to allocate memory for the %s\n",
+			SP_ARGS_HEADER_NAMESPACE, SP_MAIN_HEADER_MEMORY_ALLOC,
+			what);
+		sap->options |= SA_OPT_ERROR;
+		return;
+	}
+
+	strcpy(*path, arg);
+	#ifdef DEBUG_ARG
+	impact(1, "%s: Processed %s: %s\n",
+		SP_ARGS_HEADER_NAMESPACE,
+		what, *path);
+	#endif // DEBUG_ARG
+}
+
+/*!
+ * \brief Process the configuration file argument.
+ *
+ * \note The configuration file is not read until all of the command line
+ * arguments have been processed, so that they take precedence over it.
+ *
+ * \param[inout] sap Instance to act on
+ * \param[in] optstr String containing the configuration file option
+ * \param[in] arg    Argument string to process
+ */
+static void __set_config(simplearg_t sap, const char* optstr, const char* arg)
+{
+	__set_path(sap, optstr, arg, &sap->config, "configuration file");
+}
+
+/*!
+ * \brief Process the journal argument.
+ *
+ * \param[inout] sap Instance to act on
+ * \param[in] optstr String containing the journal option
+ * \param[in] arg    Argument string to process
+ */
+static void __set_journal(simplearg_t sap, const char* optstr, const char* arg)
+{
+	__set_path(sap, optstr, arg, &sap->journal, "journal");
+}
+
+/*!
+ * \brief Process the index argument.
+ *
+ * \param[inout] sap Instance to act on
+ * \param[in] optstr String containing the index option
+ * \param[in] arg    Argument string to process
+ */
+static void __set_index(simplearg_t sap, const char* optstr, const char* arg)
+{
+	__set_path(sap, optstr, arg, &sap->index, "index");
+}
+
+/*!
+ * \brief Process the argument to write an index.
+ *
+ * \param[inout] sap Instance to act on
+ * \param[in] optstr String containing the write index option
+ * \param[in] arg    Argument string to process
+ */
+static void __set_write_index(simplearg_t sap, const char* optstr, const char* arg)
+{
+	__set_path(sap, optstr, arg, &sap->write_index, "index to write");
+}
+
+/*!
+ * \brief Process the match argument.
+ *
+ * \param[inout] sap Instance to act on
+ * \param[in] optstr String containing the match option
+ * \param[in] arg    Argument string to process
+ */
+static void __set_match(simplearg_t sap, const char* optstr, const char* arg)
+{
+	__set_path(sap, optstr, arg, &sap->match, "pattern to match");
+}
+
+/*!
+ * \brief Process the purge argument.
+ *
+ * \param[inout] sap Instance to act on
+ * \param[in] optstr String containing the purge option
+ * \param[in] arg    Argument string to process
+ */
+static void __set_purge(simplearg_t sap, const char* optstr, const char* arg)
+{
+	__set_path(sap, optstr, arg, &sap->purge, "pattern to purge");
+	if(sap->purge) sap->actions |= SA_ACT_PURGE;
+}
+
+/*!
+ * \brief Process the sign-key argument.
+ *
+ * \note The key itself is read when it is used.
+ *
+ * \param[inout] sap Instance to act on
+ * \param[in] optstr String containing the sign-key option
+ * \param[in] arg    Argument string to process
+ */
+static void __set_sign_key(simplearg_t sap, const char* optstr, const char* arg)
+{
+	__set_path(sap, optstr, arg, &sap->sign_key, "key for signed links");
+}
+
+/*!
+ * \brief Process the sign-table argument.
+ *
+ * \param[inout] sap Instance to act on
+ * \param[in] optstr String containing the sign-table option
+ * \param[in] arg    Argument string to process
+ */
+static void __set_sign_table(simplearg_t sap, const char* optstr, const char* arg)
+{
+	__set_path(sap, optstr, arg, &sap->sign_table, "table of signed links");
+}
+
+/*!
+ * \brief Process the sign argument.
+ *
+ * \param[inout] sap Instance to act on
+ * \param[in] optstr String containing the sign option
+ * \param[in] arg    Argument string to process
+ */
+static void __set_sign(simplearg_t sap, const char* optstr, const char* arg)
+{
+	if(arg && arg[0] != '-' && arg[0] != '/')
+	{
+		impact(0, "%s: %s: URI must start with a /: %s\n",
+			SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_INVLAID_OPTION,
+			arg);
+		sap->options |= SA_OPT_ERROR;
+		return;
+	}
+
+	__set_path(sap, optstr, arg, &sap->sign, "URI to sign");
+	if(sap->sign) sap->actions |= SA_ACT_SIGN;
+}
+
+/*!
+ * \brief Process the sign-links argument.
+ *
+ * \param[inout] sap Instance to act on
+ * \param[in] optstr String containing the sign-links option
+ * \param[in] arg    Argument string to process
+ */
+static void __set_sign_links(simplearg_t sap, const char* optstr, const char* arg)
+{
+	int i;
+
+	if(sap->sign_links)
+	{
+		impact(0, "%s: %s: sign-links argument may only be specified once\n",
+			SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_INVLAID_OPTION);
+		sap->options |= SA_OPT_ERROR;
+		return;
+	}
+
+	if(arg == NULL || arg[0] == '\0')
+	{
+		__set_missing(sap, optstr);
+		return;
+	}
+	else if(sscanf(arg, "%d", &i) != 1 || i < 1)
+	{
+		impact(0, "%s: %s: LINKS must be a positive integer: %s\n",
+			SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_INVLAID_OPTION,
+			arg);
+		sap->options |= SA_OPT_ERROR;
+		return;
+	}
+
+	sap->sign_links = (unsigned int) i;
+	#ifdef DEBUG_ARG
+	impact(1, "%s: Processed sign-links argument: %u\n",
+		SP_ARGS_HEADER_NAMESPACE,
+		sap->sign_links);
+	#endif // DEBUG_ARG
+}
+
+/*!
+ * \brief Process the sign-count or sign-ttl argument.
+ *
+ * \param[inout] sap  Instance to act on
+ * \param[in] optstr  String containing the option
+ * \param[in] arg     Argument string to process
+ * \param[in] is_ttl  Is the argument the sign-ttl, rather than the sign-count?
+ */
+static void __set_sign_limit(simplearg_t sap, const char* optstr, const char* arg, bool is_ttl)
+{
+	int i;
+
+	if(arg == NULL || arg[0] == '\0')
+	{
+		__set_missing(sap, optstr);
+		return;
+	}
+	else if(sscanf(arg, "%d", &i) != 1 || i < (is_ttl ? 1 : 0))
+	{
+		impact(0, "%s: %s: %s must be a %s integer: %s\n",
+			SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_INVLAID_OPTION,
+			is_ttl ? "SECONDS" : "COUNT", is_ttl ? "positive" : "non-negative", arg);
+		sap->options |= SA_OPT_ERROR;
+		return;
+	}
+
+	if(is_ttl) sap->sign_ttl = (unsigned int) i;
+	else sap->sign_count = (unsigned int) i;
+	#ifdef DEBUG_ARG
+	impact(1, "%s: Processed %s argument: %d\n",
+		SP_ARGS_HEADER_NAMESPACE,
+		is_ttl ? "sign-ttl" : "sign-count", i);
+	#endif // DEBUG_ARG
+}
+
+/*!
+ * \brief Process the cpus argument.
+ *
+ * \note The list itself is checked when it is applied to the server.
+ *
+ * \param[inout] sap Instance to act on
+ * \param[in] optstr String containing the cpus option
+ * \param[in] arg    Argument string to process
+ */
+static void __set_cpus(simplearg_t sap, const char* optstr, const char* arg)
+{
+	__set_path(sap, optstr, arg, &sap->cpus, "list of CPUs");
+}
+
+/*!
+ * \brief Process the tcp-profile argument.
+ *
+ * \note The profile itself is checked when it is applied to the server.
+ *
+ * \param[inout] sap Instance to act on
+ * \param[in] optstr String containing the tcp-profile option
+ * \param[in] arg    Argument string to process
+ */
+static void __set_tcp_profile(simplearg_t sap, const char* optstr, const char* arg)
+{
+	__set_path(sap, optstr, arg, &sap->tcp_profile, "TCP profile");
+}
+
+/*!
+ * \brief Process the numa argument.
+ *
+ * \param[inout] sap Instance to act on
+ */
+static void __set_numa(simplearg_t sap)
+{
+	if(sap->options & SA_OPT_NUMA)
+	{
+		impact(0, "%s: %s: numa argument may only be specified once\n",
+			SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_INVLAID_OPTION);
+		sap->options |= SA_OPT_ERROR;
+	}
+	else
+	{
+		sap->options |= SA_OPT_NUMA;
+		#ifdef DEBUG_ARG
+		impact(1, "%s: Processed numa argument: 0x%02X\n",
+			SP_ARGS_HEADER_NAMESPACE,
+			sap->options & SA_OPT_NUMA);
+		#endif // DEBUG_ARG
+	}
+}
+
+/*!
+ * \brief Process the preload argument.
+ *
+ * \param[inout] sap Instance to act on
+ */
+static void __set_preload(simplearg_t sap)
+{
+	if(sap->options & SA_OPT_PRELOAD)
+	{
+		impact(0, "%s: %s: preload argument may only be specified once\n",
+			SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_INVLAID_OPTION);
+		sap->options |= SA_OPT_ERROR;
+	}
+	else
+	{
+		sap->options |= SA_OPT_PRELOAD;
+		#ifdef DEBUG_ARG
+		impact(1, "%s: Processed preload argument: 0x%02X\n",
+			SP_ARGS_HEADER_NAMESPACE,
+			sap->options & SA_OPT_PRELOAD);
+		#endif // DEBUG_ARG
+	}
+}
+
+/*!
+ * \brief Process the watch argument.
+ *
+ * \param[inout] sap Instance to act on
+ * \param[in] optstr String containing the watch option
+ * \param[in] arg    Argument string to process (NULL if there is none)
+ */
+static void __set_watch(simplearg_t sap, const char* optstr, const char* arg)
+{
+	if(sap->options & SA_OPT_WATCH)
+	{
+		impact(0, "%s: %s: watch argument may only be specified once\n",
+			SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_INVLAID_OPTION);
+		sap->options |= SA_OPT_ERROR;
+		return;
+	}
+
+	if(arg && arg[0] == '\0')
+	{
+		__set_missing(sap, optstr);
+		return;
+	}
+	else if(arg && strcmp(arg, "purge") != 0)
+	{
+		impact(0, "%s: %s: The only thing deleted files may be watched for is \"purge\": %s\n",
+			SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_INVLAID_OPTION,
+			arg);
+		sap->options |= SA_OPT_ERROR;
+		return;
+	}
+
+	sap->options |= SA_OPT_WATCH;
+	if(arg) sap->options |= SA_OPT_WATCH_PURGE;
+	#ifdef DEBUG_ARG
+	impact(1, "%s: Processed watch argument: 0x%03X\n",
+		SP_ARGS_HEADER_NAMESPACE,
+		sap->options & (SA_OPT_WATCH | SA_OPT_WATCH_PURGE));
+	#endif // DEBUG_ARG
+}
+
 /*!
  * \brief Get the last file in the list.
  *
@@ -518,7 +1153,8 @@ static simplefile_t __get_last_file(simplearg_t sap, short new)
 		}
 	}
 
-	for(last = sap->files; last->next; last = last->next);
+	if(sap->files_tail == NULL) sap->files_tail = sap->files;
+	last = sap->files_tail;
 
 	if(last->file && new)
 	{
@@ -528,7 +1164,7 @@ static simplefile_t __get_last_file(simplearg_t sap, short new)
 		memset(last->next, 0, sizeof(struct simplefile));
 		last->next->prev = last;
 
-		last = last->next;
+		last = sap->files_tail = last->next;
 	}
 
 	return last;
@@ -593,9 +1229,75 @@ static void __set_count(simplearg_t sap, const char* optstr, const char* arg)
 	{
 		last->count = (unsigned int) i;
 		#ifdef DEBUG_ARG
-		impact(1, "%s: Processed COUNT: %u\n",
+		impact(1, "%s: Processed COUNT: %u\n",
+			SP_ARGS_HEADER_NAMESPACE,
+			last->count);
+		#endif // DEBUG_ARG
+	}
+}
+
+/*!
+ * \brief Process the TTL or expires argument.
+ *
+ * \param[inout] sap Instance to act on
+ * \param[in] optstr String containing the TTL or expires option
+ * \param[in] arg    Argument string to process
+ * \param[in] is_ttl
+ * \parblock
+ * Is the argument a number of seconds from now (TTL), rather than a time in
+ * seconds since the Epoch?
+ * \endparblock
+ */
+static void __set_expiry(simplearg_t sap, const char* optstr, const char* arg, bool is_ttl)
+{
+	simplefile_t last = __get_last_file(sap, 1);
+	if(last == NULL)
+	{
+		impact(0, "%s: %s: Failed to allocate memory for FILE\n",
+			SP_ARGS_HEADER_NAMESPACE, SP_MAIN_HEADER_MEMORY_ALLOC);
+		sap->options |= SA_OPT_ERROR;
+		return;
+	}
+
+	if(last->expires)
+	{
+		impact(0, "%s: %s: TTL or expiry time already set for FILE\n",
+			SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_INVLAID_OPTION);
+		sap->options |= SA_OPT_ERROR;
+		return;
+	}
+
+	if(arg == NULL)
+	{
+		impact(0, "%s:%d: BUG! No %s given to process\n",
+			__PRETTY_FUNCTION__, __LINE__,
+			is_ttl ? "TTL" : "expiry time");
+		sap->options |= SA_OPT_ERROR;
+		return;
+	}
+
+	if(arg[0] == '-')
+	{
+		__set_missing(sap, optstr);
+		return;
+	}
+
+	long long i;
+	if(sscanf(arg, "%lld", &i) != 1 || i <= 0)
+	{
+		impact(0, "%s: %s: %s must be a positive integer: %s\n",
+			SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_INVLAID_OPTION,
+			is_ttl ? "TTL" : "Expiry time", arg);
+		sap->options |= SA_OPT_ERROR;
+	}
+	else
+	{
+		last->expires = (time_t) i;
+		if(is_ttl) last->expires += time(NULL);
+		#ifdef DEBUG_ARG
+		impact(1, "%s: Processed expiry time: %lld\n",
 			SP_ARGS_HEADER_NAMESPACE,
-			last->count);
+			(long long) last->expires);
 		#endif // DEBUG_ARG
 	}
 }
@@ -758,6 +1460,316 @@ static void __set_file(simplearg_t sap, const char* file)
 	#endif // DEBUG_ARG
 }
 
+/*!
+ * \brief Split the next token off of a line of the configuration file.
+ *
+ * Tokens are separated by whitespace. A token may be enclosed in double
+ * quotes to include whitespace or a "#" in it; inside the quotes, a backslash
+ * escapes the next character. An unquoted "#" starts a comment which runs to
+ * the end of the line.
+ *
+ * \param[inout] line
+ * \parblock
+ * Remainder of the line to process
+ *
+ * The token is terminated in place, and this pointer is advanced past it.
+ * \endparblock
+ * \param[out] error Set if the line has an unterminated quote
+ *
+ * \return the token, or NULL if there are no more tokens on the line
+ */
+static char* __next_token(char** line, bool* error)
+{
+	char* p = *line; // Current position in the line
+	char* token;     // Beginning of the token
+	char* q;         // End of the unescaped token
+
+	while(*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') ++p;
+	if(*p == '\0' || *p == '#')
+	{
+		*line = p;
+		return NULL;
+	}
+
+	if(*p != '"')
+	{
+		token = p;
+		while(*p != '\0' && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n' && *p != '#') ++p;
+		if(*p == '#') *line = p;
+		else *line = (*p == '\0') ? p : p + 1;
+		*p = '\0';
+		return token;
+	}
+
+	token = q = ++p;
+	while(*p != '"')
+	{
+		if(*p == '\\' && p[1] != '\0') ++p;
+		if(*p == '\0' || *p == '\n')
+		{
+			*error = true;
+			*line = p;
+			return NULL;
+		}
+		*q++ = *p++;
+	}
+	*q = '\0';
+	*line = p + 1;
+
+	return token;
+}
+
+/*!
+ * \brief Parse an unsigned integer setting from the configuration file.
+ *
+ * \param[inout] sap  Instance to act on
+ * \param[in] name    Name of the setting
+ * \param[in] arg     Value of the setting
+ * \param[out] value  Parsed value
+ */
+static void __set_config_uint(simplearg_t sap, const char* name, const char* arg, unsigned int* value)
+{
+	int i;
+	if(arg == NULL || sscanf(arg, "%d", &i) != 1 || i < 0)
+	{
+		impact(0, "%s: %s: %s must be a positive integer: %s\n",
+			SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_CONFIG,
+			name, arg ? arg : "");
+		sap->options |= SA_OPT_ERROR;
+		return;
+	}
+
+	*value = (unsigned int) i;
+	#ifdef DEBUG_ARG
+	impact(1, "%s: Processed %s: %u\n",
+		SP_ARGS_HEADER_NAMESPACE,
+		name, *value);
+	#endif // DEBUG_ARG
+}
+
+/*!
+ * \brief Parse the configuration file.
+ *
+ * The configuration file is a plain text file with one setting per line:
+ *
+ * \code
+ * # Comments start with a "#".
+ * address 127.0.0.1
+ * port 8080
+ * connection-limit 64
+ * connection-timeout 30
+ * workers 4
+ * idle-timeout 300
+ * resume-grace 600
+ * cpus 0-3
+ * tcp-profile lan-bulk
+ * preload
+ * watch purge
+ * direct-threshold 4096
+ * journal /var/lib/simplepost/journal
+ * index /var/lib/simplepost/index
+ * sign-key /etc/simplepost/links.key
+ * sign-links 1000000
+ * sign-table /var/lib/simplepost/links.table
+ * file /srv/debian.iso
+ * file "/srv/Release Notes.pdf" /notes.pdf 5
+ * file /srv/preview.mp4 /preview.mp4 expires=1893456000
+ * \endcode
+ *
+ * A file line takes the name and path of the FILE, optionally followed by its
+ * URI (which must start with a "/"), its COUNT, and its expiry time (either
+ * ttl=SECONDS from when the file is read or expires=TIME in seconds since the
+ * Epoch), in any order.
+ *
+ * \note Settings given on the command line take precedence over the same
+ * settings in the configuration file. Files listed in the configuration file
+ * are served after the files given on the command line.
+ *
+ * \param[inout] sap Instance to act on
+ */
+static void __parse_config(simplearg_t sap)
+{
+	FILE* fp;                            // Configuration file
+	char line[SP_ARGS_CONFIG_LINE_MAX];  // Line read from the file
+	size_t line_number = 0;              // Number of the line being processed
+
+	fp = fopen(sap->config, "r");
+	if(fp == NULL)
+	{
+		impact(0, "%s: %s: Cannot open %s: %s\n",
+			SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_CONFIG,
+			sap->config, strerror(errno));
+		sap->options |= SA_OPT_ERROR;
+		return;
+	}
+
+	while(!(sap->options & SA_OPT_ERROR) && fgets(line, sizeof(line), fp))
+	{
+		char* p = line;      // Remainder of the line to process
+		bool error = false;  // Does the line have an unterminated quote?
+		char* name;          // Name of the setting
+		char* arg;           // First argument of the setting
+
+		++line_number;
+
+		if(strchr(line, '\n') == NULL && feof(fp) == 0)
+		{
+			impact(0, "%s: %s: Line is longer than %zu characters\n",
+				SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_CONFIG,
+				sizeof(line) - 2);
+			sap->options |= SA_OPT_ERROR;
+			break;
+		}
+
+		name = __next_token(&p, &error);
+		if(name == NULL && error == false) continue;
+		arg = name ? __next_token(&p, &error) : NULL;
+
+		if(error)
+		{
+			impact(0, "%s: %s: Unterminated quote\n",
+				SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_CONFIG);
+			sap->options |= SA_OPT_ERROR;
+		}
+		else if(strcmp(name, "file") == 0)
+		{
+			if(arg == NULL)
+			{
+				impact(0, "%s: %s: file requires a FILE\n",
+					SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_CONFIG);
+				sap->options |= SA_OPT_ERROR;
+			}
+
+			for(char* opt = __next_token(&p, &error); opt && !(sap->options & SA_OPT_ERROR); opt = __next_token(&p, &error))
+			{
+				if(opt[0] == '/') __set_uri(sap, name, opt);
+				else if(strncmp(opt, "ttl=", 4) == 0) __set_expiry(sap, name, opt + 4, true);
+				else if(strncmp(opt, "expires=", 8) == 0) __set_expiry(sap, name, opt + 8, false);
+				else __set_count(sap, name, opt);
+			}
+
+			if(error)
+			{
+				impact(0, "%s: %s: Unterminated quote\n",
+					SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_CONFIG);
+				sap->options |= SA_OPT_ERROR;
+			}
+
+			if(!(sap->options & SA_OPT_ERROR)) __set_file(sap, arg);
+		}
+		else if(strcmp(name, "address") == 0)
+		{
+			if(sap->address == NULL) __set_address(sap, name, arg ? arg : "-");
+		}
+		else if(strcmp(name, "port") == 0)
+		{
+			if(sap->port == 0) __set_port(sap, name, arg ? arg : "-");
+		}
+		else if(strcmp(name, "connection-limit") == 0)
+		{
+			__set_config_uint(sap, name, arg, &sap->connection_limit);
+		}
+		else if(strcmp(name, "connection-timeout") == 0)
+		{
+			__set_config_uint(sap, name, arg, &sap->connection_timeout);
+		}
+		else if(strcmp(name, "workers") == 0)
+		{
+			if(sap->workers == 0) __set_workers(sap, name, arg);
+		}
+		else if(strcmp(name, "idle-timeout") == 0)
+		{
+			if(sap->idle_timeout == 0) __set_idle_timeout(sap, name, arg);
+		}
+		else if(strcmp(name, "resume-grace") == 0)
+		{
+			if(sap->resume_grace < 0) __set_resume_grace(sap, name, arg);
+		}
+		else if(strcmp(name, "direct-threshold") == 0)
+		{
+			if(sap->direct_threshold == 0) __set_direct_threshold(sap, name, arg);
+		}
+		else if(strcmp(name, "cpus") == 0)
+		{
+			if(sap->cpus == NULL) __set_cpus(sap, name, arg ? arg : "-");
+		}
+		else if(strcmp(name, "tcp-profile") == 0)
+		{
+			if(sap->tcp_profile == NULL) __set_tcp_profile(sap, name, arg ? arg : "-");
+		}
+		else if(strcmp(name, "numa") == 0)
+		{
+			if(arg)
+			{
+				impact(0, "%s: %s: Too many arguments to %s\n",
+					SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_CONFIG,
+					name);
+				sap->options |= SA_OPT_ERROR;
+			}
+			else if(!(sap->options & SA_OPT_NUMA)) __set_numa(sap);
+		}
+		else if(strcmp(name, "preload") == 0)
+		{
+			if(arg)
+			{
+				impact(0, "%s: %s: Too many arguments to %s\n",
+					SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_CONFIG,
+					name);
+				sap->options |= SA_OPT_ERROR;
+			}
+			else if(!(sap->options & SA_OPT_PRELOAD)) __set_preload(sap);
+		}
+		else if(strcmp(name, "watch") == 0)
+		{
+			if(!(sap->options & SA_OPT_WATCH)) __set_watch(sap, name, arg);
+		}
+		else if(strcmp(name, "journal") == 0)
+		{
+			if(sap->journal == NULL) __set_journal(sap, name, arg ? arg : "-");
+		}
+		else if(strcmp(name, "index") == 0)
+		{
+			if(sap->index == NULL) __set_index(sap, name, arg ? arg : "-");
+		}
+		else if(strcmp(name, "sign-key") == 0)
+		{
+			if(sap->sign_key == NULL) __set_sign_key(sap, name, arg ? arg : "-");
+		}
+		else if(strcmp(name, "sign-links") == 0)
+		{
+			if(sap->sign_links == 0) __set_sign_links(sap, name, arg);
+		}
+		else if(strcmp(name, "sign-table") == 0)
+		{
+			if(sap->sign_table == NULL) __set_sign_table(sap, name, arg ? arg : "-");
+		}
+		else
+		{
+			impact(0, "%s: %s: Unknown setting: %s\n",
+				SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_CONFIG,
+				name);
+			sap->options |= SA_OPT_ERROR;
+		}
+
+		if(!(sap->options & SA_OPT_ERROR) && name && strcmp(name, "file") != 0 && __next_token(&p, &error))
+		{
+			impact(0, "%s: %s: Too many arguments to %s\n",
+				SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_CONFIG,
+				name);
+			sap->options |= SA_OPT_ERROR;
+		}
+	}
+
+	if(sap->options & SA_OPT_ERROR)
+	{
+		impact(0, "%s: %s: Error on line %zu of %s\n",
+			SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_CONFIG,
+			line_number, sap->config);
+	}
+
+	fclose(fp);
+}
+
 /*!
  * \brief Is the given option defined the long options array?
  *
@@ -850,11 +1862,33 @@ static bool __is_longopt(const struct option* longopts, int opt, const char* arg
  */
 static int __parse_global_opts(simplearg_t sap, int argc, char* argv[])
 {
-	int have_pid = 0;     // Is the pid argument set?
-	int have_new = 0;     // Is the new argument set?
-	int have_daemon = 0;  // Is the daemon argument set?
-	int have_help = 0;    // Is the help argument set?
-	int have_version = 0; // Is the version argument set?
+	int have_pid = 0;         // Is the pid argument set?
+	int have_config = 0;      // Is the config argument set?
+	int have_journal = 0;     // Is the journal argument set?
+	int have_index = 0;       // Is the index argument set?
+	int have_write_index = 0; // Is the write-index argument set?
+	int have_match = 0;       // Is the match argument set?
+	int have_purge = 0;       // Is the purge argument set?
+	int have_sign_key = 0;    // Is the sign-key argument set?
+	int have_sign_links = 0;  // Is the sign-links argument set?
+	int have_sign_table = 0;  // Is the sign-table argument set?
+	int have_sign = 0;        // Is the sign argument set?
+	int have_sign_count = 0;  // Is the sign-count argument set?
+	int have_sign_ttl = 0;    // Is the sign-ttl argument set?
+	int have_new = 0;         // Is the new argument set?
+	int have_handoff = 0;     // Is the handoff argument set?
+	int have_workers = 0;     // Is the workers argument set?
+	int have_idle = 0;        // Is the idle-timeout argument set?
+	int have_grace = 0;       // Is the resume-grace argument set?
+	int have_cpus = 0;        // Is the cpus argument set?
+	int have_numa = 0;        // Is the numa argument set?
+	int have_tcp = 0;         // Is the tcp-profile argument set?
+	int have_preload = 0;     // Is the preload argument set?
+	int have_watch = 0;       // Is the watch argument set?
+	int have_direct = 0;      // Is the direct-threshold argument set?
+	int have_daemon = 0;      // Is the daemon argument set?
+	int have_help = 0;        // Is the help argument set?
+	int have_version = 0;     // Is the version argument set?
 
 	int opt_index = 0; // Index of the next option to process in argv
 	int opt_long;      // Index of the current option in global_longopts
@@ -862,18 +1896,40 @@ static int __parse_global_opts(simplearg_t sap, int argc, char* argv[])
 
 	struct option global_longopts[] =
 	{
-		{"address",     required_argument, NULL,        'i'},
-		{"port",        required_argument, NULL,        'p'},
-		{"pid",         required_argument, &have_pid,     1},
-		{"new",         no_argument,       &have_new,     1},
-		{"kill",        no_argument,       NULL,        'k'},
-		{"daemon",      no_argument,       &have_daemon,  1},
-		{"list",        required_argument, NULL,        'l'},
-		{"quiet",       no_argument,       NULL,        'q'},
-		{"no-messages", no_argument,       NULL,        's'},
-		{"verbose",     no_argument,       NULL,        'v'},
-		{"help",        no_argument,       &have_help,    1},
-		{"version",     no_argument,       &have_version, 1},
+		{"address",      required_argument, NULL,            'i'},
+		{"port",         required_argument, NULL,            'p'},
+		{"pid",          required_argument, &have_pid,         1},
+		{"config",       required_argument, &have_config,      1},
+		{"journal",      required_argument, &have_journal,     1},
+		{"index",        required_argument, &have_index,       1},
+		{"write-index",  required_argument, &have_write_index, 1},
+		{"match",        required_argument, &have_match,       1},
+		{"purge",        required_argument, &have_purge,       1},
+		{"sign-key",     required_argument, &have_sign_key,    1},
+		{"sign-links",   required_argument, &have_sign_links,  1},
+		{"sign-table",   required_argument, &have_sign_table,  1},
+		{"sign",         required_argument, &have_sign,        1},
+		{"sign-count",   required_argument, &have_sign_count,  1},
+		{"sign-ttl",     required_argument, &have_sign_ttl,    1},
+		{"new",          no_argument,       &have_new,         1},
+		{"handoff",      optional_argument, &have_handoff,     1},
+		{"workers",      required_argument, &have_workers,     1},
+		{"idle-timeout", required_argument, &have_idle,        1},
+		{"resume-grace", required_argument, &have_grace,       1},
+		{"cpus",         required_argument, &have_cpus,        1},
+		{"numa",         no_argument,       &have_numa,        1},
+		{"tcp-profile",  required_argument, &have_tcp,         1},
+		{"preload",      no_argument,       &have_preload,     1},
+		{"watch",        optional_argument, &have_watch,       1},
+		{"direct-threshold", required_argument, &have_direct,  1},
+		{"kill",         no_argument,       NULL,            'k'},
+		{"daemon",       no_argument,       &have_daemon,      1},
+		{"list",         required_argument, NULL,            'l'},
+		{"quiet",        no_argument,       NULL,            'q'},
+		{"no-messages",  no_argument,       NULL,            's'},
+		{"verbose",      no_argument,       NULL,            'v'},
+		{"help",         no_argument,       &have_help,        1},
+		{"version",      no_argument,       &have_version,     1},
 		{0, 0, 0, 0}
 	};
 
@@ -915,10 +1971,98 @@ static int __parse_global_opts(simplearg_t sap, int argc, char* argv[])
 				{
 					__set_pid(sap, argv[opt_index], optarg);
 				}
+				else if(global_longopts[opt_long].flag == &have_config)
+				{
+					__set_config(sap, argv[opt_index], optarg);
+				}
+				else if(global_longopts[opt_long].flag == &have_journal)
+				{
+					__set_journal(sap, argv[opt_index], optarg);
+				}
+				else if(global_longopts[opt_long].flag == &have_index)
+				{
+					__set_index(sap, argv[opt_index], optarg);
+				}
+				else if(global_longopts[opt_long].flag == &have_write_index)
+				{
+					__set_write_index(sap, argv[opt_index], optarg);
+				}
+				else if(global_longopts[opt_long].flag == &have_match)
+				{
+					__set_match(sap, argv[opt_index], optarg);
+				}
+				else if(global_longopts[opt_long].flag == &have_purge)
+				{
+					__set_purge(sap, argv[opt_index], optarg);
+				}
+				else if(global_longopts[opt_long].flag == &have_sign_key)
+				{
+					__set_sign_key(sap, argv[opt_index], optarg);
+				}
+				else if(global_longopts[opt_long].flag == &have_sign_links)
+				{
+					__set_sign_links(sap, argv[opt_index], optarg);
+				}
+				else if(global_longopts[opt_long].flag == &have_sign_table)
+				{
+					__set_sign_table(sap, argv[opt_index], optarg);
+				}
+				else if(global_longopts[opt_long].flag == &have_sign)
+				{
+					__set_sign(sap, argv[opt_index], optarg);
+				}
+				else if(global_longopts[opt_long].flag == &have_sign_count)
+				{
+					__set_sign_limit(sap, argv[opt_index], optarg, false);
+				}
+				else if(global_longopts[opt_long].flag == &have_sign_ttl)
+				{
+					__set_sign_limit(sap, argv[opt_index], optarg, true);
+				}
 				else if(global_longopts[opt_long].flag == &have_new)
 				{
 					__set_new(sap);
 				}
+				else if(global_longopts[opt_long].flag == &have_handoff)
+				{
+					__set_handoff(sap, argv[opt_index], optarg);
+				}
+				else if(global_longopts[opt_long].flag == &have_workers)
+				{
+					__set_workers(sap, argv[opt_index], optarg);
+				}
+				else if(global_longopts[opt_long].flag == &have_idle)
+				{
+					__set_idle_timeout(sap, argv[opt_index], optarg);
+				}
+				else if(global_longopts[opt_long].flag == &have_grace)
+				{
+					__set_resume_grace(sap, argv[opt_index], optarg);
+				}
+				else if(global_longopts[opt_long].flag == &have_cpus)
+				{
+					__set_cpus(sap, argv[opt_index], optarg);
+				}
+				else if(global_longopts[opt_long].flag == &have_numa)
+				{
+					__set_numa(sap);
+				}
+				else if(global_longopts[opt_long].flag == &have_tcp)
+				{
+					__set_tcp_profile(sap, argv[opt_index], optarg);
+				}
+				else if(global_longopts[opt_long].flag == &have_preload)
+				{
+					__set_preload(sap);
+				}
+				else if(global_longopts[opt_long].flag == &have_watch)
+				{
+					__set_watch(sap, argv[opt_index], optarg);
+				}
+				else if(global_longopts[opt_long].flag == &have_direct)
+				{
+					__set_direct_threshold(sap, argv[opt_index], optarg);
+				}
 				else if(global_longopts[opt_long].flag == &have_daemon)
 				{
 					__set_daemon(sap);
@@ -1012,8 +2156,10 @@ static int __parse_file_opts(simplearg_t sap, int argc, char* argv[])
 
 	struct option file_longopts[] =
 	{
-		{"count", required_argument, NULL, 'c'},
-		{"uri",   required_argument, NULL, 'u'},
+		{"count",   required_argument, NULL, 'c'},
+		{"uri",     required_argument, NULL, 'u'},
+		{"ttl",     required_argument, NULL, 't'},
+		{"expires", required_argument, NULL, 'e'},
 		{0, 0, 0, 0}
 	};
 
@@ -1041,7 +2187,7 @@ static int __parse_file_opts(simplearg_t sap, int argc, char* argv[])
 				break;
 			}
 
-			opt_arg = getopt_long(argc + 1, argv - 1, "c:u:", file_longopts, &opt_long);
+			opt_arg = getopt_long(argc + 1, argv - 1, "c:u:t:", file_longopts, &opt_long);
 
 			if(optind < 1 || (optind - 1) < opt_index)
 			{
@@ -1067,6 +2213,14 @@ static int __parse_file_opts(simplearg_t sap, int argc, char* argv[])
 					__set_uri(sap, argv[opt_index], optarg);
 					break;
 
+				case 't':
+					__set_expiry(sap, argv[opt_index], optarg, true);
+					break;
+
+				case 'e':
+					__set_expiry(sap, argv[opt_index], optarg, false);
+					break;
+
 				case '?':
 					if(__is_longopt(file_longopts, optopt, argv[opt_index]) == false)
 					{
@@ -1126,6 +2280,9 @@ simplearg_t simplearg_init()
 	memset(sap, 0, sizeof(struct simplearg));
 
 	sap->verbosity = DEFAULT_IMPACT_LEVEL;
+	sap->sign_count = SA_SIGN_COUNT;
+	sap->sign_ttl = SA_SIGN_TTL;
+	sap->resume_grace = -1;
 
 	return sap;
 }
@@ -1140,6 +2297,17 @@ void simplearg_free(simplearg_t sap)
 	if(sap == NULL) return;
 
 	free(sap->address);
+	free(sap->config);
+	free(sap->journal);
+	free(sap->index);
+	free(sap->write_index);
+	free(sap->match);
+	free(sap->purge);
+	free(sap->sign_key);
+	free(sap->sign_table);
+	free(sap->sign);
+	free(sap->cpus);
+	free(sap->tcp_profile);
 
 	while(sap->files)
 	{
@@ -1176,7 +2344,28 @@ void simplearg_parse(simplearg_t sap, int argc, char* argv[])
 	opterr = 0;
 
 	opt_index += __parse_global_opts(sap, argc - opt_index, argv + opt_index);
-	if(sap->options & SA_OPT_ERROR || sap->actions != SA_ACT_NONE)
+	if(sap->options & SA_OPT_ERROR)
+	{
+		return;
+	}
+
+	if(sap->match && !(sap->actions & SA_ACT_LIST_FILES))
+	{
+		impact(0, "%s: %s: The \"match\" option may only be given to list files\n",
+			SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_INVLAID_OPTION);
+		sap->options |= SA_OPT_ERROR;
+		return;
+	}
+
+	if(sap->sign && sap->sign_key == NULL)
+	{
+		impact(0, "%s: %s: The \"sign\" option requires the \"sign-key\" option\n",
+			SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_INVLAID_OPTION);
+		sap->options |= SA_OPT_ERROR;
+		return;
+	}
+
+	if(sap->actions != SA_ACT_NONE)
 	{
 		return;
 	}
@@ -1187,8 +2376,82 @@ void simplearg_parse(simplearg_t sap, int argc, char* argv[])
 		return;
 	}
 
+	if(sap->config)
+	{
+		__parse_config(sap);
+		if(sap->options & SA_OPT_ERROR) return;
+	}
+
+	if(sap->write_index && sap->options & SA_OPT_HANDOFF)
+	{
+		impact(0, "%s: %s: The \"write-index\" and \"handoff\" options are mutually exclusive\n",
+			SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_INVLAID_OPTION);
+		sap->options |= SA_OPT_ERROR;
+		return;
+	}
+
+	if(sap->sign_table && sap->sign_key == NULL)
+	{
+		impact(0, "%s: %s: The \"sign-table\" option requires the \"sign-key\" option\n",
+			SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_INVLAID_OPTION);
+		sap->options |= SA_OPT_ERROR;
+		return;
+	}
+
+	// Counts kept only in memory would start over in the new instance.
+	if(sap->sign_key && sap->sign_table == NULL && sap->options & SA_OPT_HANDOFF)
+	{
+		impact(0, "%s: %s: The \"handoff\" option requires the \"sign-table\" option when links are signed\n",
+			SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_INVLAID_OPTION);
+		sap->options |= SA_OPT_ERROR;
+		return;
+	}
+
+	if(sap->workers > 1 && sap->options & SA_OPT_HANDOFF)
+	{
+		impact(0, "%s: %s: The \"workers\" and \"handoff\" options are mutually exclusive\n",
+			SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_INVLAID_OPTION);
+		sap->options |= SA_OPT_ERROR;
+		return;
+	}
+
+	if(sap->workers > 1 && sap->pid && !(sap->options & SA_OPT_HANDOFF))
+	{
+		impact(0, "%s: %s: The \"workers\" and \"process identifier\" options are mutually exclusive\n",
+			SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_INVLAID_OPTION);
+		sap->options |= SA_OPT_ERROR;
+		return;
+	}
+
+	// When taking over, the PID selects the instance we take over from.
+	if(sap->journal && sap->pid && !(sap->options & SA_OPT_HANDOFF))
+	{
+		impact(0, "%s: %s: The \"journal\" and \"process identifier\" options are mutually exclusive\n",
+			SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_INVLAID_OPTION);
+		sap->options |= SA_OPT_ERROR;
+		return;
+	}
+
+	if(sap->index && sap->pid && !(sap->options & SA_OPT_HANDOFF))
+	{
+		impact(0, "%s: %s: The \"index\" and \"process identifier\" options are mutually exclusive\n",
+			SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_INVLAID_OPTION);
+		sap->options |= SA_OPT_ERROR;
+		return;
+	}
+
 	simplefile_t last = __get_last_file(sap, 0);
-	if(last == NULL)
+	if(last == NULL && (sap->journal || sap->index) && sap->write_index == NULL)
+	{
+		// The files to serve will be restored from the journal or index.
+		return;
+	}
+	else if(last == NULL && sap->options & SA_OPT_HANDOFF)
+	{
+		// The files to serve will be handed off to us.
+		return;
+	}
+	else if(last == NULL)
 	{
 		impact(0, "%s: %s: At least one FILE must be specified\n",
 			SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_INVLAID_SYNTAX);
@@ -1202,7 +2465,8 @@ void simplearg_parse(simplearg_t sap, int argc, char* argv[])
 			SP_ARGS_HEADER_NAMESPACE, SP_ARGS_HEADER_INVLAID_SYNTAX);
 
 		if(sap->files == last) sap->files = NULL;
-		if(last->prev) last->prev = NULL;
+		if(last->prev) last->prev->next = NULL;
+		sap->files_tail = last->prev;
 		free(last);
 
 		sap->options |= SA_OPT_ERROR;
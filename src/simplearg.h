@@ -43,27 +43,66 @@
 /// An error occurred. Abort!
 #define SA_OPT_ERROR    0x10
 
+/// Take over from the targeted instance of this program
+#define SA_OPT_HANDOFF  0x20
+
+/// Spread the processes serving HTTP requests across NUMA nodes
+#define SA_OPT_NUMA     0x40
+
+/// Read files which may be downloaded more than once into the page cache as they are added
+#define SA_OPT_PRELOAD  0x80
+
+/// Watch the files being served for changes
+#define SA_OPT_WATCH    0x100
+
+/// Purge files being served once they are deleted (with SA_OPT_WATCH)
+#define SA_OPT_WATCH_PURGE 0x200
+
+/// Seconds the instance we take over from may spend finishing its transfers by default
+#define SA_HANDOFF_TIMEOUT 600
+
+/// Maximum number of processes which may serve HTTP requests
+#define SA_WORKERS_MAX 256
+
+/// Number of times a signed link may be downloaded by default
+#define SA_SIGN_COUNT 1
+
+/// Seconds a signed link works for by default
+#define SA_SIGN_TTL 86400
+
 
 /// No actions are defined (default)
-#define SA_ACT_NONE       0x00
+#define SA_ACT_NONE        0x00
 
 /// List all accessible instances of this program
-#define SA_ACT_LIST_INST  0x01
+#define SA_ACT_LIST_INST   0x01
 
 /// List all files being served by the targeted instance of this program
-#define SA_ACT_LIST_FILES 0x02
+#define SA_ACT_LIST_FILES  0x02
 
 /// Stop serving all files from the targeted instance of this program
-#define SA_ACT_DELETE     0x04
+#define SA_ACT_DELETE      0x04
 
 /// Shut down the HTTP server on the targeted instance of this program
-#define SA_ACT_SHUTDOWN   0x08
+#define SA_ACT_SHUTDOWN    0x08
 
 /// Print this program's help information
-#define SA_ACT_HELP       0x10
+#define SA_ACT_HELP        0x10
 
 /// Print this program's version information
-#define SA_ACT_VERSION    0x20
+#define SA_ACT_VERSION     0x20
+
+/// Print events from the targeted instance of this program as they happen
+#define SA_ACT_LIST_EVENTS 0x40
+
+/// Print the current status of the targeted instance of this program
+#define SA_ACT_LIST_STATUS 0x80
+
+/// Stop serving the files on URIs matching a pattern from the targeted instance of this program
+#define SA_ACT_PURGE       0x100
+
+/// Print a link to a URI signed with a key
+#define SA_ACT_SIGN        0x200
 
 
 /*!
@@ -77,6 +116,9 @@ typedef struct simplefile
 	/// Number of times the file may be downloaded
 	unsigned int count;
 
+	/// Time (seconds since the Epoch) the file stops being served (0 = never)
+	time_t expires;
+
 	/// Uniform Resource Identifier of the file
 	char* uri;
 
@@ -102,6 +144,69 @@ typedef struct simplearg
 	/// PID of the instance of this program to act on
 	pid_t pid;
 
+	/// Maximum number of concurrent client connections (0 = default)
+	unsigned int connection_limit;
+
+	/// Seconds a client connection may be idle before it is closed (0 = never)
+	unsigned int connection_timeout;
+
+	/// Name and path of the configuration file to read
+	char* config;
+
+	/// Name and path of the journal of the files being served
+	char* journal;
+
+	/// Name and path of the index of files to serve
+	char* index;
+
+	/// Name and path of the index to write (instead of serving any files)
+	char* write_index;
+
+	/// Pattern the URIs of the files to list must match (NULL = all of them)
+	char* match;
+
+	/// Pattern the URIs of the files to purge must match
+	char* purge;
+
+	/// Name and path of the key links are signed with (NULL = files are served on their URIs alone)
+	char* sign_key;
+
+	/// Number of signed links which may be outstanding at once (0 = default)
+	unsigned int sign_links;
+
+	/// Name and path of the file the downloads of signed links are counted in (NULL = only in memory)
+	char* sign_table;
+
+	/// URI to print a signed link to
+	char* sign;
+
+	/// Number of times the signed link may be downloaded (0 = unlimited)
+	unsigned int sign_count;
+
+	/// Seconds the signed link works for
+	unsigned int sign_ttl;
+
+	/// Seconds the instance we take over from may spend finishing its transfers (0 = no limit)
+	unsigned int handoff_timeout;
+
+	/// Number of processes which should serve HTTP requests (0 = just this one)
+	unsigned int workers;
+
+	/// Seconds the server may go without any clients before it shuts down (0 = never)
+	unsigned int idle_timeout;
+
+	/// Seconds a client has to resume an interrupted download (-1 = the default)
+	int resume_grace;
+
+	/// List of the CPUs the server may run on (NULL = any)
+	char* cpus;
+
+	/// Name of the socket and TCP settings of the server (NULL = the system's defaults)
+	char* tcp_profile;
+
+	/// Mebibytes from which files are read with O_DIRECT (0 = never)
+	unsigned int direct_threshold;
+
 
 	/// Verbosity level of messages to print
 	int verbosity;
@@ -116,6 +221,9 @@ typedef struct simplearg
 
 	/// List of files to serve
 	simplefile_t files;
+
+	/// Last file in the list
+	simplefile_t files_tail;
 } * simplearg_t;
 
 simplearg_t simplearg_init();
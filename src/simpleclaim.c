@@ -0,0 +1,479 @@
+/*
+ * SimplePost - A Simple HTTP Server
+ *
+ * Copyright (C) 2016 Karl Lenz.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have recieved a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ */
+
+#include "simpleclaim.h"
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+/// Number of downloads which may be reserved for clients to resume at once
+#define SP_CLAIM_SLOTS  4096
+
+/// Number of separate ranges of a file each reservation remembers sending
+#define SP_CLAIM_RANGES 4
+
+/*!
+ * \brief Download of a file reserved for a client
+ *
+ * The download is only counted once the client has been sent every byte of
+ * the file, however many requests that took. Until then, the reservation
+ * holds one of the downloads of the file for the client, so it may resume
+ * the download with a Range request without another one being counted, and
+ * the file is never downloaded by more clients than its COUNT allows. Only
+ * one request uses a reservation at a time, so a client downloading the file
+ * several times at once holds a reservation for each download.
+ */
+struct simpleclaim
+{
+	/// Address of the client (IPv4 addresses are mapped to IPv6)
+	uint8_t client[16];
+
+	/// Size (in bytes) of the file the ranges were sent from
+	uint64_t size;
+
+	/// Ranges of the file sent to the client, sorted and disjoint (first byte, and one past the last byte)
+	uint64_t ranges[SP_CLAIM_RANGES][2];
+
+	/// Number of ranges
+	uint32_t ranges_count;
+
+	/// Number of requests using the reservation (0 or 1)
+	uint32_t requests;
+
+	/// Time (seconds since the Epoch) the reservation lapses once no request is using it
+	uint32_t expires;
+
+	/// Serial number of the reservation (0 if it is free)
+	uint32_t serial;
+
+	/// Slot of the file in the table of files shared with the worker processes (see simpleshare_t; 0 if the file is not shared)
+	uint32_t slot;
+
+	/// Next reservation of the same file, or the next free one (plus one; 0 = none)
+	uint32_t next;
+};
+
+/*!
+ * \brief Table of the downloads reserved for clients
+ *
+ * Each file keeps the reservations of its downloads in a list threaded
+ * through the table, which is only as long as the number of its downloads
+ * in progress or waiting to be resumed. Reservations which have lapsed are
+ * freed the next time the list is walked. The table is mapped into memory
+ * shared with the worker processes, so a client may resume a download from
+ * any of them.
+ */
+struct simpleclaim_table
+{
+	/// Lock for everything in the table, as well as the list of reservations of every file (shared with the worker processes)
+	pthread_mutex_t lock;
+
+	/// First free reservation plus one (0 = none but those never used)
+	uint32_t free;
+
+	/// Number of reservations which have ever been used
+	uint32_t used;
+
+	/// Serial number of the last reservation made
+	uint32_t serial;
+
+	/// Reservations
+	struct simpleclaim claims[SP_CLAIM_SLOTS];
+};
+
+/*!
+ * \brief Free a reservation, taking it off the list of its file.
+ *
+ * \warning The caller must hold the lock on the table.
+ *
+ * \param[in] table   Table to act on
+ * \param[inout] link Link to the reservation in the list of its file
+ * \param[inout] list Reservations of the file
+ */
+static void __free_claim(simpleclaim_table_t table, uint32_t* link, struct simpleclaim_list* list)
+{
+	uint32_t i = *link;                                // Reservation to free plus one
+	struct simpleclaim* claim = &table->claims[i - 1]; // Reservation to free
+
+	*link = claim->next;
+	claim->serial = 0;
+	claim->next = table->free;
+	table->free = i;
+	--(list->count);
+}
+
+/*!
+ * \brief Remember that a range of a file was sent to the client holding a
+ * reservation.
+ *
+ * \note Ranges which overlap or touch are merged. If the reservation cannot
+ * remember any more ranges, it forgets the shortest one, which the client
+ * then has to be sent again before the download is counted.
+ *
+ * \param[inout] claim Reservation to act on
+ * \param[in] first    First byte of the range
+ * \param[in] end      One past the last byte of the range
+ */
+static void __add_range(struct simpleclaim* claim, uint64_t first, uint64_t end)
+{
+	uint64_t ranges[SP_CLAIM_RANGES + 1][2]; // Ranges in order, before they are merged
+	uint32_t n = 0;                          // Number of ranges
+	uint32_t i = 0;                          // Range of the reservation to copy
+	uint32_t j = 0;                          // Last merged range
+
+	for(; i < claim->ranges_count && claim->ranges[i][0] <= first; ++i, ++n)
+	{
+		ranges[n][0] = claim->ranges[i][0];
+		ranges[n][1] = claim->ranges[i][1];
+	}
+	ranges[n][0] = first;
+	ranges[n][1] = end;
+	++n;
+	for(; i < claim->ranges_count; ++i, ++n)
+	{
+		ranges[n][0] = claim->ranges[i][0];
+		ranges[n][1] = claim->ranges[i][1];
+	}
+
+	for(i = 1; i < n; ++i)
+	{
+		if(ranges[i][0] <= ranges[j][1])
+		{
+			if(ranges[i][1] > ranges[j][1]) ranges[j][1] = ranges[i][1];
+		}
+		else
+		{
+			++j;
+			ranges[j][0] = ranges[i][0];
+			ranges[j][1] = ranges[i][1];
+		}
+	}
+	n = j + 1;
+
+	if(n > SP_CLAIM_RANGES)
+	{
+		uint32_t shortest = 0; // Shortest range
+
+		for(i = 1; i < n; ++i)
+		{
+			if(ranges[i][1] - ranges[i][0] < ranges[shortest][1] - ranges[shortest][0]) shortest = i;
+		}
+		memmove(ranges[shortest], ranges[shortest + 1], sizeof(ranges[0]) * (n - shortest - 1));
+		--n;
+	}
+
+	memcpy(claim->ranges, ranges, sizeof(ranges[0]) * n);
+	claim->ranges_count = n;
+}
+
+/*!
+ * \brief Map a new table of downloads reserved for clients.
+ *
+ * \note The table is mapped into memory shared with any process forked
+ * afterwards. Pages of the table are only backed by memory once they are
+ * touched, and reservations are made from the start of it, so the table
+ * costs about as much memory as the most downloads ever reserved at once.
+ *
+ * \return the table, or NULL (with errno set) if it could not be mapped
+ */
+simpleclaim_table_t simpleclaim_table_map()
+{
+	struct simpleclaim_table* table; // Table of reservations
+	pthread_mutexattr_t attr;        // Attributes of its lock
+
+	table = (struct simpleclaim_table*) mmap(NULL, sizeof(struct simpleclaim_table),
+		PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if(table == MAP_FAILED) return NULL;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+	pthread_mutex_init(&table->lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+
+	return table;
+}
+
+/*!
+ * \brief Unmap a table of downloads reserved for clients.
+ *
+ * \param[in] table Table to unmap
+ */
+void simpleclaim_table_unmap(simpleclaim_table_t table)
+{
+	if(table == NULL) return;
+
+	pthread_mutex_destroy(&table->lock);
+	munmap(table, sizeof(struct simpleclaim_table));
+}
+
+/*!
+ * \brief Lock a table of downloads reserved for clients, along with the list
+ * of reservations of every file.
+ *
+ * \param[in] table Table to lock
+ */
+void simpleclaim_lock(simpleclaim_table_t table)
+{
+	pthread_mutex_lock(&table->lock);
+}
+
+/*!
+ * \brief Unlock a table of downloads reserved for clients.
+ *
+ * \param[in] table Table to unlock
+ */
+void simpleclaim_unlock(simpleclaim_table_t table)
+{
+	pthread_mutex_unlock(&table->lock);
+}
+
+/*!
+ * \brief Reserve a download of a file for the client of a request.
+ *
+ * \note If the request is for a range of the file, and the client holds a
+ * reservation for the file which no other request is using, the request
+ * resumes that download. Otherwise the request starts a new download, which
+ * is reserved unless every download the file has left is reserved already
+ * (including for the same client, which may be downloading it already). If the
+ * table is full, nothing is reserved, and the caller must count the download
+ * as it starts. Reservations of the file which have lapsed are freed along
+ * the way.
+ *
+ * \warning The caller must hold the lock on the table.
+ *
+ * \param[in] table     Table to act on
+ * \param[inout] list   Reservations of the file
+ * \param[in] count     Number of times the file may still be downloaded (never unlimited)
+ * \param[in] client    Address of the client (16 bytes; IPv4 addresses are mapped to IPv6)
+ * \param[in] is_resume Was a range of the file requested, so the request may resume a download?
+ * \param[in] slot      Slot of the file in the table of files shared with the worker processes (see simpleshare_t; 0 if the file is not shared)
+ * \param[out] claim    Reservation plus one (0 if nothing was reserved)
+ * \param[out] serial   Serial number of the reservation
+ * \param[out] is_last  Is this the last time the file may be downloaded?
+ *
+ * \retval true the file may be served
+ * \retval false every download of the file is reserved already
+ */
+bool simpleclaim_reserve(
+	simpleclaim_table_t table,
+	struct simpleclaim_list* list,
+	uint32_t count,
+	const uint8_t* client,
+	bool is_resume,
+	uint32_t slot,
+	uint32_t* claim,
+	uint32_t* serial,
+	bool* is_last)
+{
+	time_t now = time(NULL);       // Current time
+	uint32_t* link = &list->first; // Link to the next reservation of the file
+	uint32_t found = 0;            // Reservation to resume plus one
+	struct simpleclaim* p;         // Reservation to check
+
+	*claim = 0;
+
+	while(*link)
+	{
+		p = &table->claims[*link - 1];
+
+		if(p->requests == 0 && (time_t) p->expires <= now)
+		{
+			__free_claim(table, link, list);
+			continue;
+		}
+
+		// A request which is not for a range starts over, so it is a new download.
+		if(found == 0 &&
+			is_resume &&
+			p->requests == 0 &&
+			memcmp(p->client, client, sizeof(p->client)) == 0)
+		{
+			found = *link;
+		}
+		link = &p->next;
+	}
+
+	if(found == 0)
+	{
+		if(list->count >= count) return false;
+
+		if(table->free)
+		{
+			found = table->free;
+			table->free = table->claims[found - 1].next;
+		}
+		else if(table->used < SP_CLAIM_SLOTS)
+		{
+			found = ++(table->used);
+		}
+		else
+		{
+			*is_last = (count - list->count == 1);
+			return true;
+		}
+
+		p = &table->claims[found - 1];
+		memset(p, 0, sizeof(struct simpleclaim));
+		memcpy(p->client, client, sizeof(p->client));
+		if(++(table->serial) == 0) ++(table->serial);
+		p->serial = table->serial;
+		p->next = list->first;
+		list->first = found;
+		++(list->count);
+	}
+
+	p = &table->claims[found - 1];
+	++(p->requests);
+	p->slot = slot;
+	*claim = found;
+	*serial = p->serial;
+	*is_last = (list->count == count);
+
+	return true;
+}
+
+/*!
+ * \brief Get a reservation made by simpleclaim_reserve().
+ *
+ * \warning The caller must hold the lock on the table.
+ *
+ * \param[in] table  Table to act on
+ * \param[in] claim  Reservation plus one
+ * \param[in] serial Serial number of the reservation
+ *
+ * \return the reservation, or NULL if it has been freed (because its file
+ * is no longer served, or the client was sent the whole file by another
+ * request)
+ */
+simpleclaim_t simpleclaim_get(simpleclaim_table_t table, uint32_t claim, uint32_t serial)
+{
+	struct simpleclaim* p = &table->claims[claim - 1]; // Reservation
+
+	return (p->serial == serial) ? p : NULL;
+}
+
+/*!
+ * \brief Finish a request using a reservation, remembering the part of the
+ * file it sent.
+ *
+ * \note Once the client has been sent every byte of the file, the
+ * reservation is freed, and the caller must count the download. Otherwise
+ * the reservation lapses if the client does not resume the download within
+ * the grace period, unless it was not sent anything at all, in which case it
+ * is freed right away.
+ *
+ * \warning The caller must hold the lock on the table.
+ *
+ * \param[in] table   Table to act on
+ * \param[in] claim   Reservation of the request (see simpleclaim_get())
+ * \param[inout] list Reservations of the file
+ * \param[in] size    Number of bytes in the whole file
+ * \param[in] offset  Number of bytes into the file the response started
+ * \param[in] bytes   Number of bytes of the file sent, from offset on
+ * \param[in] is_sent Was the whole file response sent?
+ * \param[in] grace   Seconds the client has to resume the download
+ *
+ * \return true if the download should be counted now, false if not
+ */
+bool simpleclaim_finish(
+	simpleclaim_table_t table,
+	simpleclaim_t claim,
+	struct simpleclaim_list* list,
+	uint64_t size,
+	uint64_t offset,
+	uint64_t bytes,
+	bool is_sent,
+	uint32_t grace)
+{
+	uint32_t i = (uint32_t) (claim - table->claims) + 1; // Reservation plus one
+	uint32_t* link;                                      // Link to the reservation in the list of its file
+	bool is_complete;                                    // Has the client been sent the whole file?
+
+	--(claim->requests);
+
+	// Whatever was sent of a file which has changed since has to be sent again.
+	if((bytes || is_sent) && claim->size != size)
+	{
+		claim->size = size;
+		claim->ranges_count = 0;
+	}
+	if(bytes) __add_range(claim, offset, offset + bytes);
+
+	if(claim->size == 0) is_complete = is_sent;
+	else is_complete = (claim->ranges_count == 1 && claim->ranges[0][0] == 0 && claim->ranges[0][1] >= claim->size);
+
+	if(is_complete || (claim->requests == 0 && claim->ranges_count == 0))
+	{
+		for(link = &list->first; *link != i; link = &table->claims[*link - 1].next);
+		__free_claim(table, link, list);
+	}
+	else if(claim->requests == 0)
+	{
+		claim->expires = (uint32_t) (time(NULL) + grace);
+	}
+
+	return is_complete;
+}
+
+/*!
+ * \brief Free every reservation of a file.
+ *
+ * \warning The caller must hold the lock on the table.
+ *
+ * \param[in] table   Table to act on
+ * \param[inout] list Reservations of the file
+ */
+void simpleclaim_free_all(simpleclaim_table_t table, struct simpleclaim_list* list)
+{
+	while(list->first) __free_claim(table, &list->first, list);
+}
+
+/*!
+ * \brief Get the slot of the file a download was reserved from.
+ *
+ * \param[in] claim Reservation to act on
+ *
+ * \return the slot of the file in the table of files shared with the worker
+ * processes (see simpleshare_t), or 0 if the file is not shared
+ */
+uint32_t simpleclaim_get_slot(const simpleclaim_t claim)
+{
+	return claim->slot;
+}
+
+/*!
+ * \brief Move every reservation of a file to a new slot of the table of
+ * files shared with the worker processes.
+ *
+ * \warning The caller must hold the lock on the table.
+ *
+ * \param[in] table Table to act on
+ * \param[in] list  Reservations of the file
+ * \param[in] slot  New slot of the file (see simpleshare_t)
+ */
+void simpleclaim_set_slot(simpleclaim_table_t table, const struct simpleclaim_list* list, uint32_t slot)
+{
+	for(uint32_t i = list->first; i; i = table->claims[i - 1].next) table->claims[i - 1].slot = slot;
+}
@@ -0,0 +1,86 @@
+/*
+ * SimplePost - A Simple HTTP Server
+ *
+ * Copyright (C) 2016 Karl Lenz.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have recieved a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ */
+
+#ifndef _SIMPLECLAIM_H_
+#define _SIMPLECLAIM_H_
+
+#include <sys/types.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+
+/*!
+ * \brief Table of the downloads reserved for clients
+ */
+typedef struct simpleclaim_table* simpleclaim_table_t;
+
+/*!
+ * \brief Download of a file reserved for a client
+ */
+typedef struct simpleclaim* simpleclaim_t;
+
+/*!
+ * \brief Downloads of one file reserved for clients
+ *
+ * This is kept with the file, and may only be touched with the lock on the
+ * table held.
+ */
+struct simpleclaim_list
+{
+	/// First reservation of the file plus one (0 = none)
+	uint32_t first;
+
+	/// Number of downloads of the file reserved
+	uint32_t count;
+};
+
+simpleclaim_table_t simpleclaim_table_map();
+void simpleclaim_table_unmap(simpleclaim_table_t table);
+
+void simpleclaim_lock(simpleclaim_table_t table);
+void simpleclaim_unlock(simpleclaim_table_t table);
+
+bool simpleclaim_reserve(
+	simpleclaim_table_t table,
+	struct simpleclaim_list* list,
+	uint32_t count,
+	const uint8_t* client,
+	bool is_resume,
+	uint32_t slot,
+	uint32_t* claim,
+	uint32_t* serial,
+	bool* is_last);
+simpleclaim_t simpleclaim_get(simpleclaim_table_t table, uint32_t claim, uint32_t serial);
+bool simpleclaim_finish(
+	simpleclaim_table_t table,
+	simpleclaim_t claim,
+	struct simpleclaim_list* list,
+	uint64_t size,
+	uint64_t offset,
+	uint64_t bytes,
+	bool is_sent,
+	uint32_t grace);
+void simpleclaim_free_all(simpleclaim_table_t table, struct simpleclaim_list* list);
+
+uint32_t simpleclaim_get_slot(const simpleclaim_t claim);
+void simpleclaim_set_slot(simpleclaim_table_t table, const struct simpleclaim_list* list, uint32_t slot);
+
+#endif // _SIMPLECLAIM_H_
@@ -19,6 +19,9 @@
  * Boston, MA 021110-1307, USA.
  */
 
+// Needed for struct ucred
+#define _GNU_SOURCE
+
 #include "simplecmd.h"
 #include "impact.h"
 #include "config.h"
@@ -34,11 +37,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
+#include <inttypes.h>
 #include <errno.h>
 #include <pthread.h>
+#include <signal.h>
 #include <dirent.h>
-#include <regex.h>
 
 /// Command namespace header
 #define SP_COMMAND_HEADER_NAMESPACE      "SimplePost::Command"
@@ -46,8 +49,23 @@
 /// Protocol error string
 #define SP_COMMAND_HEADER_PROTOCOL_ERROR "Local Protocol Error"
 
-/// Directory where this program opens its command sockets
-#define SP_COMMAND_SOCK_DIR              "/tmp"
+/// Directory where this program opens its command sockets and registers its
+/// instances (followed by a hyphen and the user ID, as each user has their own)
+#define SP_COMMAND_SOCK_DIR              "/tmp/simplepost"
+
+/// Permissions of the socket directory (only its user may use it)
+#define SP_COMMAND_SOCK_DIR_MODE         0700
+
+/// Permissions of our command socket (only we may send commands)
+#define SP_COMMAND_SOCK_MODE             0600
+
+/*************************************************
+ * Names of the fields in the instance registry *
+ *************************************************/
+#define SP_COMMAND_INST_PID     "PID"
+#define SP_COMMAND_INST_ADDRESS "Address"
+#define SP_COMMAND_INST_PORT    "Port"
+#define SP_COMMAND_INST_VERSION "Version"
 
 /*****************************************************************************
  *                              Socket Support                               *
@@ -106,6 +124,71 @@ static void __sock_send(int sock, const char* command, const char* data)
 	}
 }
 
+/*!
+ * \brief Write the whole buffer to the socket without raising SIGPIPE.
+ *
+ * \param[in] sock Socket descriptor
+ * \param[in] buf  Buffer to write
+ * \param[in] size Number of bytes to write
+ *
+ * \retval true the whole buffer was written
+ * \retval false the other end is gone or another error occurred
+ */
+static bool __sock_write(int sock, const char* buf, size_t size)
+{
+	while(size)
+	{
+		ssize_t n = send(sock, buf, size, MSG_NOSIGNAL);
+
+		if(n == -1)
+		{
+			if(errno == EINTR) continue;
+			return false;
+		}
+
+		buf += n;
+		size -= (size_t) n;
+	}
+
+	return true;
+}
+
+/*!
+ * \brief Send a command to a client that may disappear at any time.
+ *
+ * \note This is the same as __sock_send(), except that a client that closes
+ * its end of the socket is reported by return value rather than by SIGPIPE.
+ * Streaming commands which are expected to outlive their clients should use
+ * this function.
+ *
+ * \param[in] sock    Socket descriptor
+ * \param[in] command Command to send to the client (may be NULL)
+ * \param[in] data    Data to send to the client (may be NULL)
+ *
+ * \retval true the command and data were sent
+ * \retval false the client is gone
+ */
+static bool __sock_push(int sock, const char* command, const char* data)
+{
+	char buffer[30]; // Number of characters to be written
+
+	if(command)
+	{
+		sprintf(buffer, "%zu", strlen(command));
+		if(__sock_write(sock, buffer, strlen(buffer) + 1) == false) return false;
+		if(__sock_write(sock, command, strlen(command)) == false) return false;
+	}
+
+	if(data)
+	{
+		sprintf(buffer, "%zu", strlen(data));
+		if(__sock_write(sock, buffer, strlen(buffer) + 1) == false) return false;
+		if(__sock_write(sock, data, strlen(data)) == false) return false;
+	}
+
+	return true;
+}
+
 /*!
  * \brief Send a command to the client and read the response.
  *
@@ -128,14 +211,16 @@ static void __sock_send(int sock, const char* command, const char* data)
  */
 static size_t __sock_recv(int sock, const char* command, char** data)
 {
-	char buffer[30]; // Number of characters to be read from the buffer
-	size_t length;   // Number of characters received
-	char b;          // Last byte read from the client
-	*data = NULL;    // Failsafe
+	char buffer[30];            // Number of characters to be read from the buffer
+	size_t length;              // Number of characters received
+	char b;                     // Last byte read from the client
+	size_t i;                   // Number of bytes of the string size read
+	bool is_terminated = false; // Did we read the whole string size?
+	*data = NULL;               // Failsafe
 
 	if(command) __sock_send(sock, command, NULL);
 
-	for(size_t i = 0; read(sock, (void*) &b, 1) == 1; ++i)
+	for(i = 0; read(sock, (void*) &b, 1) == 1; ++i)
 	{
 		if(i == sizeof(buffer))
 		{
@@ -146,7 +231,25 @@ static size_t __sock_recv(int sock, const char* command, char** data)
 		}
 
 		buffer[i] = b;
-		if(b == '\0') break;
+		if(b == '\0')
+		{
+			is_terminated = true;
+			break;
+		}
+	}
+
+	/* If the other end closed the socket between strings, there is nothing
+	 * to complain about. That is how streaming commands end.
+	 */
+	if(is_terminated == false)
+	{
+		if(i)
+		{
+			impact(0, "%s: %s: Connection closed after receiving only %zu bytes of a string size\n",
+				SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR,
+				i);
+		}
+		return 0;
 	}
 
 	if(sscanf(buffer, "%zu", &length) != 1)
@@ -207,6 +310,381 @@ static size_t __sock_recv(int sock, const char* command, char** data)
 	return length;
 }
 
+/*!
+ * \brief Pass a file descriptor to the client.
+ *
+ * \note The descriptor is attached to a single NUL byte, so that the client
+ * knows exactly where in the stream to receive it with __sock_recv_fd().
+ *
+ * \param[in] sock Socket descriptor
+ * \param[in] fd   File descriptor to pass
+ *
+ * \retval true the file descriptor was sent
+ * \retval false the client is gone
+ */
+static bool __sock_send_fd(int sock, int fd)
+{
+	char b = '\0';         // Byte carrying the descriptor
+	struct iovec iov;      // Data to send
+	struct msghdr msg;     // Message to send
+	struct cmsghdr* cmsg;  // Control message holding the descriptor
+	union
+	{
+		struct cmsghdr align;
+		char buf[CMSG_SPACE(sizeof(int))];
+	} control;             // Buffer for the control message
+
+	memset(&msg, 0, sizeof(msg));
+	memset(&control, 0, sizeof(control));
+
+	iov.iov_base = &b;
+	iov.iov_len = 1;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+	while(sendmsg(sock, &msg, MSG_NOSIGNAL) == -1)
+	{
+		if(errno != EINTR) return false;
+	}
+
+	return true;
+}
+
+/*!
+ * \brief Receive a file descriptor passed by __sock_send_fd().
+ *
+ * \param[in] sock Socket descriptor
+ *
+ * \return the file descriptor received, or -1 if none was received
+ */
+static int __sock_recv_fd(int sock)
+{
+	char b;                // Byte carrying the descriptor
+	struct iovec iov;      // Data to receive
+	struct msghdr msg;     // Message to receive
+	struct cmsghdr* cmsg;  // Control message holding the descriptor
+	ssize_t n;             // recvmsg() return code
+	int fd = -1;           // File descriptor received
+	union
+	{
+		struct cmsghdr align;
+		char buf[CMSG_SPACE(sizeof(int))];
+	} control;             // Buffer for the control message
+
+	memset(&msg, 0, sizeof(msg));
+
+	iov.iov_base = &b;
+	iov.iov_len = 1;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+
+	do n = recvmsg(sock, &msg, 0);
+	while(n == -1 && errno == EINTR);
+	if(n != 1) return -1;
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	if(cmsg &&
+		cmsg->cmsg_level == SOL_SOCKET &&
+		cmsg->cmsg_type == SCM_RIGHTS &&
+		cmsg->cmsg_len == CMSG_LEN(sizeof(int)))
+	{
+		memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+	}
+
+	if(msg.msg_flags & MSG_CTRUNC)
+	{
+		impact(0, "%s: %s: Received more file descriptors than expected\n",
+			SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR);
+		if(fd != -1) close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/*!
+ * \brief Check that the client is run by our user (or by root).
+ *
+ * \param[in] sock Client socket
+ *
+ * \retval true the client may act on our behalf
+ * \retval false the client is run by someone else, or we cannot tell
+ */
+static bool __sock_peer_trusted(int sock)
+{
+	struct ucred cred;                         // Credentials of the client
+	socklen_t cred_len = sizeof(struct ucred); // Length of the credentials
+
+	if(getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) == -1)
+	{
+		impact(0, "%s: Failed to get the credentials of the client: %s\n",
+			SP_COMMAND_HEADER_NAMESPACE, strerror(errno));
+		return false;
+	}
+
+	if(cred.uid != 0 && cred.uid != getuid())
+	{
+		impact(0, "%s: Refusing client %d run by user %u\n",
+			SP_COMMAND_HEADER_NAMESPACE,
+			(int) cred.pid, (unsigned int) cred.uid);
+		return false;
+	}
+
+	return true;
+}
+
+/*****************************************************************************
+ *                             Registry Support                              *
+ *****************************************************************************/
+
+/*!
+ * \brief Get the absolute name of our socket directory.
+ *
+ * \param[out] buf Buffer to receive the directory name
+ * \param[in] size Size (in bytes) of buf
+ *
+ * \return the number of characters written to the buffer, excluding the NULL-
+ * terminating character. If there was an error, zero will be returned instead.
+ */
+static size_t __get_sock_dir(char* buf, size_t size)
+{
+	int len = snprintf(buf, size, "%s-%u", SP_COMMAND_SOCK_DIR, (unsigned int) getuid());
+	if(len <= 0 || ((size_t) len) >= size) return 0;
+	return (size_t) len;
+}
+
+/*!
+ * \brief Make sure that the socket directory exists and is safe to use.
+ *
+ * \note Every user has a socket directory of their own, which nobody else
+ * may enter, so the instances of a user only ever see each other. If it
+ * already exists, it must be a real directory, not a symbolic link to one,
+ * owned by us and closed to everyone else. Otherwise whoever created it could
+ * remove our records and sockets, or plant their own.
+ *
+ * \retval true the directory is ready to use
+ * \retval false the directory could not be created or is not safe to use
+ */
+static bool __make_sock_dir()
+{
+	char sock_dir[64];      // Name of the socket directory
+	struct stat dir_status; // Status of the socket directory
+
+	if(__get_sock_dir(sock_dir, sizeof(sock_dir)) == 0) return false;
+
+	if(mkdir(sock_dir, SP_COMMAND_SOCK_DIR_MODE) == -1 && errno != EEXIST)
+	{
+		impact(0, "%s: Failed to create the command socket directory %s: %s\n",
+			SP_COMMAND_HEADER_NAMESPACE,
+			sock_dir, strerror(errno));
+		return false;
+	}
+
+	if(lstat(sock_dir, &dir_status) == -1 || S_ISDIR(dir_status.st_mode) == 0)
+	{
+		impact(0, "%s: The command socket directory %s is not a directory\n",
+			SP_COMMAND_HEADER_NAMESPACE,
+			sock_dir);
+		return false;
+	}
+
+	if(dir_status.st_uid != getuid() || (dir_status.st_mode & 07777) != SP_COMMAND_SOCK_DIR_MODE)
+	{
+		impact(0, "%s: The command socket directory %s must be owned by us, and only we may use it\n",
+			SP_COMMAND_HEADER_NAMESPACE,
+			sock_dir);
+		return false;
+	}
+
+	return true;
+}
+
+/*!
+ * \brief Get the absolute file name of the command socket for the given
+ * instance.
+ *
+ * \param[out] buf Buffer to receive the socket name
+ * \param[in] size Size (in bytes) of buf
+ * \param[in] pid  Process identifier of the instance
+ *
+ * \return the number of characters written to the buffer, excluding the NULL-
+ * terminating character. If there was an error, zero will be returned instead.
+ */
+static size_t __get_sock_name(char* buf, size_t size, pid_t pid)
+{
+	int len = snprintf(buf, size, "%s-%u/%s_sock_%d", SP_COMMAND_SOCK_DIR, (unsigned int) getuid(), SP_MAIN_SHORT_NAME, pid);
+	if(len <= 0 || ((size_t) len) >= size) return 0;
+	return (size_t) len;
+}
+
+/*!
+ * \brief Get the absolute file name of the registry record for the given
+ * instance.
+ *
+ * \param[out] buf Buffer to receive the record name
+ * \param[in] size Size (in bytes) of buf
+ * \param[in] pid  Process identifier of the instance
+ *
+ * \return the number of characters written to the buffer, excluding the NULL-
+ * terminating character. If there was an error, zero will be returned instead.
+ */
+static size_t __get_inst_name(char* buf, size_t size, pid_t pid)
+{
+	int len = snprintf(buf, size, "%s-%u/%s_inst_%d", SP_COMMAND_SOCK_DIR, (unsigned int) getuid(), SP_MAIN_SHORT_NAME, pid);
+	if(len <= 0 || ((size_t) len) >= size) return 0;
+	return (size_t) len;
+}
+
+/*!
+ * \brief Is the process with the given identifier still running?
+ *
+ * \note A process owned by another user is still alive even though we are
+ * not allowed to signal it.
+ *
+ * \param[in] pid Process identifier to check
+ *
+ * \retval true the process exists
+ * \retval false there is no such process
+ */
+static bool __is_inst_alive(pid_t pid)
+{
+	return !(kill(pid, 0) == -1 && errno == ESRCH);
+}
+
+/*!
+ * \brief Write the registry record describing this instance.
+ *
+ * The record is a short list of "Field=Value" lines. It is written to a
+ * temporary file first, then renamed into place, so that readers never see a
+ * partially-written record.
+ *
+ * \param[in] inst_name Absolute file name of the record
+ * \param[in] pid       Process identifier of the instance
+ * \param[in] address   Address the instance's HTTP server is bound to
+ * \param[in] port      Port the instance's HTTP server is listening on
+ *
+ * \retval true the record was written successfully
+ * \retval false the record could not be written
+ */
+static bool __inst_register(
+	const char* inst_name,
+	pid_t pid,
+	const char* address,
+	unsigned short port)
+{
+	char tmp_name[512]; // Temporary name of the record while it is being written
+	int fd;             // File descriptor of the temporary record
+	FILE* fp;           // Stream of the temporary record
+
+	if(snprintf(tmp_name, sizeof(tmp_name), "%s.tmp", inst_name) >= (int) sizeof(tmp_name)) return false;
+
+	// A previous process with our PID may have left its temporary record.
+	remove(tmp_name);
+
+	fd = open(tmp_name, O_WRONLY | O_CREAT | O_EXCL, 0644);
+	if(fd == -1)
+	{
+		impact(0, "%s: Failed to create the registry record %s: %s\n",
+			SP_COMMAND_HEADER_NAMESPACE,
+			tmp_name, strerror(errno));
+		return false;
+	}
+
+	fp = fdopen(fd, "w");
+	if(fp == NULL)
+	{
+		close(fd);
+		remove(tmp_name);
+		return false;
+	}
+
+	fprintf(fp, "%s=%d\n", SP_COMMAND_INST_PID, pid);
+	fprintf(fp, "%s=%s\n", SP_COMMAND_INST_ADDRESS, address ? address : "");
+	fprintf(fp, "%s=%hu\n", SP_COMMAND_INST_PORT, port);
+	fprintf(fp, "%s=%s\n", SP_COMMAND_INST_VERSION, SP_MAIN_VERSION);
+
+	if(fclose(fp) != 0 || rename(tmp_name, inst_name) == -1)
+	{
+		impact(0, "%s: Failed to write the registry record %s: %s\n",
+			SP_COMMAND_HEADER_NAMESPACE,
+			inst_name, strerror(errno));
+		remove(tmp_name);
+		return false;
+	}
+
+	return true;
+}
+
+/*!
+ * \brief Read the registry record of another instance.
+ *
+ * \param[in] inst_name Absolute file name of the record
+ * \param[out] sclp     Instance to fill in from the record
+ *
+ * \retval true the record was read successfully
+ * \retval false the record could not be read or does not describe the instance
+ *         we expected
+ */
+static bool __inst_read(const char* inst_name, simplecmd_list_t sclp)
+{
+	FILE* fp;        // Stream of the record
+	char line[1024]; // Line read from the record
+	pid_t pid = 0;   // PID read from the record
+
+	fp = fopen(inst_name, "r");
+	if(fp == NULL) return false;
+
+	while(fgets(line, sizeof(line), fp))
+	{
+		char* value = strchr(line, '='); // Value of the field on this line
+		if(value == NULL) continue;
+
+		*value++ = '\0';
+		value[strcspn(value, "\n")] = '\0';
+
+		if(strcmp(line, SP_COMMAND_INST_PID) == 0)
+		{
+			if(sscanf(value, "%d", &pid) != 1) pid = 0;
+		}
+		else if(strcmp(line, SP_COMMAND_INST_ADDRESS) == 0 && sclp->address == NULL)
+		{
+			sclp->address = (char*) malloc(sizeof(char) * (strlen(value) + 1));
+			if(sclp->address == NULL) goto error;
+			strcpy(sclp->address, value);
+		}
+		else if(strcmp(line, SP_COMMAND_INST_PORT) == 0)
+		{
+			if(sscanf(value, "%hu", &sclp->port) != 1) sclp->port = 0;
+		}
+		else if(strcmp(line, SP_COMMAND_INST_VERSION) == 0 && sclp->version == NULL)
+		{
+			sclp->version = (char*) malloc(sizeof(char) * (strlen(value) + 1));
+			if(sclp->version == NULL) goto error;
+			strcpy(sclp->version, value);
+		}
+	}
+
+	fclose(fp);
+	return (pid == sclp->inst_pid);
+
+error:
+	impact(2, "%s: %s: Failed to allocate memory for registry record %s\n",
+		SP_COMMAND_HEADER_NAMESPACE, SP_MAIN_HEADER_MEMORY_ALLOC,
+		inst_name);
+	fclose(fp);
+	return false;
+}
+
 /*****************************************************************************
  *                            SimpleCommand List                             *
  *****************************************************************************/
@@ -224,6 +702,9 @@ simplecmd_list_t simplecmd_list_init()
 
 	sclp->sock_name = NULL;
 	sclp->inst_pid = 0;
+	sclp->address = NULL;
+	sclp->port = 0;
+	sclp->version = NULL;
 
 	sclp->next = NULL;
 	sclp->prev = NULL;
@@ -243,6 +724,8 @@ void simplecmd_list_free(simplecmd_list_t sclp)
 		simplecmd_list_t p = sclp;
 		sclp = sclp->next;
 		if(p->sock_name) free(p->sock_name);
+		if(p->address) free(p->address);
+		if(p->version) free(p->version);
 		free(p);
 	}
 }
@@ -250,6 +733,11 @@ void simplecmd_list_free(simplecmd_list_t sclp)
 /*!
  * \brief Get a list of all SimplePost instances on the system with open sockets.
  *
+ * Every instance registers itself in the socket directory with a small record
+ * describing its PID, address, port, and version, so this function never has
+ * to connect to another instance to describe it. Records left behind by
+ * instances that are no longer running are removed along the way.
+ *
  * \note This function has two very important exclusions. (1) First, it will
  * not include the socket created by this SimplePost instance in the resulting
  * list. (2) Second, it will only include sockets that we have read/write
@@ -268,128 +756,122 @@ void simplecmd_list_free(simplecmd_list_t sclp)
  */
 size_t simplecmd_list_inst(simplecmd_list_t* sclp)
 {
-	DIR* dp;                    // Directory handle
-	struct dirent* ep;          // Entity in the directory
-	char suspect[512];          // Absolute path of the current entity
-	int suspect_len;            // Length of the current entity's absolute path
-	struct stat suspect_status; // Status of the current entity
+	DIR* dp;           // Directory handle
+	struct dirent* ep; // Entity in the directory
+	char sock_dir[64]; // Name of the socket directory
 
-	char sock_name[512]; // Name of our socket
-	regex_t regex;       // Compiled SimplePost socket matching regular expression
+	char prefix[64];     // Prefix of every registry record name
+	size_t prefix_len;   // Length of the registry record prefix
+	char inst_name[512]; // Absolute path of the current registry record
+	char sock_name[512]; // Absolute path of the current socket
+	pid_t inst_pid;      // PID of the current instance
+	char trailer;        // First character after the PID in the record name
 
 	simplecmd_list_t tail; // Last element in the list
 	size_t count = 0;      // Number of items in the list
 	tail = *sclp = NULL;   // Failsafe
 
-	dp = opendir(SP_COMMAND_SOCK_DIR);
+	if(__get_sock_dir(sock_dir, sizeof(sock_dir)) == 0) return 0;
+	dp = opendir(sock_dir);
 	if(dp == NULL)
 	{
-		impact(0, "%s: Failed to open the command socket directory %s: %s\n",
-			SP_COMMAND_HEADER_NAMESPACE,
-			SP_COMMAND_SOCK_DIR, strerror(errno));
-		return 0;
-	}
-
-	sprintf(sock_name, "^%s_sock_[0-9]+$", SP_MAIN_SHORT_NAME);
-	if(regcomp(&regex, sock_name, REG_EXTENDED | REG_NOSUB | REG_NEWLINE))
-	{
-		impact(0, "%s: BUG! Failed to compile the socket matching regular expression\n",
-			__PRETTY_FUNCTION__);
-		closedir(dp);
+		/* If the socket directory does not exist, we have never registered
+		 * an instance on this system. That is not an error.
+		 */
+		if(errno != ENOENT)
+		{
+			impact(0, "%s: Failed to open the command socket directory %s: %s\n",
+				SP_COMMAND_HEADER_NAMESPACE,
+				sock_dir, strerror(errno));
+		}
 		return 0;
 	}
 
-	sprintf(sock_name, "%s_sock_%d", SP_MAIN_SHORT_NAME, getpid());
+	sprintf(prefix, "%s_inst_", SP_MAIN_SHORT_NAME);
+	prefix_len = strlen(prefix);
 
 	while((ep = readdir(dp)))
 	{
-		suspect_len = snprintf(suspect, sizeof(suspect), "%s/%s", SP_COMMAND_SOCK_DIR, ep->d_name);
-		if(suspect_len < 1 || (size_t) suspect_len >= sizeof(suspect))
+		if(strncmp(ep->d_name, prefix, prefix_len) != 0) continue;
+
+		// Skip temporary records and anything else that is not "<prefix><pid>".
+		if(sscanf(ep->d_name + prefix_len, "%d%c", &inst_pid, &trailer) != 1) continue;
+		if(inst_pid == getpid()) continue;
+
+		if(__get_inst_name(inst_name, sizeof(inst_name), inst_pid) == 0) continue;
+		if(__get_sock_name(sock_name, sizeof(sock_name), inst_pid) == 0) continue;
+
+		if(__is_inst_alive(inst_pid) == false)
 		{
-			impact(0, "%s: Skipping %s/%s because only %zu of %d bytes are available in the buffer\n",
+			impact(2, "%s: Removing stale registration of %s:%d\n",
 				SP_COMMAND_HEADER_NAMESPACE,
-				SP_COMMAND_SOCK_DIR, ep->d_name,
-				sizeof(suspect), suspect_len);
+				SP_MAIN_DESCRIPTION, inst_pid);
+			remove(sock_name);
+			remove(inst_name);
 			continue;
 		}
 
-		if(stat(suspect, &suspect_status) == 0 && S_ISSOCK(suspect_status.st_mode) && access(suspect, R_OK | W_OK) == 0)
-		{
-			int regex_ret = regexec(&regex, ep->d_name, 0, NULL, 0);
-			if(regex_ret == 0 && strcmp(sock_name, ep->d_name) != 0)
-			{
-				if(tail)
-				{
-					tail->next = simplecmd_list_init();
-					if(tail->next == NULL)
-					{
-						impact(0, "%s: %s: Failed to add a new element to the element list\n",
-							SP_COMMAND_HEADER_NAMESPACE, SP_MAIN_HEADER_MEMORY_ALLOC);
-
-						simplecmd_list_free(*sclp);
-						*sclp = NULL;
-						count = 0;
-
-						break;
-					}
-					tail->next->prev = tail;
-					tail = tail->next;
-				}
-				else
-				{
-					tail = *sclp = simplecmd_list_init();
-					if(tail == NULL)
-					{
-						impact(0, "%s:%d: Failed to initialize the list\n",
-							__FILE__, __LINE__);
-						break;
-					}
-				}
-				count++;
+		if(access(sock_name, R_OK | W_OK) != 0) continue;
 
-				tail->sock_name = (char*) malloc(sizeof(char) * (strlen(suspect) + 1));
-				if(tail->sock_name == NULL)
-				{
-					impact(2, "%s: %s: Failed to allocate memory for socket name\n",
-						SP_COMMAND_HEADER_NAMESPACE, SP_MAIN_HEADER_MEMORY_ALLOC);
+		simplecmd_list_t p = simplecmd_list_init(); // New element in the list
+		if(p == NULL)
+		{
+			impact(0, "%s: %s: Failed to add a new element to the element list\n",
+				SP_COMMAND_HEADER_NAMESPACE, SP_MAIN_HEADER_MEMORY_ALLOC);
 
-					simplecmd_list_free(*sclp);
-					*sclp = NULL;
-					count = 0;
+			simplecmd_list_free(*sclp);
+			*sclp = NULL;
+			count = 0;
 
-					break;
-				}
-				strcpy(tail->sock_name, suspect);
+			break;
+		}
+		p->inst_pid = inst_pid;
 
-				const char* pid_ptr = suspect;
-				while(isdigit(*pid_ptr) == 0) ++pid_ptr;
-				sscanf(pid_ptr, "%d", &tail->inst_pid);
+		p->sock_name = (char*) malloc(sizeof(char) * (strlen(sock_name) + 1));
+		if(p->sock_name == NULL)
+		{
+			impact(2, "%s: %s: Failed to allocate memory for socket name\n",
+				SP_COMMAND_HEADER_NAMESPACE, SP_MAIN_HEADER_MEMORY_ALLOC);
 
-				impact(4, "%s: Found %s:%d socket %s\n",
-					SP_COMMAND_HEADER_NAMESPACE,
-						SP_MAIN_DESCRIPTION, tail->inst_pid,
-						tail->sock_name);
-			}
-			else if(regex_ret != REG_NOMATCH)
-			{
-				char buffer[1024]; // regerror() error message
+			simplecmd_list_free(p);
+			simplecmd_list_free(*sclp);
+			*sclp = NULL;
+			count = 0;
 
-				regerror(regex_ret, &regex, buffer, sizeof(buffer)/sizeof(buffer[0]));
-				impact(0, "%s: %s\n", SP_COMMAND_HEADER_NAMESPACE, buffer);
+			break;
+		}
+		strcpy(p->sock_name, sock_name);
 
-				if(*sclp)
-				{
-					simplecmd_list_free(*sclp);
-					*sclp = NULL;
-					count = 0;
-				}
+		if(__inst_read(inst_name, p) == false)
+		{
+			/* The record is either being rewritten right now or is corrupt.
+			 * Either way, we can't describe this instance.
+			 */
+			impact(2, "%s: Skipping unreadable registry record %s\n",
+				SP_COMMAND_HEADER_NAMESPACE,
+				inst_name);
+			simplecmd_list_free(p);
+			continue;
+		}
 
-				break;
-			}
+		if(tail)
+		{
+			tail->next = p;
+			p->prev = tail;
 		}
-	}
+		else
+		{
+			*sclp = p;
+		}
+		tail = p;
+		count++;
+
+		impact(4, "%s: Found %s:%d socket %s\n",
+			SP_COMMAND_HEADER_NAMESPACE,
+				SP_MAIN_DESCRIPTION, tail->inst_pid,
+				tail->sock_name);
+	}
 
-	regfree(&regex);
 	closedir(dp);
 
 	return count;
@@ -442,21 +924,12 @@ pid_t simplecmd_find_inst(const char* address, unsigned short port, pid_t pid)
 
 		if(address)
 		{
-			char* inst_address; // Address of the server
-
-			if(simplecmd_get_address(p->inst_pid, &inst_address) == 0) continue;
-
-			int address_match = strcmp(address, inst_address);
-			free(inst_address);
-			if(address_match) continue;
+			if(p->address == NULL || strcmp(address, p->address) != 0) continue;
 		}
 
 		if(port)
 		{
-			unsigned short inst_port; // Port the server is listening on
-
-			inst_port = simplecmd_get_port(p->inst_pid);
-			if(port != inst_port) continue;
+			if(port != p->port) continue;
 		}
 
 		lowest_pid = p->inst_pid;
@@ -490,6 +963,11 @@ static bool __command_send_port(simplecmd_t scp, int sock);
 static bool __command_send_version(simplecmd_t scp, int sock);
 static bool __command_send_files(simplecmd_t scp, int sock);
 static bool __command_recv_file(simplecmd_t scp, int sock);
+static bool __command_find_files(simplecmd_t scp, int sock);
+static bool __command_purge_files(simplecmd_t scp, int sock);
+static bool __command_send_events(simplecmd_t scp, int sock);
+static bool __command_send_status(simplecmd_t scp, int sock);
+static bool __command_handoff(simplecmd_t scp, int sock);
 
 /*!
  * \brief SimplePost commands to handle
@@ -500,7 +978,12 @@ static struct simplecmd_handler __command_handlers[] =
 	{"GetPort", &__command_send_port},
 	{"GetVersion", &__command_send_version},
 	{"GetFiles", &__command_send_files},
-	{"SetFile", &__command_recv_file}
+	{"SetFile", &__command_recv_file},
+	{"Subscribe", &__command_send_events},
+	{"GetStatus", &__command_send_status},
+	{"Handoff", &__command_handoff},
+	{"FindFiles", &__command_find_files},
+	{"PurgeFiles", &__command_purge_files}
 };
 
 /***************************************************
@@ -511,18 +994,67 @@ static struct simplecmd_handler __command_handlers[] =
 #define SP_COMMAND_GET_VERSION  2
 #define SP_COMMAND_GET_FILES    3
 #define SP_COMMAND_SET_FILE     4
+#define SP_COMMAND_SUBSCRIBE    5
+#define SP_COMMAND_GET_STATUS   6
+#define SP_COMMAND_HANDOFF      7
+#define SP_COMMAND_FIND_FILES   8
+#define SP_COMMAND_PURGE_FILES  9
 
 #define SP_COMMAND_MIN          0
-#define SP_COMMAND_MAX          4
+#define SP_COMMAND_MAX          9
 
 /**********************************************************
  * Names of the fields transferred from simplepost_file_t *
  **********************************************************/
-#define SP_COMMAND_FILE_INDEX "Index"
-#define SP_COMMAND_FILE_FILE  "File"
-#define SP_COMMAND_FILE_URI   "URI"
-#define SP_COMMAND_FILE_URL   "URL"
-#define SP_COMMAND_FILE_COUNT "Count"
+#define SP_COMMAND_FILE_INDEX   "Index"
+#define SP_COMMAND_FILE_FILE    "File"
+#define SP_COMMAND_FILE_URI     "URI"
+#define SP_COMMAND_FILE_URL     "URL"
+#define SP_COMMAND_FILE_COUNT   "Count"
+#define SP_COMMAND_FILE_EXPIRES "Expires"
+#define SP_COMMAND_FILE_END     "End"
+
+/***********************************************************
+ * Names of the fields transferred from simplepost_event_t *
+ ***********************************************************/
+#define SP_COMMAND_EVENT_TYPE    "Event"
+#define SP_COMMAND_EVENT_FILE    "File"
+#define SP_COMMAND_EVENT_URI     "URI"
+#define SP_COMMAND_EVENT_BYTES   "Bytes"
+#define SP_COMMAND_EVENT_COUNT   "Count"
+#define SP_COMMAND_EVENT_DROPPED "Dropped"
+
+/// Milliseconds to wait for an event before checking on the subscriber
+#define SP_COMMAND_EVENT_WAIT    1000
+
+/************************************************************
+ * Names of the fields transferred from simplepost_status_t *
+ ************************************************************/
+#define SP_COMMAND_STATUS_FILES       "Files"
+#define SP_COMMAND_STATUS_INDEXED     "Indexed"
+#define SP_COMMAND_STATUS_UNLIMITED   "Unlimited"
+#define SP_COMMAND_STATUS_REMAINING   "Remaining"
+#define SP_COMMAND_STATUS_STARTED     "Started"
+#define SP_COMMAND_STATUS_COMPLETED   "Completed"
+#define SP_COMMAND_STATUS_ABORTED     "Aborted"
+#define SP_COMMAND_STATUS_CONNECTIONS "Connections"
+#define SP_COMMAND_STATUS_BYTES_SENT  "BytesSent"
+#define SP_COMMAND_STATUS_MIME_HITS   "CacheHits"
+#define SP_COMMAND_STATUS_MIME_MISSES "CacheMisses"
+#define SP_COMMAND_STATUS_PENDING     "LookupsPending"
+#define SP_COMMAND_STATUS_LOOKUPS     "Lookups"
+#define SP_COMMAND_STATUS_LOOKUP_TIME "LookupTime"
+#define SP_COMMAND_STATUS_LOOKUP_MAX  "LookupTimeMax"
+#define SP_COMMAND_STATUS_UPTIME      "Uptime"
+#define SP_COMMAND_STATUS_END         "End"
+
+/*************************************************
+ * Acknowledgment of a handoff by the new server *
+ *************************************************/
+#define SP_COMMAND_HANDOFF_READY "Ready"
+
+/// Seconds to wait for the new server to start accepting connections
+#define SP_COMMAND_HANDOFF_WAIT  60
 
 /*!
  * \brief SimplePost container for processing client requests
@@ -551,6 +1083,9 @@ struct simplecmd
 	/// Absolute file name of the socket
 	char* sock_name;
 
+	/// Absolute file name of our registry record
+	char* inst_name;
+
 	/// Handle of the primary thread
 	pthread_t accept_thread;
 
@@ -640,91 +1175,150 @@ static bool __command_send_version(simplecmd_t scp, int sock)
 }
 
 /*!
- * \brief Send the list of files that we are serving to the client.
+ * \brief Send a file of a listing to the client.
  *
- * \param[in] scp  Instance to act on
  * \param[in] sock Client socket
+ * \param[in] p    File to send
+ * \param[in] i    Index of the file in the listing
  *
- * \retval true the requested information was sent successfully
- * \retval false failed to respond to the request
+ * \retval true the file was sent successfully
+ * \retval false failed to send the file
  */
-static bool __command_send_files(simplecmd_t scp, int sock)
+static bool __send_file(int sock, simplepost_file_t p, size_t i)
 {
-	char buffer[30];         // File count or index as a string
-	simplepost_file_t files; // List of files being served
-	size_t count;            // Number of files being served
-	size_t i = 0;            // Index of the current file being sent
+	char buffer[30]; // Index, count, or expiry time as a string
 
-	count = simplepost_get_files(scp->spp, &files);
+	impact(3, "%s: %s: Sending %s %zu\n",
+		SP_COMMAND_HEADER_NAMESPACE, __func__,
+		SP_COMMAND_FILE_INDEX, i);
+	if(sprintf(buffer, "%zu", i) <= 0) return false;
+	__sock_send(sock, SP_COMMAND_FILE_INDEX, buffer);
 
-	impact(3, "%s: %s: Sending list of %zu files\n",
-		SP_COMMAND_HEADER_NAMESPACE,
-		__func__, count);
-	if(sprintf(buffer, "%zu", count) <= 0)
+	if(p->file)
 	{
-		simplepost_file_free(files);
-		return false;
+		impact(3, "%s: %s: Sending %s %s\n",
+			SP_COMMAND_HEADER_NAMESPACE, __func__,
+			SP_COMMAND_FILE_FILE, p->file);
+		__sock_send(sock, SP_COMMAND_FILE_FILE, p->file);
 	}
-	__sock_send(sock, NULL, buffer);
 
-	for(simplepost_file_t p = files; p; p = p->next)
+	if(p->count)
 	{
-		impact(3, "%s: %s: Sending %s %zu\n",
-			SP_COMMAND_HEADER_NAMESPACE, __func__,
-			SP_COMMAND_FILE_INDEX, i);
-		if(sprintf(buffer, "%zu", i++) <= 0)
+		if(sprintf(buffer, "%u", p->count) <= 0)
 		{
-			simplepost_file_free(files);
+			impact(0, "%s: %s: Failed to buffer %s %u\n",
+				SP_COMMAND_HEADER_NAMESPACE, __func__,
+				SP_COMMAND_FILE_COUNT, p->count);
 			return false;
 		}
-		__sock_send(sock, SP_COMMAND_FILE_INDEX, buffer);
 
-		if(p->file)
+		impact(3, "%s: %s: Sending %s %s\n",
+			SP_COMMAND_HEADER_NAMESPACE, __func__,
+			SP_COMMAND_FILE_COUNT, buffer);
+		__sock_send(sock, SP_COMMAND_FILE_COUNT, buffer);
+	}
+
+	if(p->expires)
+	{
+		if(sprintf(buffer, "%lld", (long long) p->expires) <= 0)
 		{
-			impact(3, "%s: %s: Sending %s %s\n",
+			impact(0, "%s: %s: Failed to buffer %s %lld\n",
 				SP_COMMAND_HEADER_NAMESPACE, __func__,
-				SP_COMMAND_FILE_FILE, p->file);
-			__sock_send(sock, SP_COMMAND_FILE_FILE, p->file);
+				SP_COMMAND_FILE_EXPIRES, (long long) p->expires);
+			return false;
 		}
 
-		if(p->count)
+		impact(3, "%s: %s: Sending %s %s\n",
+			SP_COMMAND_HEADER_NAMESPACE, __func__,
+			SP_COMMAND_FILE_EXPIRES, buffer);
+		__sock_send(sock, SP_COMMAND_FILE_EXPIRES, buffer);
+	}
+
+	/* Always send the URL last. The reason for this is that only the
+	 * FILE and URL fields and required per-file. All others are
+	 * optional. Therefore to make sure that the optional fields are
+	 * not skipped on the client side, always send a required field
+	 * last.
+	 */
+	if(p->url)
+	{
+		impact(3, "%s: %s: Sending %s %s\n",
+			SP_COMMAND_HEADER_NAMESPACE, __func__,
+			SP_COMMAND_FILE_URL, p->url);
+		__sock_send(sock, SP_COMMAND_FILE_URL, p->url);
+	}
+
+	return true;
+}
+
+/*!
+ * \brief Send the list of files that we are serving to the client.
+ *
+ * \note The list is streamed from a listing cursor one page at a time, so
+ * neither the whole list nor the files lock is held while the client reads
+ * it. The number of files sent first is only the number being served when
+ * the listing began. The authoritative number of files sent follows the last
+ * file as the SP_COMMAND_FILE_END field.
+ *
+ * \param[in] scp  Instance to act on
+ * \param[in] sock Client socket
+ *
+ * \retval true the requested information was sent successfully
+ * \retval false failed to respond to the request
+ */
+static bool __command_send_files(simplecmd_t scp, int sock)
+{
+	char buffer[30];             // File count or index as a string
+	simplepost_cursor_t cursor;  // Cursor to list the files with
+	simplepost_file_t files;     // Current page of files being served
+	ssize_t page_count;          // Number of files in the current page
+	size_t count;                // Number of files being served
+	size_t i = 0;                // Index of the current file being sent
+
+	cursor = simplepost_cursor_init(scp->spp);
+	if(cursor == NULL) return false;
+
+	count = simplepost_get_files(scp->spp, NULL);
+
+	impact(3, "%s: %s: Sending list of %zu files\n",
+		SP_COMMAND_HEADER_NAMESPACE,
+		__func__, count);
+	if(sprintf(buffer, "%zu", count) <= 0) goto error;
+	__sock_send(sock, NULL, buffer);
+
+	while((page_count = simplepost_get_files_page(cursor, &files, 0)) > 0)
+	{
+		for(simplepost_file_t p = files; p; p = p->next)
 		{
-			if(sprintf(buffer, "%u", p->count) <= 0)
+			if(__send_file(sock, p, i++) == false)
 			{
-				impact(0, "%s: %s: Failed to buffer %s %u\n",
-					SP_COMMAND_HEADER_NAMESPACE, __func__,
-					SP_COMMAND_FILE_COUNT, p->count);
 				simplepost_file_free(files);
-				return false;
+				goto error;
 			}
-
-			impact(3, "%s: %s: Sending %s %s\n",
-				SP_COMMAND_HEADER_NAMESPACE, __func__,
-				SP_COMMAND_FILE_COUNT, buffer);
-			__sock_send(sock, SP_COMMAND_FILE_COUNT, buffer);
 		}
 
-		/* Always send the URL last. The reason for this is that only the FILE
-		 * and URL fields and required per-file. All others are optional.
-		 * Therefore to make sure that the optional fields are not skipped on
-		 * the client side, always send a required field last.
-		 */
-		if(p->url)
-		{
-			impact(3, "%s: %s: Sending %s %s\n",
-				SP_COMMAND_HEADER_NAMESPACE, __func__,
-				SP_COMMAND_FILE_URL, p->url);
-			__sock_send(sock, SP_COMMAND_FILE_URL, p->url);
-		}
+		simplepost_file_free(files);
 	}
+	if(page_count < 0) goto error;
 
-	simplepost_file_free(files);
+	impact(3, "%s: %s: Sending %s %zu\n",
+		SP_COMMAND_HEADER_NAMESPACE, __func__,
+		SP_COMMAND_FILE_END, i);
+	if(sprintf(buffer, "%zu", i) <= 0) goto error;
+	__sock_send(sock, SP_COMMAND_FILE_END, buffer);
+
+	simplepost_cursor_free(cursor);
 
 	return true;
+
+error:
+	simplepost_cursor_free(cursor);
+	return false;
 }
 
 /*!
- * \brief Receive a file and count from the client and add it our web server.
+ * \brief Receive a file, count, and expiry time from the client and add it
+ * our web server.
  *
  * \param[in] scp  Instance to act on
  * \param[in] sock Client socket
@@ -734,11 +1328,12 @@ static bool __command_send_files(simplecmd_t scp, int sock)
  */
 static bool __command_recv_file(simplecmd_t scp, int sock)
 {
-	char* url = NULL;    // URL of the file being served
-	char* file = NULL;   // Name and path of the file to serve
-	char* uri = NULL;    // URI of the file to serve
-	char* buffer = NULL; // Count or identifier string from the client
-	unsigned int count;  // Number of times the file should be served
+	char* url = NULL;       // URL of the file being served
+	char* file = NULL;      // Name and path of the file to serve
+	char* uri = NULL;       // URI of the file to serve
+	char* buffer = NULL;    // Count or identifier string from the client
+	unsigned int count = 0; // Number of times the file should be served
+	long long expires = 0;  // Time (seconds since the Epoch) to stop serving the file
 
 	while(__sock_recv(sock, NULL, &buffer))
 	{
@@ -807,6 +1402,29 @@ static bool __command_recv_file(simplecmd_t scp, int sock)
 			free(buffer);
 			buffer = NULL;
 		}
+		else if(strcmp(buffer, SP_COMMAND_FILE_EXPIRES) == 0)
+		{
+			free(buffer);
+			buffer = NULL;
+
+			if(__sock_recv(sock, NULL, &buffer) == 0)
+			{
+				impact(0, "%s: %s: Did not receive the expiry time as expected\n",
+					SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR);
+				goto error;
+			}
+
+			if(sscanf(buffer, "%lld", &expires) != 1 || expires < 0)
+			{
+				impact(0, "%s: %s: %s is not a valid expiry time\n",
+					SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR,
+					buffer);
+				goto error;
+			}
+
+			free(buffer);
+			buffer = NULL;
+		}
 		else
 		{
 			impact(3, "%s: %s: Invalid file identifier \"%s\"\n",
@@ -823,7 +1441,7 @@ static bool __command_recv_file(simplecmd_t scp, int sock)
 		goto error;
 	}
 
-	if(simplepost_serve_file(scp->spp, &url, file, uri, count) == 0) return false;
+	if(simplepost_serve_file(scp->spp, &url, file, uri, count, (time_t) expires, false) == 0) return false;
 
 	free(buffer);
 	free(uri);
@@ -840,698 +1458,1986 @@ error:
 }
 
 /*!
- * \brief Process a request accepted by the server.
+ * \brief Send an event to a subscribed client.
  *
- * \param[in] p SimplePost command + client socket wrapper
+ * \param[in] sock  Client socket
+ * \param[in] event Event to send
  *
- * \return NULL
+ * \retval true the event was sent successfully
+ * \retval false the client is gone
  */
-static void* __process_request(void* p)
+static bool __send_event(int sock, const simplepost_event_t event)
 {
-	struct simplecmd_request* scrp = (struct simplecmd_request*) p; // Properly cast SimplePost command request handle
-
-	simplecmd_t scp = scrp->scp;  // SimplePost command instance to act on
-	int sock = scrp->client_sock; // Socket the client connected on
+	char buffer[30]; // Bytes, count, or dropped event count as a string
 
-	free(scrp);
-	scrp = p = NULL;
-
-	char* command; // Command to process
-	size_t length; // Length of the command string
-	bool response; // Command handler return value
-
-	++(scp->client_count);
+	impact(3, "%s: %s: Sending %s %s %s\n",
+		SP_COMMAND_HEADER_NAMESPACE, __func__,
+		SP_COMMAND_EVENT_TYPE, simplepost_event_name(event->type), event->uri);
 
-	length = __sock_recv(sock, NULL, &command);
-	if(command == NULL || length == 0) goto error;
-	response = -1;
+	if(__sock_push(sock, SP_COMMAND_EVENT_TYPE, simplepost_event_name(event->type)) == false) return false;
 
-	for(unsigned int i = SP_COMMAND_MIN; i <= SP_COMMAND_MAX; ++i)
+	if(event->file)
 	{
-		if(strcmp(command, __command_handlers[i].request) == 0)
-		{
-			impact(2, "%s: Request 0x%lx: Responding to %s command\n",
-				SP_COMMAND_HEADER_NAMESPACE, pthread_self(),
-				__command_handlers[i].request);
-			response = (*__command_handlers[i].handler)(scp, sock);
-			break;
-		}
+		if(__sock_push(sock, SP_COMMAND_EVENT_FILE, event->file) == false) return false;
 	}
 
-	#ifdef DEBUG
-	if(response)
+	if(event->bytes)
 	{
-		impact(2, "%s: Request 0x%lx: Successfully processed %s command\n",
-			SP_COMMAND_HEADER_NAMESPACE, pthread_self(),
-			command);
+		sprintf(buffer, "%zu", event->bytes);
+		if(__sock_push(sock, SP_COMMAND_EVENT_BYTES, buffer) == false) return false;
 	}
-	else
+
+	if(event->count)
 	{
-		impact(2, "%s: Request 0x%lx: Failed to process %s command\n",
-			SP_COMMAND_HEADER_NAMESPACE, pthread_self(),
-			command);
+		sprintf(buffer, "%u", event->count);
+		if(__sock_push(sock, SP_COMMAND_EVENT_COUNT, buffer) == false) return false;
 	}
-	#endif // DEBUG
 
-error:
-	impact(4, "%s: Request 0x%lx: Closing client %d\n",
-		SP_COMMAND_HEADER_NAMESPACE, pthread_self(),
-		sock);
-	close(sock);
-
-	if(command) free(command);
-	--(scp->client_count);
+	if(event->dropped)
+	{
+		sprintf(buffer, "%zu", event->dropped);
+		if(__sock_push(sock, SP_COMMAND_EVENT_DROPPED, buffer) == false) return false;
+	}
 
-	return NULL;
+	/* Always send the URI last. It is the only field other than the event
+	 * type that every event has, so the client can use it to tell that the
+	 * event is complete.
+	 */
+	return __sock_push(sock, SP_COMMAND_EVENT_URI, event->uri ? event->uri : "");
 }
 
 /*!
- * \brief Start accepting requests from clients.
+ * \brief Push events to the client as they happen.
  *
- * \param[in] p Instance to act on
+ * \note Unlike the other commands, this one keeps the connection open until
+ * the client closes it or the command server is shut down. Events are queued
+ * for the client independently of the web server, so a client that does not
+ * keep up will miss events rather than slow down the server. See
+ * simplepost_subscribe().
  *
- * \return NULL
+ * \param[in] scp  Instance to act on
+ * \param[in] sock Client socket
+ *
+ * \retval true the client was served until it (or we) hung up
+ * \retval false failed to respond to the request
  */
-static void* __accept_requests(void* p)
+static bool __command_send_events(simplecmd_t scp, int sock)
 {
-	simplecmd_t scp = (simplecmd_t) p; // Properly cast SimplePost command handle
-
-	int client_sock;                // Socket the client connected on
-	struct sockaddr_in client_name; // Name of the client
-	socklen_t client_name_len;      // Length of the client name structure
-	pthread_t client_thread;        // Handle of the client thread
+	simplepost_subscriber_t subscriber; // Our subscription to the web server
+	simplepost_event_t event;           // Event to send
+	short status;                       // simplepost_get_event() return code
+	bool ret = false;                   // Return code
 
-	struct timespec timeout; // Maximum time to wait for a connection before checking the shutdown sentinel
-	fd_set fds;              // File descriptor set (for pselect() socket monitoring)
+	subscriber = simplepost_subscribe(scp->spp, 0);
+	if(subscriber == NULL) return false;
 
-	scp->client_count = 0;
-	scp->accpeting_clients = true;
+	/* Acknowledge the subscription so that the client knows it will receive
+	 * every event from this point on.
+	 */
+	if(__sock_push(sock, NULL, __command_handlers[SP_COMMAND_SUBSCRIBE].request) == false) goto error;
 
 	while(scp->accpeting_clients)
 	{
-		FD_ZERO(&fds);
-		FD_SET(scp->sock, &fds);
-
-		timeout.tv_sec = 2;
-		timeout.tv_nsec = 0;
+		status = simplepost_get_event(subscriber, &event, SP_COMMAND_EVENT_WAIT);
+		if(status < 0) goto error;
 
-		switch(pselect(scp->sock + 1, &fds, NULL, NULL, &timeout, NULL))
+		if(status == 0)
 		{
-			case -1:
-				impact(0, "%s: Cannot accept connections on socket %d\n",
-					SP_COMMAND_HEADER_NAMESPACE,
-					scp->sock);
-				scp->accpeting_clients = false;
-				continue;
-
-			case 0:
-				continue;
-		}
-
-		client_name_len = sizeof(client_name);
-		client_sock = accept(scp->sock, (struct sockaddr*) &client_name, &client_name_len);
-		if(client_sock == -1) continue;
+			char b;    // Byte the client should not have sent
+			ssize_t n; // recv() return code
 
-		struct simplecmd_request* scrp = (struct simplecmd_request*) malloc(sizeof(struct simplecmd_request));
-		if(scrp == NULL)
-		{
-			impact(0, "%s: %s: Failed to allocate memory for a new command request thread\n",
-				SP_COMMAND_HEADER_NAMESPACE, SP_MAIN_HEADER_MEMORY_ALLOC);
-			scp->accpeting_clients = false;
+			n = recv(sock, &b, 1, MSG_PEEK | MSG_DONTWAIT);
+			if(n == 0) break;
+			if(n == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) break;
 			continue;
 		}
-		scrp->scp = scp;
-		scrp->client_sock = client_sock;
 
-		if(pthread_create(&client_thread, NULL, &__process_request, (void*) scrp) == 0)
-		{
-			impact(2, "%s: Launched request processing thread 0x%lx for client %d\n",
-				SP_COMMAND_HEADER_NAMESPACE,
-				client_thread, client_sock);
-			pthread_detach(client_thread);
-		}
-		else
+		if(__send_event(sock, event) == false)
 		{
-			impact(2, "%s: Failed to launch request processing thread for client %d\n",
-				SP_COMMAND_HEADER_NAMESPACE,
-				client_sock);
-			close(scrp->client_sock);
-			free(scrp);
+			simplepost_event_free(event);
+			break;
 		}
+		simplepost_event_free(event);
 	}
 
-	impact(2, "%s: Waiting for %zu clients to finish processing ...\n",
-		SP_COMMAND_HEADER_NAMESPACE,
-		scp->client_count);
-	while(scp->client_count) usleep(1000);
-
-	impact(4, "%s: Closing socket %d\n",
-		SP_COMMAND_HEADER_NAMESPACE,
-		scp->sock);
-	close(scp->sock);
-	scp->sock = -1;
-	remove(scp->sock_name);
+	ret = true;
 
-	return NULL;
+error:
+	simplepost_unsubscribe(subscriber);
+	return ret;
 }
 
-/*****************************************************************************
- *                       SimpleCommand Server Public                         *
- *****************************************************************************/
-
 /*!
- * \brief Initialize a SimplePost command instance.
+ * \brief Send a single statistic from simplepost_status_t to the client.
  *
- * \return an initialized SimplePost command instance on success, NULL
- * otherwise.
+ * \param[in] sock  Client socket
+ * \param[in] field Name of the statistic
+ * \param[in] value Value of the statistic
  */
-simplecmd_t simplecmd_init()
+static void __send_status_field(int sock, const char* field, uint64_t value)
 {
-	simplecmd_t scp = (simplecmd_t) malloc(sizeof(struct simplecmd));
-	if(scp == NULL) return NULL;
+	char buffer[30]; // Value as a string
 
-	scp->sock = -1;
-	scp->sock_name = NULL;
-	scp->accept_thread = -1;
-
-	scp->accpeting_clients = false;
-	scp->client_count = 0;
-	scp->spp = NULL;
+	sprintf(buffer, "%" PRIu64, value);
 
-	return scp;
+	impact(3, "%s: %s: Sending %s %s\n",
+		SP_COMMAND_HEADER_NAMESPACE, __func__,
+		field, buffer);
+	__sock_send(sock, field, buffer);
 }
 
 /*!
- * \brief Free the given SimplePost command instance.
+ * \brief Send the current status of our web server to the client.
  *
- * \param[in] scp Instance to act on
- */
-void simplecmd_free(simplecmd_t scp)
-{
-	if(scp == NULL) return;
-
-	if(scp->accpeting_clients) simplecmd_deactivate(scp);
-
-	if(scp->sock != -1)
-	{
-		impact(2, "%s:%d: BUG! %s should have (directly or indirectly) closed the socket already!\n",
-			__FILE__, __LINE__, __func__);
-		close(scp->sock);
-	}
+ * \note Each statistic is sent as a field name followed by its value. The
+ * client should skip any field it does not understand; the last field is
+ * always SP_COMMAND_STATUS_END.
+ *
+ * \param[in] scp  Instance to act on
+ * \param[in] sock Client socket
+ *
+ * \retval true the requested information was sent successfully
+ * \retval false failed to respond to the request
+ */
+static bool __command_send_status(simplecmd_t scp, int sock)
+{
+	struct simplepost_status status; // Status of the web server
+
+	simplepost_get_status(scp->spp, &status);
+
+	__send_status_field(sock, SP_COMMAND_STATUS_FILES, status.files);
+	__send_status_field(sock, SP_COMMAND_STATUS_INDEXED, status.files_indexed);
+	__send_status_field(sock, SP_COMMAND_STATUS_UNLIMITED, status.files_unlimited);
+	__send_status_field(sock, SP_COMMAND_STATUS_REMAINING, status.downloads_remaining);
+	__send_status_field(sock, SP_COMMAND_STATUS_STARTED, status.downloads_started);
+	__send_status_field(sock, SP_COMMAND_STATUS_COMPLETED, status.downloads_completed);
+	__send_status_field(sock, SP_COMMAND_STATUS_ABORTED, status.downloads_aborted);
+	__send_status_field(sock, SP_COMMAND_STATUS_CONNECTIONS, status.connections);
+	__send_status_field(sock, SP_COMMAND_STATUS_BYTES_SENT, status.bytes_sent);
+	__send_status_field(sock, SP_COMMAND_STATUS_MIME_HITS, status.mime_hits);
+	__send_status_field(sock, SP_COMMAND_STATUS_MIME_MISSES, status.mime_misses);
+	__send_status_field(sock, SP_COMMAND_STATUS_PENDING, status.lookups_pending);
+	__send_status_field(sock, SP_COMMAND_STATUS_LOOKUPS, status.lookups);
+	__send_status_field(sock, SP_COMMAND_STATUS_LOOKUP_TIME, status.lookup_time);
+	__send_status_field(sock, SP_COMMAND_STATUS_LOOKUP_MAX, status.lookup_time_max);
+	__send_status_field(sock, SP_COMMAND_STATUS_UPTIME, status.uptime);
+
+	__sock_send(sock, SP_COMMAND_STATUS_END, NULL);
 
-	if(scp->sock_name)
-	{
-		remove(scp->sock_name);
-		free(scp->sock_name);
-	}
+	return true;
 }
 
 /*!
- * \brief Start accepting client commands.
+ * \brief Hand our listening socket and files off to the client.
  *
- * \param[in] scp Instance to act on
- * \param[in] spp SimplePost instance to back our client requests
+ * \note The client is a new server taking over from us. Once we stop
+ * accepting connections, we pass it the listening socket, followed by every
+ * file being served with the number of times it may still be downloaded. If
+ * the client reports that it is accepting connections within
+ * SP_COMMAND_HANDOFF_WAIT seconds, we unregister ourselves, then shut down
+ * once our transfers finish (or the client's deadline passes). Otherwise we
+ * start accepting connections again.
  *
- * \retval true the command server was successfully started
- * \retval false the command server is already running or could not be started
+ * \note Only a client run by our user (or by root) may take over, since it
+ * gets our listening socket and everything we serve.
+ *
+ * \param[in] scp  Instance to act on
+ * \param[in] sock Client socket
+ *
+ * \retval true the client took over
+ * \retval false failed to hand off to the client
  */
-bool simplecmd_activate(simplecmd_t scp, simplepost_t spp)
+static bool __command_handoff(simplecmd_t scp, int sock)
 {
-	if(scp->sock != -1)
+	char buffer[30];                   // Count or number of files as a string
+	char* data = NULL;                 // Deadline or acknowledgment from the client
+	unsigned int timeout;              // Seconds the client gives us to finish our transfers
+	int listen_sock;                   // Socket the web server was listening on
+	simplepost_cursor_t cursor = NULL; // Cursor to list the files with
+	simplepost_file_t files;           // Current page of files being served
+	ssize_t page_count;                // Number of files in the current page
+	size_t i = 0;                      // Number of files sent
+	struct timeval wait;               // Maximum time to wait for the client to take over
+
+	if(__sock_peer_trusted(sock) == false) return false;
+
+	if(__sock_recv(sock, NULL, &data) == 0 || sscanf(data, "%u", &timeout) != 1)
 	{
-		impact(0, "%s: Server is already activated\n",
-			SP_COMMAND_HEADER_NAMESPACE);
+		impact(0, "%s: %s: Did not receive the deadline as expected\n",
+			SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR);
+		free(data);
 		return false;
 	}
+	free(data);
+	data = NULL;
 
-	if(spp == NULL)
-	{
-		impact(0, "%s: Cannot activate command server without a %s instance\n",
-			SP_COMMAND_HEADER_NAMESPACE,
-			SP_MAIN_DESCRIPTION);
-		return false;
-	}
-	scp->spp = spp;
+	listen_sock = simplepost_quiesce(scp->spp);
+	if(listen_sock < 0) return false;
 
-	if(scp->sock_name == NULL)
-	{
-		char buffer[2048]; // Buffer for the the socket name string
+	cursor = simplepost_cursor_init(scp->spp);
+	if(cursor == NULL) goto error;
 
-		sprintf(buffer, "%s/%s_sock_%d", SP_COMMAND_SOCK_DIR, SP_MAIN_SHORT_NAME, getpid());
+	if(__sock_push(sock, NULL, __command_handlers[SP_COMMAND_HANDOFF].request) == false) goto error;
+	if(__sock_send_fd(sock, listen_sock) == false) goto error;
 
-		scp->sock_name = (char*) malloc(sizeof(char) * (strlen(buffer) + 1));
-		if(scp->sock_name == NULL)
+	while((page_count = simplepost_get_files_page(cursor, &files, 0)) > 0)
+	{
+		for(simplepost_file_t p = files; p; p = p->next)
 		{
-			impact(0, "%s: %s: Failed to allocate memory for the socket name\n",
-				SP_COMMAND_HEADER_NAMESPACE, SP_MAIN_HEADER_MEMORY_ALLOC);
-			return false;
+			impact(3, "%s: %s: Sending %s %s\n",
+				SP_COMMAND_HEADER_NAMESPACE, __func__,
+				SP_COMMAND_FILE_URI, p->uri);
+
+			if(__sock_push(sock, SP_COMMAND_FILE_FILE, p->file) == false)
+			{
+				simplepost_file_free(files);
+				goto error;
+			}
+
+			if(p->count)
+			{
+				sprintf(buffer, "%u", p->count);
+				if(__sock_push(sock, SP_COMMAND_FILE_COUNT, buffer) == false)
+				{
+					simplepost_file_free(files);
+					goto error;
+				}
+			}
+
+			if(p->expires)
+			{
+				sprintf(buffer, "%lld", (long long) p->expires);
+				if(__sock_push(sock, SP_COMMAND_FILE_EXPIRES, buffer) == false)
+				{
+					simplepost_file_free(files);
+					goto error;
+				}
+			}
+
+			// The URI always comes last, completing the file.
+			if(__sock_push(sock, SP_COMMAND_FILE_URI, p->uri) == false)
+			{
+				simplepost_file_free(files);
+				goto error;
+			}
+
+			++i;
 		}
-		strcpy(scp->sock_name, buffer);
-	}
 
-	scp->sock = socket(AF_UNIX, SOCK_STREAM, 0);
-	if(scp->sock == -1)
-	{
-		impact(0, "%s: Socket could not be created\n",
-			SP_COMMAND_HEADER_NAMESPACE);
-		return false;
+		simplepost_file_free(files);
 	}
+	if(page_count < 0) goto error;
 
-	struct sockaddr_un sock_addr; // Address to assign to the socket
-	memset(&sock_addr, 0, sizeof(struct sockaddr_un));
-	sock_addr.sun_family = AF_UNIX;
-	strncpy(sock_addr.sun_path, scp->sock_name, sizeof(sock_addr.sun_path) - 1);
+	simplepost_cursor_free(cursor);
+	cursor = NULL;
 
-	if(bind(scp->sock, (struct sockaddr*) &sock_addr, sizeof(struct sockaddr_un)) == -1)
-	{
-		impact(0, "%s: Failed to bind %s to socket %d\n",
-			SP_COMMAND_HEADER_NAMESPACE,
-			scp->sock_name, scp->sock);
-		goto error;
-	}
+	sprintf(buffer, "%zu", i);
+	if(__sock_push(sock, SP_COMMAND_FILE_END, buffer) == false) goto error;
 
-	if(listen(scp->sock, 30) == -1)
-	{
-		impact(0, "%s: Cannot listen on socket %d\n",
-			SP_COMMAND_HEADER_NAMESPACE,
-			scp->sock);
-		goto error;
-	}
+	wait.tv_sec = SP_COMMAND_HANDOFF_WAIT;
+	wait.tv_usec = 0;
+	setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &wait, sizeof(wait));
 
-	if(pthread_create(&scp->accept_thread, NULL, &__accept_requests, (void*) scp) != 0)
+	if(__sock_recv(sock, NULL, &data) == 0 || strcmp(data, SP_COMMAND_HANDOFF_READY) != 0)
 	{
-		impact(0, "%s: Failed to create listen thread for %s\n",
-			SP_COMMAND_HEADER_NAMESPACE,
-			scp->sock_name);
+		impact(0, "%s: The new server did not take over\n",
+			SP_COMMAND_HEADER_NAMESPACE);
 		goto error;
 	}
+	free(data);
 
-	impact(1, "%s: Now accepting commands on %s\n",
+	impact(1, "%s: Handed off %zu files to the new server\n",
 		SP_COMMAND_HEADER_NAMESPACE,
-		scp->sock_name);
+		i);
+
+	// Clients looking for the server should find the new one instead of us.
+	if(scp->inst_name) remove(scp->inst_name);
+
+	simplepost_drain(scp->spp, timeout);
 
 	return true;
 
 error:
-	close(scp->sock);
-	scp->sock = -1;
-
-	remove(scp->sock_name);
-	free(scp->sock_name);
-	scp->sock_name = NULL;
+	free(data);
+	simplepost_cursor_free(cursor);
+	simplepost_resume(scp->spp);
 
 	return false;
 }
 
 /*!
- * \brief Stop accepting client commands.
+ * \brief Receive a pattern from the client and send it the list of files
+ * served on URIs matching it.
  *
- * \param[in] scp Instance to act on
+ * \note The list is sent in the same format as the one sent for GetFiles.
  *
- * \retval true the command server has been successfully killed
- * \retval false the command server is not running or could not be shut down
+ * \param[in] scp  Instance to act on
+ * \param[in] sock Client socket
+ *
+ * \retval true the requested information was sent successfully
+ * \retval false failed to respond to the request
  */
-bool simplecmd_deactivate(simplecmd_t scp)
+static bool __command_find_files(simplecmd_t scp, int sock)
 {
-	if(scp->sock == -1)
+	char buffer[30];         // File count or index as a string
+	char* pattern = NULL;    // Pattern the URIs of the files must match
+	simplepost_file_t files; // Files served on matching URIs
+	ssize_t count;           // Number of matching files
+	size_t i = 0;            // Index of the current file being sent
+
+	if(__sock_recv(sock, NULL, &pattern) == 0)
 	{
-		impact(0, "%s: Server is not active\n", SP_COMMAND_HEADER_NAMESPACE);
+		impact(0, "%s: %s: Did not receive a pattern as expected\n",
+			SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR);
+		free(pattern);
 		return false;
 	}
 
-	impact(1, "%s: Shutting down ...\n", SP_COMMAND_HEADER_NAMESPACE);
+	count = simplepost_find_files(scp->spp, pattern, &files);
+	free(pattern);
+	if(count < 0) return false;
 
-	scp->accpeting_clients = false;
-	pthread_join(scp->accept_thread, NULL);
+	impact(3, "%s: %s: Sending list of %zd files\n",
+		SP_COMMAND_HEADER_NAMESPACE,
+		__func__, count);
+	if(sprintf(buffer, "%zd", count) <= 0) goto error;
+	__sock_send(sock, NULL, buffer);
 
-	#ifdef DEBUG
-	impact(2, "%s: 0x%tu cleanup complete\n",
-		SP_COMMAND_HEADER_NAMESPACE, scp->accept_thread);
-	#endif // DEBUG
+	for(simplepost_file_t p = files; p; p = p->next)
+	{
+		if(__send_file(sock, p, i++) == false) goto error;
+	}
+
+	impact(3, "%s: %s: Sending %s %zu\n",
+		SP_COMMAND_HEADER_NAMESPACE, __func__,
+		SP_COMMAND_FILE_END, i);
+	if(sprintf(buffer, "%zu", i) <= 0) goto error;
+	__sock_send(sock, SP_COMMAND_FILE_END, buffer);
+
+	simplepost_file_free(files);
 
 	return true;
-}
 
-/*!
- * \brief Are we listening for client connections?
- *
- * \param[in] scp Instance to act on
- *
- * \retval true the server is online
- * \retval false the server is not running
- */
-bool simplecmd_is_alive(const simplecmd_t scp)
-{
-	return (scp->sock == -1) ? false : true;
+error:
+	simplepost_file_free(files);
+	return false;
 }
 
-/*****************************************************************************
- *                       SimpleCommand Client Private                        *
- *****************************************************************************/
-
 /*!
- * \brief Open a socket to the server with the specified process identifier.
+ * \brief Receive a pattern from the client, stop serving every file on a URI
+ * matching it, and send the client the number of files purged.
  *
- * \note This functions prints error messages so its consumers don't have to.
+ * \note If the files could not be purged, "-1" is sent instead.
  *
- * \param[in] server_pid Process identifier of the server
+ * \param[in] scp  Instance to act on
+ * \param[in] sock Client socket
  *
- * \return an open socket descriptor if the specified PID belongs to a
- * compatible SimplePost server with an open local socket, -1 if POSIX open()
- * encounters an error, or -2 if this function encounters an error
+ * \retval true the files were purged and the client was told how many
+ * \retval false failed to respond to the request
  */
-static int __open_sock_by_pid(pid_t server_pid)
+static bool __command_purge_files(simplecmd_t scp, int sock)
 {
-	int sock;                     // Socket descriptor
-	struct sockaddr_un sock_addr; // Address to assign to the socket
-	char sock_name[512];          // Name of the socket
-	struct stat sock_status;      // Status of the socket
-
-	sprintf(sock_name, "%s/%s_sock_%d", SP_COMMAND_SOCK_DIR, SP_MAIN_SHORT_NAME, server_pid);
-	if(stat(sock_name, &sock_status) == -1)
-	{
-		impact(0, "%s: Socket %s does not exist\n",
-			SP_COMMAND_HEADER_NAMESPACE,
-			sock_name);
-		return -2;
-	}
-	if(S_ISSOCK(sock_status.st_mode) == 0)
-	{
-		impact(0, "%s: %s is not a socket\n",
-			SP_COMMAND_HEADER_NAMESPACE,
-			sock_name);
-		return -2;
-	}
+	char buffer[30];      // Number of files purged as a string
+	char* pattern = NULL; // Pattern the URIs of the files must match
+	ssize_t count;        // Number of files purged
 
-	sock = socket(AF_UNIX, SOCK_STREAM, 0);
-	if(sock == -1)
+	if(__sock_recv(sock, NULL, &pattern) == 0)
 	{
-		impact(0, "%s: Failed to open socket %s\n",
-			SP_COMMAND_HEADER_NAMESPACE,
-			sock_name);
-		return -1;
+		impact(0, "%s: %s: Did not receive a pattern as expected\n",
+			SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR);
+		free(pattern);
+		return false;
 	}
 
-	memset(&sock_addr, 0, sizeof(struct sockaddr_un));
-	sock_addr.sun_family = AF_UNIX;
-	strncpy(sock_addr.sun_path, sock_name, sizeof(sock_addr.sun_path) - 1);
+	count = simplepost_purge_files(scp->spp, pattern);
+	free(pattern);
 
-	if(connect(sock, (struct sockaddr*) &sock_addr, sizeof(sock_addr)) == -1)
-	{
-		impact(0, "%s: Failed to connect to socket %s\n",
-			SP_COMMAND_HEADER_NAMESPACE,
-			sock_name);
-		close(sock);
-		return -1;
-	}
+	if(sprintf(buffer, "%zd", count) <= 0) return false;
+	__sock_send(sock, NULL, buffer);
 
-	return sock;
+	return (count >= 0);
 }
 
-/*****************************************************************************
- *                       SimpleCommand Client Public                         *
- *****************************************************************************/
-
 /*!
- * \brief Get the address the specified server is bound to.
- *
- * \param[in]  server_pid Process identifier of the server to query
- * \param[out] address
- * \parblock
- * Address of the server
+ * \brief Process a request accepted by the server.
  *
- * The storage for this string will be dynamically allocated. You are
- * responsible for freeing it (unless it is NULL, in which case an error
- * occurred).
- * \endparblock
+ * \param[in] p SimplePost command + client socket wrapper
  *
- * \return the number of characters written to the address (excluding the NULL-
- * terminating character)
+ * \return NULL
  */
-size_t simplecmd_get_address(pid_t server_pid, char** address)
+static void* __process_request(void* p)
 {
-	int sock;          // Socket descriptor
-	size_t length = 0; // Length of the address
-	*address = NULL;   // Failsafe
+	struct simplecmd_request* scrp = (struct simplecmd_request*) p; // Properly cast SimplePost command request handle
 
-	sock = __open_sock_by_pid(server_pid);
-	if(sock < 0) return 0;
+	simplecmd_t scp = scrp->scp;  // SimplePost command instance to act on
+	int sock = scrp->client_sock; // Socket the client connected on
 
-	length = __sock_recv(sock, __command_handlers[SP_COMMAND_GET_ADDRESS].request, address);
+	free(scrp);
+	scrp = p = NULL;
 
-	close(sock);
+	char* command; // Command to process
+	size_t length; // Length of the command string
+	bool response; // Command handler return value
 
-	return length;
-}
+	++(scp->client_count);
 
-/*!
- * \brief Get the port the specified server is listening on.
- *
- * \param[in] server_pid Process identifier of the server to query
+	length = __sock_recv(sock, NULL, &command);
+	if(command == NULL || length == 0) goto error;
+	response = -1;
+
+	for(unsigned int i = SP_COMMAND_MIN; i <= SP_COMMAND_MAX; ++i)
+	{
+		if(strcmp(command, __command_handlers[i].request) == 0)
+		{
+			impact(2, "%s: Request 0x%lx: Responding to %s command\n",
+				SP_COMMAND_HEADER_NAMESPACE, pthread_self(),
+				__command_handlers[i].request);
+			response = (*__command_handlers[i].handler)(scp, sock);
+			break;
+		}
+	}
+
+	#ifdef DEBUG
+	if(response)
+	{
+		impact(2, "%s: Request 0x%lx: Successfully processed %s command\n",
+			SP_COMMAND_HEADER_NAMESPACE, pthread_self(),
+			command);
+	}
+	else
+	{
+		impact(2, "%s: Request 0x%lx: Failed to process %s command\n",
+			SP_COMMAND_HEADER_NAMESPACE, pthread_self(),
+			command);
+	}
+	#endif // DEBUG
+
+error:
+	impact(4, "%s: Request 0x%lx: Closing client %d\n",
+		SP_COMMAND_HEADER_NAMESPACE, pthread_self(),
+		sock);
+	close(sock);
+
+	if(command) free(command);
+	--(scp->client_count);
+
+	return NULL;
+}
+
+/*!
+ * \brief Start accepting requests from clients.
+ *
+ * \param[in] p Instance to act on
+ *
+ * \return NULL
+ */
+static void* __accept_requests(void* p)
+{
+	simplecmd_t scp = (simplecmd_t) p; // Properly cast SimplePost command handle
+
+	int client_sock;                // Socket the client connected on
+	struct sockaddr_in client_name; // Name of the client
+	socklen_t client_name_len;      // Length of the client name structure
+	pthread_t client_thread;        // Handle of the client thread
+
+	struct timespec timeout; // Maximum time to wait for a connection before checking the shutdown sentinel
+	fd_set fds;              // File descriptor set (for pselect() socket monitoring)
+
+	scp->client_count = 0;
+	scp->accpeting_clients = true;
+
+	while(scp->accpeting_clients)
+	{
+		FD_ZERO(&fds);
+		FD_SET(scp->sock, &fds);
+
+		timeout.tv_sec = 2;
+		timeout.tv_nsec = 0;
+
+		switch(pselect(scp->sock + 1, &fds, NULL, NULL, &timeout, NULL))
+		{
+			case -1:
+				impact(0, "%s: Cannot accept connections on socket %d\n",
+					SP_COMMAND_HEADER_NAMESPACE,
+					scp->sock);
+				scp->accpeting_clients = false;
+				continue;
+
+			case 0:
+				continue;
+		}
+
+		client_name_len = sizeof(client_name);
+		client_sock = accept(scp->sock, (struct sockaddr*) &client_name, &client_name_len);
+		if(client_sock == -1) continue;
+
+		struct simplecmd_request* scrp = (struct simplecmd_request*) malloc(sizeof(struct simplecmd_request));
+		if(scrp == NULL)
+		{
+			impact(0, "%s: %s: Failed to allocate memory for a new command request thread\n",
+				SP_COMMAND_HEADER_NAMESPACE, SP_MAIN_HEADER_MEMORY_ALLOC);
+			scp->accpeting_clients = false;
+			continue;
+		}
+		scrp->scp = scp;
+		scrp->client_sock = client_sock;
+
+		if(pthread_create(&client_thread, NULL, &__process_request, (void*) scrp) == 0)
+		{
+			impact(2, "%s: Launched request processing thread 0x%lx for client %d\n",
+				SP_COMMAND_HEADER_NAMESPACE,
+				client_thread, client_sock);
+			pthread_detach(client_thread);
+		}
+		else
+		{
+			impact(2, "%s: Failed to launch request processing thread for client %d\n",
+				SP_COMMAND_HEADER_NAMESPACE,
+				client_sock);
+			close(scrp->client_sock);
+			free(scrp);
+		}
+	}
+
+	impact(2, "%s: Waiting for %zu clients to finish processing ...\n",
+		SP_COMMAND_HEADER_NAMESPACE,
+		scp->client_count);
+	while(scp->client_count) usleep(1000);
+
+	impact(4, "%s: Closing socket %d\n",
+		SP_COMMAND_HEADER_NAMESPACE,
+		scp->sock);
+	close(scp->sock);
+	scp->sock = -1;
+	remove(scp->sock_name);
+	if(scp->inst_name) remove(scp->inst_name);
+
+	return NULL;
+}
+
+/*****************************************************************************
+ *                       SimpleCommand Server Public                         *
+ *****************************************************************************/
+
+/*!
+ * \brief Initialize a SimplePost command instance.
+ *
+ * \return an initialized SimplePost command instance on success, NULL
+ * otherwise.
+ */
+simplecmd_t simplecmd_init()
+{
+	simplecmd_t scp = (simplecmd_t) malloc(sizeof(struct simplecmd));
+	if(scp == NULL) return NULL;
+
+	scp->sock = -1;
+	scp->sock_name = NULL;
+	scp->inst_name = NULL;
+	scp->accept_thread = -1;
+
+	scp->accpeting_clients = false;
+	scp->client_count = 0;
+	scp->spp = NULL;
+
+	return scp;
+}
+
+/*!
+ * \brief Free the given SimplePost command instance.
+ *
+ * \param[in] scp Instance to act on
+ */
+void simplecmd_free(simplecmd_t scp)
+{
+	if(scp == NULL) return;
+
+	if(scp->accpeting_clients) simplecmd_deactivate(scp);
+
+	if(scp->sock != -1)
+	{
+		impact(2, "%s:%d: BUG! %s should have (directly or indirectly) closed the socket already!\n",
+			__FILE__, __LINE__, __func__);
+		close(scp->sock);
+	}
+
+	if(scp->sock_name)
+	{
+		remove(scp->sock_name);
+		free(scp->sock_name);
+	}
+
+	if(scp->inst_name)
+	{
+		remove(scp->inst_name);
+		free(scp->inst_name);
+	}
+}
+
+/*!
+ * \brief Start accepting client commands.
+ *
+ * \note If the service manager passed us a listening local socket (see
+ * simplepost_get_activated_socket()), commands are accepted on it instead of
+ * a new one. It is linked to from the usual place, so other instances can
+ * still find it by our PID.
+ *
+ * \param[in] scp Instance to act on
+ * \param[in] spp SimplePost instance to back our client requests
+ *
+ * \retval true the command server was successfully started
+ * \retval false the command server is already running or could not be started
+ */
+bool simplecmd_activate(simplecmd_t scp, simplepost_t spp)
+{
+	if(scp->sock != -1)
+	{
+		impact(0, "%s: Server is already activated\n",
+			SP_COMMAND_HEADER_NAMESPACE);
+		return false;
+	}
+
+	if(spp == NULL)
+	{
+		impact(0, "%s: Cannot activate command server without a %s instance\n",
+			SP_COMMAND_HEADER_NAMESPACE,
+			SP_MAIN_DESCRIPTION);
+		return false;
+	}
+	scp->spp = spp;
+
+	if(__make_sock_dir() == false) return false;
+
+	if(scp->sock_name == NULL)
+	{
+		char buffer[2048]; // Buffer for the the socket name string
+
+		if(__get_sock_name(buffer, sizeof(buffer), getpid()) == 0) return false;
+
+		scp->sock_name = (char*) malloc(sizeof(char) * (strlen(buffer) + 1));
+		if(scp->sock_name == NULL)
+		{
+			impact(0, "%s: %s: Failed to allocate memory for the socket name\n",
+				SP_COMMAND_HEADER_NAMESPACE, SP_MAIN_HEADER_MEMORY_ALLOC);
+			return false;
+		}
+		strcpy(scp->sock_name, buffer);
+	}
+
+	if(scp->inst_name == NULL)
+	{
+		char buffer[2048]; // Buffer for the the registry record name string
+
+		if(__get_inst_name(buffer, sizeof(buffer), getpid()) == 0) return false;
+
+		scp->inst_name = (char*) malloc(sizeof(char) * (strlen(buffer) + 1));
+		if(scp->inst_name == NULL)
+		{
+			impact(0, "%s: %s: Failed to allocate memory for the registry record name\n",
+				SP_COMMAND_HEADER_NAMESPACE, SP_MAIN_HEADER_MEMORY_ALLOC);
+			return false;
+		}
+		strcpy(scp->inst_name, buffer);
+	}
+
+	/* A socket left behind by a previous process that happened to have our
+	 * PID would make bind() fail below.
+	 */
+	remove(scp->sock_name);
+
+	struct sockaddr_un sock_addr; // Address to assign to the socket
+	memset(&sock_addr, 0, sizeof(struct sockaddr_un));
+
+	scp->sock = simplepost_get_activated_socket(AF_UNIX);
+	if(scp->sock != -1)
+	{
+		socklen_t sock_addr_len = sizeof(struct sockaddr_un); // Length of the socket's address
+
+		/* Other instances find our socket by our PID, so link it to the one
+		 * the service manager opened for us.
+		 */
+		if(getsockname(scp->sock, (struct sockaddr*) &sock_addr, &sock_addr_len) == -1 ||
+			sock_addr.sun_path[0] == '\0' ||
+			symlink(sock_addr.sun_path, scp->sock_name) == -1)
+		{
+			impact(0, "%s: Failed to link %s to socket %d passed by the service manager\n",
+				SP_COMMAND_HEADER_NAMESPACE,
+				scp->sock_name, scp->sock);
+			goto error;
+		}
+	}
+	else
+	{
+		scp->sock = socket(AF_UNIX, SOCK_STREAM, 0);
+		if(scp->sock == -1)
+		{
+			impact(0, "%s: Socket could not be created\n",
+				SP_COMMAND_HEADER_NAMESPACE);
+			return false;
+		}
+
+		sock_addr.sun_family = AF_UNIX;
+		strncpy(sock_addr.sun_path, scp->sock_name, sizeof(sock_addr.sun_path) - 1);
+
+		if(bind(scp->sock, (struct sockaddr*) &sock_addr, sizeof(struct sockaddr_un)) == -1)
+		{
+			impact(0, "%s: Failed to bind %s to socket %d\n",
+				SP_COMMAND_HEADER_NAMESPACE,
+				scp->sock_name, scp->sock);
+			goto error;
+		}
+
+		/* bind() creates the socket subject to our umask. Nobody can connect
+		 * before we listen(), so restricting it here leaves no window.
+		 */
+		if(chmod(scp->sock_name, SP_COMMAND_SOCK_MODE) == -1)
+		{
+			impact(0, "%s: Failed to set the permissions of %s: %s\n",
+				SP_COMMAND_HEADER_NAMESPACE,
+				scp->sock_name, strerror(errno));
+			goto error;
+		}
+
+		if(listen(scp->sock, 30) == -1)
+		{
+			impact(0, "%s: Cannot listen on socket %d\n",
+				SP_COMMAND_HEADER_NAMESPACE,
+				scp->sock);
+			goto error;
+		}
+	}
+
+	char* address = NULL; // Address our web server is bound to
+	simplepost_get_address(spp, &address);
+	if(__inst_register(scp->inst_name, getpid(), address, simplepost_get_port(spp)) == false)
+	{
+		free(address);
+		goto error;
+	}
+	free(address);
+
+	if(pthread_create(&scp->accept_thread, NULL, &__accept_requests, (void*) scp) != 0)
+	{
+		impact(0, "%s: Failed to create listen thread for %s\n",
+			SP_COMMAND_HEADER_NAMESPACE,
+			scp->sock_name);
+		goto error;
+	}
+
+	impact(1, "%s: Now accepting commands on %s\n",
+		SP_COMMAND_HEADER_NAMESPACE,
+		scp->sock_name);
+
+	return true;
+
+error:
+	close(scp->sock);
+	scp->sock = -1;
+
+	remove(scp->sock_name);
+	free(scp->sock_name);
+	scp->sock_name = NULL;
+
+	remove(scp->inst_name);
+	free(scp->inst_name);
+	scp->inst_name = NULL;
+
+	return false;
+}
+
+/*!
+ * \brief Stop accepting client commands.
+ *
+ * \param[in] scp Instance to act on
+ *
+ * \retval true the command server has been successfully killed
+ * \retval false the command server is not running or could not be shut down
+ */
+bool simplecmd_deactivate(simplecmd_t scp)
+{
+	if(scp->sock == -1)
+	{
+		impact(0, "%s: Server is not active\n", SP_COMMAND_HEADER_NAMESPACE);
+		return false;
+	}
+
+	impact(1, "%s: Shutting down ...\n", SP_COMMAND_HEADER_NAMESPACE);
+
+	scp->accpeting_clients = false;
+	pthread_join(scp->accept_thread, NULL);
+
+	#ifdef DEBUG
+	impact(2, "%s: 0x%tu cleanup complete\n",
+		SP_COMMAND_HEADER_NAMESPACE, scp->accept_thread);
+	#endif // DEBUG
+
+	return true;
+}
+
+/*!
+ * \brief Are we listening for client connections?
+ *
+ * \param[in] scp Instance to act on
+ *
+ * \retval true the server is online
+ * \retval false the server is not running
+ */
+bool simplecmd_is_alive(const simplecmd_t scp)
+{
+	return (scp->sock == -1) ? false : true;
+}
+
+/*****************************************************************************
+ *                       SimpleCommand Client Private                        *
+ *****************************************************************************/
+
+/*!
+ * \brief Open a socket to the server with the specified process identifier.
+ *
+ * \note This functions prints error messages so its consumers don't have to.
+ *
+ * \param[in] server_pid Process identifier of the server
+ *
+ * \return an open socket descriptor if the specified PID belongs to a
+ * compatible SimplePost server with an open local socket, -1 if POSIX open()
+ * encounters an error, or -2 if this function encounters an error
+ */
+static int __open_sock_by_pid(pid_t server_pid)
+{
+	int sock;                     // Socket descriptor
+	struct sockaddr_un sock_addr; // Address to assign to the socket
+	char sock_name[512];          // Name of the socket
+	struct stat sock_status;      // Status of the socket
+
+	if(__get_sock_name(sock_name, sizeof(sock_name), server_pid) == 0) return -2;
+	if(stat(sock_name, &sock_status) == -1)
+	{
+		impact(0, "%s: Socket %s does not exist\n",
+			SP_COMMAND_HEADER_NAMESPACE,
+			sock_name);
+		return -2;
+	}
+	if(S_ISSOCK(sock_status.st_mode) == 0)
+	{
+		impact(0, "%s: %s is not a socket\n",
+			SP_COMMAND_HEADER_NAMESPACE,
+			sock_name);
+		return -2;
+	}
+
+	sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(sock == -1)
+	{
+		impact(0, "%s: Failed to open socket %s\n",
+			SP_COMMAND_HEADER_NAMESPACE,
+			sock_name);
+		return -1;
+	}
+
+	memset(&sock_addr, 0, sizeof(struct sockaddr_un));
+	sock_addr.sun_family = AF_UNIX;
+	strncpy(sock_addr.sun_path, sock_name, sizeof(sock_addr.sun_path) - 1);
+
+	if(connect(sock, (struct sockaddr*) &sock_addr, sizeof(sock_addr)) == -1)
+	{
+		impact(0, "%s: Failed to connect to socket %s\n",
+			SP_COMMAND_HEADER_NAMESPACE,
+			sock_name);
+		close(sock);
+		return -1;
+	}
+
+	return sock;
+}
+
+/*!
+ * \brief Hand a completely received file to the consumer of a file listing.
+ *
+ * \note Regardless of the outcome, the strings in the file will be freed and
+ * the file will be blanked so that it can receive the next one.
+ *
+ * \param[in] spfp     File received from the server
+ * \param[in] i        Index of the file in the listing
+ * \param[in] callback Function to hand the file to
+ * \param[in] arg      Argument to pass to the callback function
+ *
+ * \retval true the file was complete and the callback accepted it
+ * \retval false the file was incomplete or the callback failed
+ */
+static bool __deliver_file(
+	simplepost_file_t spfp,
+	size_t i,
+	bool (*callback) (simplepost_file_t, void*),
+	void* arg)
+{
+	bool ret = false; // Return code
+
+	if(spfp->file == NULL || spfp->url == NULL)
+	{
+		impact(0, "%s: %s: Did not receive the file[%zu] location and URL as expected\n",
+			SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR,
+			i);
+	}
+	else
+	{
+		ret = callback(spfp, arg);
+	}
+
+	free(spfp->file);
+	free(spfp->url);
+	memset(spfp, 0, sizeof(struct simplepost_file));
+
+	return ret;
+}
+
+/*!
+ * \brief List being assembled by simplecmd_get_files()
+ */
+struct simplecmd_file_list
+{
+	/// First file in the list
+	simplepost_file_t head;
+
+	/// Last file in the list
+	simplepost_file_t tail;
+};
+
+/*!
+ * \brief Append a copy of the given file to a simplecmd_file_list.
+ *
+ * \param[in] spfp File to copy
+ * \param[in] arg  List to append the file to
+ *
+ * \retval true the file was appended to the list
+ * \retval false we failed to allocate the requested memory
+ */
+static bool __append_file(simplepost_file_t spfp, void* arg)
+{
+	struct simplecmd_file_list* list = (struct simplecmd_file_list*) arg;
+	simplepost_file_t p;
+
+	p = simplepost_file_init();
+	if(p == NULL) return false;
+
+	p->file = (char*) malloc(sizeof(char) * (strlen(spfp->file) + 1));
+	p->url = (char*) malloc(sizeof(char) * (strlen(spfp->url) + 1));
+	if(p->file == NULL || p->url == NULL)
+	{
+		simplepost_file_free(p);
+		return false;
+	}
+	strcpy(p->file, spfp->file);
+	strcpy(p->url, spfp->url);
+	p->count = spfp->count;
+	p->expires = spfp->expires;
+
+	if(list->tail)
+	{
+		p->prev = list->tail;
+		list->tail->next = p;
+	}
+	else
+	{
+		list->head = p;
+	}
+	list->tail = p;
+
+	return true;
+}
+
+/*****************************************************************************
+ *                       SimpleCommand Client Public                         *
+ *****************************************************************************/
+
+/*!
+ * \brief Get the address the specified server is bound to.
+ *
+ * \param[in]  server_pid Process identifier of the server to query
+ * \param[out] address
+ * \parblock
+ * Address of the server
+ *
+ * The storage for this string will be dynamically allocated. You are
+ * responsible for freeing it (unless it is NULL, in which case an error
+ * occurred).
+ * \endparblock
+ *
+ * \return the number of characters written to the address (excluding the NULL-
+ * terminating character)
+ */
+size_t simplecmd_get_address(pid_t server_pid, char** address)
+{
+	int sock;          // Socket descriptor
+	size_t length = 0; // Length of the address
+	*address = NULL;   // Failsafe
+
+	sock = __open_sock_by_pid(server_pid);
+	if(sock < 0) return 0;
+
+	length = __sock_recv(sock, __command_handlers[SP_COMMAND_GET_ADDRESS].request, address);
+
+	close(sock);
+
+	return length;
+}
+
+/*!
+ * \brief Get the port the specified server is listening on.
+ *
+ * \param[in] server_pid Process identifier of the server to query
+ *
+ * \return the server's port number
+ */
+unsigned short simplecmd_get_port(pid_t server_pid)
+{
+	int sock;            // Socket descriptor
+	unsigned short port; // Port the specified server is listening on
+	char* buffer;        // Port as a string (directly from the server)
+
+	sock = __open_sock_by_pid(server_pid);
+	if(sock < 0) return 0;
+
+	__sock_recv(sock, __command_handlers[SP_COMMAND_GET_PORT].request, &buffer);
+	if(buffer)
+	{
+		if(sscanf(buffer, "%hu", &port) != 1)
+		{
+			impact(0, "%s: %s: %s is not a port number\n",
+				SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR,
+				buffer);
+			port = 0;
+		}
+		free(buffer);
+	}
+	else
+	{
+		port = 0;
+	}
+
+	close(sock);
+
+	return port;
+}
+
+/*!
+ * \brief Get the version of the specified server.
+ *
+ * \param[in]  server_pid Process identifier of the server to query
+ * \param[out] version
+ * \parblock
+ * Version of the server
+ *
+ * The storage for this string will be dynamically allocated. You are
+ * responsible for freeing it (unless it is NULL, in which case an error
+ * occurred).
+ * \endparblock
+ *
+ * \return the number of characters written to the version string (excluding
+ * the NULL-terminating character)
+ */
+size_t simplecmd_get_version(pid_t server_pid, char** version)
+{
+	int sock;          // Socket descriptor
+	size_t length = 0; // Length of the version string
+	*version = NULL;   // Failsafe
+
+	sock = __open_sock_by_pid(server_pid);
+	if(sock < 0) return 0;
+
+	length = __sock_recv(sock, __command_handlers[SP_COMMAND_GET_VERSION].request, version);
+
+	close(sock);
+
+	return length;
+}
+
+/*!
+ * \brief Walk the list of files being served by the specified server.
+ *
+ * \note The files are handed to the callback as they arrive from the server,
+ * so the memory used by this function does not grow with the length of the
+ * list. The file passed to the callback (including its strings) is only valid
+ * until the callback returns.
+ *
+ * \param[in] server_pid Process identifier of the server to act on
+ * \param[in] pattern
+ * \parblock
+ * Shell wildcard pattern the URIs of the files must match (see
+ * simplepost_purge_files())
+ *
+ * If this parameter is NULL, every file being served will be walked.
+ * \endparblock
+ * \param[in] callback
+ * \parblock
+ * Function to call with each file being served
+ *
+ * If the callback returns false, the walk will be aborted.
+ * \endparblock
+ * \param[in] arg        Argument to pass to the callback function
+ *
+ * \return the number of files hosted by the server, or -1 if the list could
+ * not be retrieved or the walk was aborted
+ */
+ssize_t simplecmd_foreach_file(
+	pid_t server_pid,
+	const char* pattern,
+	bool (*callback) (simplepost_file_t, void*),
+	void* arg)
+{
+	int sock;                    // Socket descriptor
+	char* buffer = NULL;         // Count, index, or identifier string from the server
+	size_t count;                // Number of files being served
+	size_t i = 0;                // Number of files handed to the callback
+	size_t t = 0;                // Temporary file index converted from the buffer
+	struct simplepost_file file; // File currently being received
+	bool is_file_open = false;   // Have we received the index of the current file?
+
+	memset(&file, 0, sizeof(struct simplepost_file));
+
+	sock = __open_sock_by_pid(server_pid);
+	if(sock < 0) return -1;
+
+	if(pattern)
+	{
+		__sock_send(sock, __command_handlers[SP_COMMAND_FIND_FILES].request, pattern);
+		__sock_recv(sock, NULL, &buffer);
+	}
+	else
+	{
+		__sock_recv(sock, __command_handlers[SP_COMMAND_GET_FILES].request, &buffer);
+	}
+	if(buffer == NULL) goto error;
+
+	if(sscanf(buffer, "%zu", &count) != 1)
+	{
+		impact(0, "%s: %s: %s is not a number\n",
+			SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR,
+			buffer);
+		goto error;
+	}
+	free(buffer);
+	buffer = NULL;
+
+	impact(3, "%s: %s: Receiving list of %zu files\n",
+		SP_COMMAND_HEADER_NAMESPACE, __func__,
+		count);
+
+	for(;;)
+	{
+		__sock_recv(sock, NULL, &buffer);
+		if(buffer == NULL)
+		{
+			impact(0, "%s: %s: The list of files ended before the file count\n",
+				SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR);
+			goto error;
+		}
+
+		impact(3, "%s: %s: Receiving %s\n",
+			SP_COMMAND_HEADER_NAMESPACE, __func__,
+			buffer);
+
+		if(strcmp(buffer, SP_COMMAND_FILE_INDEX) == 0 || strcmp(buffer, SP_COMMAND_FILE_END) == 0)
+		{
+			bool is_end = (strcmp(buffer, SP_COMMAND_FILE_END) == 0);
+
+			free(buffer);
+			buffer = NULL;
+
+			if(is_file_open)
+			{
+				if(__deliver_file(&file, i, callback, arg) == false) goto error;
+				is_file_open = false;
+				++i;
+			}
+
+			__sock_recv(sock, NULL, &buffer);
+			if(buffer == NULL)
+			{
+				impact(0, "%s: %s: Did not receive the next file index as expected\n",
+					SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR);
+				goto error;
+			}
+
+			if(sscanf(buffer, "%zu", &t) != 1)
+			{
+				impact(0, "%s: %s: %s is not a number\n",
+					SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR,
+					buffer);
+				goto error;
+			}
+			free(buffer);
+			buffer = NULL;
+
+			if(t != i)
+			{
+				impact(0, "%s: %s: Expected the next file index to be %zu, not %zu\n",
+					SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR,
+					i, t);
+				goto error;
+			}
+
+			if(is_end) break;
+			is_file_open = true;
+		}
+		else if(is_file_open == false)
+		{
+			impact(0, "%s: %s: Received \"%s\" before the first file index\n",
+				SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR,
+				buffer);
+			goto error;
+		}
+		else if(strcmp(buffer, SP_COMMAND_FILE_FILE) == 0)
+		{
+			free(buffer);
+			buffer = NULL;
+
+			__sock_recv(sock, NULL, &buffer);
+			if(buffer == NULL)
+			{
+				impact(0, "%s: %s: Did not receive the file[%zu] location as expected\n",
+					SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR,
+					i);
+				goto error;
+			}
+
+			if(file.file)
+			{
+				impact(0, "%s: %s: Received new file[%zu] location \"%s\", but it is already set to \"%s\"\n",
+					SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR,
+					i, buffer, file.file);
+				goto error;
+			}
+
+			file.file = buffer;
+			buffer = NULL;
+		}
+		else if(strcmp(buffer, SP_COMMAND_FILE_URL) == 0)
+		{
+			free(buffer);
+			buffer = NULL;
+
+			__sock_recv(sock, NULL, &buffer);
+			if(buffer == NULL)
+			{
+				impact(0, "%s: %s: Did not receive the file[%zu] URL as expected\n",
+					SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR,
+					i);
+				goto error;
+			}
+
+			if(file.url)
+			{
+				impact(0, "%s: %s: Received new file[%zu] URL \"%s\", but it is already set to \"%s\"\n",
+					SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR,
+					i, buffer, file.url);
+				goto error;
+			}
+
+			file.url = buffer;
+			buffer = NULL;
+		}
+		else if(strcmp(buffer, SP_COMMAND_FILE_COUNT) == 0)
+		{
+			free(buffer);
+			buffer = NULL;
+
+			__sock_recv(sock, NULL, &buffer);
+			if(buffer == NULL)
+			{
+				impact(0, "%s: %s: Did not receive the file[%zu] count as expected\n",
+					SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR,
+					i);
+				goto error;
+			}
+
+			if(sscanf(buffer, "%u", &file.count) != 1)
+			{
+				impact(0, "%s: %s: Received new file[%zu] count \"%s\", but it is not a positive integer as expected!\n",
+					SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR,
+					i, buffer);
+				goto error;
+			}
+
+			free(buffer);
+			buffer = NULL;
+		}
+		else if(strcmp(buffer, SP_COMMAND_FILE_EXPIRES) == 0)
+		{
+			long long expires; // Time (seconds since the Epoch) the file stops being served
+
+			free(buffer);
+			buffer = NULL;
+
+			__sock_recv(sock, NULL, &buffer);
+			if(buffer == NULL)
+			{
+				impact(0, "%s: %s: Did not receive the file[%zu] expiry time as expected\n",
+					SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR,
+					i);
+				goto error;
+			}
+
+			if(sscanf(buffer, "%lld", &expires) != 1 || expires < 0)
+			{
+				impact(0, "%s: %s: Received new file[%zu] expiry time \"%s\", but it is not a positive integer as expected!\n",
+					SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR,
+					i, buffer);
+				goto error;
+			}
+			file.expires = (time_t) expires;
+
+			free(buffer);
+			buffer = NULL;
+		}
+		else
+		{
+			/* We probably should not have run into this condition in the
+			 * first place. It most likely means that we are talking to an
+			 * older (or newer) version of this program, and the command
+			 * protocol has changed. If not, it is probably a bug.
+			 */
+			impact(3, "%s: %s: Skipping unsupported file identifier \"%s\"\n",
+				SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR,
+				buffer);
+			free(buffer);
+			buffer = NULL;
+
+			/* Read and discard the argument that presumably comes after the
+			 * unsupported file identifier that we encountered.
+			 */
+			__sock_recv(sock, NULL, &buffer);
+			free(buffer);
+			buffer = NULL;
+		}
+	}
+
+	close(sock);
+
+	return i;
+
+error:
+	free(file.file);
+	free(file.url);
+
+	free(buffer);
+	close(sock);
+
+	return -1;
+}
+
+/*!
+ * \brief Get the list of files being served by the specified server.
  *
- * \return the server's port number
+ * \note The whole list is held in memory. Prefer simplecmd_foreach_file() if
+ * you only need to look at one file at a time.
+ *
+ * \param[in] server_pid Process identifier of the server to act on
+ * \param[in] pattern
+ * \parblock
+ * Shell wildcard pattern the URIs of the files must match
+ *
+ * If this parameter is NULL, every file being served will be listed.
+ * \endparblock
+ * \param[out] files     List of files currently being served
+ *
+ * \return the number of files hosted by the server, or -1 if the list could
+ * not be retrieved
  */
-unsigned short simplecmd_get_port(pid_t server_pid)
+ssize_t simplecmd_get_files(pid_t server_pid, const char* pattern, simplepost_file_t* files)
+{
+	struct simplecmd_file_list list = {NULL, NULL}; // List of files received
+	ssize_t count;                                  // Number of files received
+
+	count = simplecmd_foreach_file(server_pid, pattern, &__append_file, &list);
+	if(count < 0)
+	{
+		simplepost_file_free(list.head);
+		list.head = NULL;
+	}
+
+	*files = list.head;
+
+	return count;
+}
+
+/*!
+ * \brief Add a file to the specified server.
+ *
+ * \param[in] server_pid Process identifier of the server to act on
+ * \param[in] file       Name and path of the file to serve
+ * \param[in] uri        URI of the file to serve
+ * \param[in] count      Number of times the file should be served
+ * \param[in] expires    Time (seconds since the Epoch) to stop serving the file (0 = never)
+ *
+ * \return true if the file was successfully added to the server, false if
+ * something went wrong (and the file was not added to the server)
+ */
+bool simplecmd_set_file(
+	pid_t server_pid,
+	const char* file,
+	const char* uri,
+	unsigned int count,
+	time_t expires)
+{
+	int sock;         // Socket descriptor
+	char buffer[512]; // Count or expiry time as a string
+
+	sock = __open_sock_by_pid(server_pid);
+	if(sock < 0) return false;
+
+	__sock_send(sock, __command_handlers[SP_COMMAND_SET_FILE].request, NULL);
+
+	if(file)
+	{
+		impact(3, "%s: %s: Sending %s %s\n",
+			SP_COMMAND_HEADER_NAMESPACE, __func__,
+			SP_COMMAND_FILE_FILE, file);
+		__sock_send(sock, SP_COMMAND_FILE_FILE, file);
+	}
+
+	if(count)
+	{
+		sprintf(buffer, "%u", count);
+
+		impact(3, "%s: %s: Sending %s %s\n",
+			SP_COMMAND_HEADER_NAMESPACE, __func__,
+			SP_COMMAND_FILE_COUNT, buffer);
+		__sock_send(sock, SP_COMMAND_FILE_COUNT, buffer);
+	}
+
+	if(expires)
+	{
+		sprintf(buffer, "%lld", (long long) expires);
+
+		impact(3, "%s: %s: Sending %s %s\n",
+			SP_COMMAND_HEADER_NAMESPACE, __func__,
+			SP_COMMAND_FILE_EXPIRES, buffer);
+		__sock_send(sock, SP_COMMAND_FILE_EXPIRES, buffer);
+	}
+
+	if(uri)
+	{
+		impact(3, "%s: %s: Sending %s %s\n",
+			SP_COMMAND_HEADER_NAMESPACE, __func__,
+			SP_COMMAND_FILE_URI, uri);
+		__sock_send(sock, SP_COMMAND_FILE_URI, uri);
+	}
+
+	close(sock);
+
+	return true;
+}
+
+/*!
+ * \brief Stop serving every file on a URI matching a pattern from the
+ * specified server.
+ *
+ * \param[in] server_pid Process identifier of the server to act on
+ * \param[in] pattern
+ * \parblock
+ * Shell wildcard pattern the URIs of the files must match
+ *
+ * See simplepost_purge_files() for its syntax.
+ * \endparblock
+ *
+ * \return the number of files the server stopped serving, or -1 if the
+ * files could not be purged
+ */
+ssize_t simplecmd_purge_files(pid_t server_pid, const char* pattern)
 {
 	int sock;            // Socket descriptor
-	unsigned short port; // Port the specified server is listening on
-	char* buffer;        // Port as a string (directly from the server)
+	char* buffer = NULL; // Number of files purged as a string (directly from the server)
+	ssize_t count = -1;  // Number of files purged
 
 	sock = __open_sock_by_pid(server_pid);
-	if(sock < 0) return 0;
+	if(sock < 0) return -1;
 
-	__sock_recv(sock, __command_handlers[SP_COMMAND_GET_PORT].request, &buffer);
-	if(buffer)
+	impact(3, "%s: %s: Sending pattern %s\n",
+		SP_COMMAND_HEADER_NAMESPACE, __func__,
+		pattern);
+	__sock_send(sock, __command_handlers[SP_COMMAND_PURGE_FILES].request, pattern);
+
+	__sock_recv(sock, NULL, &buffer);
+	if(buffer == NULL)
 	{
-		if(sscanf(buffer, "%hu", &port) != 1)
+		impact(0, "%s: Server %d did not say how many files it purged\n",
+			SP_COMMAND_HEADER_NAMESPACE,
+			server_pid);
+	}
+	else if(sscanf(buffer, "%zd", &count) != 1)
+	{
+		impact(0, "%s: %s: %s is not a number\n",
+			SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR,
+			buffer);
+		count = -1;
+	}
+
+	free(buffer);
+	close(sock);
+
+	return count;
+}
+
+/*!
+ * \brief Get the current status of the specified server.
+ *
+ * \param[in]  server_pid Process identifier of the server to query
+ * \param[out] status     Status of the server
+ *
+ * \retval true the status was received from the server
+ * \retval false the server could not be queried or broke the protocol
+ */
+bool simplecmd_get_status(pid_t server_pid, simplepost_status_t status)
+{
+	int sock;            // Socket descriptor
+	char* field = NULL;  // Name of the statistic
+	char* value = NULL;  // Value of the statistic
+	bool ret = false;    // Return code
+
+	memset(status, 0, sizeof(struct simplepost_status));
+
+	sock = __open_sock_by_pid(server_pid);
+	if(sock < 0) return false;
+
+	__sock_send(sock, __command_handlers[SP_COMMAND_GET_STATUS].request, NULL);
+
+	for(;;)
+	{
+		__sock_recv(sock, NULL, &field);
+		if(field == NULL)
 		{
-			impact(0, "%s: %s: %s is not a port number\n",
+			impact(0, "%s: %s: Did not receive the end of the status as expected\n",
+				SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR);
+			goto error;
+		}
+		if(strcmp(field, SP_COMMAND_STATUS_END) == 0) break;
+
+		__sock_recv(sock, NULL, &value);
+		if(value == NULL)
+		{
+			impact(0, "%s: %s: Did not receive the value of %s as expected\n",
 				SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR,
-				buffer);
-			port = 0;
+				field);
+			goto error;
 		}
-		free(buffer);
-	}
-	else
-	{
-		port = 0;
+
+		impact(3, "%s: %s: Received %s %s\n",
+			SP_COMMAND_HEADER_NAMESPACE, __func__,
+			field, value);
+
+		if(strcmp(field, SP_COMMAND_STATUS_FILES) == 0) sscanf(value, "%zu", &status->files);
+		else if(strcmp(field, SP_COMMAND_STATUS_INDEXED) == 0) sscanf(value, "%zu", &status->files_indexed);
+		else if(strcmp(field, SP_COMMAND_STATUS_UNLIMITED) == 0) sscanf(value, "%zu", &status->files_unlimited);
+		else if(strcmp(field, SP_COMMAND_STATUS_REMAINING) == 0) sscanf(value, "%zu", &status->downloads_remaining);
+		else if(strcmp(field, SP_COMMAND_STATUS_STARTED) == 0) sscanf(value, "%zu", &status->downloads_started);
+		else if(strcmp(field, SP_COMMAND_STATUS_COMPLETED) == 0) sscanf(value, "%zu", &status->downloads_completed);
+		else if(strcmp(field, SP_COMMAND_STATUS_ABORTED) == 0) sscanf(value, "%zu", &status->downloads_aborted);
+		else if(strcmp(field, SP_COMMAND_STATUS_CONNECTIONS) == 0) sscanf(value, "%zu", &status->connections);
+		else if(strcmp(field, SP_COMMAND_STATUS_BYTES_SENT) == 0) sscanf(value, "%" SCNu64, &status->bytes_sent);
+		else if(strcmp(field, SP_COMMAND_STATUS_MIME_HITS) == 0) sscanf(value, "%zu", &status->mime_hits);
+		else if(strcmp(field, SP_COMMAND_STATUS_MIME_MISSES) == 0) sscanf(value, "%zu", &status->mime_misses);
+		else if(strcmp(field, SP_COMMAND_STATUS_PENDING) == 0) sscanf(value, "%zu", &status->lookups_pending);
+		else if(strcmp(field, SP_COMMAND_STATUS_LOOKUPS) == 0) sscanf(value, "%zu", &status->lookups);
+		else if(strcmp(field, SP_COMMAND_STATUS_LOOKUP_TIME) == 0) sscanf(value, "%" SCNu64, &status->lookup_time);
+		else if(strcmp(field, SP_COMMAND_STATUS_LOOKUP_MAX) == 0) sscanf(value, "%" SCNu64, &status->lookup_time_max);
+		else if(strcmp(field, SP_COMMAND_STATUS_UPTIME) == 0) sscanf(value, "%lu", &status->uptime);
+		else
+		{
+			impact(3, "%s: %s: Skipping unsupported field \"%s\"\n",
+				SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR,
+				field);
+		}
+
+		free(field);
+		free(value);
+		field = value = NULL;
 	}
 
+	ret = true;
+
+error:
+	if(field) free(field);
+	if(value) free(value);
 	close(sock);
 
-	return port;
+	return ret;
 }
 
 /*!
- * \brief Get the version of the specified server.
+ * \brief Take over the listening socket and files of the specified server.
  *
- * \param[in]  server_pid Process identifier of the server to query
- * \param[out] version
+ * \note The server stops accepting connections, then passes its listening
+ * socket and a snapshot of the files it is serving (with the number of times
+ * each may still be downloaded) to the callback. Connections made in the
+ * meantime wait for the callback to accept them, so no client is turned away.
+ * If the callback succeeds, the server is told to shut down as soon as the
+ * files it is still sending have been sent. Otherwise it starts accepting
+ * connections again.
+ *
+ * \param[in] server_pid Process identifier of the server to take over
+ * \param[in] timeout
  * \parblock
- * Version of the server
+ * Maximum number of seconds the server may take to finish sending files
  *
- * The storage for this string will be dynamically allocated. You are
- * responsible for freeing it (unless it is NULL, in which case an error
- * occurred).
+ * If the timeout is zero, the server will wait for every transfer to finish.
  * \endparblock
+ * \param[in] callback
+ * \parblock
+ * Function to start serving the files on the socket
  *
- * \return the number of characters written to the version string (excluding
- * the NULL-terminating character)
+ * The callback must start accepting connections on the socket (see
+ * simplepost_bind_socket()) and return true within SP_COMMAND_HANDOFF_WAIT
+ * seconds, or return false if it cannot. Either way, the socket belongs to
+ * the callback. The list of files (including its strings) is only valid until
+ * the callback returns.
+ * \endparblock
+ * \param[in] arg        Argument to pass to the callback function
+ *
+ * \retval true the callback took over from the server
+ * \retval false the server or the callback failed to hand off
  */
-size_t simplecmd_get_version(pid_t server_pid, char** version)
+bool simplecmd_handoff(
+	pid_t server_pid,
+	unsigned int timeout,
+	bool (*callback) (int, simplepost_file_t, void*),
+	void* arg)
 {
-	int sock;          // Socket descriptor
-	size_t length = 0; // Length of the version string
-	*version = NULL;   // Failsafe
+	int sock;                                       // Socket descriptor
+	char buffer[30];                                // Timeout as a string
+	char* field = NULL;                             // Name of the field received
+	char* value = NULL;                             // Value of the field received
+	int listen_sock = -1;                           // Socket the server was listening on
+	struct simplepost_file file;                    // File currently being received
+	struct simplecmd_file_list list = {NULL, NULL}; // Files received
+	size_t count = 0;                               // Number of files received
+	size_t t;                                       // Number of files the server sent
+	bool ret = false;                               // Return code
+
+	memset(&file, 0, sizeof(struct simplepost_file));
 
 	sock = __open_sock_by_pid(server_pid);
-	if(sock < 0) return 0;
+	if(sock < 0) return false;
 
-	length = __sock_recv(sock, __command_handlers[SP_COMMAND_GET_VERSION].request, version);
+	sprintf(buffer, "%u", timeout);
+	__sock_send(sock, __command_handlers[SP_COMMAND_HANDOFF].request, buffer);
+
+	__sock_recv(sock, NULL, &field);
+	if(field == NULL || strcmp(field, __command_handlers[SP_COMMAND_HANDOFF].request) != 0)
+	{
+		impact(0, "%s: Server %d refused to hand off its socket\n",
+			SP_COMMAND_HEADER_NAMESPACE,
+			server_pid);
+		goto error;
+	}
+	free(field);
+	field = NULL;
+
+	listen_sock = __sock_recv_fd(sock);
+	if(listen_sock < 0)
+	{
+		impact(0, "%s: %s: Did not receive the listening socket as expected\n",
+			SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR);
+		goto error;
+	}
+
+	for(;;)
+	{
+		__sock_recv(sock, NULL, &field);
+		if(field == NULL)
+		{
+			impact(0, "%s: %s: The list of files ended before the file count\n",
+				SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR);
+			goto error;
+		}
+
+		__sock_recv(sock, NULL, &value);
+		if(value == NULL)
+		{
+			impact(0, "%s: %s: Did not receive the value of %s as expected\n",
+				SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR,
+				field);
+			goto error;
+		}
+
+		impact(3, "%s: %s: Received %s %s\n",
+			SP_COMMAND_HEADER_NAMESPACE, __func__,
+			field, value);
+
+		if(strcmp(field, SP_COMMAND_FILE_FILE) == 0)
+		{
+			free(file.file);
+			file.file = value;
+			value = NULL;
+		}
+		else if(strcmp(field, SP_COMMAND_FILE_COUNT) == 0)
+		{
+			if(sscanf(value, "%u", &file.count) != 1)
+			{
+				impact(0, "%s: %s: %s is not a valid COUNT\n",
+					SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR,
+					value);
+				goto error;
+			}
+		}
+		else if(strcmp(field, SP_COMMAND_FILE_EXPIRES) == 0)
+		{
+			long long expires; // Time (seconds since the Epoch) the file stops being served
+
+			if(sscanf(value, "%lld", &expires) != 1 || expires < 0)
+			{
+				impact(0, "%s: %s: %s is not a valid expiry time\n",
+					SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR,
+					value);
+				goto error;
+			}
+			file.expires = (time_t) expires;
+		}
+		else if(strcmp(field, SP_COMMAND_FILE_URI) == 0)
+		{
+			simplepost_file_t p; // Copy of the file received
+
+			if(file.file == NULL)
+			{
+				impact(0, "%s: %s: Received URI %s without a FILE\n",
+					SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR,
+					value);
+				goto error;
+			}
+
+			p = simplepost_file_init();
+			if(p == NULL)
+			{
+				impact(0, "%s: %s: Failed to allocate memory for file %zu\n",
+					SP_COMMAND_HEADER_NAMESPACE, SP_MAIN_HEADER_MEMORY_ALLOC,
+					count);
+				goto error;
+			}
+
+			p->file = file.file;
+			p->uri = value;
+			p->count = file.count;
+			p->expires = file.expires;
+			memset(&file, 0, sizeof(struct simplepost_file));
+			value = NULL;
+
+			if(list.tail)
+			{
+				p->prev = list.tail;
+				list.tail->next = p;
+			}
+			else
+			{
+				list.head = p;
+			}
+			list.tail = p;
+			++count;
+		}
+		else if(strcmp(field, SP_COMMAND_FILE_END) == 0)
+		{
+			if(sscanf(value, "%zu", &t) != 1 || t != count)
+			{
+				impact(0, "%s: %s: Received %zu files, not %s\n",
+					SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR,
+					count, value);
+				goto error;
+			}
+			break;
+		}
+		else
+		{
+			impact(3, "%s: %s: Skipping unsupported field \"%s\"\n",
+				SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR,
+				field);
+		}
+
+		free(field);
+		free(value);
+		field = value = NULL;
+	}
+
+	impact(2, "%s: Received the socket and %zu files from server %d\n",
+		SP_COMMAND_HEADER_NAMESPACE,
+		count, server_pid);
 
+	t = (size_t) listen_sock;
+	listen_sock = -1;
+	if(callback((int) t, list.head, arg) == false) goto error;
+
+	ret = __sock_push(sock, NULL, SP_COMMAND_HANDOFF_READY);
+
+error:
+	free(field);
+	free(value);
+	free(file.file);
+	simplepost_file_free(list.head);
+	if(listen_sock != -1) close(listen_sock);
 	close(sock);
 
-	return length;
+	return ret;
 }
 
 /*!
- * \brief Get the list of files being served by the specified server.
+ * \brief Receive events from the specified server as they happen.
+ *
+ * \note This function does not return until the server hangs up (usually
+ * because it is shutting down) or the callback asks it to stop. The event
+ * passed to the callback (including its strings) is only valid until the
+ * callback returns.
  *
  * \param[in] server_pid Process identifier of the server to act on
- * \param[out] files     List of files currently being served
+ * \param[in] callback
+ * \parblock
+ * Function to call with each event
  *
- * \return the number of files hosted by the server, or -1 if the list could
- * not be retrieved
+ * If the callback returns false, we will unsubscribe and return.
+ * \endparblock
+ * \param[in] arg        Argument to pass to the callback function
+ *
+ * \retval true we received events until the server hung up or the callback
+ * asked us to stop
+ * \retval false we could not subscribe or the server broke the protocol
  */
-ssize_t simplecmd_get_files(pid_t server_pid, simplepost_file_t* files)
+bool simplecmd_subscribe(
+	pid_t server_pid,
+	bool (*callback) (simplepost_event_t, void*),
+	void* arg)
 {
-	int sock;               // Socket descriptor
-	char* buffer = NULL;    // Count, index, or identifier string from the server
-	size_t count;           // Number of files being served
-	size_t i = 0;           // Index of the current file being received
-	size_t t = 0;           // Temporary file index converted from the buffer
-	simplepost_file_t tail; // Last file in the *files list
-	tail = *files = NULL;   // Failsafe
+	int sock;                      // Socket descriptor
+	char* buffer = NULL;           // Acknowledgment or identifier string from the server
+	struct simplepost_event event; // Event currently being received
+	bool is_event_open = false;    // Have we received the type of the current event?
+	bool is_event_known = false;   // Do we understand the type of the current event?
 
-	sock = __open_sock_by_pid(server_pid);
-	if(sock < 0) return -1;
+	memset(&event, 0, sizeof(struct simplepost_event));
 
-	__sock_recv(sock, __command_handlers[SP_COMMAND_GET_FILES].request, &buffer);
-	if(buffer == NULL) goto error;
+	sock = __open_sock_by_pid(server_pid);
+	if(sock < 0) return false;
 
-	if(sscanf(buffer, "%zu", &count) != 1)
+	__sock_recv(sock, __command_handlers[SP_COMMAND_SUBSCRIBE].request, &buffer);
+	if(buffer == NULL || strcmp(buffer, __command_handlers[SP_COMMAND_SUBSCRIBE].request) != 0)
 	{
-		impact(0, "%s: %s: %s is not a number\n",
-			SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR,
-			buffer);
+		impact(0, "%s: %s: The server did not acknowledge the subscription\n",
+			SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR);
 		goto error;
 	}
 	free(buffer);
 	buffer = NULL;
 
-	impact(3, "%s: %s: Receiving list of %zu files\n",
-		SP_COMMAND_HEADER_NAMESPACE, __func__,
-		count);
-	if(count == 0) goto no_error;
-
-	while((i + 1) < count || tail == NULL || tail->file == NULL || tail->url == NULL)
+	for(;;)
 	{
 		__sock_recv(sock, NULL, &buffer);
-		if(buffer == NULL) goto error;
+		if(buffer == NULL) break;
 
 		impact(3, "%s: %s: Receiving %s\n",
 			SP_COMMAND_HEADER_NAMESPACE, __func__,
 			buffer);
 
-		if(strcmp(buffer, SP_COMMAND_FILE_INDEX) == 0)
+		if(strcmp(buffer, SP_COMMAND_EVENT_TYPE) == 0)
 		{
 			free(buffer);
 			buffer = NULL;
 
+			free(event.file);
+			free(event.uri);
+			memset(&event, 0, sizeof(struct simplepost_event));
+
 			__sock_recv(sock, NULL, &buffer);
 			if(buffer == NULL)
 			{
-				impact(0, "%s: %s: Did not receive the next file index as expected\n",
+				impact(0, "%s: %s: Did not receive the event type as expected\n",
 					SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR);
 				goto error;
 			}
 
-			if(sscanf(buffer, "%zu", &t) != 1)
-			{
-				impact(0, "%s: %s: %s is not a number\n",
-					SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR,
-					buffer);
-				goto error;
-			}
-			free(buffer);
-			buffer = NULL;
-
-			if(tail == NULL)
+			is_event_open = true;
+			is_event_known = false;
+			for(enum simplepost_event_type t = SP_EVENT_FILE_ADDED; t <= SP_EVENT_FILE_EXPIRED; ++t)
 			{
-				if(t != i)
+				if(strcmp(buffer, simplepost_event_name(t)) == 0)
 				{
-					impact(0, "%s: %s: Expected the next file index to be %zu, not %zu\n",
-						SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR,
-						i, t);
-					goto error;
+					event.type = t;
+					is_event_known = true;
+					break;
 				}
-
-				tail = *files = simplepost_file_init();
-				if(tail == NULL) goto error;
 			}
-			else
+			if(is_event_known == false)
 			{
-				if(t != ++i)
-				{
-					impact(0, "%s: %s: Expected the next file index to be %zu, not %zu\n",
-						SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR,
-						i, t);
-					goto error;
-				}
-
-				simplepost_file_t prev = tail;
-
-				tail = simplepost_file_init();
-				if(tail == NULL) goto error;
-
-				tail->prev = prev;
-				prev->next = tail;
+				impact(3, "%s: %s: Skipping unsupported event \"%s\"\n",
+					SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR,
+					buffer);
 			}
+
+			free(buffer);
+			buffer = NULL;
 		}
-		else if(tail == NULL)
+		else if(is_event_open == false)
 		{
-			impact(0, "%s: %s: Received \"%s\" before the first file index\n",
+			impact(0, "%s: %s: Received \"%s\" before the first event type\n",
 				SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR,
 				buffer);
 			goto error;
 		}
-		else if(strcmp(buffer, SP_COMMAND_FILE_FILE) == 0)
+		else if(strcmp(buffer, SP_COMMAND_EVENT_FILE) == 0 || strcmp(buffer, SP_COMMAND_EVENT_URI) == 0)
 		{
+			bool is_uri = (strcmp(buffer, SP_COMMAND_EVENT_URI) == 0);
+
 			free(buffer);
 			buffer = NULL;
 
 			__sock_recv(sock, NULL, &buffer);
 			if(buffer == NULL)
 			{
-				impact(0, "%s: %s: Did not receive the file[%zu] location as expected\n",
+				impact(0, "%s: %s: Did not receive the event %s as expected\n",
 					SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR,
-					i);
+					is_uri ? SP_COMMAND_EVENT_URI : SP_COMMAND_EVENT_FILE);
 				goto error;
 			}
 
-			if(tail->file)
+			if(is_uri == false)
 			{
-				impact(0, "%s: %s: Received new file[%zu] location \"%s\", but it is already set to \"%s\"\n",
-					SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR,
-					i, buffer, tail->file);
-				goto error;
+				free(event.file);
+				event.file = buffer;
+				buffer = NULL;
+				continue;
 			}
 
-			tail->file = buffer;
+			// The URI is always the last field of an event.
+			free(event.uri);
+			event.uri = buffer;
+			buffer = NULL;
+			is_event_open = false;
+
+			if(is_event_known && callback(&event, arg) == false) break;
 		}
-		else if(strcmp(buffer, SP_COMMAND_FILE_URL) == 0)
+		else if(strcmp(buffer, SP_COMMAND_EVENT_COUNT) == 0)
 		{
 			free(buffer);
 			buffer = NULL;
 
 			__sock_recv(sock, NULL, &buffer);
-			if(buffer == NULL)
-			{
-				impact(0, "%s: %s: Did not receive the file[%zu] URL as expected\n",
-					SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR,
-					i);
-				goto error;
-			}
-
-			if(tail->url)
+			if(buffer == NULL || sscanf(buffer, "%u", &event.count) != 1)
 			{
-				impact(0, "%s: %s: Received new file[%zu] URL \"%s\", but it is already set to \"%s\"\n",
+				impact(0, "%s: %s: Did not receive the event %s as expected\n",
 					SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR,
-					i, buffer, tail->url);
+					SP_COMMAND_EVENT_COUNT);
 				goto error;
 			}
 
-			tail->url = buffer;
+			free(buffer);
+			buffer = NULL;
 		}
-		else if(strcmp(buffer, SP_COMMAND_FILE_COUNT) == 0)
+		else if(strcmp(buffer, SP_COMMAND_EVENT_BYTES) == 0 || strcmp(buffer, SP_COMMAND_EVENT_DROPPED) == 0)
 		{
+			bool is_bytes = (strcmp(buffer, SP_COMMAND_EVENT_BYTES) == 0);
+
 			free(buffer);
 			buffer = NULL;
 
 			__sock_recv(sock, NULL, &buffer);
-			if(buffer == NULL)
-			{
-				impact(0, "%s: %s: Did not receive the file[%zu] count as expected\n",
-					SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR,
-					i);
-				goto error;
-			}
-
-			if(sscanf(buffer, "%u", &tail->count) != 1)
+			if(buffer == NULL || sscanf(buffer, "%zu", is_bytes ? &event.bytes : &event.dropped) != 1)
 			{
-				impact(0, "%s: %s: Received new file[%zu] count \"%s\", but it is not a positive integer as expected!\n",
+				impact(0, "%s: %s: Did not receive the event %s as expected\n",
 					SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR,
-					i, buffer);
+					is_bytes ? SP_COMMAND_EVENT_BYTES : SP_COMMAND_EVENT_DROPPED);
 				goto error;
 			}
 
@@ -1540,102 +3446,33 @@ ssize_t simplecmd_get_files(pid_t server_pid, simplepost_file_t* files)
 		}
 		else
 		{
-			/* We probably should not have run into this condition in the
-			 * first place. It most likely means that we are talking to an
-			 * older (or newer) version of this program, and the command
-			 * protocol has changed. If not, it is probably a bug.
+			/* See the related comment in simplecmd_foreach_file(). We are
+			 * most likely talking to a newer version of this program.
 			 */
-			impact(3, "%s: %s: Skipping unsupported file identifier \"%s\"\n",
+			impact(3, "%s: %s: Skipping unsupported event identifier \"%s\"\n",
 				SP_COMMAND_HEADER_NAMESPACE, SP_COMMAND_HEADER_PROTOCOL_ERROR,
 				buffer);
 			free(buffer);
 			buffer = NULL;
 
-			/* Read and discard the argument that presumably comes after the
-			 * unsupported file identifier that we encountered.
-			 */
 			__sock_recv(sock, NULL, &buffer);
 			free(buffer);
 			buffer = NULL;
 		}
 	}
 
-	for(tail = *files, i = 0; tail; tail = tail->next, ++i);
-	if(i != count)
-	{
-		impact(0, "%s: BUG! Only received %zu of %zu files\n",
-			__PRETTY_FUNCTION__,
-			i, count);
-		goto error;
-	}
-
-no_error:
+	free(event.file);
+	free(event.uri);
 	close(sock);
 
-	return count;
+	return true;
 
 error:
-	simplepost_file_free(*files);
-	*files = NULL;
+	free(event.file);
+	free(event.uri);
 
 	free(buffer);
 	close(sock);
 
-	return -1;
-}
-
-/*!
- * \brief Add a file to the specified server.
- *
- * \param[in] server_pid Process identifier of the server to act on
- * \param[in] file       Name and path of the file to serve
- * \param[in] uri        URI of the file to serve
- * \param[in] count      Number of times the file should be served
- *
- * \return true if the file was successfully added to the server, false if
- * something went wrong (and the file was not added to the server)
- */
-bool simplecmd_set_file(
-	pid_t server_pid,
-	const char* file,
-	const char* uri,
-	unsigned int count)
-{
-	int sock;         // Socket descriptor
-	char buffer[512]; // Count as a string
-
-	sock = __open_sock_by_pid(server_pid);
-	if(sock < 0) return false;
-
-	__sock_send(sock, __command_handlers[SP_COMMAND_SET_FILE].request, NULL);
-
-	if(file)
-	{
-		impact(3, "%s: %s: Sending %s %s\n",
-			SP_COMMAND_HEADER_NAMESPACE, __func__,
-			SP_COMMAND_FILE_FILE, file);
-		__sock_send(sock, SP_COMMAND_FILE_FILE, file);
-	}
-
-	if(count)
-	{
-		sprintf(buffer, "%u", count);
-
-		impact(3, "%s: %s: Sending %s %s\n",
-			SP_COMMAND_HEADER_NAMESPACE, __func__,
-			SP_COMMAND_FILE_COUNT, buffer);
-		__sock_send(sock, SP_COMMAND_FILE_COUNT, buffer);
-	}
-
-	if(uri)
-	{
-		impact(3, "%s: %s: Sending %s %s\n",
-			SP_COMMAND_HEADER_NAMESPACE, __func__,
-			SP_COMMAND_FILE_URI, uri);
-		__sock_send(sock, SP_COMMAND_FILE_URI, uri);
-	}
-
-	close(sock);
-
-	return true;
+	return false;
 }
@@ -39,6 +39,15 @@ typedef struct simplecmd_list
 	/// PID of the SimplePost instance listening on the socket
 	pid_t inst_pid;
 
+	/// Address the instance's HTTP server is bound to
+	char* address;
+
+	/// Port the instance's HTTP server is listening on
+	unsigned short port;
+
+	/// Version of the instance
+	char* version;
+
 
 	/// Next instance in the linked list
 	struct simplecmd_list* next;
@@ -77,7 +86,15 @@ size_t simplecmd_get_address(pid_t server_pid, char** address);
 unsigned short simplecmd_get_port(pid_t server_pid);
 size_t simplecmd_get_version(pid_t server_pid, char** version);
 
-ssize_t simplecmd_get_files(pid_t server_pid, simplepost_file_t* files);
-bool simplecmd_set_file(pid_t server_pid, const char* file, const char* uri, unsigned int count);
+ssize_t simplecmd_foreach_file(pid_t server_pid, const char* pattern, bool (*callback) (simplepost_file_t, void*), void* arg);
+ssize_t simplecmd_get_files(pid_t server_pid, const char* pattern, simplepost_file_t* files);
+bool simplecmd_set_file(pid_t server_pid, const char* file, const char* uri, unsigned int count, time_t expires);
+ssize_t simplecmd_purge_files(pid_t server_pid, const char* pattern);
+
+bool simplecmd_subscribe(pid_t server_pid, bool (*callback) (simplepost_event_t, void*), void* arg);
+
+bool simplecmd_get_status(pid_t server_pid, simplepost_status_t status);
+
+bool simplecmd_handoff(pid_t server_pid, unsigned int timeout, bool (*callback) (int, simplepost_file_t, void*), void* arg);
 
 #endif // _SIMPLECMD_H_
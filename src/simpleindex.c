@@ -0,0 +1,665 @@
+/*
+ * SimplePost - A Simple HTTP Server
+ *
+ * Copyright (C) 2016 Karl Lenz.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have recieved a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ */
+
+#include "simpleindex.h"
+#include "impact.h"
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/// Index namespace header
+#define SP_INDEX_HEADER_NAMESPACE "SimplePost::Index"
+
+/// Signature at the start of every index
+#define SP_INDEX_MAGIC            "SPINDEX1"
+
+/// Average number of files in each bucket of an index's perfect hash
+#define SP_INDEX_BUCKET_SIZE      4
+
+/// Maximum displacement tried for a bucket of an index's perfect hash
+#define SP_INDEX_DISPLACEMENT_MAX 0x1000000
+
+/// Slot of an index's perfect hash which holds no file
+#define SP_INDEX_SLOT_EMPTY       UINT32_MAX
+
+/// Suffix of the temporary file an index is written to
+#define SP_INDEX_TMP_SUFFIX       ".tmp"
+
+/*!
+ * \brief Header of an index
+ *
+ * An index is an immutable, memory-mapped table of files to serve. The header
+ * is followed by the displacement of each bucket of the perfect hash
+ * (uint32_t), the number of the file in each slot of the hash (uint32_t), the
+ * files (struct simpleindex_entry), and finally the terminated strings
+ * they refer to. Each table starts on an 8-byte boundary.
+ */
+struct simpleindex_header
+{
+	/// Signature of the index (SP_INDEX_MAGIC)
+	char magic[8];
+
+	/// Number of files in the index
+	uint64_t files;
+
+	/// Number of buckets in the perfect hash
+	uint64_t buckets;
+
+	/// Number of slots in the perfect hash
+	uint64_t slots;
+
+	/// Size (in bytes) of the whole index
+	uint64_t size;
+};
+
+/*!
+ * \brief File in an index
+ *
+ * Strings are referred to by their offset from the start of the index.
+ */
+struct simpleindex_entry
+{
+	/// Uniform Resource Identifier assigned to the file
+	uint64_t uri;
+
+	/// Name and path of the file on the filesystem
+	uint64_t file;
+
+	/// MIME type of the file (zero if it is not known)
+	uint64_t mime_type;
+
+	/// Size (in bytes) of the file when the index was written
+	uint64_t size;
+};
+
+/*!
+ * \brief Immutable index of files mapped into memory
+ */
+struct simpleindex
+{
+	/// Start of the mapping
+	const char* map;
+
+	/// Size (in bytes) of the mapping
+	size_t size;
+
+	/// Header of the index
+	const struct simpleindex_header* header;
+
+	/// Displacement of each bucket of the perfect hash
+	const uint32_t* displacements;
+
+	/// Number of the file in each slot of the perfect hash
+	const uint32_t* slots;
+
+	/// Files in the index
+	const struct simpleindex_entry* entries;
+};
+
+/*!
+ * \brief Determine whether two URIs are equivalent.
+ *
+ * \note The leading "/" of each URI is ignored.
+ *
+ * \param[in] uri1 First URI to compare
+ * \param[in] uri2 Second URI to compare
+ *
+ * \return true if both URIs are equivalent, false if not
+ */
+static bool __is_same_uri(const char* uri1, const char* uri2)
+{
+	if(uri1[0] == '/') ++uri1;
+	if(uri2[0] == '/') ++uri2;
+
+	return (strcmp(uri1, uri2) == 0);
+}
+
+/*!
+ * \brief Hash a URI for an index.
+ *
+ * \note Like __is_same_uri(), this ignores the leading "/" of the URI.
+ *
+ * \param[in] uri Uniform Resource Identifier to hash
+ *
+ * \return 64-bit FNV-1a hash of the URI
+ */
+static uint64_t __hash_uri(const char* uri)
+{
+	uint64_t hash = 14695981039346656037ULL; // FNV offset basis
+
+	if(uri[0] == '/') ++uri;
+	for(; *uri != '\0'; ++uri)
+	{
+		hash ^= (unsigned char) *uri;
+		hash *= 1099511628211ULL; // FNV prime
+	}
+
+	return hash;
+}
+
+/*!
+ * \brief Scramble the bits of a hash (the SplitMix64 finalizer).
+ *
+ * \param[in] hash Hash to scramble
+ *
+ * \return the scrambled hash
+ */
+static uint64_t __mix_hash(uint64_t hash)
+{
+	hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBULL;
+	return hash ^ (hash >> 31);
+}
+
+/*!
+ * \brief Get the slot of an index's perfect hash a URI hashes to.
+ *
+ * \param[in] hash         Hash of the URI (from __hash_uri())
+ * \param[in] displacement Displacement of the URI's bucket
+ * \param[in] slots        Number of slots in the perfect hash
+ *
+ * \return the slot of the URI
+ */
+static uint64_t __get_slot(uint64_t hash, uint32_t displacement, uint64_t slots)
+{
+	return __mix_hash(hash + (displacement + 1ULL) * 0x9E3779B97F4A7C15ULL) % slots;
+}
+
+/*!
+ * \brief Calculate where each table of an index starts.
+ *
+ * \param[in] files          Number of files in the index
+ * \param[in] buckets        Number of buckets in the perfect hash
+ * \param[in] slots          Number of slots in the perfect hash
+ * \param[out] displacements Offset of the displacements
+ * \param[out] table         Offset of the slots
+ * \param[out] entries       Offset of the files
+ * \param[out] strings       Offset of the strings
+ */
+static void __get_layout(
+	uint64_t files,
+	uint64_t buckets,
+	uint64_t slots,
+	uint64_t* displacements,
+	uint64_t* table,
+	uint64_t* entries,
+	uint64_t* strings)
+{
+	*displacements = sizeof(struct simpleindex_header);
+	*table = (*displacements + buckets * sizeof(uint32_t) + 7) & ~7ULL;
+	*entries = (*table + slots * sizeof(uint32_t) + 7) & ~7ULL;
+	*strings = *entries + files * sizeof(struct simpleindex_entry);
+}
+
+/*!
+ * \brief Bucket of an index's perfect hash being built
+ */
+struct simpleindex_bucket
+{
+	/// Number of the bucket
+	uint64_t bucket;
+
+	/// Number of files in the bucket
+	size_t size;
+};
+
+/*!
+ * \brief Order buckets from largest to smallest.
+ *
+ * \param[in] a First bucket (struct simpleindex_bucket*)
+ * \param[in] b Second bucket (struct simpleindex_bucket*)
+ *
+ * \return a qsort() comparison of the buckets
+ */
+static int __compare_buckets(const void* a, const void* b)
+{
+	const struct simpleindex_bucket* bucket_a = (const struct simpleindex_bucket*) a; // Properly cast first bucket
+	const struct simpleindex_bucket* bucket_b = (const struct simpleindex_bucket*) b; // Properly cast second bucket
+
+	if(bucket_a->size != bucket_b->size) return (bucket_a->size < bucket_b->size) ? 1 : -1;
+	return (bucket_a->bucket < bucket_b->bucket) ? -1 : (bucket_a->bucket > bucket_b->bucket);
+}
+
+/*!
+ * \brief Build the perfect hash of an index.
+ *
+ * This is the "hash, displace, and compress" algorithm without the compress
+ * part. The URIs are hashed into buckets of about SP_INDEX_BUCKET_SIZE files.
+ * Then, starting with the largest bucket, each bucket is assigned the first
+ * displacement which moves all of its files into free slots of the table.
+ *
+ * \param[in] uris           URIs of the files in the index
+ * \param[in] hashes         Hash of each URI (from __hash_uri())
+ * \param[in] files          Number of files in the index
+ * \param[in] buckets        Number of buckets in the perfect hash
+ * \param[in] slots          Number of slots in the perfect hash
+ * \param[out] displacements Displacement of each bucket
+ * \param[out] table         Number of the file in each slot
+ *
+ * \return true on success, false if a URI is listed twice or an error occurred
+ */
+static bool __build_hash(
+	const char* const* uris,
+	const uint64_t* hashes,
+	size_t files,
+	uint64_t buckets,
+	uint64_t slots,
+	uint32_t* displacements,
+	uint32_t* table)
+{
+	size_t* bucket_start = NULL;             // Index in members of the first file of each bucket
+	uint32_t* members = NULL;                // Files sorted by bucket
+	struct simpleindex_bucket* order = NULL; // Buckets from largest to smallest
+	bool ret = false;                        // Was the perfect hash built?
+
+	bucket_start = (size_t*) calloc(buckets + 1, sizeof(size_t));
+	members = (uint32_t*) malloc(sizeof(uint32_t) * files);
+	order = (struct simpleindex_bucket*) malloc(sizeof(struct simpleindex_bucket) * buckets);
+	if(bucket_start == NULL || members == NULL || order == NULL)
+	{
+		impact(0, "%s: %s: Failed to allocate memory for the perfect hash of %zu files\n",
+			SP_INDEX_HEADER_NAMESPACE, SP_MAIN_HEADER_MEMORY_ALLOC,
+			files);
+		goto error;
+	}
+
+	for(size_t i = 0; i < files; ++i) ++bucket_start[__mix_hash(hashes[i]) % buckets + 1];
+	for(uint64_t b = 0; b < buckets; ++b)
+	{
+		order[b].bucket = b;
+		order[b].size = bucket_start[b + 1];
+		bucket_start[b + 1] += bucket_start[b];
+	}
+	for(size_t i = 0; i < files; ++i)
+	{
+		uint64_t b = __mix_hash(hashes[i]) % buckets; // Bucket of the file
+		members[bucket_start[b] + (--order[b].size)] = (uint32_t) i;
+	}
+	for(uint64_t b = 0; b < buckets; ++b) order[b].size = bucket_start[b + 1] - bucket_start[b];
+	qsort(order, buckets, sizeof(struct simpleindex_bucket), &__compare_buckets);
+
+	for(uint64_t i = 0; i < slots; ++i) table[i] = SP_INDEX_SLOT_EMPTY;
+	memset(displacements, 0, sizeof(uint32_t) * buckets);
+
+	for(uint64_t i = 0; i < buckets && order[i].size > 0; ++i)
+	{
+		const uint32_t* member = members + bucket_start[order[i].bucket]; // Files in the bucket
+		size_t size = order[i].size;                                      // Number of files in the bucket
+		uint32_t displacement;                                            // Displacement being tried
+
+		// Files with the same URI would never fit, so catch them here.
+		for(size_t j = 0; j < size; ++j)
+		{
+			for(size_t k = j + 1; k < size; ++k)
+			{
+				if(hashes[member[j]] == hashes[member[k]] && __is_same_uri(uris[member[j]], uris[member[k]]))
+				{
+					impact(0, "%s: URI %s is listed more than once\n",
+						SP_INDEX_HEADER_NAMESPACE,
+						uris[member[j]]);
+					goto error;
+				}
+			}
+		}
+
+		for(displacement = 0; displacement < SP_INDEX_DISPLACEMENT_MAX; ++displacement)
+		{
+			size_t placed = 0; // Number of files placed with this displacement
+
+			for(; placed < size; ++placed)
+			{
+				uint64_t slot = __get_slot(hashes[member[placed]], displacement, slots); // Slot of the file
+				if(table[slot] != SP_INDEX_SLOT_EMPTY) break;
+				table[slot] = member[placed];
+			}
+			if(placed == size) break;
+
+			while(placed-- > 0) table[__get_slot(hashes[member[placed]], displacement, slots)] = SP_INDEX_SLOT_EMPTY;
+		}
+		if(displacement == SP_INDEX_DISPLACEMENT_MAX)
+		{
+			impact(0, "%s: Failed to find a perfect hash for URI %s\n",
+				SP_INDEX_HEADER_NAMESPACE,
+				uris[member[0]]);
+			goto error;
+		}
+
+		displacements[order[i].bucket] = displacement;
+	}
+
+	ret = true;
+
+error:
+	free(bucket_start);
+	free(members);
+	free(order);
+
+	return ret;
+}
+
+/*!
+ * \brief Commit the given file to disk.
+ *
+ * \param[in] fd File descriptor of the file
+ *
+ * \return true on success, false if an error occurred
+ */
+static bool __sync_file(int fd)
+{
+	#ifdef HAVE_FDATASYNC
+	return (fdatasync(fd) == 0);
+	#else
+	return (fsync(fd) == 0);
+	#endif // HAVE_FDATASYNC
+}
+
+/*!
+ * \brief Write an index of files.
+ *
+ * \note The index is an immutable table of the files, their URIs, sizes, and
+ * MIME types, with a perfect hash of the URIs. The index is written to a
+ * temporary file and renamed over the given one, so a process which mapped
+ * the old index may keep using it.
+ *
+ * \param[in] path       Name and path of the index to write
+ * \param[in] uris       Uniform Resource Identifiers of the files (each starting with "/")
+ * \param[in] files      Names and paths of the files
+ * \param[in] mime_types MIME types of the files (any of which may be NULL if it is not known)
+ * \param[in] sizes      Sizes (in bytes) of the files
+ * \param[in] n          Number of elements in each array
+ *
+ * \return true if the index was written, false if a URI is listed twice or
+ * an error occurred
+ */
+bool simpleindex_write(
+	const char* path,
+	const char* const* uris,
+	const char* const* files,
+	const char* const* mime_types,
+	const uint64_t* sizes,
+	size_t n)
+{
+	struct simpleindex_header header; // Header of the index
+	struct simpleindex_entry entry;   // File being written
+	uint64_t displacements_offset;    // Offset of the displacements
+	uint64_t table_offset;            // Offset of the slots
+	uint64_t entries_offset;          // Offset of the files
+	uint64_t string_offset;           // Offset of the next string
+	uint64_t* hashes = NULL;          // Hashes of the URIs
+	uint32_t* displacements = NULL;   // Displacement of each bucket
+	uint32_t* table = NULL;           // Number of the file in each slot
+	char* tmp_path = NULL;            // Name and path of the index being written
+	FILE* fp = NULL;                  // Index being written
+	bool ok = false;                  // Was the index written?
+
+	if(n == 0 || n > SIMPLEINDEX_FILES_MAX)
+	{
+		impact(0, "%s: Cannot index %zu files\n",
+			SP_INDEX_HEADER_NAMESPACE,
+			n);
+		return false;
+	}
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SP_INDEX_MAGIC, sizeof(header.magic));
+	header.files = n;
+	header.buckets = (n + SP_INDEX_BUCKET_SIZE - 1) / SP_INDEX_BUCKET_SIZE;
+	header.slots = n + n / 8 + 1;
+	__get_layout(header.files, header.buckets, header.slots, &displacements_offset, &table_offset, &entries_offset, &string_offset);
+
+	hashes = (uint64_t*) malloc(sizeof(uint64_t) * n);
+	displacements = (uint32_t*) malloc(sizeof(uint32_t) * header.buckets);
+	table = (uint32_t*) malloc(sizeof(uint32_t) * header.slots);
+	tmp_path = (char*) malloc(sizeof(char) * (strlen(path) + sizeof(SP_INDEX_TMP_SUFFIX)));
+	if(hashes == NULL || displacements == NULL || table == NULL || tmp_path == NULL)
+	{
+		impact(0, "%s: %s: Failed to allocate memory to index %zu files\n",
+			SP_INDEX_HEADER_NAMESPACE, SP_MAIN_HEADER_MEMORY_ALLOC,
+			n);
+		goto error;
+	}
+
+	header.size = string_offset;
+	for(size_t i = 0; i < n; ++i)
+	{
+		hashes[i] = __hash_uri(uris[i]);
+
+		header.size += strlen(uris[i]) + 1 + strlen(files[i]) + 1;
+		if(mime_types[i]) header.size += strlen(mime_types[i]) + 1;
+	}
+
+	if(__build_hash(uris, hashes, n, header.buckets, header.slots, displacements, table) == false) goto error;
+
+	strcpy(tmp_path, path);
+	strcat(tmp_path, SP_INDEX_TMP_SUFFIX);
+
+	fp = fopen(tmp_path, "wb");
+	if(fp == NULL)
+	{
+		impact(0, "%s: Cannot create %s: %s\n",
+			SP_INDEX_HEADER_NAMESPACE,
+			tmp_path, strerror(errno));
+		goto error;
+	}
+
+	ok = (fwrite(&header, sizeof(header), 1, fp) == 1);
+	if(ok) ok = (fwrite(displacements, sizeof(uint32_t), header.buckets, fp) == header.buckets);
+	if(ok) ok = (fseek(fp, table_offset, SEEK_SET) == 0 && fwrite(table, sizeof(uint32_t), header.slots, fp) == header.slots);
+	if(ok) ok = (fseek(fp, entries_offset, SEEK_SET) == 0);
+	for(size_t i = 0; i < n && ok; ++i)
+	{
+		entry.uri = string_offset;
+		string_offset += strlen(uris[i]) + 1;
+		entry.file = string_offset;
+		string_offset += strlen(files[i]) + 1;
+		entry.mime_type = mime_types[i] ? string_offset : 0;
+		if(mime_types[i]) string_offset += strlen(mime_types[i]) + 1;
+		entry.size = sizes[i];
+
+		ok = (fwrite(&entry, sizeof(entry), 1, fp) == 1);
+	}
+	for(size_t i = 0; i < n && ok; ++i)
+	{
+		ok = (fwrite(uris[i], strlen(uris[i]) + 1, 1, fp) == 1 &&
+			fwrite(files[i], strlen(files[i]) + 1, 1, fp) == 1 &&
+			(mime_types[i] == NULL || fwrite(mime_types[i], strlen(mime_types[i]) + 1, 1, fp) == 1));
+	}
+	if(ok) ok = (fflush(fp) == 0 && __sync_file(fileno(fp)));
+	if(ok) ok = (rename(tmp_path, path) == 0);
+	if(ok == false)
+	{
+		impact(0, "%s: Failed to write the index %s: %s\n",
+			SP_INDEX_HEADER_NAMESPACE,
+			path, strerror(errno));
+		unlink(tmp_path);
+	}
+
+error:
+	if(fp) fclose(fp);
+	free(hashes);
+	free(displacements);
+	free(table);
+	free(tmp_path);
+
+	return ok;
+}
+
+/*!
+ * \brief Map an index into memory.
+ *
+ * \note The index is mapped, not read, so it is loaded in constant time and
+ * its pages are shared with every other process mapping it.
+ *
+ * \param[in] path Name and path of the index (written by simpleindex_write())
+ *
+ * \return the index, or NULL if it cannot be mapped or is not valid
+ */
+simpleindex_t simpleindex_map(const char* path)
+{
+	struct simpleindex* index = NULL;        // Index being mapped
+	struct stat index_status;                // Status of the index
+	const struct simpleindex_header* header; // Header of the index
+	uint64_t displacements_offset;           // Offset of the displacements
+	uint64_t table_offset;                   // Offset of the slots
+	uint64_t entries_offset;                 // Offset of the files
+	uint64_t string_offset;                  // Offset of the strings
+	void* map;                               // Mapping of the index
+	int fd;                                  // File descriptor of the index
+
+	fd = open(path, O_RDONLY);
+	if(fd == -1 || fstat(fd, &index_status) == -1)
+	{
+		impact(0, "%s: Cannot open the index %s: %s\n",
+			SP_INDEX_HEADER_NAMESPACE,
+			path, strerror(errno));
+		if(fd != -1) close(fd);
+		return NULL;
+	}
+	if(index_status.st_size < (off_t) sizeof(struct simpleindex_header))
+	{
+		close(fd);
+		goto invalid_index;
+	}
+
+	map = mmap(NULL, index_status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED)
+	{
+		impact(0, "%s: Cannot map the index %s: %s\n",
+			SP_INDEX_HEADER_NAMESPACE,
+			path, strerror(errno));
+		return NULL;
+	}
+	posix_madvise(map, index_status.st_size, POSIX_MADV_RANDOM);
+
+	index = (struct simpleindex*) malloc(sizeof(struct simpleindex));
+	if(index == NULL)
+	{
+		impact(0, "%s: %s: Failed to allocate memory for the index %s\n",
+			SP_INDEX_HEADER_NAMESPACE, SP_MAIN_HEADER_MEMORY_ALLOC,
+			path);
+		munmap(map, index_status.st_size);
+		return NULL;
+	}
+	index->map = (const char*) map;
+	index->size = index_status.st_size;
+
+	/* Check that every table fits in the index, taking care not to overflow
+	 * while doing so. Each file is checked as it is looked up.
+	 */
+	header = (const struct simpleindex_header*) map;
+	if(memcmp(header->magic, SP_INDEX_MAGIC, sizeof(header->magic)) != 0 ||
+		header->size != index->size ||
+		header->files == 0 || header->files >= SP_INDEX_SLOT_EMPTY ||
+		header->buckets == 0 || header->buckets > index->size / sizeof(uint32_t) ||
+		header->slots < header->files || header->slots > index->size / sizeof(uint32_t) ||
+		header->files > index->size / sizeof(struct simpleindex_entry))
+	{
+		goto invalid_index;
+	}
+	__get_layout(header->files, header->buckets, header->slots, &displacements_offset, &table_offset, &entries_offset, &string_offset);
+	if(string_offset >= index->size || index->map[index->size - 1] != '\0') goto invalid_index;
+
+	index->header = header;
+	index->displacements = (const uint32_t*) (index->map + displacements_offset);
+	index->slots = (const uint32_t*) (index->map + table_offset);
+	index->entries = (const struct simpleindex_entry*) (index->map + entries_offset);
+
+	return index;
+
+invalid_index:
+	impact(0, "%s: %s is not a valid index\n",
+		SP_INDEX_HEADER_NAMESPACE,
+		path);
+	simpleindex_unmap(index);
+
+	return NULL;
+}
+
+/*!
+ * \brief Unmap an index.
+ *
+ * \param[in] index Index to unmap
+ */
+void simpleindex_unmap(simpleindex_t index)
+{
+	if(index == NULL) return;
+
+	munmap((void*) index->map, index->size);
+	free(index);
+}
+
+/*!
+ * \brief Get the number of files in an index.
+ *
+ * \param[in] index Index to act on
+ *
+ * \return the number of files in the index
+ */
+size_t simpleindex_get_count(const simpleindex_t index)
+{
+	return (size_t) index->header->files;
+}
+
+/*!
+ * \brief Find a file in an index.
+ *
+ * \note An index may not be trusted, so every offset is checked before it
+ * is followed. (The index is checked to end with a terminator when it is
+ * mapped, so every string in it is terminated.)
+ *
+ * \param[in] index      Index to search
+ * \param[in] uri        Uniform Resource Identifier of the file
+ * \param[out] file      Name and path of the file (valid until the index is unmapped)
+ * \param[out] mime_type MIME type of the file (NULL if it is not known)
+ *
+ * \return true if the file was found, false if there is no file with the URI
+ */
+bool simpleindex_find(const simpleindex_t index, const char* uri, const char** file, const char** mime_type)
+{
+	const struct simpleindex_entry* entry; // File in the slot of the URI
+	uint64_t hash;                         // Hash of the URI
+	uint32_t displacement;                 // Displacement of the URI's bucket
+	uint32_t number;                       // Number of the file in the slot of the URI
+
+	if(index == NULL || uri == NULL) return false;
+
+	hash = __hash_uri(uri);
+	displacement = index->displacements[__mix_hash(hash) % index->header->buckets];
+	number = index->slots[__get_slot(hash, displacement, index->header->slots)];
+	if(number >= index->header->files) return false;
+
+	entry = &index->entries[number];
+	if(entry->uri >= index->size || entry->file >= index->size || entry->mime_type >= index->size) return false;
+	if(__is_same_uri(index->map + entry->uri, uri) == false) return false;
+
+	*file = index->map + entry->file;
+	*mime_type = entry->mime_type ? index->map + entry->mime_type : NULL;
+
+	return true;
+}
@@ -0,0 +1,52 @@
+/*
+ * SimplePost - A Simple HTTP Server
+ *
+ * Copyright (C) 2016 Karl Lenz.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have recieved a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ */
+
+#ifndef _SIMPLEINDEX_H_
+#define _SIMPLEINDEX_H_
+
+#include <sys/types.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+
+/// Maximum number of files in an index
+#define SIMPLEINDEX_FILES_MAX (UINT32_MAX - 1)
+
+/*!
+ * \brief Immutable index of files mapped into memory
+ */
+typedef struct simpleindex* simpleindex_t;
+
+bool simpleindex_write(
+	const char* path,
+	const char* const* uris,
+	const char* const* files,
+	const char* const* mime_types,
+	const uint64_t* sizes,
+	size_t n);
+
+simpleindex_t simpleindex_map(const char* path);
+void simpleindex_unmap(simpleindex_t index);
+
+size_t simpleindex_get_count(const simpleindex_t index);
+bool simpleindex_find(const simpleindex_t index, const char* uri, const char** file, const char** mime_type);
+
+#endif // _SIMPLEINDEX_H_
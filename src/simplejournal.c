@@ -0,0 +1,762 @@
+/*
+ * SimplePost - A Simple HTTP Server
+ *
+ * Copyright (C) 2016 Karl Lenz.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have recieved a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ */
+
+#include "simplejournal.h"
+#include "impact.h"
+#include "config.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+/// Journal namespace header
+#define SP_JOURNAL_HEADER_NAMESPACE "SimplePost::Journal"
+
+/// Signature at the start of every journal
+#define SP_JOURNAL_MAGIC           "SPJRNL01"
+
+/// Suffix of the temporary file the journal is compacted into
+#define SP_JOURNAL_TMP_SUFFIX      ".tmp"
+
+/// Milliseconds between commits of the journal to disk
+#define SP_JOURNAL_COMMIT_INTERVAL 100
+
+/// Minimum number of records appended to the journal before it is compacted
+#define SP_JOURNAL_COMPACT_RECORDS 65536
+
+/// Maximum length of a string in a journal record
+#define SP_JOURNAL_STRING_MAX      65536
+
+/*!
+ * \brief Header of a record in the journal
+ *
+ * The header is followed by the name and path of the file and then its URI
+ * (neither of which is terminated).
+ */
+struct simplejournal_record
+{
+	/// FNV-1a hash of the rest of the record
+	uint32_t checksum;
+
+	/// Type of record (enum simplejournal_type)
+	uint32_t type;
+
+	/// New COUNT of the file (SIMPLEJOURNAL_SERVE), or its expiry time in seconds since the Epoch (SIMPLEJOURNAL_EXPIRE)
+	uint32_t count;
+
+	/// How the file is served (SIMPLEJOURNAL_FLAG_* for SIMPLEJOURNAL_SERVE, 0 otherwise)
+	uint32_t flags;
+
+	/// Length of the name and path of the file
+	uint32_t file_length;
+
+	/// Length of the URI of the file
+	uint32_t uri_length;
+};
+
+/*!
+ * \brief Journal of changes to a list of files
+ */
+struct simplejournal
+{
+	/// Name and path of the journal
+	char* path;
+
+	/// Journal being appended to (NULL if the journal is not started)
+	FILE* fp;
+
+	/// Snapshot being written by simplejournal_snapshot() (with the caller's lock)
+	FILE* snapshot_fp;
+
+	/// Number of records appended to the journal since it was compacted
+	size_t records;
+
+	/// Number of records the journal was compacted into (only changed while compacting)
+	size_t snapshot_records;
+
+	/// Have records been appended to the journal since it was last committed?
+	bool is_dirty;
+
+	/// Did we fail to append a record to the journal?
+	bool is_failed;
+
+	/// Should the journal thread exit?
+	bool is_stopping;
+
+	/// Lock the caller holds around every change to its list of files
+	pthread_mutex_t* lock;
+
+	/// Function writing a snapshot of the list of files
+	simplejournal_snapshot_t snapshot;
+
+	/// Argument to pass to the function
+	void* arg;
+
+	/// Thread committing and compacting the journal
+	pthread_t thread;
+
+	/// Mutex for fp, records, is_dirty, is_failed, and is_stopping
+	pthread_mutex_t mutex;
+
+	/// Condition signaled when is_stopping is set
+	pthread_cond_t cond;
+};
+
+/*!
+ * \brief Continue an FNV-1a hash of journal data.
+ *
+ * \param[in] hash Hash of the preceding data
+ * \param[in] data Data to hash
+ * \param[in] size Size (in bytes) of data
+ *
+ * \return 32-bit FNV-1a hash of the preceding data and this data
+ */
+static uint32_t __hash_record(uint32_t hash, const void* data, size_t size)
+{
+	const unsigned char* p = (const unsigned char*) data; // Byte to hash
+
+	for(; size > 0; --size, ++p)
+	{
+		hash ^= *p;
+		hash *= 16777619U; // FNV prime
+	}
+
+	return hash;
+}
+
+/*!
+ * \brief Write a record to a journal.
+ *
+ * \param[in] fp    Journal to write to
+ * \param[in] type  Type of record to write
+ * \param[in] file  Name and path of the file (may be NULL)
+ * \param[in] uri   Uniform Resource Identifier of the file
+ * \param[in] count New COUNT of the file
+ * \param[in] flags How the file is served (SIMPLEJOURNAL_FLAG_*)
+ *
+ * \return true if the record was written, false if an error occurred
+ */
+static bool __write_record(
+	FILE* fp,
+	enum simplejournal_type type,
+	const char* file,
+	const char* uri,
+	unsigned int count,
+	unsigned int flags)
+{
+	struct simplejournal_record record; // Header of the record
+
+	record.type = (uint32_t) type;
+	record.count = (uint32_t) count;
+	record.flags = (uint32_t) flags;
+	record.file_length = file ? (uint32_t) strlen(file) : 0;
+	record.uri_length = (uint32_t) strlen(uri);
+
+	record.checksum = __hash_record(2166136261U, &record.type, sizeof(record) - sizeof(record.checksum));
+	record.checksum = __hash_record(record.checksum, file, record.file_length);
+	record.checksum = __hash_record(record.checksum, uri, record.uri_length);
+
+	if(fwrite(&record, sizeof(record), 1, fp) != 1) return false;
+	if(record.file_length && fwrite(file, record.file_length, 1, fp) != 1) return false;
+	if(fwrite(uri, record.uri_length, 1, fp) != 1) return false;
+
+	return true;
+}
+
+/*!
+ * \brief Commit the given file to disk.
+ *
+ * \param[in] fd File descriptor of the file
+ *
+ * \return true on success, false if an error occurred
+ */
+static bool __sync_file(int fd)
+{
+	#ifdef HAVE_FDATASYNC
+	return (fdatasync(fd) == 0);
+	#else
+	return (fsync(fd) == 0);
+	#endif // HAVE_FDATASYNC
+}
+
+/*!
+ * \brief Commit the directory containing the given file to disk.
+ *
+ * \note This makes a file which was just created or renamed durable.
+ *
+ * \param[in] path Name and path of the file
+ *
+ * \return true on success, false if an error occurred
+ */
+static bool __sync_directory(const char* path)
+{
+	const char* slash = strrchr(path, '/'); // Separator between the directory and the file
+	size_t length;                          // Length of the name of the directory
+	char* directory;                        // Name of the directory
+	int fd;                                 // File descriptor of the directory
+	bool ret = false;                       // Was the directory committed?
+
+	if(slash == NULL)
+	{
+		path = ".";
+		length = 1;
+	}
+	else if(slash == path) length = 1;
+	else length = slash - path;
+
+	directory = (char*) malloc(sizeof(char) * (length + 1));
+	if(directory == NULL) return false;
+
+	memcpy(directory, path, length);
+	directory[length] = '\0';
+
+	fd = open(directory, O_RDONLY);
+	if(fd >= 0)
+	{
+		ret = (fsync(fd) == 0);
+		close(fd);
+	}
+
+	free(directory);
+
+	return ret;
+}
+
+/*!
+ * \brief Replace a journal with a snapshot of the list of files.
+ *
+ * \note The snapshot is written to a temporary file while the caller's lock
+ * is held, then committed to disk and renamed over the journal while only the
+ * journal is locked. Changes which do not need to be appended to the journal
+ * are never held up by the disk.
+ *
+ * \param[in] journal Journal to compact
+ *
+ * \return true on success, false if an error occurred (in which case the old
+ * journal is still being appended to)
+ */
+static bool __compact(simplejournal_t journal)
+{
+	char* tmp_path; // Name and path of the snapshot
+	FILE* fp;       // Snapshot
+	bool ok;        // Was the snapshot written?
+
+	tmp_path = (char*) malloc(sizeof(char) * (strlen(journal->path) + sizeof(SP_JOURNAL_TMP_SUFFIX)));
+	if(tmp_path == NULL)
+	{
+		impact(0, "%s: %s: Failed to allocate memory to compact the journal %s\n",
+			SP_JOURNAL_HEADER_NAMESPACE, SP_MAIN_HEADER_MEMORY_ALLOC,
+			journal->path);
+		return false;
+	}
+
+	strcpy(tmp_path, journal->path);
+	strcat(tmp_path, SP_JOURNAL_TMP_SUFFIX);
+
+	fp = fopen(tmp_path, "wb");
+	if(fp == NULL)
+	{
+		impact(0, "%s: Cannot create %s: %s\n",
+			SP_JOURNAL_HEADER_NAMESPACE,
+			tmp_path, strerror(errno));
+		free(tmp_path);
+		return false;
+	}
+
+	pthread_mutex_lock(journal->lock);
+	journal->snapshot_fp = fp;
+	journal->snapshot_records = 0;
+	ok = (fwrite(SP_JOURNAL_MAGIC, sizeof(SP_JOURNAL_MAGIC) - 1, 1, fp) == 1);
+	if(ok) ok = journal->snapshot(journal, journal->arg);
+	journal->snapshot_fp = NULL;
+
+	/* Lock the journal before the caller's lock is released, so that every
+	 * change made after the snapshot was taken is appended to the new journal.
+	 */
+	pthread_mutex_lock(&journal->mutex);
+	pthread_mutex_unlock(journal->lock);
+
+	if(ok) ok = (fflush(fp) == 0 && __sync_file(fileno(fp)));
+	if(ok) ok = (rename(tmp_path, journal->path) == 0);
+	if(ok)
+	{
+		if(__sync_directory(journal->path) == false)
+		{
+			impact(1, "%s: Failed to commit the directory of %s: %s\n",
+				SP_JOURNAL_HEADER_NAMESPACE,
+				journal->path, strerror(errno));
+		}
+
+		if(journal->fp) fclose(journal->fp);
+		journal->fp = fp;
+		journal->records = 0;
+		journal->is_dirty = false;
+		journal->is_failed = false;
+	}
+	else
+	{
+		impact(0, "%s: Failed to compact the journal %s: %s\n",
+			SP_JOURNAL_HEADER_NAMESPACE,
+			journal->path, strerror(errno));
+
+		fclose(fp);
+		unlink(tmp_path);
+	}
+	pthread_mutex_unlock(&journal->mutex);
+
+	free(tmp_path);
+
+	return ok;
+}
+
+/*!
+ * \brief Commit and compact a journal until it is stopped.
+ *
+ * \note Records are appended to the journal by the threads which change the
+ * list of files, but only this thread waits for them to reach the disk. Every
+ * change made in an interval is committed together (group commit), so a crash
+ * loses at most the last SP_JOURNAL_COMMIT_INTERVAL milliseconds of changes.
+ * The journal is compacted once the records appended to it outnumber those in
+ * its snapshot (and SP_JOURNAL_COMPACT_RECORDS), which keeps replay time
+ * proportional to the number of files in the list.
+ *
+ * \param[in] p Journal to act on (simplejournal_t)
+ *
+ * \return NULL
+ */
+static void* __run(void* p)
+{
+	simplejournal_t journal = (simplejournal_t) p; // Properly cast journal handle
+	struct timespec deadline;                      // Time of the next commit
+	bool compact;                                  // Should the journal be compacted?
+
+	pthread_mutex_lock(&journal->mutex);
+	for(;;)
+	{
+		if(journal->is_stopping == false)
+		{
+			clock_gettime(CLOCK_REALTIME, &deadline);
+			deadline.tv_nsec += SP_JOURNAL_COMMIT_INTERVAL * 1000000L;
+			deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+			deadline.tv_nsec %= 1000000000L;
+			pthread_cond_timedwait(&journal->cond, &journal->mutex, &deadline);
+		}
+
+		if(journal->is_dirty)
+		{
+			int fd = fileno(journal->fp); // File descriptor of the journal
+			bool ok;                      // Was the journal committed?
+
+			journal->is_dirty = false;
+			ok = (fflush(journal->fp) == 0);
+
+			/* Only this thread replaces the journal, so it is safe to commit
+			 * it without holding the lock. Changes may keep being appended to
+			 * it in the meantime.
+			 */
+			pthread_mutex_unlock(&journal->mutex);
+			if(ok) ok = __sync_file(fd);
+			pthread_mutex_lock(&journal->mutex);
+
+			if(ok == false && journal->is_failed == false)
+			{
+				impact(0, "%s: Failed to commit the journal %s: %s\n",
+					SP_JOURNAL_HEADER_NAMESPACE,
+					journal->path, strerror(errno));
+				journal->is_failed = true;
+			}
+		}
+
+		if(journal->is_stopping) break;
+
+		compact = journal->is_failed ||
+			(journal->records > SP_JOURNAL_COMPACT_RECORDS && journal->records > journal->snapshot_records);
+		if(compact)
+		{
+			pthread_mutex_unlock(&journal->mutex);
+			compact = __compact(journal);
+			pthread_mutex_lock(&journal->mutex);
+
+			/* If the compaction failed, do not retry it until another append
+			 * fails or enough records are appended again.
+			 */
+			if(compact == false)
+			{
+				journal->records = 0;
+				journal->is_failed = false;
+			}
+		}
+	}
+	pthread_mutex_unlock(&journal->mutex);
+
+	return NULL;
+}
+
+/*!
+ * \brief Initialize a journal of changes to a list of files.
+ *
+ * \note Nothing is read or written until the journal is replayed or started.
+ *
+ * \param[in] path     Name and path of the journal
+ * \param[in] lock     Lock the caller holds around every change to its list of files
+ * \param[in] snapshot Function writing a snapshot of the list when the journal is compacted
+ * \param[in] arg      Argument to pass to the function
+ *
+ * \return the journal, or NULL if we failed to allocate it
+ */
+simplejournal_t simplejournal_init(const char* path, pthread_mutex_t* lock, simplejournal_snapshot_t snapshot, void* arg)
+{
+	simplejournal_t journal; // Journal to initialize
+
+	journal = (simplejournal_t) calloc(1, sizeof(struct simplejournal));
+	if(journal == NULL) return NULL;
+
+	journal->path = (char*) malloc(sizeof(char) * (strlen(path) + 1));
+	if(journal->path == NULL)
+	{
+		free(journal);
+		return NULL;
+	}
+	strcpy(journal->path, path);
+
+	journal->lock = lock;
+	journal->snapshot = snapshot;
+	journal->arg = arg;
+
+	pthread_mutex_init(&journal->mutex, NULL);
+	pthread_cond_init(&journal->cond, NULL);
+
+	return journal;
+}
+
+/*!
+ * \brief Stop a journal (if it is started) and free it.
+ *
+ * \warning The caller must not hold its lock.
+ *
+ * \param[in] journal Journal to free
+ */
+void simplejournal_free(simplejournal_t journal)
+{
+	if(journal == NULL) return;
+
+	simplejournal_stop(journal);
+
+	pthread_mutex_destroy(&journal->mutex);
+	pthread_cond_destroy(&journal->cond);
+	free(journal->path);
+	free(journal);
+}
+
+/*!
+ * \brief Replay the records of a journal.
+ *
+ * \note Replay stops at the first incomplete or damaged record, which is
+ * what a crash in the middle of an append leaves behind. Everything before it
+ * is replayed. A journal which does not exist yet is empty.
+ *
+ * \warning The journal must not be started.
+ *
+ * \param[in] journal Journal to replay
+ * \param[in] replay  Function to call with each record
+ * \param[in] arg     Argument to pass to the function
+ *
+ * \return true on success, false if the file is not a journal or an error
+ * occurred
+ */
+bool simplejournal_replay(simplejournal_t journal, simplejournal_replay_t replay, void* arg)
+{
+	char magic[sizeof(SP_JOURNAL_MAGIC) - 1]; // Signature of the journal
+	struct simplejournal_record record;       // Header of the record being replayed
+	FILE* fp;                                 // Journal being replayed
+	char* file = NULL;                        // Name and path of the file in the record
+	char* uri = NULL;                         // URI of the file in the record
+	size_t records = 0;                       // Number of records replayed
+	size_t length;                            // Number of bytes read
+	bool is_damaged = true;                   // Did replay stop before the end of the journal?
+	bool ret = false;                         // Was the journal replayed?
+
+	fp = fopen(journal->path, "rb");
+	if(fp == NULL)
+	{
+		if(errno == ENOENT) return true;
+
+		impact(0, "%s: Cannot open the journal %s: %s\n",
+			SP_JOURNAL_HEADER_NAMESPACE,
+			journal->path, strerror(errno));
+		return false;
+	}
+
+	length = fread(magic, 1, sizeof(magic), fp);
+	if(ferror(fp))
+	{
+		impact(0, "%s: Cannot read the journal %s: %s\n",
+			SP_JOURNAL_HEADER_NAMESPACE,
+			journal->path, strerror(errno));
+		goto error;
+	}
+
+	// An empty journal is a new journal.
+	if(length == 0)
+	{
+		ret = true;
+		goto error;
+	}
+
+	if(length != sizeof(magic) || memcmp(magic, SP_JOURNAL_MAGIC, sizeof(magic)) != 0)
+	{
+		impact(0, "%s: %s is not a journal\n",
+			SP_JOURNAL_HEADER_NAMESPACE,
+			journal->path);
+		goto error;
+	}
+
+	file = (char*) malloc(sizeof(char) * (SP_JOURNAL_STRING_MAX + 1));
+	uri = (char*) malloc(sizeof(char) * (SP_JOURNAL_STRING_MAX + 1));
+	if(file == NULL || uri == NULL)
+	{
+		impact(0, "%s: %s: Failed to allocate memory to replay the journal %s\n",
+			SP_JOURNAL_HEADER_NAMESPACE, SP_MAIN_HEADER_MEMORY_ALLOC,
+			journal->path);
+		goto error;
+	}
+
+	for(;;)
+	{
+		uint32_t checksum; // Checksum of the record read
+
+		length = fread(&record, 1, sizeof(record), fp);
+		if(length == 0 && feof(fp))
+		{
+			is_damaged = false;
+			break;
+		}
+		if(length != sizeof(record)) break;
+
+		if(record.file_length > SP_JOURNAL_STRING_MAX || record.uri_length > SP_JOURNAL_STRING_MAX) break;
+		if(record.file_length && fread(file, record.file_length, 1, fp) != 1) break;
+		if(record.uri_length == 0 || fread(uri, record.uri_length, 1, fp) != 1) break;
+
+		checksum = __hash_record(2166136261U, &record.type, sizeof(record) - sizeof(record.checksum));
+		checksum = __hash_record(checksum, file, record.file_length);
+		checksum = __hash_record(checksum, uri, record.uri_length);
+		if(checksum != record.checksum) break;
+
+		file[record.file_length] = '\0';
+		uri[record.uri_length] = '\0';
+		++records;
+
+		if(record.type < SIMPLEJOURNAL_SERVE || record.type > SIMPLEJOURNAL_EXPIRE)
+		{
+			impact(1, "%s: Skipping unknown record type %u in the journal %s\n",
+				SP_JOURNAL_HEADER_NAMESPACE,
+				record.type, journal->path);
+			continue;
+		}
+
+		replay((enum simplejournal_type) record.type, record.file_length ? file : NULL, uri, record.count, record.flags, arg);
+	}
+
+	if(ferror(fp))
+	{
+		impact(0, "%s: Cannot read the journal %s: %s\n",
+			SP_JOURNAL_HEADER_NAMESPACE,
+			journal->path, strerror(errno));
+		goto error;
+	}
+	if(is_damaged)
+	{
+		impact(0, "%s: Ignoring damaged records after record %zu of the journal %s\n",
+			SP_JOURNAL_HEADER_NAMESPACE,
+			records, journal->path);
+	}
+
+	impact(2, "%s: Replayed %zu records from the journal %s\n",
+		SP_JOURNAL_HEADER_NAMESPACE,
+		records, journal->path);
+
+	ret = true;
+
+error:
+	free(file);
+	free(uri);
+	fclose(fp);
+
+	return ret;
+}
+
+/*!
+ * \brief Start appending changes to a journal.
+ *
+ * \note The journal is replaced with a compact snapshot of the list of files
+ * before the journal thread is started.
+ *
+ * \warning The caller must not hold its lock.
+ *
+ * \param[in] journal Journal to start
+ *
+ * \return true on success, false if an error occurred (in which case the
+ * journal is not started)
+ */
+bool simplejournal_start(simplejournal_t journal)
+{
+	if(__compact(journal) == false) return false;
+
+	journal->is_stopping = false;
+	if(pthread_create(&journal->thread, NULL, &__run, (void*) journal) != 0)
+	{
+		impact(0, "%s: Failed to start the journal thread\n",
+			SP_JOURNAL_HEADER_NAMESPACE);
+
+		pthread_mutex_lock(&journal->mutex);
+		fclose(journal->fp);
+		journal->fp = NULL;
+		pthread_mutex_unlock(&journal->mutex);
+
+		return false;
+	}
+
+	return true;
+}
+
+/*!
+ * \brief Stop appending changes to a journal.
+ *
+ * \note Every change already appended to the journal is committed to disk
+ * before it is closed. It is not an error if the journal is not started.
+ *
+ * \param[in] journal Journal to stop
+ */
+void simplejournal_stop(simplejournal_t journal)
+{
+	if(journal->fp == NULL) return;
+
+	pthread_mutex_lock(&journal->mutex);
+	journal->is_stopping = true;
+	pthread_cond_signal(&journal->cond);
+	pthread_mutex_unlock(&journal->mutex);
+
+	pthread_join(journal->thread, NULL);
+
+	pthread_mutex_lock(&journal->mutex);
+	fclose(journal->fp);
+	journal->fp = NULL;
+	pthread_mutex_unlock(&journal->mutex);
+}
+
+/*!
+ * \brief Lock a journal, so that no record is appended to it or committed.
+ *
+ * \param[in] journal Journal to lock
+ */
+void simplejournal_lock(simplejournal_t journal)
+{
+	pthread_mutex_lock(&journal->mutex);
+}
+
+/*!
+ * \brief Unlock a journal locked by simplejournal_lock().
+ *
+ * \param[in] journal Journal to unlock
+ */
+void simplejournal_unlock(simplejournal_t journal)
+{
+	pthread_mutex_unlock(&journal->mutex);
+}
+
+/*!
+ * \brief Append a change to the list of files to a journal.
+ *
+ * \note The record is only buffered here. The journal thread commits the
+ * buffered records to disk every SP_JOURNAL_COMMIT_INTERVAL milliseconds, so
+ * the caller never waits for the disk. Nothing is appended if the journal is
+ * not started.
+ *
+ * \warning The caller must hold its lock, so that records are appended in the
+ * same order as the changes they describe are made.
+ *
+ * \param[in] journal Journal to append to
+ * \param[in] type    Type of change made
+ * \param[in] file    Name and path of the file changed (may be NULL)
+ * \param[in] uri     Uniform Resource Identifier of the file changed
+ * \param[in] count   New COUNT of the file, or its expiry time
+ * \param[in] flags   How the file is served (SIMPLEJOURNAL_FLAG_*)
+ */
+void simplejournal_append(
+	simplejournal_t journal,
+	enum simplejournal_type type,
+	const char* file,
+	const char* uri,
+	unsigned int count,
+	unsigned int flags)
+{
+	pthread_mutex_lock(&journal->mutex);
+	if(journal->fp)
+	{
+		if(__write_record(journal->fp, type, file, uri, count, flags))
+		{
+			++(journal->records);
+			journal->is_dirty = true;
+		}
+		else if(journal->is_failed == false)
+		{
+			impact(0, "%s: Failed to write to the journal %s: %s\n",
+				SP_JOURNAL_HEADER_NAMESPACE,
+				journal->path, strerror(errno));
+			journal->is_failed = true;
+		}
+	}
+	pthread_mutex_unlock(&journal->mutex);
+}
+
+/*!
+ * \brief Write a file in the list to the snapshot a journal is compacted into.
+ *
+ * \warning This function may only be called by the function given to
+ * simplejournal_init() to write the snapshot.
+ *
+ * \param[in] journal Journal being compacted
+ * \param[in] type    Type of record (SIMPLEJOURNAL_SERVE or SIMPLEJOURNAL_EXPIRE)
+ * \param[in] file    Name and path of the file (may be NULL)
+ * \param[in] uri     Uniform Resource Identifier of the file
+ * \param[in] count   COUNT of the file, or its expiry time
+ * \param[in] flags   How the file is served (SIMPLEJOURNAL_FLAG_*)
+ *
+ * \return true if the record was written, false if an error occurred
+ */
+bool simplejournal_snapshot(
+	simplejournal_t journal,
+	enum simplejournal_type type,
+	const char* file,
+	const char* uri,
+	unsigned int count,
+	unsigned int flags)
+{
+	if(__write_record(journal->snapshot_fp, type, file, uri, count, flags) == false) return false;
+	++(journal->snapshot_records);
+
+	return true;
+}
@@ -0,0 +1,114 @@
+/*
+ * SimplePost - A Simple HTTP Server
+ *
+ * Copyright (C) 2016 Karl Lenz.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have recieved a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ */
+
+#ifndef _SIMPLEJOURNAL_H_
+#define _SIMPLEJOURNAL_H_
+
+#include <sys/types.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+
+/// Flag of a SIMPLEJOURNAL_SERVE record: the file is read with O_DIRECT
+#define SIMPLEJOURNAL_FLAG_DIRECT 0x1
+
+/*!
+ * \brief Journal of changes to a list of files
+ */
+typedef struct simplejournal* simplejournal_t;
+
+/*!
+ * \brief Types of records in a journal
+ */
+enum simplejournal_type
+{
+	/// A file was inserted into the list, or its COUNT was changed
+	SIMPLEJOURNAL_SERVE = 1,
+
+	/// A file was purged from the list
+	SIMPLEJOURNAL_PURGE = 2,
+
+	/// A file with a limited COUNT was downloaded
+	SIMPLEJOURNAL_DOWNLOAD = 3,
+
+	/// The expiry time of a file was set (always follows its SIMPLEJOURNAL_SERVE record)
+	SIMPLEJOURNAL_EXPIRE = 4
+};
+
+/*!
+ * \brief Function called by simplejournal_replay() for each record
+ *
+ * \param[in] type  Type of change made
+ * \param[in] file  Name and path of the file changed (NULL if the record has none)
+ * \param[in] uri   Uniform Resource Identifier of the file changed
+ * \param[in] count New COUNT of the file, or its expiry time
+ * \param[in] flags How the file is served (SIMPLEJOURNAL_FLAG_*)
+ * \param[in] arg   Argument given to simplejournal_replay()
+ */
+typedef void (*simplejournal_replay_t)(
+	enum simplejournal_type type,
+	const char* file,
+	const char* uri,
+	unsigned int count,
+	unsigned int flags,
+	void* arg);
+
+/*!
+ * \brief Function writing a snapshot of the list of files when a journal is
+ * compacted
+ *
+ * The function is called with the lock of the journal held, and should hand
+ * every file in the list to simplejournal_snapshot().
+ *
+ * \param[in] journal Journal being compacted
+ * \param[in] arg     Argument given to simplejournal_init()
+ *
+ * \return true if the snapshot was written, false if an error occurred
+ */
+typedef bool (*simplejournal_snapshot_t)(simplejournal_t journal, void* arg);
+
+simplejournal_t simplejournal_init(const char* path, pthread_mutex_t* lock, simplejournal_snapshot_t snapshot, void* arg);
+void simplejournal_free(simplejournal_t journal);
+
+bool simplejournal_replay(simplejournal_t journal, simplejournal_replay_t replay, void* arg);
+
+bool simplejournal_start(simplejournal_t journal);
+void simplejournal_stop(simplejournal_t journal);
+
+void simplejournal_lock(simplejournal_t journal);
+void simplejournal_unlock(simplejournal_t journal);
+
+void simplejournal_append(
+	simplejournal_t journal,
+	enum simplejournal_type type,
+	const char* file,
+	const char* uri,
+	unsigned int count,
+	unsigned int flags);
+bool simplejournal_snapshot(
+	simplejournal_t journal,
+	enum simplejournal_type type,
+	const char* file,
+	const char* uri,
+	unsigned int count,
+	unsigned int flags);
+
+#endif // _SIMPLEJOURNAL_H_
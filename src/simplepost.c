@@ -19,8 +19,20 @@
  * Boston, MA 021110-1307, USA.
  */
 
+// Needed for sched_setaffinity(), cpu_set_t, and O_DIRECT
+#define _GNU_SOURCE
+
 #include "simplepost.h"
 #include "simplestr.h"
+#include "simplesign.h"
+#include "simplering.h"
+#include "simpletimer.h"
+#include "simpletrie.h"
+#include "simpleclaim.h"
+#include "simplewatch.h"
+#include "simplejournal.h"
+#include "simpleindex.h"
+#include "simpleshare.h"
 #include "impact.h"
 #include "config.h"
 
@@ -28,17 +40,24 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/file.h>
 #include <netinet/in.h>
 #include <microhttpd.h>
 #include <pthread.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <string.h>
 #include <netdb.h>
 #include <fcntl.h>
+#include <signal.h>
 #include <stdio.h>
 #include <errno.h>
+#include <time.h>
+#include <fnmatch.h>
 
 #if defined(HAVE_IFADDRS_H) && \
     defined(HAVE_NET_IF_H)  && \
@@ -62,6 +81,29 @@
 #include <magic.h>
 #endif
 
+#ifdef HAVE_STRUCT_TCP_INFO_TCPI_BYTES_ACKED
+#include <linux/tcp.h>
+#else
+#include <netinet/tcp.h>
+#endif
+
+#ifdef HAVE_SCHED_SETAFFINITY
+#include <sched.h>
+#include <dirent.h>
+#include <ctype.h>
+#endif
+
+#if defined(HAVE_AIO_READ) && \
+    defined(O_DIRECT)
+#define HAVE_DIRECT_IO_SUPPORT
+#else
+#undef HAVE_DIRECT_IO_SUPPORT
+#endif
+
+#ifdef HAVE_DIRECT_IO_SUPPORT
+#include <aio.h>
+#endif
+
 /// SimplePost namespace header
 #define SP_HTTP_HEADER_NAMESPACE  "SimplePost::HTTP"
 
@@ -460,36 +502,118 @@ static enum simplepost_addrerr __get_default_address(char** addr, size_t* size)
  */
 struct simplepost_serve
 {
-	/// Name and path of the file on the filesystem
+	/// Name and path of the file on the filesystem (stored in strings)
 	char* file;
 
-	/// Uniform Resource Identifier assigned to the file
+	/// Uniform Resource Identifier assigned to the file (stored in strings, possibly as the end of file)
 	char* uri;
 
+	/// MIME type of the file (NULL until it is first downloaded)
+	char* mime_type;
+
+	/// Next file in the same bucket of simplepost::files_index
+	struct simplepost_serve* hash_next;
+
+	/// Timer in simplepost::timers which stops serving the file at its expiry time (NULL if it never expires)
+	simpletimer_t timer;
+
+	/// Serial number assigned when the file was inserted into the list
+	uint64_t id;
+
 	/// Number of times the file may be downloaded
 	unsigned int count;
 
+	/// Downloads of the file reserved for clients (see simpleclaim_lock())
+	struct simpleclaim_list claims;
+
+	/// Number of cursors positioned on this element
+	unsigned int pins;
+
+	/// Slot of the file in simplepost::shared (0 if the file is not shared)
+	uint32_t shared_slot;
+
+	/// Has this element been removed while cursors were positioned on it?
+	bool removed;
+
+	/// Should the file be read with O_DIRECT, bypassing the page cache?
+	bool direct;
+
+	/// File in simplepost::watch (NULL if changes to it are not watched)
+	simplewatch_file_t watch;
 
 	/// Next file in the doubly-linked list
 	struct simplepost_serve* next;
 
 	/// Previous file in the doubly-linked list
 	struct simplepost_serve* prev;
+
+
+	/// Storage for file and uri, allocated along with the element
+	char strings[];
 };
 
 /*!
- * \brief Initialize a blank SimpleServe instance.
+ * \brief Initialize a SimpleServe instance.
+ *
+ * \note The element and both of its strings are allocated at once. A URI
+ * which is the end of the name and path of the file, as it is when the file
+ * is served on its base name, is not stored a second time.
+ *
+ * \param[in] file Name and path of the file on the filesystem (optional)
+ * \param[in] uri
+ * \parblock
+ * Uniform Resource Identifier of the file (optional)
+ *
+ * A "/" is prepended to the URI if it does not already start with one.
+ * \endparblock
  *
  * \return a new instance on success, or NULL if we failed to allocate the
  * requested memory
  */
-static struct simplepost_serve* __simplepost_serve_init()
+static struct simplepost_serve* __simplepost_serve_init(const char* file, const char* uri)
 {
-	struct simplepost_serve* spsp = (struct simplepost_serve*) malloc(sizeof(struct simplepost_serve));
+	struct simplepost_serve* spsp;                   // New instance
+	size_t file_size = file ? strlen(file) + 1 : 0;  // Number of bytes to store the file in
+	size_t uri_length = uri ? strlen(uri) : 0;       // Length of the URI
+	size_t uri_size = 0;                             // Number of bytes to store the URI in
+	bool is_uri_shared = false;                      // Is the URI the end of the file?
+
+	if(uri)
+	{
+		is_uri_shared = (uri[0] == '/' && file && file_size > uri_length &&
+			strcmp(file + file_size - 1 - uri_length, uri) == 0);
+		if(is_uri_shared == false) uri_size = uri_length + ((uri[0] == '/') ? 1 : 2);
+	}
+
+	spsp = (struct simplepost_serve*) malloc(sizeof(struct simplepost_serve) + file_size + uri_size);
 	if(spsp == NULL) return NULL;
 
 	memset(spsp, 0, sizeof(struct simplepost_serve));
 
+	if(file)
+	{
+		spsp->file = spsp->strings;
+		memcpy(spsp->file, file, file_size);
+	}
+
+	if(is_uri_shared)
+	{
+		spsp->uri = spsp->file + file_size - 1 - uri_length;
+	}
+	else if(uri)
+	{
+		spsp->uri = spsp->strings + file_size;
+		if(uri[0] == '/')
+		{
+			memcpy(spsp->uri, uri, uri_length + 1);
+		}
+		else
+		{
+			spsp->uri[0] = '/';
+			memcpy(spsp->uri + 1, uri, uri_length + 1);
+		}
+	}
+
 	return spsp;
 }
 
@@ -512,8 +636,7 @@ static void __simplepost_serve_free(struct simplepost_serve* spsp)
 		struct simplepost_serve* p = spsp;
 		spsp = spsp->next;
 
-		if(p->file) free(p->file);
-		if(p->uri) free(p->uri);
+		if(p->mime_type) free(p->mime_type);
 		free(p);
 	}
 }
@@ -538,7 +661,7 @@ static struct simplepost_serve* __simplepost_serve_insert_before(
 {
 	if(spsp2 == NULL)
 	{
-		spsp2 = __simplepost_serve_init();
+		spsp2 = __simplepost_serve_init(NULL, NULL);
 		if(spsp2 == NULL) return NULL;
 	}
 
@@ -579,7 +702,7 @@ static struct simplepost_serve* __simplepost_serve_insert_after(
 {
 	if(spsp2 == NULL)
 	{
-		spsp2 = __simplepost_serve_init();
+		spsp2 = __simplepost_serve_init(NULL, NULL);
 		if(spsp2 == NULL) return NULL;
 	}
 
@@ -640,9 +763,8 @@ static struct simplepost_serve* __simplepost_serve_remove(
 			struct simplepost_serve* p = spsp;
 			spsp = spsp->next;
 
-			if(p->file) free(p->file);
-			if(p->uri) free(p->uri);
-			free(p);
+			if(p->mime_type) free(p->mime_type);
+				free(p);
 		}
 
 		if(prev)
@@ -677,6 +799,147 @@ static size_t __simplepost_serve_length(struct simplepost_serve* spsp)
 	return n;
 }
 
+/*****************************************************************************
+ *                              Event Support                                *
+ *****************************************************************************/
+
+/// Number of events each subscriber may have queued if no depth is requested
+#define SP_HTTP_EVENTS_DEPTH 1024
+
+/*!
+ * \brief Names of the SimplePost event types
+ *
+ * \note The order of this array MUST match enum simplepost_event_type.
+ */
+static const char* __event_names[] =
+{
+	"FileAdded",
+	"DownloadStarted",
+	"DownloadCompleted",
+	"DownloadAborted",
+	"FileExpired"
+};
+
+/*!
+ * \brief SimplePost event subscriber
+ *
+ * \note Every field of every subscriber is protected by
+ * simplepost::events_lock.
+ */
+struct simplepost_subscriber
+{
+	/// SimplePost instance we are subscribed to
+	struct simplepost* spp;
+
+	/// Ring buffer of queued events
+	simplepost_event_t* events;
+
+	/// Number of events the ring buffer can hold
+	size_t depth;
+
+	/// Index of the oldest queued event
+	size_t head;
+
+	/// Number of queued events
+	size_t length;
+
+	/// Number of events dropped since the last one was queued
+	size_t dropped;
+
+	/// Types of events to queue (see SP_EVENT_MASK())
+	unsigned int mask;
+
+	/// Signaled when an event is queued
+	pthread_cond_t ready;
+
+
+	/// Next subscriber in the doubly-linked list
+	struct simplepost_subscriber* next;
+
+	/// Previous subscriber in the doubly-linked list
+	struct simplepost_subscriber* prev;
+};
+
+/*!
+ * \brief SimplePost event callback
+ *
+ * \note Inline callbacks are kept in simplepost::callbacks, which is protected
+ * by simplepost::callbacks_lock. Executor callbacks are not kept in any list;
+ * the subscriber feeding the executor is all the server needs to know about.
+ */
+struct simplepost_callback
+{
+	/// SimplePost instance the callback is registered with
+	struct simplepost* spp;
+
+	/// Types of events to run the callback for (see SP_EVENT_MASK())
+	unsigned int mask;
+
+	/// Function to call with each event
+	void (*callback) (simplepost_event_t, void*);
+
+	/// Argument to pass to the callback function
+	void* arg;
+
+	/// Thread to run the callback on
+	enum simplepost_dispatch dispatch;
+
+
+	/// Queue of events for the executor (executor callbacks only)
+	struct simplepost_subscriber* subscriber;
+
+	/// Handle of the executor thread (executor callbacks only)
+	pthread_t executor;
+
+	/// Should the executor keep running? (protected by simplepost::events_lock)
+	bool running;
+
+
+	/// Next inline callback in the doubly-linked list
+	struct simplepost_callback* next;
+
+	/// Previous inline callback in the doubly-linked list
+	struct simplepost_callback* prev;
+};
+
+/*!
+ * \brief Initialize a new SimplePost event.
+ *
+ * \param[in] event Event to copy
+ *
+ * \return a new event on success, or NULL if we failed to allocate the
+ * requested memory
+ */
+static simplepost_event_t __simplepost_event_init(const struct simplepost_event* event)
+{
+	simplepost_event_t spep = (simplepost_event_t) malloc(sizeof(struct simplepost_event));
+	if(spep == NULL) return NULL;
+
+	memcpy(spep, event, sizeof(struct simplepost_event));
+	spep->file = NULL;
+	spep->uri = NULL;
+
+	if(event->file)
+	{
+		spep->file = (char*) malloc(sizeof(char) * (strlen(event->file) + 1));
+		if(spep->file == NULL) goto error;
+		strcpy(spep->file, event->file);
+	}
+
+	if(event->uri)
+	{
+		spep->uri = (char*) malloc(sizeof(char) * (strlen(event->uri) + 1));
+		if(spep->uri == NULL) goto error;
+		strcpy(spep->uri, event->uri);
+	}
+
+	return spep;
+
+error:
+	simplepost_event_free(spep);
+	return NULL;
+}
+
 /*****************************************************************************
  *                              HTTP Responses                               *
  *****************************************************************************/
@@ -691,9 +954,114 @@ static size_t __simplepost_serve_length(struct simplepost_serve* spsp)
 #define SP_HTTP_RESPONSE_NOT_ACCEPTABLE "<html><head><title>Not Acceptable\r\n</title></head>\r\n<body><p>HTTP headers request a resource we cannot satisfy.\r\n</body></html>\r\n"
 #define SP_HTTP_RESPONSE_GONE "<html><head><title>Not Available\r\n</title></head>\r\n<body><p>The requested resource is no longer available.\r\n</body></html>\r\n"
 #define SP_HTTP_RESPONSE_UNSUPPORTED_MEDIA_TYPE "<html><head><title>Unsupported Media Type\r\n</title></head>\r\n<body><p>The requested resource is not valid for the requested method.\r\n</body></html>\r\n"
+#define SP_HTTP_RESPONSE_SERVICE_UNAVAILABLE "<html><head><title>Service Unavailable\r\n</title></head>\r\n<body><p>The server is too busy to fulfill the request. Please try again later.\r\n</body></html>\r\n"
 #define SP_HTTP_RESPONSE_INTERNAL_SERVER_ERROR "<html><head><title>Internal Server Error\r\n</title></head>\r\n<body><p>HTTP server encountered an unexpected condition which prevented it from fulfilling the request.\r\n</body></html>\r\n"
 #define SP_HTTP_RESPONSE_NOT_IMPLEMENTED "<html><head><title>Method Not Implemented\r\n</title></head>\r\n<body><p>HTTP request method not supported.\r\n</body></html>\r\n"
 
+/*********************
+ * Page cache policy *
+ *********************/
+
+/// Fewest bytes to read ahead of the client when a file starts being sent
+#define SP_HTTP_READAHEAD_MIN   (256 * 1024)
+
+/// Most bytes to read ahead of the client when a file starts being sent
+#define SP_HTTP_READAHEAD_MAX   (4 * 1024 * 1024)
+
+/// Number of bytes of a file mapped at a time to check how much of it is cached
+#define SP_HTTP_RESIDENCY_CHUNK (64 * 1024 * 1024)
+
+#ifdef HAVE_POSIX_FADVISE
+/*!
+ * \brief Tell the kernel that part of a file is about to be read from start
+ * to finish.
+ *
+ * Sequential access doubles the readahead window of the open file, and the
+ * first part of the range is read into the page cache right away, so the
+ * client does not wait on the disk before the first byte is sent. That
+ * window grows with the length of the response, between
+ * SP_HTTP_READAHEAD_MIN and SP_HTTP_READAHEAD_MAX bytes; the kernel's
+ * readahead carries on from there.
+ *
+ * \param[in] fd     Descriptor of the file, open for reading
+ * \param[in] offset Number of bytes into the file the range starts
+ * \param[in] size   Number of bytes in the range
+ */
+static void __advise_sequential(int fd, size_t offset, size_t size)
+{
+	size_t window = size / 16; // Number of bytes to read right away
+
+	if(size == 0) return;
+
+	if(window < SP_HTTP_READAHEAD_MIN) window = SP_HTTP_READAHEAD_MIN;
+	if(window > SP_HTTP_READAHEAD_MAX) window = SP_HTTP_READAHEAD_MAX;
+	if(window > size) window = size;
+
+	posix_fadvise(fd, (off_t) offset, (off_t) size, POSIX_FADV_SEQUENTIAL);
+	posix_fadvise(fd, (off_t) offset, (off_t) window, POSIX_FADV_WILLNEED);
+}
+#endif // HAVE_POSIX_FADVISE
+
+/*!
+ * \brief Drop part of a file from the page cache.
+ *
+ * \note Only pages which are not dirty or mapped by anyone are dropped, so
+ * this is always safe; at worst, someone else has to read them again.
+ *
+ * \param[in] file   Name and path of the file
+ * \param[in] offset Number of bytes into the file the range starts
+ * \param[in] size   Number of bytes in the range (0 = to the end of the file)
+ */
+static void __drop_cache(const char* file, size_t offset, size_t size)
+{
+	#ifdef HAVE_POSIX_FADVISE
+	int fd = open(file, O_RDONLY); // File descriptor
+	if(fd == -1) return;
+
+	if(posix_fadvise(fd, (off_t) offset, (off_t) size, POSIX_FADV_DONTNEED) == 0)
+	{
+		impact(2, "%s: Dropped %zu bytes of FILE %s from the page cache\n",
+			SP_HTTP_HEADER_NAMESPACE,
+			size, file);
+	}
+
+	close(fd);
+	#else
+	// Unused parameters
+	(void) file;
+	(void) offset;
+	(void) size;
+	#endif // HAVE_POSIX_FADVISE
+}
+
+/*!
+ * \brief Start reading a whole file into the page cache.
+ *
+ * \note The file is read in the background; this function does not wait for
+ * it.
+ *
+ * \param[in] file Name and path of the file
+ */
+static void __preload_file(const char* file)
+{
+	#ifdef HAVE_POSIX_FADVISE
+	int fd = open(file, O_RDONLY); // File descriptor
+	if(fd == -1) return;
+
+	if(posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED) == 0)
+	{
+		impact(2, "%s: Preloading FILE %s into the page cache\n",
+			SP_HTTP_HEADER_NAMESPACE,
+			file);
+	}
+
+	close(fd);
+	#else
+	// Unused parameters
+	(void) file;
+	#endif // HAVE_POSIX_FADVISE
+}
+
 /*!
  * \brief Prepare to send a response to the client from a data buffer.
  *
@@ -754,20 +1122,65 @@ static struct MHD_Response* __response_prep_data(
 	return response;
 }
 
+/*!
+ * \brief Add the headers describing the content of a file to its response.
+ *
+ * Clients are told they may ask for part of the file, so interrupted
+ * downloads may be resumed, and a partial response says which part it holds
+ * (RFC 7233 Section 4.2).
+ *
+ * \param[in] response    Response to add the headers to
+ * \param[in] status_code HTTP status code the response is sent with
+ * \param[in] size        Number of bytes from the file sent in the response
+ * \param[in] offset      Number of bytes into the file the response starts
+ * \param[in] total       Size (in bytes) of the whole file
+ * \param[in] mime_type   MIME type of the file (NULL if it is not known)
+ */
+static void __response_add_file_headers(
+	struct MHD_Response* response,
+	unsigned int status_code,
+	size_t size,
+	size_t offset,
+	size_t total,
+	const char* mime_type)
+{
+	char content_range[64]; // Value of the Content-Range header
+
+	/* According to RFC 2616 Section 7.2.1, the content type should only be
+	 * sent if it can be determined. If not, the client should do its best to
+	 * determine what to do with the content instead. Notably, Apache used to
+	 * send application/octet-stream to indicate arbitrary binary data when it
+	 * couldn't determine the file type, but that is not correct according to
+	 * the HTTP/1.1 specification.
+	 */
+	if(mime_type) MHD_add_response_header(response, "Content-Type", mime_type);
+
+	MHD_add_response_header(response, "Accept-Ranges", "bytes");
+	if(status_code == MHD_HTTP_PARTIAL_CONTENT)
+	{
+		snprintf(content_range, sizeof(content_range), "bytes %zu-%zu/%zu",
+			offset, offset + size - 1, total);
+		MHD_add_response_header(response, "Content-Range", content_range);
+	}
+}
+
 /*!
  * \brief Prepare to send a response to the client from a file.
  *
  * \note According to the MHD_create_response_from_fd() documentation, the
- * file descriptor this function opens for the sepecified file will be closed
- * when the MHD_Response instance returned by this function is destroyed. DO
- * NOT DESTROY THE RESPONSE until AFTER libmicrohttpd has responded to the
- * request!
+ * file descriptor passed to this function will be closed when the
+ * MHD_Response instance returned by this function is destroyed. DO NOT
+ * DESTROY THE RESPONSE until AFTER libmicrohttpd has responded to the
+ * request! If this function fails, it closes the file descriptor itself.
  *
  * \param[in] connection  Connection identifying the client
  * \param[in] status_code HTTP status code to send
  * \param[in] size        Number of bytes from the file to send in the response
  * \param[in] offset      Number of bytes to seek into the file before sending
+ * \param[in] total       Size (in bytes) of the whole file
+ * \param[in] fd          File descriptor of the file opened by __open_file()
  * \param[in] file        Name and path of the file to send
+ * \param[in] mime_type   MIME type of the file (NULL if it is not known)
  *
  * \return a libmicrohttpd response instance if the specified file has been
  * queued for transmission to the client, or print an error message and return
@@ -778,22 +1191,16 @@ static struct MHD_Response* __response_prep_file(
 	unsigned int status_code,
 	size_t size,
 	size_t offset,
-	const char* file)
+	size_t total,
+	int fd,
+	const char* file,
+	const char* mime_type)
 {
 	struct MHD_Response* response; // Response to the request
-	int fd;                        // File descriptor
-	#ifdef HAVE_LIBMAGIC
-	magic_t hmagic;                // Magic file handle
-	#endif
 
-	fd = open(file, O_RDONLY);
-	if(fd == -1)
-	{
-		impact(0, "%s: Request 0x%lx: Cannot open FILE %s for reading\n",
-			SP_HTTP_HEADER_NAMESPACE, pthread_self(),
-			file);
-		return NULL;
-	}
+	#ifdef HAVE_POSIX_FADVISE
+	__advise_sequential(fd, offset, size);
+	#endif // HAVE_POSIX_FADVISE
 
 	if(offset > 0)
 	{
@@ -828,33 +1235,14 @@ static struct MHD_Response* __response_prep_file(
 		return NULL;
 	}
 
-	#ifdef HAVE_LIBMAGIC
-	hmagic = magic_open(MAGIC_MIME_TYPE);
-	if(hmagic)
-	{
-		magic_load(hmagic, NULL);
-		const char* mime_type = magic_file(hmagic, file);
-
-		/* According to RFC 2616 Section 7.2.1, the content type should only
-		 * be sent if it can be determined. If not, the client should do its
-		 * best to determine what to do with the content instead. Notably,
-		 * Apache used to send application/octet-stream to indicate arbitrary
-		 * binary data when it couldn't determine the file type, but that is
-		 * not correct according to the HTTP/1.1 specification.
-		 */
-		if(mime_type) MHD_add_response_header(response, "Content-Type", mime_type);
-
-		magic_close(hmagic);
-	}
-	#endif // HAVE_LIBMAGIC
+	__response_add_file_headers(response, status_code, size, offset, total, mime_type);
 
 	if(MHD_queue_response(connection, status_code, response) == MHD_NO)
 	{
 		impact(2, "%s: Request 0x%lx: Cannot queue FILE %s with status %u\n",
 			SP_HTTP_HEADER_NAMESPACE, pthread_self(),
 			file, status_code);
-		close(fd);
-		MHD_destroy_response(response);
+		MHD_destroy_response(response); // This closes the file too.
 		return NULL;
 	}
 
@@ -944,7 +1332,7 @@ static bool __response_get_range(
 	{
 		// The range is valid. Assign it.
 		*offset = (size_t) first_byte;
-		*length = (size_t) last_byte - first_byte;
+		*length = (size_t) last_byte - first_byte + 1;
 	}
 
 	return true;
@@ -960,1218 +1348,7831 @@ static bool __response_get_range(
 /// Milliseconds to sleep between shutdown checks while blocking
 #define SP_HTTP_SLEEP     100
 
-/// Maximum number of files which may be served simultaneously
-#define SP_HTTP_FILES_MAX SIZE_MAX
+/// First file descriptor passed to us by a service manager (see sd_listen_fds(3))
+#define SP_LISTEN_FDS_START 3
+
+/// Maximum number of file descriptors passed to us by a service manager we look at
+#define SP_LISTEN_FDS_MAX   64
+
+/// Directory describing the NUMA nodes of the system
+#define SP_NUMA_SYSFS       "/sys/devices/system/node"
+
+/* libmicrohttpd can only stop a server with a thread per connection from
+ * accepting connections (see simplepost_quiesce()) if the server was started
+ * with a pipe to wake up its listening thread.
+ */
+#ifdef HAVE_MHD_QUIESCE_DAEMON
+#if HAVE_DECL_MHD_USE_ITC
+#define SP_HTTP_FLAGS (MHD_USE_THREAD_PER_CONNECTION | MHD_USE_ITC)
+#else
+#define SP_HTTP_FLAGS (MHD_USE_THREAD_PER_CONNECTION | MHD_USE_PIPE_FOR_SHUTDOWN)
+#endif // HAVE_DECL_MHD_USE_ITC
+#else
+#define SP_HTTP_FLAGS MHD_USE_THREAD_PER_CONNECTION
+#endif // HAVE_MHD_QUIESCE_DAEMON
 
 /*!
- * \brief SimplePost request status structure
+ * \brief Socket and TCP settings tuned for a kind of traffic
+ *
+ * \note The settings are applied to the listening socket. Linux copies them
+ * to every connection accepted on it, so they cost nothing per connection.
  */
-struct simplepost_state
+struct simplepost_tcp_profile
 {
-	/// Response to the request
-	struct MHD_Response* response;
+	/// Name of the profile
+	const char* name;
 
+	/// Maximum number of connections waiting to be accepted
+	int backlog;
 
-	/// Name and path of the file to serve
-	char* file;
+	/// Size (in bytes) of the send buffer of each connection (0 = let the kernel tune it)
+	int sndbuf;
 
-	/// Length of the file name and path
-	size_t file_length;
+	/// Bytes of unsent data each connection may queue before it stops being writable (0 = no limit)
+	int notsent_lowat;
 
+	/// Send small segments immediately instead of coalescing them with the next ones?
+	bool nodelay;
 
-	/// Data to serve
-	char* data;
+	/// Maximum number of pending TCP Fast Open connections (0 = disabled)
+	int fastopen;
 
-	/// Length of the data
-	size_t data_length;
+	/// Congestion control algorithm of each connection (NULL = the system's default)
+	const char* congestion;
 };
 
 /*!
- * \brief SimplePost HTTP server status structure
+ * \brief TCP profiles which may be chosen with simplepost_set_tcp_profile()
  */
-struct simplepost
+static const struct simplepost_tcp_profile __tcp_profiles[] =
 {
-	/******************
-	 * Initialization *
-	 ******************/
+	// Few large downloads over a fast, short network: a large fixed send
+	// buffer so sendfile() is woken up rarely, and full segments.
+	{"lan-bulk", 128, 4 * 1024 * 1024, 0, false, 0, NULL},
+
+	// Many small downloads: a long accept queue, no delay for the last
+	// partial segment of a response, and no handshake round trip for
+	// clients which reconnect.
+	{"many-small", 4096, 0, 16 * 1024, true, 256, NULL},
+
+	// Large downloads over a long, lossy path: a send buffer the kernel
+	// grows with the bandwidth-delay product, but with little unsent data
+	// queued behind it, and a congestion controller which is not fooled by
+	// random loss.
+	{"wan-high-latency", 256, 0, 128 * 1024, false, 64, "bbr"}
+};
 
-	/// HTTP server instance
-	struct MHD_Daemon* httpd;
+/// Maximum number of files which may be served simultaneously
+#define SP_HTTP_FILES_MAX SIZE_MAX
 
-	/// Port for the HTTP server
-	unsigned short port;
+/// Maximum number of files copied each time a listing takes the files lock
+#define SP_HTTP_FILES_PAGE 256
 
-	/// Address of the HTTP server
-	char* address;
+/// Number of buckets in the URI index of a new instance (always a power of two)
+#define SP_HTTP_INDEX_SIZE 64
 
-	/// Mutex for port and address
-	pthread_mutex_t master_lock;
+/// Maximum number of threads checking a batch of files before they are served
+#define SP_HTTP_CHECK_THREADS 16
 
-	/*********
-	 * Files *
-	 *********/
+/// Number of files each of those threads checks at a time
+#define SP_HTTP_CHECK_BATCH   64
 
-	/// List of files being served
-	struct simplepost_serve* files;
+/// Number of milliseconds opening a file may take before it is logged as slow
+#define SP_HTTP_SLOW_LOOKUP   100
 
-	/// Number of files being served
-	size_t files_count;
+/// Size (in bytes) of each buffer files read with O_DIRECT are streamed through
+#define SP_HTTP_DIRECT_BUFFER (1024 * 1024)
 
-	/// Mutex for files and files_count
-	pthread_mutex_t files_lock;
+/// Alignment (in bytes) of the buffers, offsets, and lengths of reads with O_DIRECT
+#define SP_HTTP_DIRECT_ALIGN  4096
+
+/// Maximum number of bytes libmicrohttpd copies out of those buffers at a time
+#define SP_HTTP_DIRECT_BLOCK  (256 * 1024)
+
+/// Maximum number of idle buffers kept for reuse by later downloads
+#define SP_HTTP_DIRECT_POOL   32
+
+/// Maximum number of idle request states kept for reuse by later requests
+#define SP_HTTP_STATE_POOL    64
+
+/// Number of bytes first allocated for each string a request state holds
+#define SP_HTTP_STATE_STRING  256
+
+/// Number of slots in each bucket of the table of signed links
+#define SP_SIGNED_BUCKET 8
+
+/// Most links which may be moved to make room for another in the table of signed links
+#define SP_SIGNED_KICKS  500
+
+/// Number of signed links which may be outstanding at once by default
+#define SP_SIGNED_LINKS  (1024 * 1024)
+
+/// First bytes of a table of signed links kept in a file ("SPSIGNED")
+#define SP_SIGNED_MAGIC  UINT64_C(0x53505349474E4544)
+
+/// Seconds a client has to resume a download by default
+#define SP_CLAIM_GRACE 600
+
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+
+/*!
+ * \brief Signed link in the table of signed links
+ */
+struct simplepost_signed_slot
+{
+	/// First bytes of the signature of the link (0 = the slot is empty)
+	uint64_t tag;
+
+	/// Time (seconds since the Epoch) the link stops working, after which the slot may be reused
+	uint32_t expires;
+
+	/// Number of times the link has been downloaded
+	uint32_t downloads;
 };
 
 /*!
- * \brief Do the given URIs match?
- *
- * \note This function is slightly more complicated than a simple strcmp() of
- * both input strings. It does NULL checks and takes into account partial or
- * malformed URIs that do no start with "/".
- *
- * \param[in] uri1 First URI to compare
- * \param[in] uri2 Second URI to compare
+ * \brief Table of the signed links which have been downloaded
  *
- * \return true if both URIs are equivalent, false if not
+ * Signed links carry everything needed to serve them, so a link is only added
+ * to the table when it is first downloaded, to count its downloads, and its
+ * slot is free for another link as soon as it expires. The table is a cuckoo
+ * hash of buckets of SP_SIGNED_BUCKET slots: each link may be in either of two
+ * buckets, which are both checked to find it, and a link is added by moving
+ * others to their other bucket until there is room. That keeps every lookup
+ * to two buckets while filling nearly every slot, so the table has one slot
+ * spare in every bucket for the number of links it was sized for. It is
+ * mapped into memory shared with the worker processes, so each download is
+ * counted once no matter which process serves it. It may be mapped from a
+ * file instead, so the counts survive a restart and are shared with an
+ * instance taking over from us.
  */
-static bool __does_uri_match(const char* uri1, const char* uri2)
+struct simplepost_signed
 {
-	if(uri1 == NULL || uri2 == NULL) return false;
+	/// SP_SIGNED_MAGIC
+	uint64_t magic;
+
+	/// Size (in bytes) of the whole table
+	uint64_t size;
+
+	/// Lock for everything else in the table (shared with the worker processes and any instance using the same file)
+	pthread_mutex_t lock;
+
+	/// Number of buckets in the table
+	uint32_t buckets;
+
+	/// State of the generator choosing the links to move
+	uint64_t seed;
+
+	/// Slots of the buckets
+	struct simplepost_signed_slot slots[];
+};
+
+/*!
+ * \brief SimplePost request status structure
+ */
+struct simplepost_state
+{
+	/// Response to the request
+	struct MHD_Response* response;
+
+
+	/// Name and path of the file to serve
+	char* file;
+
+	/// Length of the file name and path
+	size_t file_length;
+
+	/// Number of bytes allocated for the file name and path
+	size_t file_size;
+
+
+	/// MIME type of the file
+	char* mime_type;
+
+	/// Length of the MIME type (0 if it is not known)
+	size_t mime_type_length;
+
+	/// Number of bytes allocated for the MIME type
+	size_t mime_type_size;
+
+
+	/// Data to serve
+	char* data;
+
+	/// Length of the data
+	size_t data_length;
+
+
+	/// Uniform Resource Identifier of the file being downloaded
+	char* uri;
+
+	/// Length of the URI (0 if we are not serving a file)
+	size_t uri_length;
+
+	/// Number of bytes allocated for the URI
+	size_t uri_size;
+
+	/// Number of bytes of the file to send
+	size_t body_length;
+
+	/// Number of bytes into the file the response starts
+	size_t body_offset;
+
+	/// Number of bytes in the whole file
+	size_t body_total;
+
+	/// Address of the client (IPv4 addresses are mapped to IPv6)
+	uint8_t client[16];
+
+	/// Download reserved for the client plus one (0 if the download was counted as it started)
+	uint32_t claim;
+
+	/// Serial number of the reservation
+	uint32_t claim_serial;
+
+	/// Was a range of the file requested, so the request may resume a download reserved for the client?
+	bool is_resume;
+
+	/// File the download was reserved from (if it is not shared with the worker processes)
+	struct simplepost_serve* claim_file;
+
+	/// Should the part of the file sent be dropped from the page cache when the response is finished?
+	bool drop_cache;
+
+	#ifdef HAVE_STRUCT_TCP_INFO_TCPI_BYTES_ACKED
+	/// Bytes the client had acknowledged on the connection when the download started
+	uint64_t bytes_acked;
+	#endif // HAVE_STRUCT_TCP_INFO_TCPI_BYTES_ACKED
+
+
+	/// Next idle request state in simplepost::states (NULL if this is the last one)
+	struct simplepost_state* next;
+};
+
+/*!
+ * \brief SimplePost HTTP server status structure
+ */
+struct simplepost
+{
+	/******************
+	 * Initialization *
+	 ******************/
+
+	/// HTTP server instance
+	struct MHD_Daemon* httpd;
+
+	/// HTTP server which no longer accepts connections, but may still be sending files (NULL if there is none)
+	struct MHD_Daemon* httpd_retired;
+
+	/// Socket httpd stopped accepting connections on (-1 unless the server is quiesced)
+	int listen_sock;
+
+	/// Port for the HTTP server
+	unsigned short port;
+
+	/// Address of the HTTP server (NULL until it is needed if address_default is set)
+	char* address;
+
+	/// Should the address of the default network interface be detected the first time it is needed?
+	bool address_default;
+
+	/// Mutex for address and address_default while the server is running (see __get_address())
+	pthread_mutex_t address_lock;
+
+	/// Maximum number of concurrent client connections
+	unsigned int connection_limit;
+
+	/// Seconds a client connection may be idle before it is closed (0 = never)
+	unsigned int connection_timeout;
+
+	/// Seconds the server may go without any clients before simplepost_block() returns (0 = never)
+	unsigned int idle_timeout;
+
+	/// Number of processes which should serve HTTP requests (0 or 1 = only this one)
+	unsigned int workers_count;
+
+	/// Process identifiers of the worker processes, terminated by 0 (NULL if there are none)
+	pid_t* workers;
+
+	#ifdef HAVE_SCHED_SETAFFINITY
+	/// CPUs the threads of the HTTP server may run on (NULL = any of them)
+	cpu_set_t* cpus;
+
+	/// Should each process serving HTTP requests be confined to a NUMA node of its own?
+	bool numa;
+	#endif // HAVE_SCHED_SETAFFINITY
+
+	/// Socket and TCP settings of the server (NULL = the system's defaults)
+	const struct simplepost_tcp_profile* tcp_profile;
+
+	/// Mutex for httpd_retired, listen_sock, port, address, connection_limit, connection_timeout, idle_timeout, workers_count, workers, cpus, numa, and tcp_profile
+	pthread_mutex_t master_lock;
+
+	/*********
+	 * Files *
+	 *********/
+
+	/// List of files being served
+	struct simplepost_serve* files;
+
+	/// Last file in the list
+	struct simplepost_serve* files_tail;
+
+	/// Hash table of the files being served (but not removed) by URI
+	struct simplepost_serve** files_index;
+
+	/// Number of buckets in files_index
+	size_t files_index_size;
+
+	/// Radix trie of the files being served (but not removed) by URI, without the leading "/" (NULL until the first file is indexed)
+	simpletrie_t files_trie;
+
+	/// Number of files being served
+	size_t files_count;
+
+	/// Serial number to assign to the next file inserted into the list
+	uint64_t files_next_id;
+
+	/// Read-only index of more files to serve (NULL if there is none)
+	simpleindex_t index;
+
+	/// Number of files which may be downloaded an unlimited number of times
+	size_t files_unlimited;
+
+	/// Sum of the COUNTs of the files which may not
+	size_t files_remaining;
+
+	/// Were the files handed off to another process? (If so, they never change again.)
+	bool quiesced;
+
+	/// Table of the files shared with the worker processes (NULL if there are none)
+	simpleshare_t shared;
+
+	/// Should files which may be downloaded more than once be read into the page cache as they are added?
+	bool preload;
+
+	/// Mutex for files, files_tail, files_index, files_trie, files_count, files_next_id, index, files_unlimited, files_remaining, quiesced, shared, preload, and the timers
+	pthread_mutex_t files_lock;
+
+	/// Condition broadcast when the last file is removed from the list
+	pthread_cond_t files_cond;
+
+	#ifdef HAVE_LIBMAGIC
+	/// Magic file handle (NULL until the first MIME type is needed)
+	magic_t magic;
+
+	/// Mutex for magic
+	pthread_mutex_t magic_lock;
+	#endif // HAVE_LIBMAGIC
+
+	/**********
+	 * Events *
+	 **********/
+
+	/// List of event subscribers
+	struct simplepost_subscriber* subscribers;
+
+	/// Mutex for subscribers
+	pthread_mutex_t events_lock;
+
+	/// List of inline event callbacks
+	struct simplepost_callback* callbacks;
+
+	/// Number of inline event callbacks (always use the __atomic builtins to read it)
+	size_t callbacks_count;
+
+	/// Lock for callbacks and callbacks_count (held for reading while they run)
+	pthread_rwlock_t callbacks_lock;
+
+	/**************
+	 * Direct I/O *
+	 **************/
+
+	/// Files at least this many bytes long are read with O_DIRECT (0 = only those served that way; always use the __atomic builtins)
+	uint64_t direct_threshold;
+
+	/// Idle buffers for reads with O_DIRECT, each starting with a pointer to the next (NULL if there are none)
+	void* direct_pool;
+
+	/// Number of buffers in direct_pool
+	size_t direct_pool_count;
+
+	/// Mutex for direct_pool and direct_pool_count
+	pthread_mutex_t direct_lock;
+
+	/// Is io_uring missing or disabled, so files read with O_DIRECT are read with POSIX AIO instead? (always use the __atomic builtins)
+	bool direct_no_ring;
+
+	/**********
+	 * Timers *
+	 **********/
+
+	/// Timing wheel of the files which expire (NULL until the first file is given an expiry time)
+	simpletimer_wheel_t timers;
+
+	/// Is the timer thread running?
+	bool timers_running;
+
+	/// Should the timer thread exit?
+	bool timers_exit;
+
+	/// Thread expiring the files
+	pthread_t timers_thread;
+
+	/// Condition signaled when the first timer is queued or timers_exit is set (with simplepost::files_lock)
+	pthread_cond_t timers_cond;
+
+	/****************
+	 * Signed Links *
+	 ****************/
+
+	/* These are set before the server is bound and never change while it
+	 * runs, so they are not protected by a mutex.
+	 */
+
+	/// Key signed links are checked with (NULL = files are served on their URIs alone)
+	simplesign_key_t sign_key;
+
+	/// Table of the signed links which have been downloaded (NULL if there is no key)
+	struct simplepost_signed* signed_links;
+
+	/// Size (in bytes) of the mapping of signed_links
+	size_t signed_size;
+
+	/// File signed_links is mapped from, locked as long as we use it (-1 if it is only in memory)
+	int signed_fd;
+
+	/*********************
+	 * Resumed Downloads *
+	 *********************/
+
+	/// Downloads reserved for clients to resume (NULL if every download is counted as it starts)
+	simpleclaim_table_t claims;
+
+	/// Seconds a client has to resume a download (0 = count every download as it starts; always use the __atomic builtins)
+	uint32_t claims_grace;
+
+	/***********
+	 * Watches *
+	 ***********/
+
+	/// Thread watching the files being served for changes (NULL if they are not watched; with simplepost::files_lock)
+	simplewatch_t watch;
+
+	/// Should files be purged once they are deleted? (with simplepost::files_lock)
+	bool watch_purge;
+
+	/*****************
+	 * Request State *
+	 *****************/
+
+	/// Idle request states, with the strings they hold still allocated (NULL if there are none)
+	struct simplepost_state* states;
+
+	/// Number of request states in states
+	size_t states_count;
+
+	/// Mutex for states and states_count
+	pthread_mutex_t states_lock;
+
+	/***********
+	 * Journal *
+	 ***********/
+
+	/// Journal of changes to the files (NULL if changes to the files are not journaled)
+	simplejournal_t journal;
+
+	/**************
+	 * Statistics *
+	 **************/
+
+	/* These are updated on every request, so they are never protected by a
+	 * mutex. Always use the __atomic builtins to access them.
+	 */
+
+	/// Time (CLOCK_MONOTONIC) the server was bound
+	struct timespec start_time;
+
+	/// Millisecond (CLOCK_MONOTONIC) a client last connected or finished a request
+	uint64_t last_active;
+
+	/// Number of open client connections
+	size_t connections;
+
+	/// Number of downloads started
+	size_t downloads_started;
+
+	/// Number of downloads completed
+	size_t downloads_completed;
+
+	/// Number of downloads aborted
+	size_t downloads_aborted;
+
+	/// Number of bytes of files sent to clients
+	uint64_t bytes_sent;
+
+	/// Number of downloads whose MIME type was already known
+	size_t mime_hits;
+
+	/// Number of downloads whose MIME type had to be determined
+	size_t mime_misses;
+
+	/// Number of requests currently waiting for the file they asked for to be opened
+	size_t lookups_pending;
+
+	/// Number of files opened to be served
+	size_t lookups;
+
+	/// Number of microseconds spent opening files to be served
+	uint64_t lookup_time;
+
+	/// Longest time (in microseconds) opening a single file took
+	uint64_t lookup_time_max;
+};
+
+/*!
+ * \brief SimplePost file listing cursor
+ *
+ * The cursor remembers the last element of simplepost::files it returned and
+ * pins it in the list, so each page can pick up where the previous one left
+ * off without walking the list from the beginning.
+ */
+struct simplepost_cursor
+{
+	/// SimplePost instance being listed
+	struct simplepost* spp;
+
+	/// Files with serial numbers at or above this one were inserted after the cursor was opened
+	uint64_t snapshot;
+
+	/// Last element visited by the cursor (NULL before the first page)
+	struct simplepost_serve* position;
+
+	/// Has the cursor reached the end of the listing?
+	bool done;
+};
+
+/*!
+ * \brief Copy a string into a buffer which is reused by later requests.
+ *
+ * \note The buffer only ever grows, so once it is large enough for the
+ * strings a server handles, copying them does not allocate any memory.
+ *
+ * \param[inout] buffer Buffer to copy into (NULL if none is allocated yet)
+ * \param[inout] size   Number of bytes allocated for the buffer
+ * \param[in] offset    Number of characters already in the buffer to keep
+ * \param[in] str       String to copy after them
+ * \param[in] length    Number of characters of the string to copy
+ *
+ * \return true if the string was copied, false if the buffer could not be
+ * grown to fit it (in which case the buffer is left untouched)
+ */
+static bool __copy_to_buffer(
+	char** buffer,
+	size_t* size,
+	size_t offset,
+	const char* str,
+	size_t length)
+{
+	if(offset + length >= *size)
+	{
+		size_t new_size = (*size) ? *size : SP_HTTP_STATE_STRING; // Number of bytes to allocate
+		char* new_buffer;                                          // Grown buffer
+
+		while(new_size <= offset + length) new_size *= 2;
+
+		new_buffer = (char*) realloc(*buffer, sizeof(char) * new_size);
+		if(new_buffer == NULL) return false;
+
+		*buffer = new_buffer;
+		*size = new_size;
+	}
+
+	memcpy(*buffer + offset, str, length);
+	(*buffer)[offset + length] = '\0';
+
+	return true;
+}
+
+/*!
+ * \brief Free a request state and the strings it holds.
+ *
+ * \param[in] spsp Request state to free
+ */
+static void __free_state(struct simplepost_state* spsp)
+{
+	if(spsp->file) free(spsp->file);
+	if(spsp->mime_type) free(spsp->mime_type);
+	if(spsp->uri) free(spsp->uri);
+	free(spsp);
+}
+
+/*!
+ * \brief Take a request state from the pool.
+ *
+ * \note The strings of the state are kept allocated between requests, so a
+ * state from the pool can usually serve a file without allocating any memory.
+ *
+ * \param[in] spp SimplePost instance to act on
+ *
+ * \return a request state with no response, file, or data, or NULL if we
+ * failed to allocate one
+ */
+static struct simplepost_state* __get_state(simplepost_t spp)
+{
+	struct simplepost_state* spsp; // State to return
+
+	pthread_mutex_lock(&spp->states_lock);
+	spsp = spp->states;
+	if(spsp)
+	{
+		spp->states = spsp->next;
+		--(spp->states_count);
+	}
+	pthread_mutex_unlock(&spp->states_lock);
+
+	if(spsp == NULL)
+	{
+		spsp = (struct simplepost_state*) calloc(1, sizeof(struct simplepost_state));
+		if(spsp == NULL) return NULL;
+	}
+
+	spsp->response = NULL;
+	spsp->file_length = 0;
+	spsp->mime_type_length = 0;
+	spsp->data = NULL;
+	spsp->data_length = 0;
+	spsp->uri_length = 0;
+	spsp->body_length = 0;
+	spsp->body_offset = 0;
+	spsp->body_total = 0;
+	spsp->claim = 0;
+	spsp->is_resume = false;
+	spsp->drop_cache = false;
+	spsp->next = NULL;
+
+	return spsp;
+}
+
+/*!
+ * \brief Return a request state taken with __get_state() to the pool.
+ *
+ * \note The data of the response is freed. Once the pool holds
+ * SP_HTTP_STATE_POOL states, the rest are freed too.
+ *
+ * \param[in] spp  SimplePost instance to act on
+ * \param[in] spsp Request state to return
+ */
+static void __put_state(simplepost_t spp, struct simplepost_state* spsp)
+{
+	if(spsp->data)
+	{
+		free(spsp->data);
+		spsp->data = NULL;
+	}
+
+	pthread_mutex_lock(&spp->states_lock);
+	if(spp->states_count < SP_HTTP_STATE_POOL)
+	{
+		spsp->next = spp->states;
+		spp->states = spsp;
+		++(spp->states_count);
+		spsp = NULL;
+	}
+	pthread_mutex_unlock(&spp->states_lock);
+
+	if(spsp) __free_state(spsp);
+}
+
+/*!
+ * \brief Do the given URIs match?
+ *
+ * \note This function is slightly more complicated than a simple strcmp() of
+ * both input strings. It does NULL checks and takes into account partial or
+ * malformed URIs that do no start with "/".
+ *
+ * \param[in] uri1 First URI to compare
+ * \param[in] uri2 Second URI to compare
+ *
+ * \return true if both URIs are equivalent, false if not
+ */
+static bool __does_uri_match(const char* uri1, const char* uri2)
+{
+	if(uri1 == NULL || uri2 == NULL) return false;
 
 	if(uri1[0] == '/') ++uri1;
 	if(uri2[0] == '/') ++uri2;
 
-	return (strcmp(uri1, uri2) == 0);
+	return (strcmp(uri1, uri2) == 0);
+}
+
+/*!
+ * \brief Hash the given URI.
+ *
+ * \note URIs are hashed the same way __does_uri_match() compares them, i.e.
+ * without their leading "/".
+ *
+ * \param[in] uri Uniform Resource Identifier to hash
+ *
+ * \return 32-bit FNV-1a hash of the URI
+ */
+static uint32_t __hash_uri(const char* uri)
+{
+	uint32_t hash = 2166136261U; // FNV offset basis
+
+	if(uri[0] == '/') ++uri;
+	for(; *uri != '\0'; ++uri)
+	{
+		hash ^= (unsigned char) *uri;
+		hash *= 16777619U; // FNV prime
+	}
+
+	return hash;
+}
+
+/*!
+ * \brief Add the given file to the URI index.
+ *
+ * \note The index is a hash table for looking up single URIs and a radix trie
+ * for finding every URI matching a pattern. The hash table grows to keep
+ * about one file per bucket. If we fail to allocate a bigger table, the old
+ * one is kept; lookups will just be a little slower.
+ *
+ * \warning The caller must hold simplepost::files_lock.
+ *
+ * \param[in] spp  SimplePost instance to act on
+ * \param[in] spsp File to index (its URI must already be set)
+ *
+ * \retval true the file was indexed
+ * \retval false we failed to allocate the requested memory
+ */
+static bool __index_file(simplepost_t spp, struct simplepost_serve* spsp)
+{
+	uint32_t bucket; // Index of the bucket to insert the file into
+
+	if(spp->files_index == NULL || spp->files_count > spp->files_index_size)
+	{
+		size_t size = spp->files_index_size ? spp->files_index_size * 2 : SP_HTTP_INDEX_SIZE;
+		struct simplepost_serve** index = (struct simplepost_serve**) calloc(size, sizeof(struct simplepost_serve*));
+
+		if(index)
+		{
+			for(size_t i = 0; i < spp->files_index_size; ++i)
+			{
+				while(spp->files_index[i])
+				{
+					struct simplepost_serve* p = spp->files_index[i];
+					spp->files_index[i] = p->hash_next;
+
+					bucket = __hash_uri(p->uri) & (size - 1);
+					p->hash_next = index[bucket];
+					index[bucket] = p;
+				}
+			}
+
+			free(spp->files_index);
+			spp->files_index = index;
+			spp->files_index_size = size;
+		}
+		else if(spp->files_index == NULL)
+		{
+			return false;
+		}
+	}
+
+	if(spp->files_trie == NULL)
+	{
+		spp->files_trie = simpletrie_init();
+		if(spp->files_trie == NULL) return false;
+	}
+	if(simpletrie_insert(spp->files_trie, spsp->uri + 1, spsp) == false) return false;
+
+	bucket = __hash_uri(spsp->uri) & (spp->files_index_size - 1);
+	spsp->hash_next = spp->files_index[bucket];
+	spp->files_index[bucket] = spsp;
+
+	return true;
+}
+
+/*!
+ * \brief Remove the given file from the URI index.
+ *
+ * \note It is not an error if the file is not in the index.
+ *
+ * \warning The caller must hold simplepost::files_lock.
+ *
+ * \param[in] spp  SimplePost instance to act on
+ * \param[in] spsp File to remove from the index
+ */
+static void __unindex_file(simplepost_t spp, struct simplepost_serve* spsp)
+{
+	if(spp->files_index == NULL || spsp->uri == NULL) return;
+
+	if(spp->files_trie) simpletrie_remove(spp->files_trie, spsp->uri + 1, spsp);
+
+	struct simplepost_serve** pp = &spp->files_index[__hash_uri(spsp->uri) & (spp->files_index_size - 1)];
+	for(; *pp; pp = &(*pp)->hash_next)
+	{
+		if(*pp == spsp)
+		{
+			*pp = spsp->hash_next;
+			spsp->hash_next = NULL;
+			break;
+		}
+	}
+}
+
+/*!
+ * \brief Find the file being served on the given URI.
+ *
+ * \warning The caller must hold simplepost::files_lock.
+ *
+ * \param[in] spp SimplePost instance to act on
+ * \param[in] uri Uniform Resource Identifier of the file
+ *
+ * \return the file, or NULL if no file is being served on the URI
+ */
+static struct simplepost_serve* __find_file(simplepost_t spp, const char* uri)
+{
+	if(spp->files_index == NULL || uri == NULL) return NULL;
+
+	struct simplepost_serve* p = spp->files_index[__hash_uri(uri) & (spp->files_index_size - 1)];
+	for(; p; p = p->hash_next)
+	{
+		if(__does_uri_match(p->uri, uri)) return p;
+	}
+
+	return NULL;
+}
+
+/*!
+ * \brief Files being matched against a pattern by __match_files()
+ */
+struct simplepost_match
+{
+	/// Shell wildcard pattern the URIs must match, without the leading "/"
+	const char* pattern;
+
+	/// Does every URI under the literal prefix of the pattern match it?
+	bool is_prefix;
+
+	/// Function to call with each matching file
+	bool (*callback) (struct simplepost_serve*, void*);
+
+	/// Argument to pass to the function
+	void* arg;
+};
+
+/*!
+ * \brief Hand a file found under the literal prefix of a pattern to the
+ * function of __match_files() if its URI matches the whole pattern.
+ *
+ * \param[in] value File found (struct simplepost_serve*)
+ * \param[in] arg   Files being matched (struct simplepost_match*)
+ *
+ * \return the value returned by the function, or true if the URI did not match
+ */
+static bool __match_file(void* value, void* arg)
+{
+	struct simplepost_serve* spsp = (struct simplepost_serve*) value; // File found
+	struct simplepost_match* match = (struct simplepost_match*) arg;  // Files being matched
+
+	if(match->is_prefix == false && fnmatch(match->pattern, spsp->uri + 1, 0) != 0) return true;
+
+	return match->callback(spsp, match->arg);
+}
+
+/*!
+ * \brief Call a function with each file being served on a URI matching the
+ * given pattern.
+ *
+ * \note Only the subtree of the URI trie under the literal prefix of the
+ * pattern (everything before its first wildcard) is walked, so the cost is
+ * proportional to the number of files sharing that prefix, not to the number
+ * of files being served.
+ *
+ * \warning The caller must hold simplepost::files_lock. The function must not
+ * add files to, or remove them from, the list.
+ *
+ * \param[in] spp      SimplePost instance to act on
+ * \param[in] pattern  Shell wildcard pattern (see fnmatch(3)) the URIs must match, without the leading "/"
+ * \param[in] callback
+ * \parblock
+ * Function to call with each matching file
+ *
+ * If the function returns false, the walk will be aborted.
+ * \endparblock
+ * \param[in] arg      Argument to pass to the function
+ *
+ * \retval true every matching file was handed to the function
+ * \retval false the walk was aborted
+ */
+static bool __match_files(
+	simplepost_t spp,
+	const char* pattern,
+	bool (*callback) (struct simplepost_serve*, void*),
+	void* arg)
+{
+	size_t prefix = strcspn(pattern, "*?[\\"); // Length of the literal prefix of the pattern
+	struct simplepost_match match;             // Files being matched
+
+	if(spp->files_trie == NULL) return true;
+
+	match.pattern = pattern;
+	match.is_prefix = (pattern[prefix] == '*' && pattern[prefix + 1] == '\0');
+	match.callback = callback;
+	match.arg = arg;
+
+	return simpletrie_walk(spp->files_trie, pattern, prefix, &__match_file, &match);
+}
+
+/*!
+ * \brief Scramble the bits of a hash (the SplitMix64 finalizer).
+ *
+ * \param[in] hash Hash to scramble
+ *
+ * \return the scrambled hash
+ */
+static uint64_t __mix_hash(uint64_t hash)
+{
+	hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBULL;
+	return hash ^ (hash >> 31);
+}
+
+/*!
+ * \brief Get the table downloads should be reserved in.
+ *
+ * \note Without knowing how much of an aborted response reached the client,
+ * a download could never be finished by resuming it, so every download is
+ * counted as it starts instead.
+ *
+ * \param[in] spp SimplePost instance to act on
+ *
+ * \return the table, or NULL if every download should be counted as it starts
+ */
+static simpleclaim_table_t __get_claims(simplepost_t spp)
+{
+	#ifdef HAVE_STRUCT_TCP_INFO_TCPI_BYTES_ACKED
+	if(__atomic_load_n(&spp->claims_grace, __ATOMIC_RELAXED) > 0) return spp->claims;
+	#else
+	(void) spp;
+	#endif // HAVE_STRUCT_TCP_INFO_TCPI_BYTES_ACKED
+
+	return NULL;
+}
+
+/*!
+ * \brief Get the address of the client on a connection.
+ *
+ * \param[in] connection Connection handle
+ * \param[out] client
+ * \parblock
+ * Address of the client (16 bytes)
+ *
+ * IPv4 addresses are mapped to IPv6. If the address is not known, it is all
+ * zeros.
+ * \endparblock
+ */
+static void __get_client(struct MHD_Connection* connection, uint8_t* client)
+{
+	const union MHD_ConnectionInfo* info; // Connection information from libmicrohttpd
+	const struct sockaddr* addr;          // Address of the client
+
+	memset(client, 0, 16);
+
+	info = MHD_get_connection_info(connection, MHD_CONNECTION_INFO_CLIENT_ADDRESS);
+	if(info == NULL || info->client_addr == NULL) return;
+	addr = (const struct sockaddr*) info->client_addr;
+
+	if(addr->sa_family == AF_INET)
+	{
+		client[10] = 0xff;
+		client[11] = 0xff;
+		memcpy(client + 12, &((const struct sockaddr_in*) addr)->sin_addr, 4);
+	}
+	else if(addr->sa_family == AF_INET6)
+	{
+		memcpy(client, &((const struct sockaddr_in6*) addr)->sin6_addr, 16);
+	}
+}
+
+/*!
+ * \brief Rebuild the shared table from the list of files being served.
+ *
+ * \note This reclaims the slots and strings of the files which are no longer
+ * served. The counts in the table are carried over, including downloads
+ * which have not been reaped yet, and so are the downloads reserved for
+ * clients.
+ *
+ * \warning The caller must hold simplepost::files_lock, as well as the lock on
+ * simplepost::shared for writing.
+ *
+ * \param[in] spp SimplePost instance to act on
+ *
+ * \retval true every file in the list is shared
+ * \retval false the table is out of room, or we failed to allocate memory
+ */
+static bool __rebuild_shared(simplepost_t spp)
+{
+	simpleshare_t shared = spp->shared; // Table to rebuild
+	uint32_t* counts;                   // Count of each file in the list
+	struct simpleclaim_list* claims;    // Downloads reserved of each file in the list
+	char** mime_types;                  // MIME type of each file in the list
+	size_t n = 0;                       // Number of files in the list
+	bool ok = true;                     // Is every file shared?
+
+	counts = (uint32_t*) malloc(sizeof(uint32_t) * (spp->files_count + 1));
+	claims = (struct simpleclaim_list*) calloc(spp->files_count + 1, sizeof(struct simpleclaim_list));
+	mime_types = (char**) calloc(spp->files_count + 1, sizeof(char*));
+	if(counts == NULL || claims == NULL || mime_types == NULL)
+	{
+		impact(0, "%s: %s: Failed to allocate memory to rebuild the table of shared files\n",
+			SP_HTTP_HEADER_NAMESPACE, SP_MAIN_HEADER_MEMORY_ALLOC);
+		ok = false;
+		goto error;
+	}
+
+	// The strings are overwritten as the table is rebuilt.
+	for(struct simplepost_serve* p = spp->files; p; p = p->next)
+	{
+		if(p->removed) continue;
+
+		counts[n] = p->count;
+		if(p->shared_slot)
+		{
+			const char* mime_type = simpleshare_get_mime_type(shared, p->shared_slot); // MIME type of the file
+
+			counts[n] = simpleshare_get_count(shared, p->shared_slot);
+			claims[n] = *simpleshare_get_claims(shared, p->shared_slot);
+			if(mime_type)
+			{
+				mime_types[n] = (char*) malloc(sizeof(char) * (strlen(mime_type) + 1));
+				if(mime_types[n]) strcpy(mime_types[n], mime_type);
+			}
+		}
+		++n;
+	}
+
+	simpleshare_clear(shared);
+
+	n = 0;
+	if(spp->claims) simpleclaim_lock(spp->claims);
+	for(struct simplepost_serve* p = spp->files; p; p = p->next)
+	{
+		if(p->removed) continue;
+
+		p->shared_slot = simpleshare_put(shared, p->uri, p->file, mime_types[n] ? mime_types[n] : p->mime_type, counts[n], p->direct);
+		if(p->shared_slot == 0)
+		{
+			if(spp->claims) simpleclaim_free_all(spp->claims, &claims[n]);
+			ok = false;
+		}
+		else
+		{
+			// The slot marked for downloads not reaped yet may have moved.
+			if(counts[n] != p->count) simpleshare_mark(shared, p->shared_slot);
+
+			if(claims[n].first)
+			{
+				struct simpleclaim_list* list = simpleshare_get_claims(shared, p->shared_slot); // Reservations in the new slot of the file
+
+				*list = claims[n];
+				simpleclaim_set_slot(spp->claims, list, p->shared_slot);
+			}
+		}
+		++n;
+	}
+	if(spp->claims) simpleclaim_unlock(spp->claims);
+
+error:
+	if(mime_types)
+	{
+		for(size_t i = 0; i < n; ++i) free(mime_types[i]);
+		free(mime_types);
+	}
+	free(claims);
+	free(counts);
+
+	return ok;
+}
+
+/*!
+ * \brief Share a file in the list with the worker processes, or update the
+ * COUNT of the file already shared.
+ *
+ * \warning The caller must hold simplepost::files_lock.
+ *
+ * \param[in] spp  SimplePost instance to act on
+ * \param[in] spsp File to share
+ *
+ * \retval true the file is shared (or there are no worker processes)
+ * \retval false the shared table is out of room
+ */
+static bool __share_file(simplepost_t spp, struct simplepost_serve* spsp)
+{
+	if(spp->shared == NULL) return true;
+
+	simpleshare_wrlock(spp->shared);
+	if(spsp->shared_slot)
+	{
+		simpleshare_update(spp->shared, spsp->shared_slot, spsp->count, spsp->direct);
+	}
+	else
+	{
+		spsp->shared_slot = simpleshare_put(spp->shared, spsp->uri, spsp->file, spsp->mime_type, spsp->count, spsp->direct);
+		if(spsp->shared_slot == 0) __rebuild_shared(spp);
+	}
+	simpleshare_unlock(spp->shared);
+
+	if(spsp->shared_slot == 0)
+	{
+		impact(0, "%s: Cannot share any more files with the workers\n",
+			SP_HTTP_HEADER_NAMESPACE);
+		return false;
+	}
+
+	return true;
+}
+
+/*!
+ * \brief Stop sharing a file with the worker processes.
+ *
+ * \note It is not an error if the file is not shared. The downloads of the
+ * file reserved for clients are freed.
+ *
+ * \warning The caller must hold simplepost::files_lock.
+ *
+ * \param[in] spp  SimplePost instance to act on
+ * \param[in] spsp File to stop sharing
+ */
+static void __unshare_file(simplepost_t spp, struct simplepost_serve* spsp)
+{
+	struct simpleclaim_list* claims; // Downloads of the file reserved for clients
+
+	if(spp->shared == NULL || spsp->shared_slot == 0) return;
+
+	simpleshare_wrlock(spp->shared);
+	simpleshare_remove(spp->shared, spsp->shared_slot);
+	claims = simpleshare_get_claims(spp->shared, spsp->shared_slot);
+	if(claims->first)
+	{
+		simpleclaim_lock(spp->claims);
+		simpleclaim_free_all(spp->claims, claims);
+		simpleclaim_unlock(spp->claims);
+	}
+	simpleshare_unlock(spp->shared);
+
+	spsp->shared_slot = 0;
+}
+
+/*!
+ * \brief Find the file being served on the given URI in the shared table, and
+ * reserve or count a download of it.
+ *
+ * \param[in] shared Table to search
+ * \param[in] claims Table to reserve the download in (NULL to count it right away)
+ * \param[out] spsp
+ * \parblock
+ * Request to serve the file
+ *
+ * The name and path of the file and its MIME type (if it is known) are copied
+ * into simplepost_state::file and simplepost_state::mime_type. The download
+ * is reserved as described for simpleclaim_reserve(), in
+ * simplepost_state::claim and simplepost_state::claim_serial.
+ * \endparblock
+ * \param[out] is_last Is this the last time the file may be downloaded?
+ * \param[out] direct  Should the file be read with O_DIRECT?
+ * \param[in] uri    Uniform Resource Identifier of the file
+ *
+ * \return the length of the name and path of the file. If the return value is
+ * zero, no file may be downloaded from the URI (or an error occurred).
+ */
+static size_t __find_shared_file(
+	simpleshare_t shared,
+	simpleclaim_table_t claims,
+	struct simplepost_state* spsp,
+	bool* is_last,
+	bool* direct,
+	const char* uri)
+{
+	uint32_t slot;           // Slot of the file
+	uint32_t count;          // Number of times the file may still be downloaded
+	bool ok;                 // May the file be downloaded?
+	const char* file;        // Name and path of the file
+	const char* mime_type;   // MIME type of the file
+	size_t file_length = 0;  // Length of the name and path of the file
+	size_t mime_type_length; // Length of the MIME type of the file
+
+	simpleshare_rdlock(shared);
+
+	slot = simpleshare_find(shared, uri);
+	if(slot == 0) goto error;
+
+	count = simpleshare_get_count(shared, slot);
+	if(claims && count > 0)
+	{
+		/* Downloads are only counted, whether they were reserved or not,
+		 * with the lock on the reservations held, so a file is never
+		 * reserved for more clients than it has downloads left.
+		 */
+		simpleclaim_lock(claims);
+		count = simpleshare_get_count(shared, slot);
+		ok = (count != SIMPLESHARE_EXPIRED && simpleclaim_reserve(
+			claims,
+			simpleshare_get_claims(shared, slot),
+			count,
+			spsp->client,
+			spsp->is_resume,
+			slot,
+			&spsp->claim,
+			&spsp->claim_serial,
+			is_last));
+		if(ok && spsp->claim == 0) ok = simpleshare_count_download(shared, slot, is_last);
+		simpleclaim_unlock(claims);
+	}
+	else
+	{
+		ok = simpleshare_count_download(shared, slot, is_last);
+	}
+	if(ok == false) goto error;
+	*direct = simpleshare_is_direct(shared, slot);
+
+	file = simpleshare_get_file(shared, slot);
+	file_length = strlen(file);
+	if(__copy_to_buffer(&spsp->file, &spsp->file_size, 0, file, file_length) == false)
+	{
+		file_length = 0;
+		goto error;
+	}
+	spsp->file_length = file_length;
+
+	mime_type = simpleshare_get_mime_type(shared, slot);
+	if(mime_type)
+	{
+		mime_type_length = strlen(mime_type);
+		if(__copy_to_buffer(&spsp->mime_type, &spsp->mime_type_size, 0, mime_type, mime_type_length))
+		{
+			spsp->mime_type_length = mime_type_length;
+		}
+	}
+
+error:
+	simpleshare_unlock(shared);
+
+	return file_length;
+}
+
+#ifdef HAVE_LIBMAGIC
+/*!
+ * \brief Remember the MIME type of a file in the shared table.
+ *
+ * \note Any process serving HTTP requests may do this, so the MIME type of
+ * each file only has to be looked up once.
+ *
+ * \param[in] shared    Table to act on
+ * \param[in] uri       Uniform Resource Identifier of the file
+ * \param[in] file      Name and path of the file
+ * \param[in] mime_type MIME type of the file
+ */
+static void __share_mime_type(
+	simpleshare_t shared,
+	const char* uri,
+	const char* file,
+	const char* mime_type)
+{
+	uint32_t slot; // Slot of the file
+
+	simpleshare_wrlock(shared);
+
+	slot = simpleshare_find(shared, uri);
+	if(slot && simpleshare_get_mime_type(shared, slot) == NULL && strcmp(simpleshare_get_file(shared, slot), file) == 0)
+	{
+		simpleshare_set_mime_type(shared, slot, mime_type);
+	}
+
+	simpleshare_unlock(shared);
+}
+#endif // HAVE_LIBMAGIC
+
+/*!
+ * \brief Map a table of signed links.
+ *
+ * \note Pages of the table are only backed by memory once they are touched,
+ * but links are spread evenly across it, so expect the whole table to be
+ * touched once a few thousand links have been downloaded.
+ *
+ * \note If the table is kept in a file, every instance using it holds a
+ * shared lock on the file. An instance which finds nobody else holding one
+ * (because the last one to use the table exited, perhaps without unlocking
+ * it) sets up the lock in the table again. A table which already exists keeps
+ * the number of links it was made for.
+ *
+ * \param[in] links Number of links which may be outstanding at once
+ * \param[in] path  Name and path of the file to keep the table in (NULL = only in memory)
+ * \param[out] size Size (in bytes) of the mapping
+ * \param[out] fd   File descriptor of the file (-1 if the table is only in memory)
+ *
+ * \return the table, or NULL if it could not be mapped
+ */
+static struct simplepost_signed* __map_signed(size_t links, const char* path, size_t* size, int* fd)
+{
+	struct simplepost_signed* table; // Table of signed links
+	pthread_mutexattr_t attr;        // Attributes of its lock
+	uint64_t buckets;                // Number of buckets in the table
+	struct stat file_status;         // Status of the file
+	bool is_new = true;              // Is the table being made?
+	bool is_alone = true;            // Is nobody else using the table?
+
+	*fd = -1;
+
+	// Leave one slot in every bucket spare.
+	buckets = ((uint64_t) links + SP_SIGNED_BUCKET - 2) / (SP_SIGNED_BUCKET - 1);
+	if(buckets == 0 || buckets > UINT32_MAX)
+	{
+		impact(0, "%s: Cannot make a table of %zu signed links\n",
+			SP_HTTP_HEADER_NAMESPACE,
+			links);
+		return NULL;
+	}
+
+	*size = sizeof(struct simplepost_signed) + sizeof(struct simplepost_signed_slot) * SP_SIGNED_BUCKET * buckets;
+
+	if(path == NULL)
+	{
+		table = (struct simplepost_signed*) mmap(NULL, *size,
+			PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if(table == MAP_FAILED)
+		{
+			impact(0, "%s: Cannot map the table of %zu signed links: %s\n",
+				SP_HTTP_HEADER_NAMESPACE,
+				links, strerror(errno));
+			return NULL;
+		}
+	}
+	else
+	{
+		*fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+		if(*fd == -1)
+		{
+			impact(0, "%s: Cannot open the table of signed links %s: %s\n",
+				SP_HTTP_HEADER_NAMESPACE,
+				path, strerror(errno));
+			return NULL;
+		}
+
+		if(flock(*fd, LOCK_EX | LOCK_NB) == -1)
+		{
+			if(errno != EWOULDBLOCK) goto error;
+			is_alone = false;
+		}
+
+		if(fstat(*fd, &file_status) == -1) goto error;
+		if(file_status.st_size == 0)
+		{
+			if(is_alone == false)
+			{
+				impact(0, "%s: The table of signed links %s is still being made by another instance\n",
+					SP_HTTP_HEADER_NAMESPACE,
+					path);
+				close(*fd);
+				*fd = -1;
+				return NULL;
+			}
+
+			#ifdef HAVE_POSIX_FALLOCATE
+			// Running out of disk space later would crash us while counting a download.
+			errno = posix_fallocate(*fd, 0, (off_t) *size);
+			if(errno != 0) goto error;
+			#else
+			if(ftruncate(*fd, (off_t) *size) == -1) goto error;
+			#endif // HAVE_POSIX_FALLOCATE
+		}
+		else
+		{
+			is_new = false;
+			*size = (size_t) file_status.st_size;
+		}
+
+		table = (struct simplepost_signed*) mmap(NULL, *size,
+			PROT_READ | PROT_WRITE, MAP_SHARED, *fd, 0);
+		if(table == MAP_FAILED) goto error;
+
+		if(is_new == false &&
+			(*size < sizeof(struct simplepost_signed) ||
+			table->magic != SP_SIGNED_MAGIC ||
+			table->size != *size ||
+			*size != sizeof(struct simplepost_signed) + sizeof(struct simplepost_signed_slot) * SP_SIGNED_BUCKET * (size_t) table->buckets))
+		{
+			impact(0, "%s: %s is not a table of signed links\n",
+				SP_HTTP_HEADER_NAMESPACE,
+				path);
+			munmap(table, *size);
+			close(*fd);
+			*fd = -1;
+			return NULL;
+		}
+	}
+
+	if(is_new)
+	{
+		table->magic = SP_SIGNED_MAGIC;
+		table->size = *size;
+		table->buckets = (uint32_t) buckets;
+		table->seed = 0x9E3779B97F4A7C15ULL;
+	}
+	else if(table->buckets != buckets)
+	{
+		impact(1, "%s: Keeping the size of the table of signed links %s, which counts %zu links\n",
+			SP_HTTP_HEADER_NAMESPACE,
+			path, (size_t) table->buckets * (SP_SIGNED_BUCKET - 1));
+	}
+
+	if(is_alone)
+	{
+		pthread_mutexattr_init(&attr);
+		pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+		pthread_mutex_init(&table->lock, &attr);
+		pthread_mutexattr_destroy(&attr);
+	}
+
+	// Let other instances use the table too, but not set it up again.
+	if(*fd != -1 && flock(*fd, LOCK_SH) == -1)
+	{
+		munmap(table, *size);
+		goto error;
+	}
+
+	return table;
+
+error:
+	impact(0, "%s: Cannot map the table of signed links %s: %s\n",
+		SP_HTTP_HEADER_NAMESPACE,
+		path, strerror(errno));
+	close(*fd);
+	*fd = -1;
+
+	return NULL;
+}
+
+/*!
+ * \brief Unmap a table of signed links.
+ *
+ * \param[in] table Table to unmap
+ * \param[in] size  Size (in bytes) of the mapping
+ * \param[in] fd    File descriptor of the file it is kept in (-1 if none)
+ */
+static void __unmap_signed(struct simplepost_signed* table, size_t size, int fd)
+{
+	if(table == NULL) return;
+
+	// Another instance may still be using a table kept in a file.
+	if(fd == -1) pthread_mutex_destroy(&table->lock);
+	munmap(table, size);
+	if(fd != -1) close(fd);
+}
+
+/*!
+ * \brief Get one of the two buckets a signed link may be in.
+ *
+ * \param[in] table     Table to act on
+ * \param[in] tag       Tag of the link
+ * \param[in] alternate Get the second bucket instead of the first?
+ *
+ * \return the index of the bucket
+ */
+static uint32_t __get_signed_bucket(const struct simplepost_signed* table, uint64_t tag, bool alternate)
+{
+	// The tag is already random, but both buckets cannot come from its top bits.
+	if(alternate) tag = __mix_hash(tag);
+
+	return (uint32_t) (((tag >> 32) * table->buckets) >> 32);
+}
+
+/*!
+ * \brief Add a signed link to the table.
+ *
+ * \note If both buckets of the link are full, a link is moved out of one of
+ * them to its other bucket, and so on, until one of the links finds a free
+ * slot. If there is still no room after SP_SIGNED_KICKS moves, every move is
+ * undone, so no link already in the table is ever lost.
+ *
+ * \warning The caller must hold simplepost_signed::lock.
+ *
+ * \param[in] table Table to act on
+ * \param[in] link  Link to add
+ * \param[in] now   Current time (seconds since the Epoch)
+ *
+ * \return true if the link was added, false if the table is full
+ */
+static bool __insert_signed(struct simplepost_signed* table, struct simplepost_signed_slot link, time_t now)
+{
+	size_t path[SP_SIGNED_KICKS]; // Slots of the links moved
+	size_t kicks = 0;             // Number of links moved
+
+	for(;;)
+	{
+		uint32_t buckets[2] = { __get_signed_bucket(table, link.tag, false), __get_signed_bucket(table, link.tag, true) };
+		struct simplepost_signed_slot swap; // Link moved out of its slot
+
+		for(size_t j = 0; j < 2; ++j)
+		{
+			struct simplepost_signed_slot* slots = table->slots + (size_t) buckets[j] * SP_SIGNED_BUCKET; // Bucket to check
+
+			for(size_t i = 0; i < SP_SIGNED_BUCKET; ++i)
+			{
+				if(slots[i].tag == 0 || slots[i].expires <= now)
+				{
+					slots[i] = link;
+					return true;
+				}
+			}
+		}
+
+		if(kicks == SP_SIGNED_KICKS) break;
+
+		// xorshift64: the links moved only need to differ from one attempt to the next.
+		table->seed ^= table->seed << 13;
+		table->seed ^= table->seed >> 7;
+		table->seed ^= table->seed << 17;
+
+		path[kicks] = (size_t) buckets[table->seed & 1] * SP_SIGNED_BUCKET + (size_t) ((table->seed >> 1) % SP_SIGNED_BUCKET);
+		swap = table->slots[path[kicks]];
+		table->slots[path[kicks]] = link;
+		link = swap;
+		++kicks;
+	}
+
+	while(kicks--)
+	{
+		struct simplepost_signed_slot swap = table->slots[path[kicks]]; // Link to put back
+
+		table->slots[path[kicks]] = link;
+		link = swap;
+	}
+
+	return false;
+}
+
+/*!
+ * \brief Count a download of a signed link.
+ *
+ * \param[in] table Table to act on
+ * \param[in] link  Link being downloaded (which must not have expired)
+ * \param[in] now   Current time (seconds since the Epoch)
+ *
+ * \retval MHD_HTTP_OK if the link may be downloaded
+ * \retval MHD_HTTP_GONE if it has already been downloaded COUNT times
+ * \retval MHD_HTTP_SERVICE_UNAVAILABLE if the table is too full to count it
+ */
+static unsigned int __count_signed_download(struct simplepost_signed* table, const struct simplesign_link* link, time_t now)
+{
+	struct simplepost_signed_slot slot;            // Slot of the link
+	unsigned int status = MHD_HTTP_OK;             // Status of the download
+	struct simplepost_signed_slot* found = NULL;   // Slot of the link in the table
+
+	memcpy(&slot.tag, link->signature, sizeof(slot.tag));
+	if(slot.tag == 0) slot.tag = 1;
+	slot.expires = (link->expires > (time_t) UINT32_MAX) ? UINT32_MAX : (uint32_t) link->expires;
+	slot.downloads = 1;
+
+	pthread_mutex_lock(&table->lock);
+
+	for(size_t j = 0; j < 2 && found == NULL; ++j)
+	{
+		struct simplepost_signed_slot* slots = table->slots + (size_t) __get_signed_bucket(table, slot.tag, j != 0) * SP_SIGNED_BUCKET; // Bucket to check
+
+		for(size_t i = 0; i < SP_SIGNED_BUCKET; ++i)
+		{
+			if(slots[i].tag == slot.tag && slots[i].expires > now)
+			{
+				found = &slots[i];
+				break;
+			}
+		}
+	}
+
+	if(found)
+	{
+		if(found->downloads >= link->count) status = MHD_HTTP_GONE;
+		else ++found->downloads;
+	}
+	else if(__insert_signed(table, slot, now) == false)
+	{
+		status = MHD_HTTP_SERVICE_UNAVAILABLE;
+	}
+
+	pthread_mutex_unlock(&table->lock);
+
+	return status;
+}
+
+/*!
+ * \brief Take back a download of a signed link counted by
+ * __count_signed_download(), because the file could not be sent after all.
+ *
+ * \param[in] table Table to act on
+ * \param[in] link  Link which was being downloaded
+ * \param[in] now   Current time (seconds since the Epoch)
+ */
+static void __uncount_signed_download(struct simplepost_signed* table, const struct simplesign_link* link, time_t now)
+{
+	uint64_t tag; // Tag of the link
+
+	memcpy(&tag, link->signature, sizeof(tag));
+	if(tag == 0) tag = 1;
+
+	pthread_mutex_lock(&table->lock);
+
+	for(size_t j = 0; j < 2; ++j)
+	{
+		struct simplepost_signed_slot* slots = table->slots + (size_t) __get_signed_bucket(table, tag, j != 0) * SP_SIGNED_BUCKET; // Bucket to check
+
+		for(size_t i = 0; i < SP_SIGNED_BUCKET; ++i)
+		{
+			if(slots[i].tag == tag && slots[i].expires > now)
+			{
+				if(slots[i].downloads) --slots[i].downloads;
+				pthread_mutex_unlock(&table->lock);
+				return;
+			}
+		}
+	}
+
+	pthread_mutex_unlock(&table->lock);
+}
+
+/*!
+ * \brief Check that a request is for a signed link which may be downloaded.
+ *
+ * \note The link is checked with nothing but the key, so the file it is for
+ * does not have to be served separately for each link. Its download is not
+ * counted yet (see __count_signed_request()).
+ *
+ * \param[in] spp        SimplePost instance to act on
+ * \param[in] connection Connection the request was made on
+ * \param[in] uri        URI of the request (without its query string)
+ * \param[out] link      Link requested
+ *
+ * \retval MHD_HTTP_OK if the file on the URI may be served
+ * \retval MHD_HTTP_FORBIDDEN if the link is not signed, or not signed correctly
+ * \retval MHD_HTTP_GONE if the link has expired
+ */
+static unsigned int __check_signed_request(
+	simplepost_t spp,
+	struct MHD_Connection* connection,
+	const char* uri,
+	struct simplesign_link* link)
+{
+	if(simplesign_check_uri(spp->sign_key, uri,
+		MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "expires"),
+		MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "count"),
+		MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "id"),
+		MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "signature"),
+		link) == false)
+	{
+		impact(0, "%s: Request 0x%lx: Missing or invalid signature: %s\n",
+			SP_HTTP_HEADER_NAMESPACE, pthread_self(),
+			uri);
+		return MHD_HTTP_FORBIDDEN;
+	}
+
+	if(link->expires <= time(NULL))
+	{
+		impact(0, "%s: Request 0x%lx: Signed link has expired: %s\n",
+			SP_HTTP_HEADER_NAMESPACE, pthread_self(),
+			uri);
+		return MHD_HTTP_GONE;
+	}
+
+	return MHD_HTTP_OK;
+}
+
+/*!
+ * \brief Count a download of a signed link checked by
+ * __check_signed_request().
+ *
+ * \note This is only done once the file on the link has been found and
+ * opened, so a request which fails before then does not use up the link. If
+ * the file cannot be sent after all, take the download back with
+ * __uncount_signed_download().
+ *
+ * \param[in] spp  SimplePost instance to act on
+ * \param[in] link Link requested
+ * \param[in] uri  URI of the request (without its query string)
+ *
+ * \retval MHD_HTTP_OK if the file may be sent
+ * \retval MHD_HTTP_GONE if the link has been downloaded COUNT times
+ * \retval MHD_HTTP_SERVICE_UNAVAILABLE if too many links are outstanding
+ */
+static unsigned int __count_signed_request(simplepost_t spp, const struct simplesign_link* link, const char* uri)
+{
+	unsigned int status; // Status of the request
+
+	// Links which may be downloaded any number of times are never counted.
+	if(link->count == 0) return MHD_HTTP_OK;
+
+	status = __count_signed_download(spp->signed_links, link, time(NULL));
+	if(status == MHD_HTTP_GONE)
+	{
+		impact(0, "%s: Request 0x%lx: Signed link has been downloaded %u times: %s\n",
+			SP_HTTP_HEADER_NAMESPACE, pthread_self(),
+			link->count, uri);
+	}
+	else if(status == MHD_HTTP_SERVICE_UNAVAILABLE)
+	{
+		impact(0, "%s: Request 0x%lx: Too many signed links are outstanding to count another: %s\n",
+			SP_HTTP_HEADER_NAMESPACE, pthread_self(),
+			uri);
+	}
+
+	return status;
+}
+
+/*!
+ * \brief Start watching a file being served for changes.
+ *
+ * \note If the directory of the file cannot be watched, the file is served
+ * anyway; its changes just go unnoticed.
+ *
+ * \warning The caller must hold simplepost::files_lock, and changes to the
+ * files must be watched (see simplepost_set_watch()).
+ *
+ * \param[in] spp  SimplePost instance to act on
+ * \param[in] spsp File to watch
+ */
+static void __watch_file(simplepost_t spp, struct simplepost_serve* spsp)
+{
+	if(spsp->watch == NULL) spsp->watch = simplewatch_add(spp->watch, spsp->file, spsp);
+}
+
+/*!
+ * \brief Stop watching a file for changes.
+ *
+ * \warning The caller must hold simplepost::files_lock.
+ *
+ * \param[in] spp  SimplePost instance to act on
+ * \param[in] spsp File to stop watching
+ */
+static void __unwatch_file(simplepost_t spp, struct simplepost_serve* spsp)
+{
+	if(spsp->watch == NULL) return;
+
+	simplewatch_remove(spp->watch, spsp->watch);
+	spsp->watch = NULL;
+}
+
+/*!
+ * \brief Unlink the given file from the list of files being served and free
+ * it.
+ *
+ * \warning The caller must hold simplepost::files_lock.
+ *
+ * \param[in] spp  SimplePost instance to act on
+ * \param[in] spsp File to unlink
+ */
+static void __unlink_file(simplepost_t spp, struct simplepost_serve* spsp)
+{
+	if(spsp == spp->files_tail) spp->files_tail = spsp->prev;
+
+	if(spsp == spp->files) spp->files = __simplepost_serve_remove(spsp, 1);
+	else __simplepost_serve_remove(spsp, 1);
+}
+
+/*!
+ * \brief Stop serving the given file.
+ *
+ * \note If a listing cursor is positioned on the file, it will only be
+ * flagged as removed. The cursor needs the element to find its way to the
+ * rest of the list. The element will be freed when the last cursor moves past
+ * it.
+ *
+ * \warning The caller must hold simplepost::files_lock.
+ *
+ * \param[in] spp  SimplePost instance to act on
+ * \param[in] spsp File to remove
+ */
+static void __remove_file(simplepost_t spp, struct simplepost_serve* spsp)
+{
+	--(spp->files_count);
+	if(spsp->count == 0) --(spp->files_unlimited);
+	else spp->files_remaining -= spsp->count;
+
+	if(spsp->timer)
+	{
+		simpletimer_remove(spp->timers, spsp->timer);
+		spsp->timer = NULL;
+	}
+
+	__unindex_file(spp, spsp);
+	__unshare_file(spp, spsp);
+
+	if(spsp->claims.first)
+	{
+		simpleclaim_lock(spp->claims);
+		simpleclaim_free_all(spp->claims, &spsp->claims);
+		simpleclaim_unlock(spp->claims);
+	}
+
+	__unwatch_file(spp, spsp);
+
+	if(spsp->pins > 0) spsp->removed = true;
+	else __unlink_file(spp, spsp);
+
+	if(spp->files_count == 0) pthread_cond_broadcast(&spp->files_cond);
+}
+
+/*!
+ * \brief Change the number of times the given file may be downloaded.
+ *
+ * \note Always use this function to change simplepost_serve::count of a file
+ * in the list. It keeps the totals reported by simplepost_get_status() up to
+ * date.
+ *
+ * \warning The caller must hold simplepost::files_lock.
+ *
+ * \param[in] spp   SimplePost instance to act on
+ * \param[in] spsp  File to modify
+ * \param[in] count New COUNT of the file (zero is unlimited)
+ */
+static void __set_file_count(simplepost_t spp, struct simplepost_serve* spsp, unsigned int count)
+{
+	if(spsp->count == 0) --(spp->files_unlimited);
+	else spp->files_remaining -= spsp->count;
+
+	spsp->count = count;
+
+	if(spsp->count == 0) ++(spp->files_unlimited);
+	else spp->files_remaining += spsp->count;
+}
+
+/*!
+ * \brief Release a file pinned by a listing cursor.
+ *
+ * \warning The caller must hold simplepost::files_lock.
+ *
+ * \param[in] spp  SimplePost instance to act on
+ * \param[in] spsp File to release
+ */
+static void __release_file(simplepost_t spp, struct simplepost_serve* spsp)
+{
+	if(--(spsp->pins) == 0 && spsp->removed) __unlink_file(spp, spsp);
+}
+
+/*!
+ * \brief Append a change to the list of files to the journal.
+ *
+ * \warning The caller must hold simplepost::files_lock, so that records are
+ * appended in the same order as the changes they describe are made.
+ *
+ * \param[in] spp   SimplePost instance to act on
+ * \param[in] type  Type of change made
+ * \param[in] file  Name and path of the file changed (may be NULL)
+ * \param[in] uri   Uniform Resource Identifier of the file changed
+ * \param[in] count New COUNT of the file
+ * \param[in] flags How the file is served (SIMPLEJOURNAL_FLAG_*)
+ */
+static void __journal_file(
+	simplepost_t spp,
+	enum simplejournal_type type,
+	const char* file,
+	const char* uri,
+	unsigned int count,
+	unsigned int flags)
+{
+	if(spp->journal) simplejournal_append(spp->journal, type, file, uri, count, flags);
+}
+
+/*!
+ * \brief Append the COUNT and expiry time of the given file to the journal.
+ *
+ * \warning The caller must hold simplepost::files_lock.
+ *
+ * \param[in] spp  SimplePost instance to act on
+ * \param[in] spsp File inserted or changed
+ */
+static void __journal_serve(simplepost_t spp, struct simplepost_serve* spsp)
+{
+	__journal_file(spp, SIMPLEJOURNAL_SERVE, spsp->file, spsp->uri, spsp->count, spsp->direct ? SIMPLEJOURNAL_FLAG_DIRECT : 0);
+
+	// Replaying the SIMPLEJOURNAL_SERVE record clears the expiry time, so only a new one needs a record.
+	if(spsp->timer)
+	{
+		__journal_file(spp, SIMPLEJOURNAL_EXPIRE, NULL, spsp->uri,
+			(simpletimer_get_expiry(spsp->timer) > UINT32_MAX) ? UINT32_MAX : (unsigned int) simpletimer_get_expiry(spsp->timer), 0);
+	}
+}
+
+/*!
+ * \brief Publish an event to every subscriber and callback.
+ *
+ * \note This function never blocks on a subscriber. If a subscriber's queue
+ * is full (or we fail to allocate its copy of the event), the event is
+ * dropped for that subscriber, and the drop is reported with the next event
+ * it does receive. Inline callbacks, on the other hand, run on this thread
+ * before this function returns.
+ *
+ * \warning Since inline callbacks may call back into this instance, this
+ * function MUST NOT be called with simplepost::files_lock held.
+ *
+ * \param[in] spp         SimplePost instance to act on
+ * \param[in] type        What happened
+ * \param[in] file        Name and path of the file on the filesystem
+ * \param[in] uri         Uniform Resource Identifier of the file
+ * \param[in] bytes       Number of bytes relevant to the event
+ * \param[in] count       Number of times the file may still be downloaded
+ * \param[in] termination Reason the request was terminated (downloads only)
+ */
+static void __publish_event(
+	simplepost_t spp,
+	enum simplepost_event_type type,
+	const char* file,
+	const char* uri,
+	size_t bytes,
+	unsigned int count,
+	int termination)
+{
+	struct simplepost_event event; // Event to publish
+
+	memset(&event, 0, sizeof(struct simplepost_event));
+	event.type = type;
+	event.file = (char*) file;
+	event.uri = (char*) uri;
+	event.bytes = bytes;
+	event.count = count;
+	event.termination = termination;
+
+	pthread_mutex_lock(&spp->events_lock);
+	for(struct simplepost_subscriber* p = spp->subscribers; p; p = p->next)
+	{
+		simplepost_event_t spep; // Subscriber's copy of the event
+
+		if((p->mask & SP_EVENT_MASK(type)) == 0) continue;
+
+		if(p->length == p->depth)
+		{
+			++(p->dropped);
+			continue;
+		}
+
+		spep = __simplepost_event_init(&event);
+		if(spep == NULL)
+		{
+			++(p->dropped);
+			continue;
+		}
+
+		spep->dropped = p->dropped;
+		p->dropped = 0;
+
+		p->events[(p->head + p->length) % p->depth] = spep;
+		++(p->length);
+
+		pthread_cond_signal(&p->ready);
+	}
+	pthread_mutex_unlock(&spp->events_lock);
+
+	if(__atomic_load_n(&spp->callbacks_count, __ATOMIC_RELAXED) == 0) return;
+
+	pthread_rwlock_rdlock(&spp->callbacks_lock);
+	for(struct simplepost_callback* p = spp->callbacks; p; p = p->next)
+	{
+		if(p->mask & SP_EVENT_MASK(type)) p->callback(&event, p->arg);
+	}
+	pthread_rwlock_unlock(&spp->callbacks_lock);
+}
+
+/*!
+ * \brief Run an executor callback until it is removed.
+ *
+ * \note Every event queued before the callback was removed is still handed
+ * to it before the executor exits.
+ *
+ * \param[in] p SimplePost callback (struct simplepost_callback*)
+ *
+ * \return NULL
+ */
+static void* __run_executor(void* p)
+{
+	struct simplepost_callback* spcp = (struct simplepost_callback*) p; // Properly cast callback handle
+	struct simplepost_subscriber* spsp = spcp->subscriber;              // Queue of events to run the callback for
+	simplepost_t spp = spcp->spp;                                       // SimplePost instance to act on
+	simplepost_event_t event;                                           // Next event
+
+	pthread_mutex_lock(&spp->events_lock);
+	for(;;)
+	{
+		while(spsp->length == 0 && spcp->running) pthread_cond_wait(&spsp->ready, &spp->events_lock);
+		if(spsp->length == 0) break;
+
+		event = spsp->events[spsp->head];
+		spsp->head = (spsp->head + 1) % spsp->depth;
+		--(spsp->length);
+		pthread_mutex_unlock(&spp->events_lock);
+
+		spcp->callback(event, spcp->arg);
+		simplepost_event_free(event);
+
+		pthread_mutex_lock(&spp->events_lock);
+	}
+	pthread_mutex_unlock(&spp->events_lock);
+
+	return NULL;
+}
+
+/*!
+ * \brief Count a download of a file in the list.
+ *
+ * \warning The caller must hold simplepost::files_lock, and the file must not
+ * be downloaded an unlimited number of times.
+ *
+ * \param[in] spp  SimplePost instance to act on
+ * \param[in] spsp File which was downloaded
+ *
+ * \return true if the file reached its COUNT and was removed, false if it may
+ * still be downloaded
+ */
+static bool __count_download(simplepost_t spp, struct simplepost_serve* spsp)
+{
+	__journal_file(spp, SIMPLEJOURNAL_DOWNLOAD, NULL, spsp->uri, 0, 0);
+
+	if(spsp->count == 1)
+	{
+		impact(2, "%s: FILE %s has reached its COUNT and will be removed\n",
+			SP_HTTP_HEADER_NAMESPACE,
+			spsp->file);
+
+		__remove_file(spp, spsp);
+		return true;
+	}
+
+	__set_file_count(spp, spsp, spsp->count - 1);
+	return false;
+}
+
+/*!
+ * \brief Reserve a download of a file in the list for the client of a request.
+ *
+ * \warning The caller must hold simplepost::files_lock.
+ *
+ * \param[in] claims    Table to reserve the download in
+ * \param[in] spsp      File to download
+ * \param[inout] state
+ * \parblock
+ * Request to serve the file
+ *
+ * The reservation is stored in simplepost_state::claim and
+ * simplepost_state::claim_serial; the former is zero if nothing was reserved.
+ * \endparblock
+ * \param[out] is_last  Is this the last time the file may be downloaded?
+ *
+ * \retval true the file may be served
+ * \retval false every download of the file is reserved already
+ */
+static bool __reserve_claimed_download(
+	simpleclaim_table_t claims,
+	struct simplepost_serve* spsp,
+	struct simplepost_state* state,
+	bool* is_last)
+{
+	bool ok; // May the file be served?
+
+	simpleclaim_lock(claims);
+	ok = simpleclaim_reserve(
+		claims,
+		&spsp->claims,
+		spsp->count,
+		state->client,
+		state->is_resume,
+		0,
+		&state->claim,
+		&state->claim_serial,
+		is_last);
+	simpleclaim_unlock(claims);
+
+	if(state->claim) state->claim_file = spsp;
+
+	return ok;
+}
+
+/*!
+ * \brief Get the name and path of the file to serve from the given URI.
+ *
+ * \note This function compares the given URI to the list of files we are
+ * serving. The URI does not necessarily correspond one-to-one to an actual
+ * file on the filesystem, hence the need for this function.
+ *
+ * \warning The file count is taken into consideration by this function. A
+ * download of a file found matching the URI is reserved for the client (see
+ * simpleclaim_reserve()), and only counted by __finish_download() once the
+ * client has been sent the whole file. If the download cannot be reserved,
+ * the file count is decremented right away instead, and the file is removed
+ * from the list of files being served if it reaches the maximum allowable
+ * times it may be served.
+ *
+ * \param[in] spp   SimplePost instance to act on
+ * \param[out] spsp
+ * \parblock
+ * Request to serve the file
+ *
+ * The name and path of the file on the filesystem are copied into
+ * simplepost_state::file, and its MIME type into simplepost_state::mime_type
+ * if we have already determined it. Their lengths are zero if they are not.
+ * The client is identified by simplepost_state::client, and the reservation
+ * is stored in simplepost_state::claim.
+ * \endparblock
+ * \param[out] is_last Is this the last time the file may be downloaded?
+ * \param[out] direct  Should the file be read with O_DIRECT?
+ * \param[in] uri   Uniform Resource Identifier to parse
+ *
+ * \return the number of characters written to the output string. If the
+ * return value is zero, either the URI does not specify a valid file, or
+ * another (more serious) error occurred
+ */
+static size_t __get_filename_from_uri(
+	simplepost_t spp,
+	struct simplepost_state* spsp,
+	bool* is_last,
+	bool* direct,
+	const char* uri)
+{
+	size_t file_length = 0;       // Length of the file name and path
+	bool is_expired = false;      // Did the file reach its COUNT?
+	spsp->file_length = 0;        // Failsafe
+	spsp->mime_type_length = 0;   // Failsafe
+	spsp->claim = 0;              // Failsafe
+	*is_last = false;             // Failsafe
+	*direct = false;              // Failsafe
+
+	struct simplepost_serve* p;                           // File being served on the URI
+	simpleclaim_table_t claims = __get_claims(spp);       // Table to reserve the download in
+
+	pthread_mutex_lock(&spp->files_lock);
+
+	/* Once the files have been handed off, the other process counts the
+	 * downloads. Serving any more from here would exceed their COUNTs.
+	 */
+	if(spp->quiesced) goto error;
+
+	if(spp->shared)
+	{
+		/* The downloads are counted in the table shared with the worker
+		 * processes, which are forked before any files are added to the list.
+		 * __reap_shared_files() catches the list up with them.
+		 */
+		file_length = __find_shared_file(spp->shared, __get_claims(spp), spsp, is_last, direct, uri);
+	}
+	else if((p = __find_file(spp, uri)) && (p->timer == NULL || simpletimer_get_expiry(p->timer) > time(NULL)) &&
+		(p->count == 0 || claims == NULL || __reserve_claimed_download(claims, p, spsp, is_last)))
+	{
+		/* The timer thread removes a file at the start of the second it
+		 * expires, but it may not have got to it yet.
+		 */
+		file_length = strlen(p->file);
+		if(__copy_to_buffer(&spsp->file, &spsp->file_size, 0, p->file, file_length) == false)
+		{
+			file_length = 0;
+			goto error;
+		}
+		spsp->file_length = file_length;
+		*direct = p->direct;
+
+		if(p->mime_type)
+		{
+			size_t mime_type_length = strlen(p->mime_type); // Length of the MIME type
+			if(__copy_to_buffer(&spsp->mime_type, &spsp->mime_type_size, 0, p->mime_type, mime_type_length))
+			{
+				spsp->mime_type_length = mime_type_length;
+			}
+		}
+
+		if(p->count > 0 && spsp->claim == 0) is_expired = __count_download(spp, p);
+	}
+
+	if(file_length == 0 && spp->index)
+	{
+		const char* file;      // Name and path of the indexed file on the URI
+		const char* mime_type; // MIME type of the indexed file
+
+		if(simpleindex_find(spp->index, uri, &file, &mime_type) == false) goto error;
+
+		file_length = strlen(file);
+		if(__copy_to_buffer(&spsp->file, &spsp->file_size, 0, file, file_length) == false)
+		{
+			file_length = 0;
+			goto error;
+		}
+		spsp->file_length = file_length;
+
+		if(mime_type)
+		{
+			size_t mime_type_length = strlen(mime_type); // Length of the MIME type
+			if(__copy_to_buffer(&spsp->mime_type, &spsp->mime_type_size, 0, mime_type, mime_type_length))
+			{
+				spsp->mime_type_length = mime_type_length;
+			}
+		}
+	}
+
+error:
+	pthread_mutex_unlock(&spp->files_lock);
+
+	if(is_expired)
+	{
+		*is_last = true;
+		__publish_event(spp, SP_EVENT_FILE_EXPIRED, file_length ? spsp->file : NULL, uri, 0, 0, 0);
+	}
+
+	return file_length;
+}
+
+/*!
+ * \brief Finish a request for a download reserved for its client.
+ *
+ * \note The download is counted once the client has been sent the whole file
+ * (see simpleclaim_finish()). Once the files have been handed off to another
+ * process, nothing is counted here any more; the downloads reserved were
+ * counted before they were handed off.
+ *
+ * \param[in] spp      SimplePost instance to act on
+ * \param[inout] spsp  Request to finish (simplepost_state::claim is cleared)
+ * \param[in] bytes    Number of bytes of the file sent, from simplepost_state::body_offset on
+ * \param[in] is_sent  Was the whole response sent?
+ */
+static void __finish_download(simplepost_t spp, struct simplepost_state* spsp, size_t bytes, bool is_sent)
+{
+	uint32_t grace = __atomic_load_n(&spp->claims_grace, __ATOMIC_RELAXED); // Seconds the client has to resume the download
+	simpleclaim_t claim;                                                    // Reservation of the request (NULL if it was freed)
+	struct simplepost_serve* p = NULL;                                      // File to count the download of
+	bool is_expired = false;                                                // Did the file reach its COUNT?
+	bool is_last;                                                           // Was this the last download of the file?
+
+	pthread_mutex_lock(&spp->files_lock);
+	if(spp->shared) simpleshare_rdlock(spp->shared);
+	simpleclaim_lock(spp->claims);
+
+	// The reservation is freed if the file is no longer served.
+	claim = simpleclaim_get(spp->claims, spsp->claim, spsp->claim_serial);
+	if(claim && spp->shared)
+	{
+		uint32_t slot = simpleclaim_get_slot(claim); // Slot of the file
+
+		if(simpleclaim_finish(spp->claims, claim, simpleshare_get_claims(spp->shared, slot), spsp->body_total, spsp->body_offset, bytes, is_sent, grace))
+		{
+			simpleshare_count_download(spp->shared, slot, &is_last);
+		}
+	}
+	else if(claim)
+	{
+		if(simpleclaim_finish(spp->claims, claim, &spsp->claim_file->claims, spsp->body_total, spsp->body_offset, bytes, is_sent, grace))
+		{
+			p = spsp->claim_file;
+		}
+	}
+
+	simpleclaim_unlock(spp->claims);
+	if(spp->shared) simpleshare_unlock(spp->shared);
+
+	// Removing the file frees its reservations, so the table must be unlocked.
+	if(p && spp->quiesced == false) is_expired = __count_download(spp, p);
+	pthread_mutex_unlock(&spp->files_lock);
+
+	spsp->claim = 0;
+
+	if(is_expired) __publish_event(spp, SP_EVENT_FILE_EXPIRED, spsp->file, spsp->uri, 0, 0, 0);
+}
+
+/*!
+ * \brief Count every download reserved for a client as if it had finished.
+ *
+ * \note This is done before the files are handed off to another process,
+ * which cannot know about the reservations, so a download being resumed is
+ * never served more times than its file may be downloaded.
+ *
+ * \warning The caller must hold simplepost::files_lock.
+ *
+ * \param[in] spp        SimplePost instance to act on
+ * \param[inout] expired Files which reached their COUNT, to publish events for once simplepost::files_lock is released
+ */
+static void __count_claimed_downloads(simplepost_t spp, simplepost_file_t* expired)
+{
+	if(spp->claims == NULL) return;
+
+	for(struct simplepost_serve* p = spp->files; p; )
+	{
+		struct simplepost_serve* next = p->next; // Next file in the list
+		uint32_t claimed;                        // Number of downloads of the file reserved
+
+		if(p->removed || p->claims.first == 0)
+		{
+			p = next;
+			continue;
+		}
+
+		simpleclaim_lock(spp->claims);
+		claimed = p->claims.count;
+		simpleclaim_free_all(spp->claims, &p->claims);
+		simpleclaim_unlock(spp->claims);
+
+		for(; claimed > 0; --claimed)
+		{
+			if(p->count == 1)
+			{
+				simplepost_file_t f = simplepost_file_init(); // Copy of the file for the event
+
+				if(f)
+				{
+					f->file = (char*) malloc(sizeof(char) * (strlen(p->file) + 1));
+					if(f->file) strcpy(f->file, p->file);
+					f->uri = (char*) malloc(sizeof(char) * (strlen(p->uri) + 1));
+					if(f->uri) strcpy(f->uri, p->uri);
+					f->next = *expired;
+					*expired = f;
+				}
+			}
+
+			if(__count_download(spp, p)) break;
+		}
+
+		p = next;
+	}
+}
+
+/*!
+ * \brief Files which expired while simplepost::files_lock was held
+ */
+struct simplepost_expiry
+{
+	/// SimplePost instance to act on
+	simplepost_t spp;
+
+	/// Files which expired, to publish events for once simplepost::files_lock is released
+	simplepost_file_t expired;
+};
+
+/*!
+ * \brief Catch a file in the list up with the downloads counted in its slot
+ * of the table shared with the worker processes.
+ *
+ * \warning The caller must hold simplepost::files_lock.
+ *
+ * \param[in] slot   Slot of the file
+ * \param[inout] arg Files which reached their COUNT so far (struct simplepost_expiry*)
+ */
+static void __reap_shared_slot(uint32_t slot, void* arg)
+{
+	struct simplepost_expiry* expiry = (struct simplepost_expiry*) arg; // Files which reached their COUNT so far
+	simplepost_t spp = expiry->spp;                                      // SimplePost instance to act on
+	const char* uri;                                                     // URI of the file
+	struct simplepost_serve* p;                                          // File in the list
+	uint32_t count;                                                      // Number of times the file may still be downloaded
+
+	// Only we change the files in the table, so they cannot change under us.
+	uri = simpleshare_get_uri(spp->shared, slot);
+	if(uri == NULL) return;
+	p = __find_file(spp, uri);
+	if(p == NULL || p->removed || p->shared_slot != slot || p->count == 0) return;
+
+	count = simpleshare_get_count(spp->shared, slot);
+	if(count == SIMPLESHARE_EXPIRED)
+	{
+		simplepost_file_t f = simplepost_file_init(); // Copy of the file for the event
+
+		impact(2, "%s: FILE %s has reached its COUNT and will be removed\n",
+			SP_HTTP_HEADER_NAMESPACE,
+			p->file);
+
+		if(f)
+		{
+			f->file = (char*) malloc(sizeof(char) * (strlen(p->file) + 1));
+			if(f->file) strcpy(f->file, p->file);
+			f->uri = (char*) malloc(sizeof(char) * (strlen(p->uri) + 1));
+			if(f->uri) strcpy(f->uri, p->uri);
+			f->next = expiry->expired;
+			expiry->expired = f;
+		}
+
+		__journal_file(spp, SIMPLEJOURNAL_PURGE, NULL, p->uri, 0, 0);
+		__remove_file(spp, p);
+	}
+	else if(count < p->count)
+	{
+		__set_file_count(spp, p, count);
+		__journal_serve(spp, p);
+	}
+}
+
+/*!
+ * \brief Catch the list of files up with the downloads counted in the table
+ * shared with the worker processes.
+ *
+ * \note The worker processes cannot change the list of files. They only count
+ * downloads in the shared table. This function journals those downloads,
+ * updates the COUNTs of the files in the list, and removes the files which
+ * have been downloaded as many times as they may be. Only the slots marked
+ * since the last time are looked at (see simpleshare_reap()).
+ *
+ * \param[in] spp SimplePost instance to act on
+ */
+static void __reap_shared_files(simplepost_t spp)
+{
+	struct simplepost_expiry expiry; // Files which reached their COUNT
+
+	expiry.spp = spp;
+	expiry.expired = NULL;
+
+	pthread_mutex_lock(&spp->files_lock);
+	if(spp->shared) simpleshare_reap(spp->shared, &__reap_shared_slot, &expiry);
+	pthread_mutex_unlock(&spp->files_lock);
+
+	for(simplepost_file_t f = expiry.expired; f; f = f->next)
+	{
+		if(f->file && f->uri) __publish_event(spp, SP_EVENT_FILE_EXPIRED, f->file, f->uri, 0, 0, 0);
+	}
+	simplepost_file_free(expiry.expired);
+}
+
+/*!
+ * \brief Stop serving a file which has reached its expiry time.
+ *
+ * \warning The caller must hold simplepost::files_lock.
+ *
+ * \param[in] timer  Timer of the file
+ * \param[in] data   File which expired (struct simplepost_serve*)
+ * \param[inout] arg Files which expired so far (struct simplepost_expiry*)
+ */
+static void __expire_file(simpletimer_t timer, void* data, void* arg)
+{
+	struct simplepost_serve* file = (struct simplepost_serve*) data;    // File which expired
+	struct simplepost_expiry* expiry = (struct simplepost_expiry*) arg; // Files which expired so far
+	simplepost_file_t f;                                                 // Copy of the file for the event
+
+	// Unused parameters
+	(void) timer;
+
+	impact(2, "%s: FILE %s has reached its expiry time and will be removed\n",
+		SP_HTTP_HEADER_NAMESPACE,
+		file->file);
+
+	f = simplepost_file_init();
+	if(f)
+	{
+		f->file = (char*) malloc(sizeof(char) * (strlen(file->file) + 1));
+		if(f->file) strcpy(f->file, file->file);
+		f->uri = (char*) malloc(sizeof(char) * (strlen(file->uri) + 1));
+		if(f->uri) strcpy(f->uri, file->uri);
+		f->next = expiry->expired;
+		expiry->expired = f;
+	}
+
+	// This removes the timer too.
+	__journal_file(expiry->spp, SIMPLEJOURNAL_PURGE, NULL, file->uri, 0, 0);
+	__remove_file(expiry->spp, file);
+}
+
+/*!
+ * \brief Advance the timing wheel to the given second, removing every file
+ * which has expired by then.
+ *
+ * \note See simpletimer_advance(). Advancing the wheel costs the same however
+ * many files are being served.
+ *
+ * \warning The caller must hold simplepost::files_lock.
+ *
+ * \param[in] spp        SimplePost instance to act on
+ * \param[in] now        Current time (seconds since the Epoch)
+ * \param[inout] expired Files which expired, to publish events for once simplepost::files_lock is released
+ */
+static void __advance_timers(simplepost_t spp, time_t now, simplepost_file_t* expired)
+{
+	struct simplepost_expiry expiry; // Files which expired
+
+	// Once the files have been handed off, they never change again.
+	if(spp->quiesced) return;
+
+	expiry.spp = spp;
+	expiry.expired = *expired;
+	simpletimer_advance(spp->timers, now, &__expire_file, &expiry);
+	*expired = expiry.expired;
+}
+
+/*!
+ * \brief Expire files until the instance is freed.
+ *
+ * \note This thread is only started once the first file is given an expiry
+ * time. It wakes at the start of every second while any file has one, and
+ * sleeps until the next one is given one otherwise.
+ *
+ * \param[in] p SimplePost instance to act on (simplepost_t)
+ *
+ * \return NULL
+ */
+static void* __run_timers(void* p)
+{
+	simplepost_t spp = (simplepost_t) p; // Properly cast instance handle
+	struct timespec now;                 // Current time
+	struct timespec deadline;            // Start of the next second
+
+	pthread_mutex_lock(&spp->files_lock);
+	while(spp->timers_exit == false)
+	{
+		simplepost_file_t expired = NULL; // Files which reached their expiry time
+
+		/* time() may read a coarser clock, which can still be on the last
+		 * second when we wake at the start of the next one.
+		 */
+		clock_gettime(CLOCK_REALTIME, &now);
+		__advance_timers(spp, now.tv_sec, &expired);
+		if(expired)
+		{
+			pthread_mutex_unlock(&spp->files_lock);
+			for(simplepost_file_t f = expired; f; f = f->next)
+			{
+				if(f->file && f->uri) __publish_event(spp, SP_EVENT_FILE_EXPIRED, f->file, f->uri, 0, 0, 0);
+			}
+			simplepost_file_free(expired);
+			pthread_mutex_lock(&spp->files_lock);
+			continue;
+		}
+
+		if(simpletimer_count(spp->timers) == 0)
+		{
+			pthread_cond_wait(&spp->timers_cond, &spp->files_lock);
+		}
+		else
+		{
+			deadline.tv_sec = now.tv_sec + 1;
+			deadline.tv_nsec = 0;
+			pthread_cond_timedwait(&spp->timers_cond, &spp->files_lock, &deadline);
+		}
+	}
+	pthread_mutex_unlock(&spp->files_lock);
+
+	return NULL;
+}
+
+/*!
+ * \brief Check a file being served which has changed since it was last
+ * checked.
+ *
+ * \note Whatever is remembered about a file which was modified or replaced
+ * (only its MIME type, since everything else is read from the file as it is
+ * served) is forgotten. A file which was deleted is purged if
+ * simplepost::watch_purge is set; otherwise it is left in the list, and
+ * requests for it fail until it is back.
+ *
+ * \warning The caller must hold simplepost::files_lock.
+ *
+ * \param[in] file   File in simplepost::watch
+ * \param[in] data   File which changed (struct simplepost_serve*)
+ * \param[inout] arg Files which were purged so far (struct simplepost_expiry*)
+ */
+static void __check_changed_file(simplewatch_file_t file, void* data, void* arg)
+{
+	struct simplepost_serve* p = (struct simplepost_serve*) data;     // File which changed
+	struct simplepost_expiry* spep = (struct simplepost_expiry*) arg; // Files which were purged so far
+	simplepost_t spp = spep->spp;                                     // SimplePost instance to act on
+	struct stat file_status;                                          // Status of the file
+
+	// Unused parameters
+	(void) file;
+
+	if(stat(p->file, &file_status) == -1 && (errno == ENOENT || errno == ENOTDIR))
+	{
+		if(spp->watch_purge == false || spp->quiesced)
+		{
+			impact(1, "%s: FILE %s was deleted\n",
+				SP_HTTP_HEADER_NAMESPACE,
+				p->file);
+			return;
+		}
+
+		impact(1, "%s: FILE %s was deleted and will be removed\n",
+			SP_HTTP_HEADER_NAMESPACE,
+			p->file);
+
+		simplepost_file_t f = simplepost_file_init(); // Copy of the file for the event
+		if(f)
+		{
+			f->file = (char*) malloc(sizeof(char) * (strlen(p->file) + 1));
+			if(f->file) strcpy(f->file, p->file);
+			f->uri = (char*) malloc(sizeof(char) * (strlen(p->uri) + 1));
+			if(f->uri) strcpy(f->uri, p->uri);
+			f->next = spep->expired;
+			spep->expired = f;
+		}
+
+		__journal_file(spp, SIMPLEJOURNAL_PURGE, NULL, p->uri, 0, 0);
+		__remove_file(spp, p);
+		return;
+	}
+
+	impact(2, "%s: FILE %s changed\n",
+		SP_HTTP_HEADER_NAMESPACE,
+		p->file);
+
+	#ifdef HAVE_LIBMAGIC
+	if(p->mime_type)
+	{
+		free(p->mime_type);
+		p->mime_type = NULL;
+	}
+	if(spp->shared && p->shared_slot)
+	{
+		simpleshare_wrlock(spp->shared);
+		simpleshare_set_mime_type(spp->shared, p->shared_slot, NULL);
+		simpleshare_unlock(spp->shared);
+	}
+	#endif // HAVE_LIBMAGIC
+}
+
+/*!
+ * \brief Check the files which have changed since they were last checked.
+ *
+ * \note This is called by the thread of simplepost::watch once the files have
+ * stopped changing.
+ *
+ * \param[in] arg SimplePost instance to act on (simplepost_t)
+ */
+static void __check_changed_files(void* arg)
+{
+	struct simplepost_expiry purged; // Files which were purged
+
+	purged.spp = (simplepost_t) arg;
+	purged.expired = NULL;
+
+	// The files are no longer watched once the watcher is being stopped.
+	pthread_mutex_lock(&purged.spp->files_lock);
+	if(purged.spp->watch) simplewatch_check(purged.spp->watch, &__check_changed_file, &purged);
+	pthread_mutex_unlock(&purged.spp->files_lock);
+
+	for(simplepost_file_t f = purged.expired; f; f = f->next)
+	{
+		if(f->file && f->uri) __publish_event(purged.spp, SP_EVENT_FILE_EXPIRED, f->file, f->uri, 0, 0, 0);
+	}
+	simplepost_file_free(purged.expired);
+}
+
+/*!
+ * \brief Stop watching the files being served for changes.
+ *
+ * \warning The caller must hold simplepost::master_lock (unless the instance
+ * is being freed).
+ *
+ * \param[in] spp SimplePost instance to act on
+ */
+static void __stop_watches(simplepost_t spp)
+{
+	simplewatch_t watch; // Watcher to stop
+
+	pthread_mutex_lock(&spp->files_lock);
+	watch = spp->watch;
+	spp->watch = NULL;
+	if(watch)
+	{
+		for(struct simplepost_serve* p = spp->files; p; p = p->next) p->watch = NULL;
+	}
+	pthread_mutex_unlock(&spp->files_lock);
+
+	// The watch thread takes simplepost::files_lock, so it must be released first.
+	simplewatch_free(watch);
+}
+
+/*!
+ * \brief Start watching the files being served for changes.
+ *
+ * \warning The caller must hold simplepost::master_lock, and changes to the
+ * files must not be watched already.
+ *
+ * \param[in] spp SimplePost instance to act on
+ *
+ * \return true on success, false if an error occurred
+ */
+static bool __start_watches(simplepost_t spp)
+{
+	simplewatch_t watch; // Watcher to start
+
+	watch = simplewatch_init(&spp->files_lock, &__check_changed_files, spp);
+	if(watch == NULL)
+	{
+		if(errno == ENOSYS)
+		{
+			impact(0, "%s: Watching files for changes is not supported on this system\n",
+				SP_HTTP_HEADER_NAMESPACE);
+		}
+		else
+		{
+			impact(0, "%s: Cannot watch the files for changes: %s\n",
+				SP_HTTP_HEADER_NAMESPACE,
+				strerror(errno));
+		}
+		return false;
+	}
+
+	pthread_mutex_lock(&spp->files_lock);
+	spp->watch = watch;
+	for(struct simplepost_serve* p = spp->files; p; p = p->next)
+	{
+		if(p->removed == false) __watch_file(spp, p);
+	}
+	pthread_mutex_unlock(&spp->files_lock);
+
+	return true;
+}
+
+/*!
+ * \brief Change the time the given file stops being served.
+ *
+ * \note Always use this function to change the expiry time of a file in the
+ * list. The thread which expires the files is started the first time it is
+ * needed.
+ *
+ * \warning The caller must hold simplepost::files_lock.
+ *
+ * \param[in] spp     SimplePost instance to act on
+ * \param[in] spsp    File to modify
+ * \param[in] expires
+ * \parblock
+ * Time (seconds since the Epoch) to stop serving the file
+ *
+ * If this is zero, the file will be served until it reaches its COUNT or is
+ * purged. A time which has already passed expires the file within a second.
+ * \endparblock
+ *
+ * \return true on success, false if an error occurred (in which case the
+ * expiry time of the file is left untouched)
+ */
+static bool __set_file_expiry(simplepost_t spp, struct simplepost_serve* spsp, time_t expires)
+{
+	if(expires == 0)
+	{
+		if(spsp->timer)
+		{
+			simpletimer_remove(spp->timers, spsp->timer);
+			spsp->timer = NULL;
+		}
+		return true;
+	}
+
+	if(spsp->timer)
+	{
+		simpletimer_set_expiry(spp->timers, spsp->timer, expires);
+		return true;
+	}
+
+	if(spp->timers == NULL)
+	{
+		spp->timers = simpletimer_wheel_init();
+		if(spp->timers == NULL)
+		{
+			impact(0, "%s: %s: Failed to allocate memory for the timing wheel\n",
+				SP_HTTP_HEADER_NAMESPACE, SP_MAIN_HEADER_MEMORY_ALLOC);
+			return false;
+		}
+	}
+
+	if(spp->timers_running == false)
+	{
+		int err = pthread_create(&spp->timers_thread, NULL, __run_timers, spp); // Error starting the thread
+		if(err != 0)
+		{
+			impact(0, "%s: Failed to start the timer thread: %s\n",
+				SP_HTTP_HEADER_NAMESPACE,
+				strerror(err));
+			return false;
+		}
+		spp->timers_running = true;
+	}
+
+	spsp->timer = simpletimer_add(spp->timers, spsp, expires);
+	if(spsp->timer == NULL)
+	{
+		impact(0, "%s: %s: Failed to allocate memory for the expiry time of FILE %s\n",
+			SP_HTTP_HEADER_NAMESPACE, SP_MAIN_HEADER_MEMORY_ALLOC,
+			spsp->file);
+		return false;
+	}
+
+	// The wheel stands still while it is empty, so wake the timer thread.
+	if(simpletimer_count(spp->timers) == 1) pthread_cond_signal(&spp->timers_cond);
+
+	return true;
+}
+
+#ifdef HAVE_LIBMAGIC
+/*!
+ * \brief Determine the MIME type of the given file.
+ *
+ * \note The magic database is only loaded once, the first time this function
+ * is called, rather than for every request. libmagic handles are not
+ * thread-safe, so access to it is serialized. That is why the file is read
+ * from a descriptor which is already open: opening it by name would make
+ * every other request wait for the path to be resolved too.
+ *
+ * \param[in] spp   SimplePost instance to act on
+ * \param[out] spsp Request to copy the MIME type into (simplepost_state::mime_type)
+ * \param[in] fd    File descriptor of the file opened by __open_file()
+ *
+ * \return true if the MIME type of the file was determined, false if not
+ */
+static bool __get_mime_type(simplepost_t spp, struct simplepost_state* spsp, int fd)
+{
+	const char* mime_type; // MIME type reported by libmagic
+	bool ret = false;      // Was the MIME type copied?
+
+	pthread_mutex_lock(&spp->magic_lock);
+
+	if(spp->magic == NULL)
+	{
+		spp->magic = magic_open(MAGIC_MIME_TYPE);
+		if(spp->magic && magic_load(spp->magic, NULL) == -1)
+		{
+			impact(2, "%s: Failed to load the magic database: %s\n",
+				SP_HTTP_HEADER_NAMESPACE,
+				magic_error(spp->magic));
+		}
+	}
+
+	if(spp->magic)
+	{
+		mime_type = magic_descriptor(spp->magic, fd);
+		if(mime_type)
+		{
+			size_t mime_type_length = strlen(mime_type); // Length of the MIME type
+			ret = __copy_to_buffer(&spsp->mime_type, &spsp->mime_type_size, 0, mime_type, mime_type_length);
+			if(ret) spsp->mime_type_length = mime_type_length;
+		}
+	}
+
+	pthread_mutex_unlock(&spp->magic_lock);
+
+	return ret;
+}
+
+/*!
+ * \brief Remember the MIME type of a file being served.
+ *
+ * \param[in] spp       SimplePost instance to act on
+ * \param[in] uri       Uniform Resource Identifier of the file
+ * \param[in] file      Name and path of the file
+ * \param[in] mime_type MIME type of the file
+ */
+static void __cache_mime_type(
+	simplepost_t spp,
+	const char* uri,
+	const char* file,
+	const char* mime_type)
+{
+	struct simplepost_serve* p; // File being served on the URI
+
+	pthread_mutex_lock(&spp->files_lock);
+	p = __find_file(spp, uri);
+	if(p && p->mime_type == NULL && strcmp(file, p->file) == 0)
+	{
+		p->mime_type = (char*) malloc(sizeof(char) * (strlen(mime_type) + 1));
+		if(p->mime_type) strcpy(p->mime_type, mime_type);
+	}
+	if(spp->shared) __share_mime_type(spp->shared, uri, file, mime_type);
+	pthread_mutex_unlock(&spp->files_lock);
+}
+#endif // HAVE_LIBMAGIC
+
+/*!
+ * \brief Remember that a client was just being served.
+ *
+ * \param[in] spp SimplePost instance to act on
+ */
+static void __touch(simplepost_t spp)
+{
+	struct timespec now; // Current time (CLOCK_MONOTONIC)
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	__atomic_store_n(&spp->last_active, (uint64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000, __ATOMIC_RELAXED);
+}
+
+/*!
+ * \brief Open a file to be served and find out what it is.
+ *
+ * \note On a network or FUSE filesystem, resolving the path may block for a
+ * long time. The file is opened once and only its descriptor is checked after
+ * that, so each request pays for a single lookup. How long that takes is kept
+ * in the statistics returned by simplepost_get_status().
+ *
+ * \param[in] spp          SimplePost instance to act on
+ * \param[in] file         Name and path of the file to open
+ * \param[out] file_status Status of the file
+ *
+ * \return the file descriptor of the file opened read-only, or -1 if it could
+ * not be opened
+ */
+static int __open_file(
+	simplepost_t spp,
+	const char* file,
+	struct stat* file_status)
+{
+	struct timespec start;   // Time (CLOCK_MONOTONIC) we started to open the file
+	struct timespec end;     // Time (CLOCK_MONOTONIC) the file was opened
+	uint64_t elapsed;        // Microseconds spent opening the file
+	uint64_t longest;        // Longest time spent opening any file
+	int fd;                  // File descriptor
+
+	__atomic_add_fetch(&spp->lookups_pending, 1, __ATOMIC_RELAXED);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	// Never wait on the writer of a FIFO. The flag is ignored for regular files.
+	fd = open(file, O_RDONLY | O_NONBLOCK);
+	if(fd != -1 && fstat(fd, file_status) == -1)
+	{
+		close(fd);
+		fd = -1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	__atomic_sub_fetch(&spp->lookups_pending, 1, __ATOMIC_RELAXED);
+
+	elapsed = (uint64_t) (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000;
+	__atomic_add_fetch(&spp->lookups, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&spp->lookup_time, elapsed, __ATOMIC_RELAXED);
+	longest = __atomic_load_n(&spp->lookup_time_max, __ATOMIC_RELAXED);
+	while(elapsed > longest && __atomic_compare_exchange_n(&spp->lookup_time_max, &longest, elapsed, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED) == false);
+
+	if(elapsed >= SP_HTTP_SLOW_LOOKUP * 1000)
+	{
+		impact(1, "%s: Request 0x%lx: Opening FILE %s took %" PRIu64 " ms\n",
+			SP_HTTP_HEADER_NAMESPACE, pthread_self(),
+			file, elapsed / 1000);
+	}
+
+	return fd;
+}
+
+/*!
+ * \brief Has the server gone without any clients for simplepost::idle_timeout?
+ *
+ * \note A server with worker processes is never idle, since it cannot tell
+ * whether they are serving anyone.
+ *
+ * \param[in] spp SimplePost instance to act on
+ *
+ * \retval true the server is idle and should shut down
+ * \retval false the server is busy, was active recently, or never idles
+ */
+static bool __is_idle(simplepost_t spp)
+{
+	struct timespec now; // Current time (CLOCK_MONOTONIC)
+	size_t transfers;    // Number of downloads in progress
+	uint64_t idle_since; // Millisecond (CLOCK_MONOTONIC) the server becomes idle
+
+	if(spp->idle_timeout == 0 || spp->workers) return false;
+	if(__atomic_load_n(&spp->connections, __ATOMIC_RELAXED) > 0) return false;
+
+	transfers = __atomic_load_n(&spp->downloads_completed, __ATOMIC_RELAXED);
+	transfers += __atomic_load_n(&spp->downloads_aborted, __ATOMIC_RELAXED);
+	transfers = __atomic_load_n(&spp->downloads_started, __ATOMIC_RELAXED) - transfers;
+	if(transfers > 0) return false;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	idle_since = __atomic_load_n(&spp->last_active, __ATOMIC_RELAXED) + (uint64_t) spp->idle_timeout * 1000;
+	if((uint64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000 < idle_since) return false;
+
+	impact(1, "%s: Server has not had any clients for %u seconds\n",
+		SP_HTTP_HEADER_NAMESPACE,
+		spp->idle_timeout);
+
+	return true;
+}
+
+#if HAVE_DECL_MHD_OPTION_NOTIFY_CONNECTION
+/*!
+ * \brief Keep track of the number of open client connections.
+ *
+ * \param[in] cls            SimplePost instance to act on
+ * \param[in] connection     Connection handle
+ * \param[in] socket_context Data preserved for the lifetime of the connection
+ * \param[in] toe            Whether the connection was opened or closed
+ */
+static void __notify_connection(
+	void* cls,
+	struct MHD_Connection* connection,
+	void** socket_context,
+	enum MHD_ConnectionNotificationCode toe)
+{
+	// Unused parameters
+	(void) connection;
+	(void) socket_context;
+
+	simplepost_t spp = (simplepost_t) cls; // Instance to act on
+
+	if(toe == MHD_CONNECTION_NOTIFY_STARTED) __atomic_add_fetch(&spp->connections, 1, __ATOMIC_RELAXED);
+	else if(toe == MHD_CONNECTION_NOTIFY_CLOSED) __atomic_sub_fetch(&spp->connections, 1, __ATOMIC_RELAXED);
+
+	__touch(spp);
+}
+#endif // HAVE_DECL_MHD_OPTION_NOTIFY_CONNECTION
+
+#ifdef HAVE_STRUCT_TCP_INFO_TCPI_BYTES_ACKED
+/*!
+ * \brief Get the number of bytes the client has acknowledged on the
+ * connection.
+ *
+ * \param[in] connection Connection handle
+ *
+ * \return the number of bytes acknowledged by the client, or zero if the
+ * kernel cannot tell us
+ */
+static uint64_t __get_bytes_acked(struct MHD_Connection* connection)
+{
+	const union MHD_ConnectionInfo* info; // Connection information from libmicrohttpd
+	struct tcp_info tcp_status;           // TCP status of the connection
+	socklen_t tcp_status_len;             // Size of the TCP status structure
+
+	info = MHD_get_connection_info(connection, MHD_CONNECTION_INFO_CONNECTION_FD);
+	if(info == NULL) return 0;
+
+	tcp_status_len = sizeof(tcp_status);
+	if(getsockopt(info->connect_fd, IPPROTO_TCP, TCP_INFO, &tcp_status, &tcp_status_len) == -1) return 0;
+
+	return tcp_status.tcpi_bytes_acked;
+}
+#endif // HAVE_STRUCT_TCP_INFO_TCPI_BYTES_ACKED
+
+#ifdef HAVE_DIRECT_IO_SUPPORT
+/*!
+ * \brief File being streamed to a client with O_DIRECT
+ *
+ * Two buffers take turns: while libmicrohttpd copies out of one, the next
+ * part of the file is read into the other in the background.
+ */
+struct simplepost_direct
+{
+	/// SimplePost instance the buffers are pooled by
+	simplepost_t spp;
+
+	/// File descriptor (opened with O_DIRECT)
+	int fd;
+
+	/// Number of bytes into the file the response starts
+	uint64_t start;
+
+	/// Number of bytes into the file the response ends
+	uint64_t end;
+
+	/// Buffers taking turns being read into and sent from
+	char* buffers[2];
+
+	/// Index of the buffer being sent from
+	unsigned int current;
+
+	/// Number of bytes into the file the buffer being sent from starts
+	uint64_t current_offset;
+
+	/// Number of bytes read into the buffer being sent from
+	size_t current_length;
+
+	/// Number of bytes into the file the next read starts
+	uint64_t next_read;
+
+	/// Number of bytes into the file the read into the other buffer starts
+	uint64_t read_offset;
+
+	/// Is that read still in flight (or not yet collected)?
+	bool is_reading;
+
+	/// Ring the reads are submitted to (NULL if they use POSIX AIO instead)
+	simplering_t ring;
+
+	/// Read into the other buffer with POSIX AIO (if there is no ring)
+	struct aiocb read;
+};
+
+/*!
+ * \brief Take a buffer for reading with O_DIRECT from the pool.
+ *
+ * \param[in] spp SimplePost instance to act on
+ *
+ * \return a buffer of SP_HTTP_DIRECT_BUFFER bytes aligned to
+ * SP_HTTP_DIRECT_ALIGN bytes, or NULL if we failed to allocate one
+ */
+static char* __get_direct_buffer(simplepost_t spp)
+{
+	void* buffer; // Buffer to return
+
+	pthread_mutex_lock(&spp->direct_lock);
+	buffer = spp->direct_pool;
+	if(buffer)
+	{
+		spp->direct_pool = *((void**) buffer);
+		--(spp->direct_pool_count);
+	}
+	pthread_mutex_unlock(&spp->direct_lock);
+
+	if(buffer == NULL && posix_memalign(&buffer, SP_HTTP_DIRECT_ALIGN, SP_HTTP_DIRECT_BUFFER) != 0) return NULL;
+
+	return (char*) buffer;
+}
+
+/*!
+ * \brief Return a buffer taken with __get_direct_buffer() to the pool.
+ *
+ * \note Once the pool holds SP_HTTP_DIRECT_POOL buffers, the rest are freed.
+ *
+ * \param[in] spp    SimplePost instance to act on
+ * \param[in] buffer Buffer to return (may be NULL)
+ */
+static void __put_direct_buffer(simplepost_t spp, char* buffer)
+{
+	if(buffer == NULL) return;
+
+	pthread_mutex_lock(&spp->direct_lock);
+	if(spp->direct_pool_count < SP_HTTP_DIRECT_POOL)
+	{
+		*((void**) buffer) = spp->direct_pool;
+		spp->direct_pool = (void*) buffer;
+		++(spp->direct_pool_count);
+		buffer = NULL;
+	}
+	pthread_mutex_unlock(&spp->direct_lock);
+
+	free(buffer);
+}
+
+/*!
+ * \brief Start reading the next part of the file into the buffer which is not
+ * being sent from.
+ *
+ * \note The read is submitted to the ring of the stream if it has one, and
+ * queued with POSIX AIO otherwise.
+ *
+ * \param[inout] spdp File being streamed
+ *
+ * \return true if the read was started (or there is nothing left to read),
+ * false if an error occurred
+ */
+static bool __direct_read_ahead(struct simplepost_direct* spdp)
+{
+	unsigned int other = spdp->current ^ 1; // Index of the buffer to read into
+
+	if(spdp->next_read >= spdp->end) return true;
+
+	if(spdp->ring)
+	{
+		if(simplering_read(spdp->ring, spdp->fd, other, spdp->next_read) == false) return false;
+	}
+	else
+	{
+		memset(&spdp->read, 0, sizeof(spdp->read));
+		spdp->read.aio_fildes = spdp->fd;
+		spdp->read.aio_buf = spdp->buffers[other];
+		spdp->read.aio_nbytes = SP_HTTP_DIRECT_BUFFER;
+		spdp->read.aio_offset = (off_t) spdp->next_read;
+		spdp->read.aio_sigevent.sigev_notify = SIGEV_NONE;
+
+		if(aio_read(&spdp->read) == -1) return false;
+	}
+
+	spdp->is_reading = true;
+	spdp->read_offset = spdp->next_read;
+	spdp->next_read += SP_HTTP_DIRECT_BUFFER;
+
+	return true;
+}
+
+/*!
+ * \brief Wait for the read in flight to finish.
+ *
+ * \param[inout] spdp File being streamed
+ *
+ * \return the number of bytes read, or -1 (with errno set) if the read failed
+ */
+static ssize_t __direct_wait(struct simplepost_direct* spdp)
+{
+	const struct aiocb* reads[1] = {&spdp->read}; // Reads to wait for
+	int error;                                    // Error of the read
+
+	spdp->is_reading = false;
+
+	if(spdp->ring) return simplering_wait(spdp->ring);
+
+	while((error = aio_error(&spdp->read)) == EINPROGRESS) aio_suspend(reads, 1, NULL);
+	if(error != 0)
+	{
+		aio_return(&spdp->read);
+		errno = error;
+		return -1;
+	}
+
+	return aio_return(&spdp->read);
+}
+
+/*!
+ * \brief Make sure no read is in flight.
+ *
+ * \note The kernel may still be writing into the other buffer, so it may not
+ * be freed or reused until this returns. Reads queued with POSIX AIO are
+ * cancelled if they have not started yet; reads on a ring are short enough to
+ * simply wait for. If we cannot tell whether the read has finished, the
+ * buffer is abandoned rather than returned to the pool.
+ *
+ * \param[inout] spdp File being streamed
+ */
+static void __direct_stop(struct simplepost_direct* spdp)
+{
+	if(spdp->is_reading == false) return;
+
+	if(spdp->ring)
+	{
+		__direct_wait(spdp);
+		if(simplering_is_reading(spdp->ring))
+		{
+			impact(0, "%s: Abandoning a buffer the kernel may still be reading into: %s\n",
+				SP_HTTP_HEADER_NAMESPACE,
+				strerror(errno));
+			spdp->buffers[spdp->current ^ 1] = NULL;
+		}
+		return;
+	}
+
+	aio_cancel(spdp->fd, &spdp->read);
+	__direct_wait(spdp);
+}
+
+/*!
+ * \brief Copy the next part of a file streamed with O_DIRECT into the buffer
+ * of libmicrohttpd.
+ *
+ * \param[in] cls File being streamed (struct simplepost_direct*)
+ * \param[in] pos Number of bytes of the response already sent
+ * \param[in] buf Buffer to copy into
+ * \param[in] max Size of the buffer
+ *
+ * \return the number of bytes copied, MHD_CONTENT_READER_END_OF_STREAM after
+ * the last byte of the response, or MHD_CONTENT_READER_END_WITH_ERROR if the
+ * file could not be read
+ */
+static ssize_t __direct_reader(void* cls, uint64_t pos, char* buf, size_t max)
+{
+	struct simplepost_direct* spdp = (struct simplepost_direct*) cls; // File being streamed
+	uint64_t offset = spdp->start + pos;                              // Number of bytes into the file to copy from
+	size_t length;                                                    // Number of bytes to copy
+
+	if(offset >= spdp->end) return MHD_CONTENT_READER_END_OF_STREAM;
+
+	// libmicrohttpd never goes back, and only skips ahead if we send too little.
+	if(offset < spdp->current_offset) return MHD_CONTENT_READER_END_WITH_ERROR;
+
+	while(offset >= spdp->current_offset + spdp->current_length)
+	{
+		ssize_t bytes_read; // Number of bytes read into the other buffer
+
+		if(spdp->is_reading == false) return MHD_CONTENT_READER_END_WITH_ERROR;
+
+		/* Each read starts where the last one should have ended, so one which
+		 * ends early (before the end of the file) would leave a gap.
+		 */
+		bytes_read = __direct_wait(spdp);
+		if(bytes_read <= 0 ||
+			((size_t) bytes_read < SP_HTTP_DIRECT_BUFFER && spdp->read_offset + (uint64_t) bytes_read < spdp->end))
+		{
+			impact(0, "%s: Request 0x%lx: Failed to read %" PRIu64 " bytes into the file: %s\n",
+				SP_HTTP_HEADER_NAMESPACE, pthread_self(),
+				spdp->read_offset, (bytes_read < 0) ? strerror(errno) : "unexpected end of file");
+			return MHD_CONTENT_READER_END_WITH_ERROR;
+		}
+
+		spdp->current ^= 1;
+		spdp->current_offset = spdp->read_offset;
+		spdp->current_length = (size_t) bytes_read;
+
+		if(__direct_read_ahead(spdp) == false) return MHD_CONTENT_READER_END_WITH_ERROR;
+	}
+	if(offset < spdp->current_offset) return MHD_CONTENT_READER_END_WITH_ERROR;
+
+	length = spdp->current_offset + spdp->current_length - offset;
+	if(length > spdp->end - offset) length = (size_t) (spdp->end - offset);
+	if(length > max) length = max;
+
+	memcpy(buf, spdp->buffers[spdp->current] + (offset - spdp->current_offset), length);
+
+	return (ssize_t) length;
+}
+
+/*!
+ * \brief Stop streaming a file with O_DIRECT.
+ *
+ * \param[in] cls File being streamed (struct simplepost_direct*)
+ */
+static void __direct_free(void* cls)
+{
+	struct simplepost_direct* spdp = (struct simplepost_direct*) cls; // File being streamed
+
+	__direct_stop(spdp);
+
+	simplering_free(spdp->ring);
+
+	__put_direct_buffer(spdp->spp, spdp->buffers[0]);
+	__put_direct_buffer(spdp->spp, spdp->buffers[1]);
+	if(spdp->fd != -1) close(spdp->fd);
+	free(spdp);
+}
+
+/*!
+ * \brief Prepare to send a response to the client from a file read with
+ * O_DIRECT.
+ *
+ * \note The first part of the file is read before this function returns. If
+ * the filesystem does not support O_DIRECT, nothing is queued, and the file
+ * descriptor is left as it was, so the caller may fall back to
+ * __response_prep_file().
+ *
+ * \param[in] spp         SimplePost instance to act on
+ * \param[in] connection  Connection identifying the client
+ * \param[in] status_code HTTP status code to send
+ * \param[in] size        Number of bytes from the file to send in the response
+ * \param[in] offset      Number of bytes to seek into the file before sending
+ * \param[in] total       Size (in bytes) of the whole file
+ * \param[inout] fd
+ * \parblock
+ * File descriptor of the file opened by __open_file()
+ *
+ * This is set to -1 once the file belongs to the response, which closes it.
+ * \endparblock
+ * \param[in] file        Name and path of the file to send
+ * \param[in] mime_type   MIME type of the file (NULL if it is not known)
+ *
+ * \return a libmicrohttpd response instance if the specified file has been
+ * queued for transmission to the client, or print an error message and return
+ * NULL if an error occurs
+ */
+static struct MHD_Response* __response_prep_direct(
+	simplepost_t spp,
+	struct MHD_Connection* connection,
+	unsigned int status_code,
+	size_t size,
+	size_t offset,
+	size_t total,
+	int* fd,
+	const char* file,
+	const char* mime_type)
+{
+	struct simplepost_direct* spdp;       // File to stream
+	struct MHD_Response* response = NULL; // Response to the request
+	ssize_t bytes_read;                   // Number of bytes read into the first buffer
+	int flags = -1;                       // File status flags of the file descriptor
+
+	spdp = (struct simplepost_direct*) calloc(1, sizeof(struct simplepost_direct));
+	if(spdp == NULL)
+	{
+		impact(2, "%s:%d: %s: Failed to allocate memory for the HTTP response %u\n",
+			__PRETTY_FUNCTION__, __LINE__, SP_MAIN_HEADER_MEMORY_ALLOC,
+			status_code);
+		return NULL;
+	}
+
+	spdp->spp = spp;
+	spdp->fd = -1;
+	spdp->ring = NULL;
+	spdp->start = offset;
+	spdp->end = (uint64_t) offset + size;
+	spdp->current_offset = offset - offset % SP_HTTP_DIRECT_ALIGN;
+	spdp->buffers[0] = __get_direct_buffer(spp);
+	spdp->buffers[1] = __get_direct_buffer(spp);
+	if(spdp->buffers[0] == NULL || spdp->buffers[1] == NULL)
+	{
+		impact(2, "%s:%d: %s: Failed to allocate memory for the HTTP response %u\n",
+			__PRETTY_FUNCTION__, __LINE__, SP_MAIN_HEADER_MEMORY_ALLOC,
+			status_code);
+		goto error;
+	}
+
+	// Switching the file we already have over saves resolving its path again.
+	flags = fcntl(*fd, F_GETFL);
+	if(flags == -1 || fcntl(*fd, F_SETFL, flags | O_DIRECT) == -1)
+	{
+		impact(2, "%s: Request 0x%lx: Cannot open FILE %s with O_DIRECT: %s\n",
+			SP_HTTP_HEADER_NAMESPACE, pthread_self(),
+			file, strerror(errno));
+		goto error;
+	}
+	spdp->fd = *fd;
+
+	// Filesystems which do not support O_DIRECT may only tell us when we read.
+	bytes_read = pread(spdp->fd, spdp->buffers[0], SP_HTTP_DIRECT_BUFFER, (off_t) spdp->current_offset);
+	if(bytes_read < 0 ||
+		((size_t) bytes_read < SP_HTTP_DIRECT_BUFFER && spdp->current_offset + (uint64_t) bytes_read < spdp->end))
+	{
+		impact(2, "%s: Request 0x%lx: Cannot read FILE %s with O_DIRECT: %s\n",
+			SP_HTTP_HEADER_NAMESPACE, pthread_self(),
+			file, (bytes_read < 0) ? strerror(errno) : "unexpected end of file");
+		goto error;
+	}
+	spdp->current_length = (size_t) bytes_read;
+	spdp->next_read = spdp->current_offset + SP_HTTP_DIRECT_BUFFER;
+
+	if(spdp->next_read < spdp->end &&
+		__atomic_load_n(&spp->direct_no_ring, __ATOMIC_RELAXED) == false &&
+		(spdp->ring = simplering_init(spdp->buffers, SP_HTTP_DIRECT_BUFFER)) == NULL)
+	{
+		/* Do not try again on a kernel which does not support io_uring or
+		 * does not let us use it. Other errors (such as running out of
+		 * locked memory for the buffers) may pass.
+		 */
+		if(errno == ENOSYS || errno == EPERM) __atomic_store_n(&spp->direct_no_ring, true, __ATOMIC_RELAXED);
+
+		impact(2, "%s: Request 0x%lx: Cannot set up io_uring for FILE %s, falling back to POSIX AIO: %s\n",
+			SP_HTTP_HEADER_NAMESPACE, pthread_self(),
+			file, strerror(errno));
+	}
+
+	if(__direct_read_ahead(spdp) == false)
+	{
+		impact(2, "%s: Request 0x%lx: Cannot read ahead in FILE %s: %s\n",
+			SP_HTTP_HEADER_NAMESPACE, pthread_self(),
+			file, strerror(errno));
+		goto error;
+	}
+
+	response = MHD_create_response_from_callback(size, SP_HTTP_DIRECT_BLOCK, &__direct_reader, spdp, &__direct_free);
+	if(response == NULL)
+	{
+		impact(2, "%s:%d: %s: Failed to allocate memory for the HTTP response %u\n",
+			__PRETTY_FUNCTION__, __LINE__, SP_MAIN_HEADER_MEMORY_ALLOC,
+			status_code);
+		goto error;
+	}
+	spdp = NULL; // The response frees it now.
+	*fd = -1;    // It closes the file too.
+
+	__response_add_file_headers(response, status_code, size, offset, total, mime_type);
+
+	if(MHD_queue_response(connection, status_code, response) == MHD_NO)
+	{
+		impact(2, "%s: Request 0x%lx: Cannot queue FILE %s with status %u\n",
+			SP_HTTP_HEADER_NAMESPACE, pthread_self(),
+			file, status_code);
+		MHD_destroy_response(response);
+		return NULL;
+	}
+
+	impact(2, "%s: Request 0x%lx: Streaming FILE %s with O_DIRECT\n",
+		SP_HTTP_HEADER_NAMESPACE, pthread_self(),
+		file);
+
+	return response;
+
+error:
+	__direct_stop(spdp);
+	spdp->fd = -1; // The caller still owns the file.
+	__direct_free(spdp);
+	if(flags != -1) fcntl(*fd, F_SETFL, flags);
+
+	return NULL;
+}
+#endif // HAVE_DIRECT_IO_SUPPORT
+
+/*!
+ * \brief Panic! Cleanup the SimplePost instance after libmicrohttpd
+ * encountered an unrecoverable error condition.
+ *
+ * \param[in] cls    SimplePost instance to act on
+ * \param[in] file   C source file where the error occured
+ * \param[in] line   Line of the C source file where the error occured
+ * \param[in] reason Error message
+ */
+static void __panic(
+	void* cls,
+	const char* file,
+	unsigned int line,
+	const char* reason)
+{
+	simplepost_t spp = (simplepost_t) cls; // Instance to act on
+
+	impact(2, "%s:%u: PANIC!\n", file, line);
+	impact(0, "%s: %s: Emergency Shutdown: %s\n",
+		SP_HTTP_HEADER_NAMESPACE, SP_HTTP_HEADER_MICROHTTPD,
+		reason);
+
+	simplepost_unbind(spp);
+}
+
+/*!
+ * \brief Print error messages from libmicrohttpd.
+ *
+ * \param[in] cls    SimplePost instance to act on
+ * \param[in] format Format string
+ * \param[in] ap     List of format arguments
+ */
+static void __log_microhttpd_messages(void* cls, const char* format, va_list ap)
+{
+	// Unused parameters
+	(void) cls;
+
+	char buffer[2048]; // libmicrohttpd error message
+	int length;        // Number of characters written to the buffer
+
+	length = vsprintf(buffer, format, ap);
+	if(length < 0)
+	{
+		impact(2, "%s:%d: BUG! Failed to process libmicrohttpd error message\n",
+			__PRETTY_FUNCTION__, __LINE__);
+	}
+	else
+	{
+		impact(0, "%s: %s: %s\n",
+			SP_HTTP_HEADER_NAMESPACE, SP_HTTP_HEADER_MICROHTTPD,
+			buffer);
+	}
+}
+
+/*!
+ * \brief Process a request accepted by the server.
+ *
+ * \param[in] cls            SimplePost instance to act on
+ * \param[in] connection     Connection handle
+ * \param[in] uri            Uniform Resource Identifier of the request
+ * \param[in] method         HTTP method
+ * \param[in] version        HTTP version
+ * \param[in] data           Data sent by the client (excluding HEADERS)
+ * \param[inout] data_size
+ * \parblock
+ * Size of the client-provided data
+ *
+ * Initially this must be the size of the data provided. This function will
+ * update it to the number of bytes NOT processed.
+ * \endparblock
+ * \param[out] state         Data preserved for future calls of this request
+ *
+ * \retval MHD_NO will be returned if the socket must be closed due to a
+ *         serious error we encountered while handling the request
+ * \retval MHD_YES will be returned if the connection was handled successfully
+ */
+static int __process_request(
+	void* cls,
+	struct MHD_Connection* connection,
+	const char* uri,
+	const char* method,
+	const char* version,
+	const char* data,
+	size_t* data_size,
+	void** state)
+{
+	// Unused parameters
+	(void) data;
+
+	simplepost_t spp = (simplepost_t) cls; // Instance to act on
+	struct simplepost_state* spsp = NULL;  // Request state
+
+	impact(2, "%s: Request 0x%lx: method: %s\n",
+		SP_HTTP_HEADER_NAMESPACE, pthread_self(),
+		method);
+	impact(2, "%s: Request 0x%lx: URI: %s\n",
+		SP_HTTP_HEADER_NAMESPACE, pthread_self(),
+		uri);
+	impact(2, "%s: Request 0x%lx: version: %s\n",
+		SP_HTTP_HEADER_NAMESPACE, pthread_self(),
+		version);
+
+	#ifdef DEBUG
+	if(*state)
+	{
+		impact(0, "%s: Request 0x%lx: Request should be stateless\n",
+			SP_HTTP_HEADER_NAMESPACE, pthread_self());
+		goto finalize_request;
+	}
+	#endif // DEBUG
+
+	spsp = __get_state(spp);
+	if(spsp == NULL)
+	{
+		impact(2, "%s: Request 0x%lx: %s: Failed to allocate memory for the request state\n",
+			SP_HTTP_HEADER_NAMESPACE, pthread_self(),
+			SP_MAIN_HEADER_MEMORY_ALLOC);
+		goto finalize_request;
+	}
+	*state = (void*) spsp;
+
+	/* There is probably a better way to implement __response_prep_data() and
+	 * __response_prep_file(), one that would allow them to directly handle
+	 * struct simplepost_state and alleviate this function of more
+	 * responsibility. For now the state comes from __get_state() here and
+	 * goes back with __put_state() in __finalize_request().
+	 */
+
+	/* We really don't care what data the client sent us. Nothing handled by
+	 * SimplePost actually requires the client to send additional data.
+	 */
+	*data_size = 0;
+
+	if(strcmp(method, MHD_HTTP_METHOD_GET) == 0)
+	{
+		struct stat file_status;          // File status
+		bool is_index = false;            // Are we serving the index of a directory?
+		bool direct;                      // Should the file be read with O_DIRECT?
+		int fd = -1;                      // File descriptor of the file to serve
+		unsigned int status;              // Status of the response
+		struct simplesign_link link;      // Signed link the request was made with
+		bool is_signed_counted = false;   // Has a download of that link been counted?
+
+		// Downloads are reserved for the client which started them.
+		__get_client(connection, spsp->client);
+		spsp->is_resume = (MHD_lookup_connection_value(connection, MHD_HEADER_KIND, "Range") != NULL);
+
+		/* Once the files have been handed off, the request is refused below
+		 * without checking the link it was made with.
+		 */
+		link.count = 0;
+		if(spp->sign_key && __atomic_load_n(&spp->quiesced, __ATOMIC_RELAXED) == false)
+		{
+			status = __check_signed_request(spp, connection, uri, &link);
+			if(status != MHD_HTTP_OK)
+			{
+				const char* page = (status == MHD_HTTP_GONE) ? SP_HTTP_RESPONSE_GONE : SP_HTTP_RESPONSE_FORBIDDEN; // Page to respond with
+
+				spsp->response = __response_prep_data(connection,
+					status,
+					strlen(page),
+					(void*) page);
+				goto finalize_request;
+			}
+		}
+
+		__get_filename_from_uri(spp, spsp, &spsp->drop_cache, &direct, uri);
+		if(spsp->file_length == 0 && __atomic_load_n(&spp->quiesced, __ATOMIC_RELAXED))
+		{
+			/* Another process has taken over the files and our listening
+			 * socket. Hang up without a response, so the client retries the
+			 * request on a new connection, which the other process accepts.
+			 */
+			impact(2, "%s: Request 0x%lx: Refusing request for %s handed off to another process\n",
+				SP_HTTP_HEADER_NAMESPACE, pthread_self(),
+				uri);
+			goto finalize_request;
+		}
+		else if(spsp->file_length == 0 || (fd = __open_file(spp, spsp->file, &file_status)) == -1)
+		{
+			impact(0, "%s: Request 0x%lx: Resource not found: %s\n",
+				SP_HTTP_HEADER_NAMESPACE, pthread_self(),
+				uri);
+			spsp->response = __response_prep_data(connection,
+				MHD_HTTP_NOT_FOUND,
+				strlen(SP_HTTP_RESPONSE_NOT_FOUND),
+				(void*) SP_HTTP_RESPONSE_NOT_FOUND);
+			goto finalize_request;
+		}
+
+		if(S_ISDIR(file_status.st_mode))
+		{
+			const char* append_index = "/index.html";
+			if(__copy_to_buffer(&spsp->file, &spsp->file_size, spsp->file_length, append_index, strlen(append_index)))
+			{
+				spsp->file_length += strlen(append_index);
+				close(fd);
+
+				// The MIME type we know is that of the directory, not the index.
+				is_index = true;
+				spsp->mime_type_length = 0;
+				fd = __open_file(spp, spsp->file, &file_status);
+				if(fd == -1)
+				{
+					impact(2, "%s: Request 0x%lx: File not found: %s\n",
+						SP_HTTP_HEADER_NAMESPACE, pthread_self(),
+						spsp->file);
+					spsp->response = __response_prep_data(connection,
+						MHD_HTTP_NOT_FOUND,
+						strlen(SP_HTTP_RESPONSE_NOT_FOUND),
+						(void*) SP_HTTP_RESPONSE_NOT_FOUND);
+					goto finalize_request;
+				}
+			}
+		}
+
+		if(S_ISDIR(file_status.st_mode))
+		{
+			impact(0, "%s: Request 0x%lx: Directory not supported: %s\n",
+				SP_HTTP_HEADER_NAMESPACE, pthread_self(),
+				spsp->file);
+			close(fd);
+			spsp->response = __response_prep_data(connection,
+				MHD_HTTP_FORBIDDEN,
+				strlen(SP_HTTP_RESPONSE_FORBIDDEN),
+				(void*) SP_HTTP_RESPONSE_FORBIDDEN);
+			goto finalize_request;
+		}
+
+		size_t file_size = file_status.st_size;
+		size_t file_offset = 0;
+		if(__response_get_range(connection, &file_size, &file_offset) == false)
+		{
+			impact(0, "%s: Request 0x%lx: Invalid range header\n",
+				SP_HTTP_HEADER_NAMESPACE, pthread_self());
+			close(fd);
+			spsp->response = __response_prep_data(connection,
+				MHD_HTTP_BAD_REQUEST,
+				strlen(SP_HTTP_RESPONSE_BAD_REQUEST),
+				(void*) SP_HTTP_RESPONSE_BAD_REQUEST);
+			goto finalize_request;
+		}
+		spsp->body_total = file_status.st_size;
+
+		// Only now is the file certain to be sent, so the link may be used up.
+		if(link.count)
+		{
+			status = __count_signed_request(spp, &link, uri);
+			if(status != MHD_HTTP_OK)
+			{
+				const char* page = (status == MHD_HTTP_GONE) ? SP_HTTP_RESPONSE_GONE : SP_HTTP_RESPONSE_SERVICE_UNAVAILABLE; // Page to respond with
+
+				close(fd);
+				spsp->response = __response_prep_data(connection,
+					status,
+					strlen(page),
+					(void*) page);
+				goto finalize_request;
+			}
+			is_signed_counted = true;
+		}
+
+		status = (file_size < spsp->body_total) ? MHD_HTTP_PARTIAL_CONTENT : MHD_HTTP_OK;
+
+		#ifdef HAVE_LIBMAGIC
+		if(spsp->mime_type_length)
+		{
+			__atomic_add_fetch(&spp->mime_hits, 1, __ATOMIC_RELAXED);
+		}
+		else
+		{
+			__atomic_add_fetch(&spp->mime_misses, 1, __ATOMIC_RELAXED);
+			if(__get_mime_type(spp, spsp, fd) && is_index == false) __cache_mime_type(spp, uri, spsp->file, spsp->mime_type);
+		}
+		#endif // HAVE_LIBMAGIC
+		const char* mime_type = spsp->mime_type_length ? spsp->mime_type : NULL; // MIME type of the file to serve
+
+		impact(2, "%s: Request 0x%lx: Serving FILE %s\n",
+			SP_HTTP_HEADER_NAMESPACE, pthread_self(),
+			spsp->file);
+		#ifdef HAVE_DIRECT_IO_SUPPORT
+		uint64_t threshold = __atomic_load_n(&spp->direct_threshold, __ATOMIC_RELAXED); // Files at least this large are read with O_DIRECT
+		if(direct || (threshold && (uint64_t) file_status.st_size >= threshold))
+		{
+			spsp->response = __response_prep_direct(spp, connection,
+				status,
+				file_size,
+				file_offset,
+				spsp->body_total,
+				&fd,
+				spsp->file,
+				mime_type);
+		}
+		#else
+		(void) direct; // Every file is read through the page cache.
+		#endif // HAVE_DIRECT_IO_SUPPORT
+
+		if(spsp->response == NULL && fd != -1)
+		{
+			spsp->response = __response_prep_file(connection,
+				status,
+				file_size,
+				file_offset,
+				spsp->body_total,
+				fd,
+				spsp->file,
+				mime_type);
+		}
+
+		if(spsp->response)
+		{
+			size_t uri_length = strlen(uri); // Length of the URI
+			if(__copy_to_buffer(&spsp->uri, &spsp->uri_size, 0, uri, uri_length)) spsp->uri_length = uri_length;
+			spsp->body_length = file_size;
+			spsp->body_offset = file_offset;
+			#ifdef HAVE_STRUCT_TCP_INFO_TCPI_BYTES_ACKED
+			spsp->bytes_acked = __get_bytes_acked(connection);
+			#endif // HAVE_STRUCT_TCP_INFO_TCPI_BYTES_ACKED
+
+			__atomic_add_fetch(&spp->downloads_started, 1, __ATOMIC_RELAXED);
+			__publish_event(spp, SP_EVENT_DOWNLOAD_STARTED, spsp->file, uri, file_size, 0, 0);
+		}
+		else if(is_signed_counted)
+		{
+			__uncount_signed_download(spp->signed_links, &link, time(NULL));
+		}
+	}
+	else
+	{
+		impact(2, "%s: Request 0x%lx: %s is not a supported HTTP method\n",
+			SP_HTTP_HEADER_NAMESPACE, pthread_self(),
+			method);
+		spsp->response = __response_prep_data(connection,
+			MHD_HTTP_METHOD_NOT_ALLOWED,
+			strlen(SP_HTTP_RESPONSE_NOT_ALLOWED),
+			(void*) SP_HTTP_RESPONSE_NOT_ALLOWED);
+	}
+
+finalize_request:
+	if(spsp == NULL)
+	{
+		impact(2, "%s: Request 0x%lx: Prematurely terminating response ...\n",
+			SP_HTTP_HEADER_NAMESPACE, pthread_self());
+		return MHD_NO;
+	}
+
+	if(spsp->response)
+	{
+		impact(2, "%s: Request 0x%lx: Sending response ...\n",
+			SP_HTTP_HEADER_NAMESPACE, pthread_self());
+		return MHD_YES;
+	}
+
+	impact(2, "%s: Request 0x%lx: Terminating response ...\n",
+		SP_HTTP_HEADER_NAMESPACE, pthread_self());
+
+	if(spsp->claim) __finish_download(spp, spsp, 0, false);
+	__put_state(spp, spsp);
+	*state = spsp = NULL;
+
+	return MHD_NO;
+}
+
+/*!
+ * \brief Cleanup the resources allocated for the request.
+ *
+ * \param[in] cls        SimplePost instance to act on
+ * \param[in] connection Connection handle
+ * \param[in] state      Data preserved from the request handler
+ * \param[in] toe        Reason the request was terminated
+ */
+void __finalize_request(
+	void* cls,
+	struct MHD_Connection* connection,
+	void** state,
+	enum MHD_RequestTerminationCode toe)
+{
+	#ifndef HAVE_STRUCT_TCP_INFO_TCPI_BYTES_ACKED
+	// Unused parameters
+	(void) connection;
+	#endif // HAVE_STRUCT_TCP_INFO_TCPI_BYTES_ACKED
+
+	simplepost_t spp = (simplepost_t) cls;                             // Instance to act on
+	struct simplepost_state* spsp = (struct simplepost_state*) *state; // Request to cleanup
+	size_t bytes = 0;                                                  // Number of bytes of the file sent to the client
+
+	/* libmicrohttpd calls us even if __process_request() hung up without
+	 * keeping any state, such as when it refuses a request.
+	 */
+	if(spsp == NULL)
+	{
+		#ifdef DEBUG
+		impact(2, "%s: Request 0x%lx: Cannot cleanup stateless request\n",
+			SP_HTTP_HEADER_NAMESPACE, pthread_self());
+		#endif // DEBUG
+		return;
+	}
+
+	if(spsp->response)
+	{
+		MHD_destroy_response(spsp->response);
+	}
+	else
+	{
+		impact(2, "%s:%d: BUG! __process_request() should have returned MHD_NO if it failed to queue a response!\n",
+			__PRETTY_FUNCTION__, __LINE__);
+	}
+
+	#ifdef DEBUG
+	if(spsp->data == NULL && spsp->data_length)
+	{
+		impact(2, "%s:%d: BUG! simplepost_state::data should NEVER be NULL while simplepost_state::data_length is non-zero\n",
+			__PRETTY_FUNCTION__, __LINE__);
+	}
+	#endif // DEBUG
+
+	if(spsp->uri_length)
+	{
+		/* libmicrohttpd does not tell us how much of an aborted response it
+		 * managed to send, so ask the kernel how much the client acknowledged
+		 * instead. That includes the response headers, so it is only an
+		 * approximation; never report more than the length of the file.
+		 */
+		if(toe == MHD_REQUEST_TERMINATED_COMPLETED_OK)
+		{
+			bytes = spsp->body_length;
+		}
+		#ifdef HAVE_STRUCT_TCP_INFO_TCPI_BYTES_ACKED
+		else
+		{
+			uint64_t bytes_acked = __get_bytes_acked(connection);
+
+			if(bytes_acked > spsp->bytes_acked) bytes = (size_t) (bytes_acked - spsp->bytes_acked);
+			if(bytes > spsp->body_length) bytes = spsp->body_length;
+		}
+		#endif // HAVE_STRUCT_TCP_INFO_TCPI_BYTES_ACKED
+
+		__atomic_add_fetch(&spp->bytes_sent, (uint64_t) bytes, __ATOMIC_RELAXED);
+		if(toe == MHD_REQUEST_TERMINATED_COMPLETED_OK) __atomic_add_fetch(&spp->downloads_completed, 1, __ATOMIC_RELAXED);
+		else __atomic_add_fetch(&spp->downloads_aborted, 1, __ATOMIC_RELAXED);
+		__touch(spp);
+
+		__publish_event(spp,
+			(toe == MHD_REQUEST_TERMINATED_COMPLETED_OK) ? SP_EVENT_DOWNLOAD_COMPLETED : SP_EVENT_DOWNLOAD_ABORTED,
+			spsp->file, spsp->uri, bytes, 0, (int) toe);
+
+		/* Nobody else will download this file from us, so whatever the
+		 * kernel cached while sending it would only push files which may
+		 * still be downloaded out of the page cache.
+		 */
+		if(spsp->drop_cache) __drop_cache(spsp->file, spsp->body_offset, spsp->body_length);
+	}
+
+	if(spsp->claim) __finish_download(spp, spsp, bytes, toe == MHD_REQUEST_TERMINATED_COMPLETED_OK && spsp->uri_length);
+
+	#ifdef DEBUG
+	if(spsp->file == NULL && spsp->file_length)
+	{
+		impact(2, "%s:%d: BUG! simplepost_state::file should NEVER be NULL while simplepost_state::file_length is non-zero\n",
+			__PRETTY_FUNCTION__, __LINE__);
+	}
+	#endif // DEBUG
+	__put_state(spp, spsp);
+	*state = NULL;
+
+	#ifdef DEBUG
+	impact(2, "%s: Request 0x%lx: ", SP_HTTP_HEADER_NAMESPACE, pthread_self());
+	switch(toe)
+	{
+		case MHD_REQUEST_TERMINATED_COMPLETED_OK:
+			impact(2, "Successfully sent the response\n");
+			break;
+
+		case MHD_REQUEST_TERMINATED_WITH_ERROR:
+			impact(2, "Error handling the connection\n");
+			break;
+
+		case MHD_REQUEST_TERMINATED_TIMEOUT_REACHED:
+			impact(2, "No activity on the connection until the timeout was reached\n");
+			break;
+
+		case MHD_REQUEST_TERMINATED_DAEMON_SHUTDOWN:
+			impact(2, "Connection terminated because the server is shutting down\n");
+			break;
+
+		case MHD_REQUEST_TERMINATED_READ_ERROR:
+			impact(2, "Connection died because the client did not send the expected data\n");
+			break;
+
+		case MHD_REQUEST_TERMINATED_CLIENT_ABORT:
+			impact(2, "The client terminated the connection by closing the socket for writing (TCP half-closed)\n");
+			break;
+
+		default:
+			impact(2, "Invalid Termination Code: %d\n", toe);
+			break;
+	}
+	#endif // DEBUG
+}
+
+/*!
+ * \brief Can the given file be served?
+ *
+ * \note This function checks the filesystem, so call it BEFORE taking
+ * simplepost::files_lock.
+ *
+ * \param[in] file         Name and path of the file
+ * \param[out] file_status Status of the file
+ *
+ * \return true if the file exists and is a regular file (or a link to one),
+ * false if not
+ */
+static bool __is_file_servable(const char* file, struct stat* file_status)
+{
+	if(stat(file, file_status) == -1)
+	{
+		impact(0, "%s: Cannot serve nonexistent FILE: %s\n",
+			SP_HTTP_HEADER_NAMESPACE,
+			file);
+		return false;
+	}
+
+	if(!(S_ISREG(file_status->st_mode) || S_ISLNK(file_status->st_mode)))
+	{
+		impact(0, "%s: FILE not supported: %s\n",
+			SP_HTTP_HEADER_NAMESPACE,
+			file);
+		return false;
+	}
+
+	return true;
+}
+
+/*!
+ * \brief Files being checked by __check_files()
+ */
+struct simplepost_validator
+{
+	/// Names and paths of the files to check
+	const char* const* files;
+
+	/// Which of the files can be served?
+	bool* is_servable;
+
+	/// Size of each file which can be served (optional)
+	uint64_t* sizes;
+
+	/// MIME type of each file which can be served (optional)
+	char** mime_types;
+
+	/// Number of files to check
+	size_t n;
+
+	/// Index of the next file to check (always use the __atomic builtins to access it)
+	size_t next;
+};
+
+/*!
+ * \brief Check files until there are none left to check.
+ *
+ * \note If their MIME types are requested, each thread loads its own magic
+ * database. libmagic handles are not thread-safe, and determining MIME types
+ * is much slower than checking files, so sharing one would serialize the
+ * threads.
+ *
+ * \param[in] p Files to check (struct simplepost_validator*)
+ *
+ * \return NULL
+ */
+static void* __check_files_worker(void* p)
+{
+	struct simplepost_validator* spvp = (struct simplepost_validator*) p; // Properly cast validator handle
+	struct stat file_status;                                              // Status of the file being checked
+
+	#ifdef HAVE_LIBMAGIC
+	magic_t magic = NULL; // Magic file handle of this thread
+	if(spvp->mime_types)
+	{
+		magic = magic_open(MAGIC_MIME_TYPE);
+		if(magic && magic_load(magic, NULL) == -1)
+		{
+			impact(2, "%s: Failed to load the magic database: %s\n",
+				SP_HTTP_HEADER_NAMESPACE,
+				magic_error(magic));
+			magic_close(magic);
+			magic = NULL;
+		}
+	}
+	#endif // HAVE_LIBMAGIC
+
+	for(;;)
+	{
+		size_t i = __atomic_fetch_add(&spvp->next, SP_HTTP_CHECK_BATCH, __ATOMIC_RELAXED); // First file to check
+		size_t end = i + SP_HTTP_CHECK_BATCH;                                             // File after the last one to check
+
+		if(i >= spvp->n) break;
+		if(end > spvp->n) end = spvp->n;
+
+		for(; i < end; ++i)
+		{
+			spvp->is_servable[i] = (spvp->files[i] && __is_file_servable(spvp->files[i], &file_status));
+			if(spvp->is_servable[i] == false) continue;
+
+			if(spvp->sizes) spvp->sizes[i] = file_status.st_size;
+
+			#ifdef HAVE_LIBMAGIC
+			if(magic)
+			{
+				const char* mime_type = magic_file(magic, spvp->files[i]); // MIME type reported by libmagic
+				if(mime_type)
+				{
+					spvp->mime_types[i] = (char*) malloc(sizeof(char) * (strlen(mime_type) + 1));
+					if(spvp->mime_types[i]) strcpy(spvp->mime_types[i], mime_type);
+				}
+			}
+			#endif // HAVE_LIBMAGIC
+		}
+	}
+
+	#ifdef HAVE_LIBMAGIC
+	if(magic) magic_close(magic);
+	#endif // HAVE_LIBMAGIC
+
+	return NULL;
+}
+
+/*!
+ * \brief Check whether each of the given files can be served.
+ *
+ * \note Checking a file means calling stat() on it, which may be slow (on a
+ * network filesystem, for example) but keeps the CPU idle. Large batches are
+ * therefore split among as many as SP_HTTP_CHECK_THREADS threads, including
+ * this one. If we fail to start the other threads, this one does their share.
+ *
+ * \param[inout] spvp Files to check
+ */
+static void __check_files(struct simplepost_validator* spvp)
+{
+	pthread_t workers[SP_HTTP_CHECK_THREADS - 1]; // Threads helping this one
+	size_t worker_count = 0;                      // Number of threads started
+
+	while(worker_count < SP_HTTP_CHECK_THREADS - 1 && (worker_count + 1) * SP_HTTP_CHECK_BATCH < spvp->n)
+	{
+		if(pthread_create(&workers[worker_count], NULL, &__check_files_worker, (void*) spvp) != 0) break;
+		++worker_count;
+	}
+
+	__check_files_worker((void*) spvp);
+
+	for(size_t i = 0; i < worker_count; ++i) pthread_join(workers[i], NULL);
+}
+
+/*!
+ * \brief Choose the URI to serve a file on.
+ *
+ * \param[in] file Name and path of the file to serve
+ * \param[in] uri  Uniform Resource Identifier requested for the file (optional)
+ *
+ * \return the URI on success, or NULL if the requested URI is invalid. If no
+ * URI was requested, the base name of the file is returned; it may not start
+ * with a "/".
+ */
+static const char* __choose_uri(const char* file, const char* uri)
+{
+	if(uri)
+	{
+		if(uri[0] != '/')
+		{
+			impact(0, "%s: Invalid URI: %s\n",
+				SP_HTTP_HEADER_NAMESPACE,
+				uri);
+			return NULL;
+		}
+		else if(uri[1] == '\0' || strstr(uri, "//"))
+		{
+			impact(0, "%s: Missing path in URI: %s\n",
+				SP_HTTP_HEADER_NAMESPACE,
+				uri);
+			return NULL;
+		}
+	}
+	else
+	{
+		uri = file;
+		if(strchr(uri, '/'))
+		{
+			while(*uri != '\0') ++uri;
+			while(*uri != '/') --uri;
+		}
+	}
+	if(uri == NULL || uri[0] == '\0')
+	{
+		impact(0, "%s:%d: BUG! No URI to insert FILE %s\n",
+			__PRETTY_FUNCTION__, __LINE__,
+			file);
+		return NULL;
+	}
+
+	return uri;
+}
+
+/*!
+ * \brief Insert a file into the list of files being served, or change the
+ * COUNT and expiry time of the file already being served on its URI.
+ *
+ * \warning The caller must hold simplepost::files_lock.
+ *
+ * \param[in] spp          SimplePost instance to act on
+ * \param[in] file         Name and path of the file to serve
+ * \param[in] uri          Uniform Resource Identifier of the file (optional)
+ * \param[in] count        Number of times the file should be served
+ * \param[in] expires      Time (seconds since the Epoch) to stop serving the file (0 = never)
+ * \param[in] direct       Should the file be read with O_DIRECT?
+ * \param[out] is_file_new Was a new file inserted into the list?
+ *
+ * \return the file being served on success, or NULL if the file could not be
+ * inserted (in which case the list is left untouched)
+ */
+static struct simplepost_serve* __insert_file(
+	simplepost_t spp,
+	const char* file,
+	const char* uri,
+	unsigned int count,
+	time_t expires,
+	bool direct,
+	bool* is_file_new)
+{
+	struct simplepost_serve* this_file; // File to serve
+	*is_file_new = false;               // Failsafe
+
+	if(spp->quiesced)
+	{
+		impact(0, "%s: Cannot serve FILE %s after the files have been handed off\n",
+			SP_HTTP_HEADER_NAMESPACE,
+			file);
+		return NULL;
+	}
+
+	uri = __choose_uri(file, uri);
+	if(uri == NULL) return NULL;
+
+	this_file = __find_file(spp, uri);
+	if(this_file)
+	{
+		if(this_file->file && strcmp(this_file->file, file) != 0)
+		{
+			impact(0, "%s: URI %s is already in use serving FILE %s, not %s\n",
+				SP_HTTP_HEADER_NAMESPACE,
+				this_file->uri, this_file->file, file);
+			return NULL;
+		}
+
+		impact(2, "%s: Changing URI %s COUNT from %u to %u\n",
+			SP_HTTP_HEADER_NAMESPACE,
+			this_file->uri, this_file->count, count);
+		if(__set_file_expiry(spp, this_file, expires) == false) return NULL;
+		__set_file_count(spp, this_file, count);
+		this_file->direct = direct;
+		__share_file(spp, this_file);
+		__journal_serve(spp, this_file);
+
+		return this_file;
+	}
+
+	#if (defined SP_HTTP_FILES_MAX) && (SP_HTTP_FILES_MAX > 0)
+	if(spp->files_count == SP_HTTP_FILES_MAX)
+	{
+		impact(0, "%s: Cannot serve more than %zu files simultaneously\n",
+			SP_HTTP_HEADER_NAMESPACE,
+			(size_t) SP_HTTP_FILES_MAX);
+		return NULL;
+	}
+	#else
+	#warning "SP_HTTP_FILES_MAX not set - simplepost::files_count may overflow!"
+	#endif
+
+	this_file = __simplepost_serve_init(file, uri);
+	if(this_file == NULL) goto cannot_insert_file;
+	if(spp->files_tail) __simplepost_serve_insert_after(spp->files_tail, this_file);
+	else spp->files = this_file;
+
+	spp->files_tail = this_file;
+	this_file->id = spp->files_next_id++;
+	++(spp->files_count);
+	++(spp->files_unlimited);
+	*is_file_new = true;
+
+	if(__index_file(spp, this_file) == false) goto cannot_insert_file;
+
+	__set_file_count(spp, this_file, count);
+	this_file->direct = direct;
+	if(__set_file_expiry(spp, this_file, expires) == false) goto cannot_insert_file;
+	if(__share_file(spp, this_file) == false) goto cannot_insert_file;
+	if(spp->watch) __watch_file(spp, this_file);
+	__journal_serve(spp, this_file);
+
+	return this_file;
+
+cannot_insert_file:
+	impact(0, "%s: Cannot insert FILE: %s\n",
+		SP_HTTP_HEADER_NAMESPACE,
+		file);
+
+	if(*is_file_new) __remove_file(spp, this_file);
+	*is_file_new = false;
+
+	return NULL;
+}
+
+/*!
+ * \brief Print where a file is being served.
+ *
+ * \param[in] file    Name and path of the file being served
+ * \param[in] url     Address of the file
+ * \param[in] count   Number of times the file may be downloaded
+ * \param[in] expires Time (seconds since the Epoch) the file stops being served (0 = never)
+ */
+static void __print_serving(const char* file, const char* url, unsigned int count, time_t expires)
+{
+	char count_buf[1024];  // COUNT string of the file being served
+	char expiry_buf[128];  // Expiry string of the file being served
+
+	if(simplestr_count_to_str(count_buf, sizeof(count_buf)/sizeof(count_buf[0]), count) == 0)
+	{
+		impact(1, "%s: Serving %s on %s\n",
+			SP_HTTP_HEADER_NAMESPACE,
+			file, url);
+	}
+	else if(simplestr_expiry_to_str(expiry_buf, sizeof(expiry_buf)/sizeof(expiry_buf[0]), expires) == 0)
+	{
+		impact(1, "%s: Serving %s on %s %s\n",
+			SP_HTTP_HEADER_NAMESPACE,
+			file, url, count_buf);
+	}
+	else
+	{
+		impact(1, "%s: Serving %s on %s %s %s\n",
+			SP_HTTP_HEADER_NAMESPACE,
+			file, url, count_buf, expiry_buf);
+	}
+}
+
+/*!
+ * \brief Write a snapshot of the files being served to the journal.
+ *
+ * \note This is called by the journal thread with simplepost::files_lock held
+ * whenever the journal is compacted.
+ *
+ * \param[in] journal Journal being compacted
+ * \param[in] p       SimplePost instance to act on (simplepost_t)
+ *
+ * \return true if the snapshot was written, false if an error occurred
+ */
+static bool __snapshot_files(simplejournal_t journal, void* p)
+{
+	simplepost_t spp = (simplepost_t) p; // Properly cast instance handle
+
+	for(struct simplepost_serve* f = spp->files; f; f = f->next)
+	{
+		if(f->removed) continue;
+
+		if(simplejournal_snapshot(journal, SIMPLEJOURNAL_SERVE, f->file, f->uri, f->count, f->direct ? SIMPLEJOURNAL_FLAG_DIRECT : 0) == false) return false;
+
+		if(f->timer && simplejournal_snapshot(journal, SIMPLEJOURNAL_EXPIRE, NULL, f->uri,
+			(simpletimer_get_expiry(f->timer) > UINT32_MAX) ? UINT32_MAX : (unsigned int) simpletimer_get_expiry(f->timer), 0) == false)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/*!
+ * \brief Restore a change to the list of files from the journal.
+ *
+ * \note The files are not checked again; a file which has disappeared since
+ * it was journaled will simply fail to download.
+ *
+ * \warning The caller must hold simplepost::files_lock.
+ *
+ * \param[in] type  Type of change made
+ * \param[in] file  Name and path of the file changed (may be NULL)
+ * \param[in] uri   Uniform Resource Identifier of the file changed
+ * \param[in] count New COUNT of the file, or its expiry time
+ * \param[in] flags How the file is served (SIMPLEJOURNAL_FLAG_*)
+ * \param[in] p     SimplePost instance to act on (simplepost_t)
+ */
+static void __replay_file(
+	enum simplejournal_type type,
+	const char* file,
+	const char* uri,
+	unsigned int count,
+	unsigned int flags,
+	void* p)
+{
+	simplepost_t spp = (simplepost_t) p; // Properly cast instance handle
+	struct simplepost_serve* f;          // File the record applies to
+	bool is_file_new;                    // Was a new file inserted?
+
+	switch(type)
+	{
+		case SIMPLEJOURNAL_SERVE:
+			if(file) __insert_file(spp, file, uri, count, 0, (flags & SIMPLEJOURNAL_FLAG_DIRECT) != 0, &is_file_new);
+			break;
+
+		case SIMPLEJOURNAL_EXPIRE:
+			f = __find_file(spp, uri);
+			if(f) __set_file_expiry(spp, f, (time_t) count);
+			break;
+
+		case SIMPLEJOURNAL_PURGE:
+			f = __find_file(spp, uri);
+			if(f) __remove_file(spp, f);
+			break;
+
+		case SIMPLEJOURNAL_DOWNLOAD:
+			f = __find_file(spp, uri);
+			if(f == NULL) break;
+			if(f->count == 1) __remove_file(spp, f);
+			else if(f->count > 1) __set_file_count(spp, f, f->count - 1);
+			break;
+	}
+}
+
+/*!
+ * \brief Remember the address the server is bound to.
+ *
+ * \warning The caller must hold simplepost::master_lock.
+ *
+ * \param[in] spp     SimplePost instance to act on
+ * \param[in] address
+ * \parblock
+ * Address the server is bound to
+ *
+ * If the address is NULL, the server is bound to all local interfaces, and
+ * the address of the default interface is remembered instead (once
+ * __get_address() detects it).
+ * \endparblock
+ *
+ * \return true on success, false if an error occurred
+ */
+static bool __set_address(simplepost_t spp, const char* address)
+{
+	char* new_address; // Copy of the address
+
+	if(address)
+	{
+		new_address = (char*) malloc(sizeof(char) * (strlen(address) + 1));
+		if(new_address == NULL)
+		{
+			impact(0, "%s: %s: Failed to allocate memory for the source address\n",
+				SP_HTTP_HEADER_NAMESPACE, SP_MAIN_HEADER_MEMORY_ALLOC);
+			return false;
+		}
+		strcpy(new_address, address);
+	}
+	else
+	{
+		// Finding the default interface is slow; it is left to __get_address().
+		new_address = NULL;
+	}
+
+	pthread_mutex_lock(&spp->address_lock);
+	if(spp->address) free(spp->address);
+	spp->address = new_address;
+	spp->address_default = (address == NULL);
+	pthread_mutex_unlock(&spp->address_lock);
+
+	return true;
+}
+
+/*!
+ * \brief Get the address of the server.
+ *
+ * \note If the server is bound to all local interfaces, the address of the
+ * default interface is detected the first time this is called.
+ *
+ * \param[in] spp SimplePost instance to act on
+ *
+ * \return the address of the server, or NULL if it is not bound (or the
+ * default address could not be detected). The address remains valid until
+ * the server is bound again or shut down.
+ */
+static const char* __get_address(simplepost_t spp)
+{
+	char* address;    // Address of the server
+	size_t size = 0;  // Size (in bytes) of the address of the default interface
+
+	pthread_mutex_lock(&spp->address_lock);
+
+	if(spp->address == NULL && spp->address_default)
+	{
+		if(__get_default_address(&spp->address, &size) < 0 || spp->address == NULL)
+		{
+			impact(0, "%s: Failed to get the default source address that the server is bound to\n",
+				SP_HTTP_HEADER_NAMESPACE);
+		}
+		else
+		{
+			spp->address_default = false;
+		}
+	}
+	address = spp->address;
+
+	pthread_mutex_unlock(&spp->address_lock);
+
+	return address;
+}
+
+#ifdef HAVE_SCHED_SETAFFINITY
+/*!
+ * \brief Parse a list of CPUs.
+ *
+ * The list is in the format used by the kernel (such as in the cpulist file of
+ * a NUMA node): CPU numbers and ranges of them separated by commas, such as
+ * "0-3,8,10-11". Whitespace around the list is ignored.
+ *
+ * \param[in] list List of CPUs to parse
+ * \param[out] set Set of the CPUs in the list
+ *
+ * \return true if the list was parsed, false if it is not a valid list
+ */
+static bool __parse_cpu_list(const char* list, cpu_set_t* set)
+{
+	const char* p = list; // Remainder of the list to parse
+
+	CPU_ZERO(set);
+
+	while(isspace((unsigned char) *p)) ++p;
+	if(*p == '\0' || *p == '\n') return true;
+
+	for(;;)
+	{
+		unsigned long first; // First CPU in the range
+		unsigned long last;  // Last CPU in the range
+		char* end;           // End of the number parsed
+
+		if(!isdigit((unsigned char) *p)) return false;
+		first = last = strtoul(p, &end, 10);
+		p = end;
+
+		if(*p == '-')
+		{
+			++p;
+			if(!isdigit((unsigned char) *p)) return false;
+			last = strtoul(p, &end, 10);
+			p = end;
+		}
+
+		if(first > last || last >= CPU_SETSIZE) return false;
+		for(unsigned long cpu = first; cpu <= last; ++cpu) CPU_SET(cpu, set);
+
+		if(*p != ',') break;
+		++p;
+	}
+
+	while(isspace((unsigned char) *p)) ++p;
+
+	return (*p == '\0');
+}
+
+/*!
+ * \brief Get the CPUs of every NUMA node of the system.
+ *
+ * \note Only the CPUs in the given set are included, and nodes without any
+ * of them are left out. The nodes are returned in order of their numbers.
+ *
+ * \param[in] cpus   CPUs which may be used
+ * \param[out] nodes
+ * \parblock
+ * CPUs of each node
+ *
+ * If any nodes are found, it is the responsibility of the caller to free this
+ * array when they are done with it.
+ * \endparblock
+ *
+ * \return the number of nodes found, or 0 if the system does not describe its
+ * NUMA nodes (or an error occurred)
+ */
+static size_t __get_numa_nodes(const cpu_set_t* cpus, cpu_set_t** nodes)
+{
+	DIR* dir;                // Directory describing the nodes
+	struct dirent* entry;    // Entry in the directory
+	unsigned int max = 0;    // Largest node number found
+	bool found = false;      // Was any node found?
+	size_t count = 0;        // Number of nodes with CPUs in the set
+
+	*nodes = NULL;
+
+	dir = opendir(SP_NUMA_SYSFS);
+	if(dir == NULL) return 0;
+
+	while((entry = readdir(dir)))
+	{
+		unsigned int node; // Number of the node
+		char tail;         // Anything following the number
+
+		if(sscanf(entry->d_name, "node%u%c", &node, &tail) != 1) continue;
+		if(node > max) max = node;
+		found = true;
+	}
+
+	closedir(dir);
+
+	if(found == false) return 0;
+
+	*nodes = (cpu_set_t*) malloc(sizeof(cpu_set_t) * (max + 1));
+	if(*nodes == NULL)
+	{
+		impact(0, "%s: %s: Failed to allocate memory for %u NUMA nodes\n",
+			SP_HTTP_HEADER_NAMESPACE, SP_MAIN_HEADER_MEMORY_ALLOC,
+			max + 1);
+		return 0;
+	}
+
+	for(unsigned int node = 0; node <= max; ++node)
+	{
+		char path[sizeof(SP_NUMA_SYSFS) + 32]; // Name and path of the node's list of CPUs
+		char list[4096];                       // List of the node's CPUs
+		FILE* fp;                              // File listing the node's CPUs
+		bool ok;                               // Was the list read?
+
+		snprintf(path, sizeof(path), "%s/node%u/cpulist", SP_NUMA_SYSFS, node);
+
+		fp = fopen(path, "r");
+		if(fp == NULL) continue;
+		ok = (fgets(list, sizeof(list), fp) != NULL);
+		fclose(fp);
+
+		if(ok == false || __parse_cpu_list(list, &(*nodes)[count]) == false) continue;
+
+		CPU_AND(&(*nodes)[count], &(*nodes)[count], cpus);
+		if(CPU_COUNT(&(*nodes)[count]) > 0) ++count;
+	}
+
+	if(count == 0)
+	{
+		free(*nodes);
+		*nodes = NULL;
+	}
+
+	return count;
+}
+
+/*!
+ * \brief Get the CPUs a process serving HTTP requests should run on.
+ *
+ * \note If simplepost::numa is set and the system has more than one NUMA
+ * node, the processes are spread round robin across the nodes, and each is
+ * confined to the CPUs of its own. Since the kernel allocates memory on the
+ * node of the CPU which first touches it, the buffers a process allocates for
+ * its clients and the pages of the files it reads into the page cache stay
+ * on its node.
+ *
+ * \warning The caller must hold simplepost::master_lock.
+ *
+ * \param[in] spp     SimplePost instance to act on
+ * \param[in] process Number of the process (0 for this one)
+ * \param[out] cpus   CPUs the process should run on
+ *
+ * \return true if the process should be confined to the CPUs returned, false
+ * if it may run anywhere
+ */
+static bool __get_affinity(simplepost_t spp, unsigned int process, cpu_set_t* cpus)
+{
+	cpu_set_t* nodes; // CPUs of each NUMA node
+	size_t count;     // Number of NUMA nodes
+
+	if(spp->cpus == NULL && (spp->numa == false || spp->workers_count < 2)) return false;
+
+	if(spp->cpus) memcpy(cpus, spp->cpus, sizeof(cpu_set_t));
+	else if(sched_getaffinity(0, sizeof(cpu_set_t), cpus) == -1) return false;
+
+	if(spp->numa == false || spp->workers_count < 2) return true;
+
+	count = __get_numa_nodes(cpus, &nodes);
+	if(count > 1)
+	{
+		memcpy(cpus, &nodes[process % count], sizeof(cpu_set_t));
+		impact(2, "%s: Process %u serving HTTP requests on the %d CPUs of NUMA node %zu of %zu in use\n",
+			SP_HTTP_HEADER_NAMESPACE,
+			process, CPU_COUNT(cpus), process % count + 1, count);
+	}
+	free(nodes);
+
+	return true;
+}
+#endif // HAVE_SCHED_SETAFFINITY
+
+/*!
+ * \brief Apply the TCP profile of the server to its listening socket.
+ *
+ * \note Settings the system does not support (such as a congestion control
+ * algorithm whose module is not loaded) are skipped with a warning; the
+ * server works without them.
+ *
+ * \warning The caller must hold simplepost::master_lock.
+ *
+ * \param[in] spp  SimplePost instance to act on
+ * \param[in] sock Socket the server is listening on
+ */
+static void __tune_socket(simplepost_t spp, int sock)
+{
+	const struct simplepost_tcp_profile* profile = spp->tcp_profile; // Settings to apply
+	int nodelay;                                                     // Value of TCP_NODELAY
+
+	if(profile == NULL) return;
+
+	// Listening again only changes the length of the accept queue.
+	if(listen(sock, profile->backlog) == -1)
+	{
+		impact(1, "%s: Cannot set the backlog of the %s profile: %s\n",
+			SP_HTTP_HEADER_NAMESPACE,
+			profile->name, strerror(errno));
+	}
+
+	if(profile->sndbuf && setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &profile->sndbuf, sizeof(profile->sndbuf)) == -1)
+	{
+		impact(1, "%s: Cannot set the send buffer of the %s profile: %s\n",
+			SP_HTTP_HEADER_NAMESPACE,
+			profile->name, strerror(errno));
+	}
+
+	nodelay = profile->nodelay ? 1 : 0;
+	if(setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay)) == -1)
+	{
+		impact(1, "%s: Cannot set TCP_NODELAY for the %s profile: %s\n",
+			SP_HTTP_HEADER_NAMESPACE,
+			profile->name, strerror(errno));
+	}
+
+	#ifdef TCP_NOTSENT_LOWAT
+	if(profile->notsent_lowat && setsockopt(sock, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &profile->notsent_lowat, sizeof(profile->notsent_lowat)) == -1)
+	{
+		impact(1, "%s: Cannot limit the unsent data of the %s profile: %s\n",
+			SP_HTTP_HEADER_NAMESPACE,
+			profile->name, strerror(errno));
+	}
+	#endif // TCP_NOTSENT_LOWAT
+
+	#ifdef TCP_FASTOPEN
+	if(profile->fastopen && setsockopt(sock, IPPROTO_TCP, TCP_FASTOPEN, &profile->fastopen, sizeof(profile->fastopen)) == -1)
+	{
+		impact(1, "%s: Cannot enable TCP Fast Open for the %s profile: %s\n",
+			SP_HTTP_HEADER_NAMESPACE,
+			profile->name, strerror(errno));
+	}
+	#endif // TCP_FASTOPEN
+
+	#ifdef TCP_CONGESTION
+	if(profile->congestion && setsockopt(sock, IPPROTO_TCP, TCP_CONGESTION, profile->congestion, strlen(profile->congestion)) == -1)
+	{
+		impact(1, "%s: Cannot use the %s congestion control algorithm of the %s profile: %s\n",
+			SP_HTTP_HEADER_NAMESPACE,
+			profile->congestion, profile->name, strerror(errno));
+	}
+	#endif // TCP_CONGESTION
+
+	impact(2, "%s: Tuned the server for the %s profile\n",
+		SP_HTTP_HEADER_NAMESPACE,
+		profile->name);
+}
+
+/*!
+ * \brief Start an HTTP server for the given instance.
+ *
+ * \note The threads of the server (which libmicrohttpd starts from this
+ * thread, and which start the threads serving each connection) are confined
+ * to the CPUs chosen by __get_affinity(). The calling thread is not. The
+ * listening socket is tuned with __tune_socket().
+ *
+ * \warning The caller must hold simplepost::master_lock.
+ *
+ * \param[in] spp     SimplePost instance to act on
+ * \param[in] process Number of the process starting the server (0 for this one)
+ * \param[in] source  Address and port to bind the server to
+ * \param[in] sock
+ * \parblock
+ * Socket to accept connections on
+ *
+ * If the socket is -1, a new socket is bound to the source address.
+ * Otherwise it must already be bound to the source address and listening, and
+ * it is closed when the server is stopped.
+ * \endparblock
+ *
+ * \return the new server, or NULL if it could not be started
+ */
+static struct MHD_Daemon* __start_daemon(simplepost_t spp, unsigned int process, struct sockaddr_in* source, int sock)
+{
+	struct MHD_Daemon* httpd; // New server
+	#ifdef HAVE_SCHED_SETAFFINITY
+	cpu_set_t cpus;           // CPUs the server should run on
+	cpu_set_t previous;       // CPUs this thread could run on before the server was started
+	bool is_pinned = false;   // Was this thread confined to cpus?
+
+	if(__get_affinity(spp, process, &cpus))
+	{
+		if(sched_getaffinity(0, sizeof(previous), &previous) == -1 ||
+			sched_setaffinity(0, sizeof(cpus), &cpus) == -1)
+		{
+			impact(0, "%s: Cannot confine the server to %d CPUs: %s\n",
+				SP_HTTP_HEADER_NAMESPACE,
+				CPU_COUNT(&cpus), strerror(errno));
+			return NULL;
+		}
+		is_pinned = true;
+	}
+	#else
+	// Unused parameters
+	(void) process;
+	#endif // HAVE_SCHED_SETAFFINITY
+
+	MHD_set_panic_func(&__panic, (void*) spp);
+	httpd = MHD_start_daemon(SP_HTTP_FLAGS, ntohs(source->sin_port),
+		NULL, NULL,
+		&__process_request, (void*) spp,
+		MHD_OPTION_NOTIFY_COMPLETED, &__finalize_request, (void*) spp,
+		#if HAVE_DECL_MHD_OPTION_NOTIFY_CONNECTION
+		MHD_OPTION_NOTIFY_CONNECTION, &__notify_connection, (void*) spp,
+		#endif // HAVE_DECL_MHD_OPTION_NOTIFY_CONNECTION
+		MHD_OPTION_CONNECTION_LIMIT, spp->connection_limit ? spp->connection_limit : SP_HTTP_BACKLOG,
+		MHD_OPTION_CONNECTION_TIMEOUT, spp->connection_timeout,
+		MHD_OPTION_SOCK_ADDR, source,
+		MHD_OPTION_LISTEN_SOCKET, sock,
+		MHD_OPTION_EXTERNAL_LOGGER, &__log_microhttpd_messages, (void*) spp,
+		MHD_OPTION_END);
+
+	#ifdef HAVE_SCHED_SETAFFINITY
+	if(is_pinned) sched_setaffinity(0, sizeof(previous), &previous);
+	#endif // HAVE_SCHED_SETAFFINITY
+
+	if(httpd && spp->tcp_profile)
+	{
+		const union MHD_DaemonInfo* httpd_sock; // Socket the server is listening on
+
+		httpd_sock = MHD_get_daemon_info(httpd, MHD_DAEMON_INFO_LISTEN_FD);
+		if(httpd_sock) __tune_socket(spp, httpd_sock->listen_fd);
+	}
+
+	return httpd;
+}
+
+/*!
+ * \brief Take every lock a worker process might need before forking it.
+ *
+ * \note Other threads (the journal's, the timers', and the watcher's) may be
+ * holding these locks at any time. A worker forked meanwhile would inherit
+ * them locked, with no thread left to unlock them, so they are held across
+ * fork() and released by __unlock_after_fork() in both processes. The locks
+ * are taken in the order the rest of this file takes them. The callbacks are
+ * only held for reading, since the callbacks themselves may take the others.
+ *
+ * \param[in] spp SimplePost instance to act on
+ */
+static void __lock_for_fork(simplepost_t spp)
+{
+	pthread_rwlock_rdlock(&spp->callbacks_lock);
+	pthread_mutex_lock(&spp->files_lock);
+	if(spp->journal) simplejournal_lock(spp->journal);
+	pthread_mutex_lock(&spp->events_lock);
+	#ifdef HAVE_LIBMAGIC
+	pthread_mutex_lock(&spp->magic_lock);
+	#endif // HAVE_LIBMAGIC
+	pthread_mutex_lock(&spp->states_lock);
+	pthread_mutex_lock(&spp->direct_lock);
+	pthread_mutex_lock(&spp->address_lock);
+}
+
+/*!
+ * \brief Release the locks taken by __lock_for_fork().
+ *
+ * \param[in] spp SimplePost instance to act on
+ */
+static void __unlock_after_fork(simplepost_t spp)
+{
+	pthread_mutex_unlock(&spp->address_lock);
+	pthread_mutex_unlock(&spp->direct_lock);
+	pthread_mutex_unlock(&spp->states_lock);
+	#ifdef HAVE_LIBMAGIC
+	pthread_mutex_unlock(&spp->magic_lock);
+	#endif // HAVE_LIBMAGIC
+	pthread_mutex_unlock(&spp->events_lock);
+	if(spp->journal) simplejournal_unlock(spp->journal);
+	pthread_mutex_unlock(&spp->files_lock);
+	pthread_rwlock_unlock(&spp->callbacks_lock);
+}
+
+/*!
+ * \brief Serve HTTP requests in a worker process until its parent is gone.
+ *
+ * \note This function runs in the child forked by __start_workers(). It never
+ * returns; the worker exits as soon as it notices its parent is gone, or
+ * when its parent terminates it.
+ *
+ * \param[in] spp    SimplePost instance to act on (the child's copy)
+ * \param[in] socks  Sockets of every process serving HTTP requests
+ * \param[in] n      Number of sockets
+ * \param[in] worker Number of this worker (the index of its socket)
+ * \param[in] source Address and port the sockets are bound to
+ * \param[in] parent Process identifier of the parent
+ */
+static void __run_worker(
+	simplepost_t spp,
+	int* socks,
+	unsigned int n,
+	unsigned int worker,
+	struct sockaddr_in* source,
+	pid_t parent)
+{
+	struct MHD_Daemon* httpd; // Server of this worker
+
+	// The worker was forked by the thread holding the locks.
+	__unlock_after_fork(spp);
+	pthread_mutex_unlock(&spp->master_lock);
+
+	signal(SIGTERM, SIG_DFL);
+
+	for(unsigned int i = 0; i < n; ++i)
+	{
+		if(i != worker) close(socks[i]);
+	}
+
+	// Only the parent may stop the workers.
+	free(spp->workers);
+	spp->workers = NULL;
+
+	httpd = __start_daemon(spp, worker, source, socks[worker]);
+	if(httpd == NULL)
+	{
+		impact(0, "%s: Worker %u failed to initialize the server\n",
+			SP_HTTP_HEADER_NAMESPACE,
+			worker);
+		_exit(1);
+	}
+
+	impact(2, "%s: Worker %u accepting connections with PID %d\n",
+		SP_HTTP_HEADER_NAMESPACE,
+		worker, getpid());
+
+	while(getppid() == parent) usleep(SP_HTTP_SLEEP * 1000);
+
+	MHD_stop_daemon(httpd);
+	_exit(0);
+}
+
+/*!
+ * \brief Stop the worker processes serving HTTP requests.
+ *
+ * \param[in] spp SimplePost instance to act on
+ */
+static void __stop_workers(simplepost_t spp)
+{
+	if(spp->workers == NULL) return;
+
+	for(pid_t* p = spp->workers; *p; ++p) kill(*p, SIGTERM);
+	for(pid_t* p = spp->workers; *p; ++p) waitpid(*p, NULL, 0);
+
+	free(spp->workers);
+	spp->workers = NULL;
+}
+
+/*!
+ * \brief Start the web server in this process and its worker processes.
+ *
+ * \note Every process accepts connections on its own socket, bound to the
+ * same address and port with SO_REUSEPORT, so the kernel spreads the
+ * connections between them. The workers count downloads in the table of
+ * files shared with this process, which is still the only process to change
+ * the files being served.
+ *
+ * \warning The workers are forked, so this should be done before this process
+ * starts any threads of its own which the workers might need (such as the
+ * command server's). The locks the workers share with the threads which may
+ * already be running are held across each fork (see __lock_for_fork()).
+ *
+ * \warning The caller must hold simplepost::master_lock.
+ *
+ * \param[in] spp       SimplePost instance to act on
+ * \param[inout] source
+ * \parblock
+ * Address and port to bind the server to
+ *
+ * If the port is 0, it is replaced by the port allocated.
+ * \endparblock
+ *
+ * \return the server of this process, or NULL if it could not be started
+ */
+static struct MHD_Daemon* __start_workers(simplepost_t spp, struct sockaddr_in* source)
+{
+	#ifdef SO_REUSEPORT
+	unsigned int n = spp->workers_count;      // Number of processes to serve HTTP requests
+	int* socks;                               // Socket of each process
+	simpleshare_t shared = NULL;              // Table of files to share with the workers
+	struct MHD_Daemon* httpd = NULL;          // Server of this process
+	pid_t parent = getpid();                  // Process identifier of this process
+	int one = 1;                              // Value to enable socket options with
+	bool ok;                                  // Is every file shared?
+
+	socks = (int*) malloc(sizeof(int) * n);
+	spp->workers = (pid_t*) calloc(n, sizeof(pid_t));
+	if(socks == NULL || spp->workers == NULL)
+	{
+		impact(0, "%s: %s: Failed to allocate memory for %u workers\n",
+			SP_HTTP_HEADER_NAMESPACE, SP_MAIN_HEADER_MEMORY_ALLOC,
+			n);
+		goto error;
+	}
+
+	for(unsigned int i = 0; i < n; ++i) socks[i] = -1;
+	for(unsigned int i = 0; i < n; ++i)
+	{
+		socks[i] = socket(AF_INET, SOCK_STREAM, 0);
+		if(socks[i] == -1 ||
+			setsockopt(socks[i], SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) == -1 ||
+			setsockopt(socks[i], SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) == -1 ||
+			bind(socks[i], (struct sockaddr*) source, sizeof(struct sockaddr_in)) == -1 ||
+			listen(socks[i], SOMAXCONN) == -1)
+		{
+			impact(0, "%s: Cannot listen on PORT %u: %s\n",
+				SP_HTTP_HEADER_NAMESPACE,
+				ntohs(source->sin_port), strerror(errno));
+			goto error;
+		}
+
+		// The other sockets must be bound to the port allocated for the first.
+		if(source->sin_port == 0)
+		{
+			socklen_t source_len = sizeof(struct sockaddr_in); // Length of the socket's address
+
+			if(getsockname(socks[i], (struct sockaddr*) source, &source_len) == -1)
+			{
+				impact(0, "%s: Socket could not be allocated: %s\n",
+					SP_HTTP_HEADER_NAMESPACE,
+					strerror(errno));
+				goto error;
+			}
+		}
+	}
+
+	pthread_mutex_lock(&spp->files_lock);
+	shared = spp->shared ? spp->shared : simpleshare_map();
+	if(shared)
+	{
+		spp->shared = shared;
+		simpleshare_wrlock(shared);
+		ok = __rebuild_shared(spp);
+		simpleshare_unlock(shared);
+	}
+	pthread_mutex_unlock(&spp->files_lock);
+
+	if(shared == NULL)
+	{
+		impact(0, "%s: Cannot map the table of files to share with the workers: %s\n",
+			SP_HTTP_HEADER_NAMESPACE,
+			strerror(errno));
+		goto error;
+	}
+	if(ok == false)
+	{
+		impact(0, "%s: Cannot share %zu files with the workers\n",
+			SP_HTTP_HEADER_NAMESPACE,
+			spp->files_count);
+		goto error;
+	}
+
+	for(unsigned int i = 1; i < n; ++i)
+	{
+		pid_t pid; // Process identifier of the worker
+
+		__lock_for_fork(spp);
+		pid = fork();
+		if(pid != 0) __unlock_after_fork(spp);
+
+		if(pid == -1)
+		{
+			impact(0, "%s: Cannot fork worker %u: %s\n",
+				SP_HTTP_HEADER_NAMESPACE,
+				i, strerror(errno));
+			goto error;
+		}
+		else if(pid == 0)
+		{
+			__run_worker(spp, socks, n, i, source, parent);
+		}
+
+		spp->workers[i - 1] = pid;
+	}
+
+	httpd = __start_daemon(spp, 0, source, socks[0]);
+	if(httpd == NULL) goto error;
+	socks[0] = -1;
+
+	for(unsigned int i = 1; i < n; ++i) close(socks[i]);
+	free(socks);
+
+	impact(1, "%s: Serving HTTP requests with %u worker processes\n",
+		SP_HTTP_HEADER_NAMESPACE,
+		n - 1);
+
+	return httpd;
+
+error:
+	__stop_workers(spp);
+
+	if(socks)
+	{
+		for(unsigned int i = 0; i < n; ++i)
+		{
+			if(socks[i] != -1) close(socks[i]);
+		}
+		free(socks);
+	}
+
+	if(shared)
+	{
+		pthread_mutex_lock(&spp->files_lock);
+		for(struct simplepost_serve* p = spp->files; p; p = p->next) p->shared_slot = 0;
+		spp->shared = NULL;
+		pthread_mutex_unlock(&spp->files_lock);
+		simpleshare_unmap(shared);
+	}
+
+	return NULL;
+	#else
+	// Unused parameters
+	(void) source;
+
+	impact(0, "%s: This system cannot run %u worker processes on the same port\n",
+		SP_HTTP_HEADER_NAMESPACE,
+		spp->workers_count);
+
+	return NULL;
+	#endif // SO_REUSEPORT
+}
+
+/*!
+ * \brief Files collected by __collect_file()
+ */
+struct simplepost_matches
+{
+	/// Files collected so far
+	struct simplepost_serve** files;
+
+	/// Number of files collected
+	size_t count;
+
+	/// Number of files there is room for in files
+	size_t size;
+};
+
+/*!
+ * \brief Collect a file matched by __match_files().
+ *
+ * \param[in] spsp File to collect
+ * \param[in] arg  Files collected so far (struct simplepost_matches)
+ *
+ * \retval true the file was collected
+ * \retval false we failed to allocate the requested memory
+ */
+static bool __collect_file(struct simplepost_serve* spsp, void* arg)
+{
+	struct simplepost_matches* matches = (struct simplepost_matches*) arg;
+
+	if(matches->count == matches->size)
+	{
+		size_t size = matches->size ? matches->size * 2 : SP_HTTP_FILES_PAGE;
+		struct simplepost_serve** files;
+
+		files = (struct simplepost_serve**) realloc(matches->files, sizeof(struct simplepost_serve*) * size);
+		if(files == NULL) return false;
+
+		matches->files = files;
+		matches->size = size;
+	}
+
+	matches->files[matches->count++] = spsp;
+
+	return true;
+}
+
+/*!
+ * \brief List of copies of files being served
+ */
+struct simplepost_file_list
+{
+	/// First file in the list
+	simplepost_file_t head;
+
+	/// Last file in the list
+	simplepost_file_t tail;
+
+	/// Number of files in the list
+	size_t count;
+};
+
+/*!
+ * \brief Append a copy of a file being served to a list of files.
+ *
+ * \note The URL of the copy is not set. Once the files lock has been
+ * released, use __set_file_urls() to build it.
+ *
+ * \warning The caller must hold simplepost::files_lock.
+ *
+ * \param[in] spsp File to copy
+ * \param[in] arg  List to append the copy to (struct simplepost_file_list)
+ *
+ * \retval true the copy was appended to the list
+ * \retval false we failed to allocate the requested memory (in which case an
+ * incomplete copy may be left at the end of the list)
+ */
+static bool __copy_file(struct simplepost_serve* spsp, void* arg)
+{
+	struct simplepost_file_list* list = (struct simplepost_file_list*) arg;
+	simplepost_file_t p; // Copy of the file
+
+	if(spsp->file == NULL || spsp->uri == NULL) return false;
+
+	p = simplepost_file_init();
+	if(p == NULL) return false;
+
+	if(list->tail)
+	{
+		p->prev = list->tail;
+		list->tail->next = p;
+	}
+	else
+	{
+		list->head = p;
+	}
+	list->tail = p;
+
+	p->file = (char*) malloc(sizeof(char) * (strlen(spsp->file) + 1));
+	if(p->file == NULL) return false;
+	strcpy(p->file, spsp->file);
+
+	p->uri = (char*) malloc(sizeof(char) * (strlen(spsp->uri) + 1));
+	if(p->uri == NULL) return false;
+	strcpy(p->uri, spsp->uri);
+
+	p->count = spsp->count;
+	p->expires = spsp->timer ? simpletimer_get_expiry(spsp->timer) : 0;
+
+	++(list->count);
+
+	return true;
+}
+
+/*!
+ * \brief Build the URL of every file in a list of copies.
+ *
+ * \param[in] spp   SimplePost instance the files are being served by
+ * \param[in] files List of files copied with __copy_file()
+ *
+ * \retval true every URL was built
+ * \retval false the address of the server is unknown, or we failed to
+ * allocate the requested memory
+ */
+static bool __set_file_urls(simplepost_t spp, simplepost_file_t files)
+{
+	const char* address; // Address of the server
+
+	if(files == NULL) return true;
+
+	address = __get_address(spp);
+	if(address == NULL) return false;
+
+	for(simplepost_file_t f = files; f; f = f->next)
+	{
+		size_t url_size = strlen(address) + strlen(f->uri) + 50; // Size of the URL buffer
+
+		f->url = (char*) malloc(sizeof(char) * url_size);
+		if(f->url == NULL) return false;
+
+		if(simplestr_get_url(f->url, url_size, f->file, address, spp->port, f->uri) == 0) return false;
+	}
+
+	return true;
+}
+
+/*****************************************************************************
+ *                            SimplePost Public                              *
+ *****************************************************************************/
+
+/*!
+ * \brief Initialize a new SimplePost instance.
+ *
+ * \return a pointer to the new instance on success, or NULL if we failed to
+ * allocate the requested memory
+ */
+simplepost_t simplepost_init()
+{
+	simplepost_t spp = (simplepost_t) malloc(sizeof(struct simplepost));
+	if(spp == NULL) return NULL;
+
+	memset(spp, 0, sizeof(struct simplepost));
+	spp->listen_sock = -1;
+	spp->signed_fd = -1;
+
+	pthread_mutex_init(&spp->master_lock, NULL);
+	pthread_mutex_init(&spp->address_lock, NULL);
+	pthread_mutex_init(&spp->files_lock, NULL);
+	pthread_cond_init(&spp->files_cond, NULL);
+	pthread_cond_init(&spp->timers_cond, NULL);
+	pthread_mutex_init(&spp->events_lock, NULL);
+	pthread_rwlock_init(&spp->callbacks_lock, NULL);
+	pthread_mutex_init(&spp->direct_lock, NULL);
+	pthread_mutex_init(&spp->states_lock, NULL);
+	#ifdef HAVE_LIBMAGIC
+	pthread_mutex_init(&spp->magic_lock, NULL);
+	#endif // HAVE_LIBMAGIC
+
+	spp->claims = simpleclaim_table_map();
+	if(spp->claims == NULL)
+	{
+		impact(0, "%s: Cannot map the table of downloads to resume: %s\n",
+			SP_HTTP_HEADER_NAMESPACE,
+			strerror(errno));
+	}
+	spp->claims_grace = SP_CLAIM_GRACE;
+
+	return spp;
+}
+
+/*!
+ * \brief Free the given SimplePost instance.
+ *
+ * \param[in] spp SimplePost instance to act on
+ */
+void simplepost_free(simplepost_t spp)
+{
+	if(spp == NULL) return;
+
+	if(spp->httpd) simplepost_unbind(spp);
+	if(spp->address) free(spp->address);
+
+	if(spp->timers_running)
+	{
+		pthread_mutex_lock(&spp->files_lock);
+		spp->timers_exit = true;
+		pthread_cond_signal(&spp->timers_cond);
+		pthread_mutex_unlock(&spp->files_lock);
+		pthread_join(spp->timers_thread, NULL);
+	}
+
+	__stop_watches(spp);
+
+	simplejournal_free(spp->journal);
+
+	if(spp->files) __simplepost_serve_free(spp->files);
+	simpletimer_wheel_free(spp->timers);
+	if(spp->files_index) free(spp->files_index);
+	simpletrie_free(spp->files_trie);
+	simpleindex_unmap(spp->index);
+	simpleshare_unmap(spp->shared);
+	__unmap_signed(spp->signed_links, spp->signed_size, spp->signed_fd);
+	simpleclaim_table_unmap(spp->claims);
+	simplesign_key_free(spp->sign_key);
+
+	#ifdef HAVE_LIBMAGIC
+	if(spp->magic) magic_close(spp->magic);
+	pthread_mutex_destroy(&spp->magic_lock);
+	#endif // HAVE_LIBMAGIC
+
+	#ifdef HAVE_SCHED_SETAFFINITY
+	if(spp->cpus) free(spp->cpus);
+	#endif // HAVE_SCHED_SETAFFINITY
+
+	while(spp->direct_pool)
+	{
+		void* buffer = spp->direct_pool; // Buffer to free
+		spp->direct_pool = *((void**) buffer);
+		free(buffer);
+	}
+
+	while(spp->states)
+	{
+		struct simplepost_state* spsp = spp->states; // Request state to free
+		spp->states = spsp->next;
+		__free_state(spsp);
+	}
+
+	pthread_mutex_destroy(&spp->master_lock);
+	pthread_mutex_destroy(&spp->address_lock);
+	pthread_mutex_destroy(&spp->files_lock);
+	pthread_cond_destroy(&spp->files_cond);
+	pthread_cond_destroy(&spp->timers_cond);
+	pthread_mutex_destroy(&spp->events_lock);
+	pthread_rwlock_destroy(&spp->callbacks_lock);
+	pthread_mutex_destroy(&spp->direct_lock);
+	pthread_mutex_destroy(&spp->states_lock);
+
+	free(spp);
+}
+
+/*!
+ * \brief Limit the number of clients which may be connected at once.
+ *
+ * \note This setting takes effect the next time the server is bound.
+ *
+ * \param[in] spp   SimplePost instance to act on
+ * \param[in] limit
+ * \parblock
+ * Maximum number of concurrent client connections
+ *
+ * If the limit is zero, a reasonable default will be used.
+ * \endparblock
+ */
+void simplepost_set_connection_limit(simplepost_t spp, unsigned int limit)
+{
+	pthread_mutex_lock(&spp->master_lock);
+	spp->connection_limit = limit;
+	pthread_mutex_unlock(&spp->master_lock);
+}
+
+/*!
+ * \brief Close client connections which have been idle too long.
+ *
+ * \note This setting takes effect the next time the server is bound.
+ *
+ * \param[in] spp     SimplePost instance to act on
+ * \param[in] timeout
+ * \parblock
+ * Number of seconds a connection may be idle
+ *
+ * If the timeout is zero, idle connections will never be closed.
+ * \endparblock
+ */
+void simplepost_set_connection_timeout(simplepost_t spp, unsigned int timeout)
+{
+	pthread_mutex_lock(&spp->master_lock);
+	spp->connection_timeout = timeout;
+	pthread_mutex_unlock(&spp->master_lock);
+}
+
+/*!
+ * \brief Stop blocking once the server has gone without clients for a while.
+ *
+ * \note This lets an instance started by a service manager for its first
+ * client exit when it is no longer needed (see
+ * simplepost_get_activated_socket()). simplepost_block() and
+ * simplepost_block_files() return once no client has been connected for the
+ * timeout; shutting the server down is up to the caller. A server with worker
+ * processes never times out.
+ *
+ * \param[in] spp     SimplePost instance to act on
+ * \param[in] timeout
+ * \parblock
+ * Number of seconds the server may go without any clients
+ *
+ * If the timeout is zero, the server never times out.
+ * \endparblock
+ */
+void simplepost_set_idle_timeout(simplepost_t spp, unsigned int timeout)
+{
+	pthread_mutex_lock(&spp->master_lock);
+	spp->idle_timeout = timeout;
+	pthread_mutex_unlock(&spp->master_lock);
+}
+
+/*!
+ * \brief Set how long a client has to resume an interrupted download.
+ *
+ * \note A download of a file with a COUNT is reserved for the client which
+ * starts it, and only counted once the client has been sent the whole file,
+ * in however many requests it takes. If the client does not resume the
+ * download within the grace period, the reservation lapses and the download
+ * is not counted. While every download the file has left is reserved, other
+ * clients are refused. Worker processes keep the grace period they were
+ * forked with. Downloads are counted as they start if the system cannot tell
+ * how much of an interrupted response reached the client.
+ *
+ * \param[in] spp   SimplePost instance to act on
+ * \param[in] grace
+ * \parblock
+ * Number of seconds the client has to resume the download (SP_CLAIM_GRACE by
+ * default)
+ *
+ * If the grace period is zero, every download is counted as it starts.
+ * \endparblock
+ */
+void simplepost_set_resume_grace(simplepost_t spp, unsigned int grace)
+{
+	__atomic_store_n(&spp->claims_grace, (uint32_t) grace, __ATOMIC_RELAXED);
+}
+
+/*!
+ * \brief Serve HTTP requests from several processes.
+ *
+ * \note This setting takes effect the next time the server is bound with
+ * simplepost_bind(), which forks the worker processes. Every process accepts
+ * connections on the same port, and downloads are counted in a table of files
+ * shared by all of them, so COUNTs are exact. This process is still the only
+ * one which accepts changes to the files being served; the workers exit when
+ * the server is shut down (or this process exits). Events are only published
+ * for the downloads served by this process, and the statistics reported by
+ * simplepost_get_status() only cover this process as well.
+ *
+ * \param[in] spp     SimplePost instance to act on
+ * \param[in] workers
+ * \parblock
+ * Number of processes which should serve HTTP requests (including this one)
+ *
+ * If the number is zero or one, only this process serves them.
+ * \endparblock
+ */
+void simplepost_set_workers(simplepost_t spp, unsigned int workers)
+{
+	pthread_mutex_lock(&spp->master_lock);
+	spp->workers_count = workers;
+	pthread_mutex_unlock(&spp->master_lock);
+}
+
+/*!
+ * \brief Confine the HTTP server to some of the CPUs of the system.
+ *
+ * \note This setting takes effect the next time the server is bound. Only the
+ * threads of the server (and of its worker processes) are confined; the
+ * thread calling simplepost_bind() and the threads of the rest of the program
+ * may still run anywhere.
+ *
+ * \param[in] spp  SimplePost instance to act on
+ * \param[in] cpus
+ * \parblock
+ * List of the CPUs the server may run on, such as "0-3,8"
+ *
+ * If the list is NULL, the server may run on any CPU.
+ * \endparblock
+ * \param[in] numa
+ * \parblock
+ * Spread the processes serving HTTP requests across the NUMA nodes of the
+ * system, and confine each to the CPUs (and so the memory) of its own node
+ *
+ * This only makes a difference with worker processes (see
+ * simplepost_set_workers()) on a system with more than one NUMA node.
+ * \endparblock
+ *
+ * \return true if the setting was changed, false if the list of CPUs is not
+ * valid or this system cannot confine threads to CPUs
+ */
+bool simplepost_set_affinity(simplepost_t spp, const char* cpus, bool numa)
+{
+	#ifdef HAVE_SCHED_SETAFFINITY
+	cpu_set_t* set = NULL; // CPUs the server may run on
+	cpu_set_t available;   // CPUs this process may run on
+
+	if(cpus)
+	{
+		set = (cpu_set_t*) malloc(sizeof(cpu_set_t));
+		if(set == NULL)
+		{
+			impact(0, "%s: %s: Failed to allocate memory for the CPUs to run on\n",
+				SP_HTTP_HEADER_NAMESPACE, SP_MAIN_HEADER_MEMORY_ALLOC);
+			return false;
+		}
+
+		if(__parse_cpu_list(cpus, set) == false || CPU_COUNT(set) == 0)
+		{
+			impact(0, "%s: Invalid list of CPUs: %s\n",
+				SP_HTTP_HEADER_NAMESPACE,
+				cpus);
+			free(set);
+			return false;
+		}
+
+		if(sched_getaffinity(0, sizeof(available), &available) == 0)
+		{
+			CPU_AND(set, set, &available);
+			if(CPU_COUNT(set) == 0)
+			{
+				impact(0, "%s: None of the CPUs %s are available\n",
+					SP_HTTP_HEADER_NAMESPACE,
+					cpus);
+				free(set);
+				return false;
+			}
+		}
+	}
+
+	pthread_mutex_lock(&spp->master_lock);
+	if(spp->cpus) free(spp->cpus);
+	spp->cpus = set;
+	spp->numa = numa;
+	pthread_mutex_unlock(&spp->master_lock);
+
+	return true;
+	#else
+	// Unused parameters
+	(void) spp;
+
+	if(cpus == NULL && numa == false) return true;
+
+	impact(0, "%s: This system cannot confine the server to some of its CPUs\n",
+		SP_HTTP_HEADER_NAMESPACE);
+
+	return false;
+	#endif // HAVE_SCHED_SETAFFINITY
+}
+
+/*!
+ * \brief Tune the sockets of the server for a kind of traffic.
+ *
+ * \note This setting takes effect the next time the server is bound (or
+ * resumed). The profiles are:
+ * - lan-bulk: few large downloads over a fast local network
+ * - many-small: many clients downloading small files
+ * - wan-high-latency: large downloads over long distances
+ *
+ * \param[in] spp     SimplePost instance to act on
+ * \param[in] profile
+ * \parblock
+ * Name of the profile to use
+ *
+ * If the name is NULL, the system's defaults are used.
+ * \endparblock
+ *
+ * \return true if the setting was changed, false if there is no such profile
+ */
+bool simplepost_set_tcp_profile(simplepost_t spp, const char* profile)
+{
+	const struct simplepost_tcp_profile* p = NULL; // Profile to use
+
+	if(profile)
+	{
+		for(size_t i = 0; i < sizeof(__tcp_profiles) / sizeof(__tcp_profiles[0]) && p == NULL; ++i)
+		{
+			if(strcmp(__tcp_profiles[i].name, profile) == 0) p = &__tcp_profiles[i];
+		}
+
+		if(p == NULL)
+		{
+			impact(0, "%s: Unknown TCP profile: %s\n",
+				SP_HTTP_HEADER_NAMESPACE,
+				profile);
+			return false;
+		}
+	}
+
+	pthread_mutex_lock(&spp->master_lock);
+	spp->tcp_profile = p;
+	pthread_mutex_unlock(&spp->master_lock);
+
+	return true;
+}
+
+/*!
+ * \brief Read files into the page cache as they are added.
+ *
+ * \note Only files which may be downloaded more than once are preloaded.
+ * Files which may only be downloaded once are dropped from the page cache
+ * after they are sent regardless of this setting, so they do not push the
+ * others out of it.
+ *
+ * \warning Call this function before simplepost_set_journal() if the files
+ * restored from the journal should be preloaded too.
+ *
+ * \param[in] spp     SimplePost instance to act on
+ * \param[in] preload Should the files be preloaded?
+ *
+ * \return true if the setting was changed, false if this system cannot
+ * preload files
+ */
+bool simplepost_set_preload(simplepost_t spp, bool preload)
+{
+	#ifdef HAVE_POSIX_FADVISE
+	pthread_mutex_lock(&spp->files_lock);
+	spp->preload = preload;
+	pthread_mutex_unlock(&spp->files_lock);
+
+	return true;
+	#else
+	// Unused parameters
+	(void) spp;
+
+	if(preload == false) return true;
+
+	impact(0, "%s: Preloading files is not supported on this system\n",
+		SP_HTTP_HEADER_NAMESPACE);
+
+	return false;
+	#endif // HAVE_POSIX_FADVISE
+}
+
+/*!
+ * \brief Watch the files being served for changes.
+ *
+ * \note A thread watches the directory of every file being served with
+ * inotify, one watch per directory. Once a file stops changing, whatever is
+ * remembered about it (its MIME type) is forgotten, so the next client is
+ * told about the new file. A file which is deleted may be purged; otherwise
+ * requests for it fail until it is back. Files in an index are not watched.
+ *
+ * \param[in] spp   SimplePost instance to act on
+ * \param[in] watch Should the files be watched?
+ * \param[in] purge Should files be purged once they are deleted?
+ *
+ * \return true on success, false if the files cannot be watched
+ */
+bool simplepost_set_watch(simplepost_t spp, bool watch, bool purge)
+{
+	bool ok = true; // Are the files being watched as requested?
+
+	pthread_mutex_lock(&spp->master_lock);
+
+	if(watch && spp->watch == NULL) ok = __start_watches(spp);
+	else if(watch == false) __stop_watches(spp);
+
+	pthread_mutex_lock(&spp->files_lock);
+	spp->watch_purge = (ok && watch && purge);
+	pthread_mutex_unlock(&spp->files_lock);
+
+	pthread_mutex_unlock(&spp->master_lock);
+
+	return ok;
+}
+
+/*!
+ * \brief Read large files with O_DIRECT, bypassing the page cache.
+ *
+ * \note Files read this way are streamed through a pool of aligned buffers,
+ * reading the next SP_HTTP_DIRECT_BUFFER bytes in the background while the
+ * last are sent. That takes a copy the kernel would not need with sendfile(),
+ * so it is only worthwhile for files too large to stay cached anyway, whose
+ * downloads would push every other file out of the page cache. Files served
+ * with simplepost_serve_file(direct = true) are read this way whatever their
+ * size. If the filesystem of a file does not support O_DIRECT, it is read
+ * through the page cache after all.
+ *
+ * \param[in] spp  SimplePost instance to act on
+ * \param[in] size
+ * \parblock
+ * Size (in bytes) from which files are read with O_DIRECT
+ *
+ * If the size is zero, only the files served that way explicitly are.
+ * \endparblock
+ *
+ * \return true if the setting was changed, false if this system cannot read
+ * files with O_DIRECT
+ */
+bool simplepost_set_direct_threshold(simplepost_t spp, uint64_t size)
+{
+	#ifdef HAVE_DIRECT_IO_SUPPORT
+	__atomic_store_n(&spp->direct_threshold, size, __ATOMIC_RELAXED);
+
+	return true;
+	#else
+	// Unused parameters
+	(void) spp;
+
+	if(size == 0) return true;
+
+	impact(0, "%s: Reading files with O_DIRECT is not supported on this system\n",
+		SP_HTTP_HEADER_NAMESPACE);
+
+	return false;
+	#endif // HAVE_DIRECT_IO_SUPPORT
+}
+
+/*!
+ * \brief Serve files only on links signed with a key.
+ *
+ * \note Once a key is set, a file is only served to requests for its URI with
+ * the query string of a link made with simplesign_sign_uri() and the same
+ * key, until the link expires or has been downloaded as many times as it
+ * allows. Requests for the URI alone are forbidden. Links need no record
+ * until they are first downloaded, so a file may be handed out on any number
+ * of links. If a link's COUNT is limited, its downloads are counted in a
+ * table holding the given number of links, which takes about 18 bytes per
+ * link; a link's slot is reused once it expires, and downloads of links
+ * beyond that are refused until some have expired. The table is only kept
+ * in memory unless it is given a file, in which case the counts survive a
+ * restart and are shared with any instance taking over from us; a table
+ * already in the file keeps the number of links it was made for. An instance
+ * counting links only in memory refuses to hand off its files, since the new
+ * instance would let each link be downloaded COUNT more times.
+ *
+ * \warning This function must be called before the server is bound.
+ *
+ * \param[in] spp   SimplePost instance to act on
+ * \param[in] key   Name and path of the file holding the key (see simplesign_key_init())
+ * \param[in] links
+ * \parblock
+ * Number of links with a limited COUNT which may be outstanding at once
+ *
+ * If the number is zero, SP_SIGNED_LINKS may be.
+ * \endparblock
+ * \param[in] table Name and path of the file to count the downloads of links in (NULL = only in memory)
+ *
+ * \return true if the key was set, false if an error occurred
+ */
+bool simplepost_set_sign_key(simplepost_t spp, const char* key, size_t links, const char* table)
+{
+	simplesign_key_t sign_key;              // Key read from the file
+	struct simplepost_signed* signed_links; // Table of signed links
+	size_t size;                            // Size (in bytes) of the table
+	int fd;                                 // File the table is kept in
+
+	pthread_mutex_lock(&spp->master_lock);
+	if(spp->httpd || spp->sign_key)
+	{
+		pthread_mutex_unlock(&spp->master_lock);
+		impact(0, "%s: The key for signed links must be set once, before the server is bound\n",
+			SP_HTTP_HEADER_NAMESPACE);
+		return false;
+	}
+
+	sign_key = simplesign_key_init(key);
+	if(sign_key == NULL)
+	{
+		pthread_mutex_unlock(&spp->master_lock);
+		return false;
+	}
+
+	signed_links = __map_signed(links ? links : SP_SIGNED_LINKS, table, &size, &fd);
+	if(signed_links == NULL)
+	{
+		pthread_mutex_unlock(&spp->master_lock);
+		simplesign_key_free(sign_key);
+		return false;
+	}
+
+	spp->sign_key = sign_key;
+	spp->signed_links = signed_links;
+	spp->signed_size = size;
+	spp->signed_fd = fd;
+	pthread_mutex_unlock(&spp->master_lock);
+
+	impact(1, "%s: Serving files only on links signed with the key %s\n",
+		SP_HTTP_HEADER_NAMESPACE,
+		key);
+
+	return true;
+}
+
+/*!
+ * \brief Journal changes to the files being served.
+ *
+ * \note If the journal already exists, the files it lists are restored with
+ * the number of times each may still be downloaded. From then on, every file
+ * served or purged and every download of a file with a limited COUNT is
+ * appended to the journal, and the journal is periodically compacted. Changes
+ * are committed to disk in groups, so a crash loses at most the last fraction
+ * of a second of them.
+ *
+ * \warning This function must be called before any files are served.
+ *
+ * \param[in] spp     SimplePost instance to act on
+ * \param[in] journal Name and path of the journal
+ *
+ * \return true if the journal was restored (or created) and changes are being
+ * journaled, false if an error occurred
+ */
+bool simplepost_set_journal(simplepost_t spp, const char* journal)
+{
+	simplejournal_t sjp; // Journal to replay
+	bool ok;             // Was the journal replayed?
+	size_t restored;     // Number of files restored
+
+	if(journal == NULL)
+	{
+		impact(0, "%s:%d: BUG! A journal is required\n",
+			__PRETTY_FUNCTION__, __LINE__);
+		return false;
+	}
+
+	pthread_mutex_lock(&spp->files_lock);
+	if(spp->journal || spp->files_count > 0)
+	{
+		pthread_mutex_unlock(&spp->files_lock);
+		impact(0, "%s: The journal must be set before any files are served\n",
+			SP_HTTP_HEADER_NAMESPACE);
+		return false;
+	}
+
+	sjp = simplejournal_init(journal, &spp->files_lock, &__snapshot_files, (void*) spp);
+	if(sjp == NULL)
+	{
+		pthread_mutex_unlock(&spp->files_lock);
+		impact(0, "%s: %s: Failed to allocate memory for the journal %s\n",
+			SP_HTTP_HEADER_NAMESPACE, SP_MAIN_HEADER_MEMORY_ALLOC,
+			journal);
+		return false;
+	}
+	spp->journal = sjp;
+
+	// Nothing is appended to the journal until it is started.
+	ok = simplejournal_replay(sjp, &__replay_file, (void*) spp);
+	restored = spp->files_count;
+	pthread_mutex_unlock(&spp->files_lock);
+
+	// Start the journal with a compact snapshot of the files restored.
+	if(ok) ok = simplejournal_start(sjp);
+
+	if(ok == false)
+	{
+		pthread_mutex_lock(&spp->files_lock);
+		spp->journal = NULL;
+		pthread_mutex_unlock(&spp->files_lock);
+		simplejournal_free(sjp);
+		return false;
+	}
+
+	impact(1, "%s: Restored %zu files from the journal %s\n",
+		SP_HTTP_HEADER_NAMESPACE,
+		restored, journal);
+
+	return true;
+}
+
+/*!
+ * \brief Claim a listening socket passed to us by the service manager.
+ *
+ * \note A service manager like systemd may open the sockets for us and start
+ * this program the first time a client connects to one of them (socket
+ * activation). It passes the sockets as file descriptors starting at 3, and
+ * sets the LISTEN_FDS and LISTEN_PID environment variables to tell us about
+ * them. Each socket may only be claimed once.
+ *
+ * \param[in] domain Communication domain of the socket (AF_INET or AF_UNIX)
+ *
+ * \return the socket, or -1 if the service manager did not pass us any
+ * (unclaimed) stream socket of the domain which is listening
+ */
+int simplepost_get_activated_socket(int domain)
+{
+	static uint64_t claimed = 0; // Sockets which were already claimed (bit i is SP_LISTEN_FDS_START + i)
+	const char* listen_pid;      // Value of LISTEN_PID
+	const char* listen_fds;      // Value of LISTEN_FDS
+	int pid;                     // Process the sockets were passed to
+	int n;                       // Number of sockets passed
+
+	listen_pid = getenv("LISTEN_PID");
+	listen_fds = getenv("LISTEN_FDS");
+	if(listen_pid == NULL || listen_fds == NULL) return -1;
+
+	// The variables are inherited by our children, but the sockets are ours.
+	if(sscanf(listen_pid, "%d", &pid) != 1 || pid != getpid()) return -1;
+	if(sscanf(listen_fds, "%d", &n) != 1 || n <= 0) return -1;
+	if(n > SP_LISTEN_FDS_MAX) n = SP_LISTEN_FDS_MAX;
+
+	for(int i = 0; i < n; ++i)
+	{
+		int sock = SP_LISTEN_FDS_START + i;      // Socket to check
+		struct sockaddr_storage addr;            // Address the socket is bound to
+		socklen_t addr_len = sizeof(addr);       // Length of the address
+		int value;                               // Value of a socket option
+		socklen_t value_len = sizeof(value);     // Length of the value
+
+		if(__atomic_load_n(&claimed, __ATOMIC_RELAXED) & (1ULL << i)) continue;
+
+		if(getsockname(sock, (struct sockaddr*) &addr, &addr_len) == -1 || addr.ss_family != domain) continue;
+		if(getsockopt(sock, SOL_SOCKET, SO_TYPE, &value, &value_len) == -1 || value != SOCK_STREAM) continue;
+		value_len = sizeof(value);
+		if(getsockopt(sock, SOL_SOCKET, SO_ACCEPTCONN, &value, &value_len) == -1 || value == 0) continue;
+
+		if(__atomic_fetch_or(&claimed, 1ULL << i, __ATOMIC_RELAXED) & (1ULL << i)) continue;
+
+		fcntl(sock, F_SETFD, FD_CLOEXEC);
+
+		impact(2, "%s: Claimed socket %d passed by the service manager\n",
+			SP_HTTP_HEADER_NAMESPACE,
+			sock);
+
+		return sock;
+	}
+
+	return -1;
+}
+
+/*!
+ * \brief Start the web server on the specified port.
+ *
+ * \note If the service manager passed us a listening IPv4 socket (see
+ * simplepost_get_activated_socket()), the server accepts connections on it
+ * instead, as if it was given to simplepost_bind_socket(), and the address and
+ * port are ignored.
+ *
+ * \param[in] spp     SimplePost instance to act on
+ * \param[in] port
+ * \parblock
+ * Port to initialize the server on
+ * 
+ * If the port is 0, a port will be dynamically allocated.
+ * \endparblock
+ * \param[in] address
+ * \parblock
+ * Network address to bind the server to
+ *
+ * If the address is NULL, the server will be bound to all local interfaces
+ * (0.0.0.0 in netstat parlance).
+ * \endparblock
+ *
+ * \return the port the server is bound to. If the return value is 0, an error
+ * occurred.
+ */
+unsigned short simplepost_bind(
+	simplepost_t spp,
+	const char* address,
+	unsigned short port)
+{
+	int sock; // Socket passed to us by the service manager
+
+	// The service manager may have started us to serve a client already waiting on its socket.
+	sock = simplepost_get_activated_socket(AF_INET);
+	if(sock != -1) return simplepost_bind_socket(spp, sock);
+
+	pthread_mutex_lock(&spp->master_lock);
+
+	if(spp->httpd)
+	{
+		impact(0, "%s: Server is already initialized\n",
+			SP_HTTP_HEADER_NAMESPACE);
+		goto error;
+	}
+
+	struct sockaddr_in source; // Source address and port the server should be bound to
+	memset(&source, 0, sizeof(source));
+
+	source.sin_family = AF_INET;
+	source.sin_port = htons(port);
+
+	if(address)
+	{
+		struct in_addr sin_addr; // Source address in network byte order
+
+		if(inet_pton(AF_INET, address, (void*) &sin_addr) != 1)
+		{
+			impact(0, "%s: Invalid source address specified\n",
+				SP_HTTP_HEADER_NAMESPACE);
+			goto error;
+		}
+		source.sin_addr = sin_addr;
+	}
+	else
+	{
+		source.sin_addr.s_addr = htonl(INADDR_ANY);
+	}
+
+	if(__set_address(spp, address) == false) goto error;
+
+	if(spp->workers_count > 1) spp->httpd = __start_workers(spp, &source);
+	else spp->httpd = __start_daemon(spp, 0, &source, -1);
+	if(spp->httpd == NULL)
+	{
+		impact(0, "%s: Failed to initialize the server on port %u\n",
+			SP_HTTP_HEADER_NAMESPACE, port);
+		goto error;
+	}
+
+	if(port == 0)
+	{
+		socklen_t source_len = sizeof(source);  // Length of the socket's source address
+		const union MHD_DaemonInfo* httpd_sock; // Socket the server is listening on
+
+		httpd_sock = MHD_get_daemon_info(spp->httpd, MHD_DAEMON_INFO_LISTEN_FD);
+		if(httpd_sock == NULL)
+		{
+			impact(0, "%s: Failed to get the socket the server is listening on\n",
+				SP_HTTP_HEADER_NAMESPACE);
+			goto error;
+		}
+
+		if(getsockname(httpd_sock->listen_fd, (struct sockaddr*) &source, &source_len) == -1)
+		{
+			impact(0, "%s: Socket could not be allocated: %s\n",
+				SP_HTTP_HEADER_NAMESPACE,
+				strerror(errno));
+			goto error;
+		}
+
+		port = ntohs(source.sin_port);
+	}
+
+	spp->port = port;
+	clock_gettime(CLOCK_MONOTONIC, &spp->start_time);
+	__touch(spp);
+
+	impact(1, "%s: Bound HTTP server to ADDRESS %s listening on PORT %u with PID %d\n",
+		SP_HTTP_HEADER_NAMESPACE,
+		address ? address : "0.0.0.0", spp->port, getpid());
+	pthread_mutex_unlock(&spp->master_lock);
+
+	return port;
+
+error:
+	if(spp->httpd)
+	{
+		MHD_stop_daemon(spp->httpd);
+		spp->httpd = NULL;
+	}
+
+	pthread_mutex_unlock(&spp->master_lock);
+
+	return 0;
+}
+
+/*!
+ * \brief Start the web server on a socket which is already listening.
+ *
+ * \note This is how a server takes over the socket of another one, which
+ * handed it off with simplepost_quiesce(). Clients waiting for their
+ * connections to be accepted in the meantime are served by this server.
+ *
+ * \param[in] spp  SimplePost instance to act on
+ * \param[in] sock
+ * \parblock
+ * IPv4 socket to accept connections on
+ *
+ * The socket belongs to the server from now on. It will be closed when the
+ * server is shut down.
+ * \endparblock
+ *
+ * \return the port the server is listening on. If the return value is 0, an
+ * error occurred.
+ */
+unsigned short simplepost_bind_socket(simplepost_t spp, int sock)
+{
+	struct sockaddr_in source;             // Address and port the socket is bound to
+	socklen_t source_len = sizeof(source); // Length of the socket's address
+	char address[INET_ADDRSTRLEN];         // Address the socket is bound to as a string
+
+	pthread_mutex_lock(&spp->master_lock);
+
+	if(spp->httpd)
+	{
+		impact(0, "%s: Server is already initialized\n",
+			SP_HTTP_HEADER_NAMESPACE);
+		goto error;
+	}
+
+	if(getsockname(sock, (struct sockaddr*) &source, &source_len) == -1)
+	{
+		impact(0, "%s: Cannot get the address of socket %d: %s\n",
+			SP_HTTP_HEADER_NAMESPACE,
+			sock, strerror(errno));
+		goto error;
+	}
+
+	if(source.sin_family != AF_INET)
+	{
+		impact(0, "%s: Socket %d is not an IPv4 socket\n",
+			SP_HTTP_HEADER_NAMESPACE,
+			sock);
+		goto error;
+	}
+
+	if(source.sin_addr.s_addr == htonl(INADDR_ANY))
+	{
+		if(__set_address(spp, NULL) == false) goto error;
+	}
+	else
+	{
+		inet_ntop(AF_INET, &source.sin_addr, address, sizeof(address));
+		if(__set_address(spp, address) == false) goto error;
+	}
+
+	spp->httpd = __start_daemon(spp, 0, &source, sock);
+	if(spp->httpd == NULL)
+	{
+		impact(0, "%s: Failed to initialize the server on socket %d\n",
+			SP_HTTP_HEADER_NAMESPACE, sock);
+		goto error;
+	}
+
+	spp->port = ntohs(source.sin_port);
+	clock_gettime(CLOCK_MONOTONIC, &spp->start_time);
+	__touch(spp);
+
+	inet_ntop(AF_INET, &source.sin_addr, address, sizeof(address));
+	impact(1, "%s: Took over HTTP server on ADDRESS %s listening on PORT %u with PID %d\n",
+		SP_HTTP_HEADER_NAMESPACE,
+		address, spp->port, getpid());
+	pthread_mutex_unlock(&spp->master_lock);
+
+	return spp->port;
+
+error:
+	pthread_mutex_unlock(&spp->master_lock);
+
+	return 0;
 }
 
 /*!
- * \brief Get the name and path of the file to serve from the given URI.
+ * \brief Shut down the web server.
  *
- * \note This function compares the given URI to the list of files we are
- * serving. The URI does not necessarily correspond one-to-one to an actual
- * file on the filesystem, hence the need for this function.
+ * \param[in] spp SimplePost instance to act on
  *
- * \warning The file count is taken into consideration by this function. It
- * will be appropriately decremented if a file is found matching the URI and
- * returned by this function. The file will also be removed from the list of
- * files being served and the instance file count decremented if the file
- * reaches the maximum allowable times it may be served.
+ * \retval true The server has been successfully killed.
+ * \retval false The server is not running or could not be shut down.
+ */
+bool simplepost_unbind(simplepost_t spp)
+{
+	if(spp->httpd == NULL)
+	{
+		impact(0, "%s: Server is not running\n", SP_HTTP_HEADER_NAMESPACE);
+		return false;
+	}
+
+	impact(1, "%s: Shutting down ...\n", SP_HTTP_HEADER_NAMESPACE);
+
+	/* The retired server may still be using the socket it stopped accepting
+	 * connections on, which the current server closes when it stops.
+	 */
+	if(spp->httpd_retired)
+	{
+		MHD_stop_daemon(spp->httpd_retired);
+		spp->httpd_retired = NULL;
+	}
+
+	MHD_stop_daemon(spp->httpd);
+
+	pthread_mutex_lock(&spp->master_lock);
+	__stop_workers(spp);
+	pthread_mutex_unlock(&spp->master_lock);
+
+	#ifdef DEBUG
+	impact(2, "%s: %p cleanup complete\n",
+		SP_HTTP_HEADER_NAMESPACE, spp->httpd);
+	#endif // DEBUG
+
+	if(spp->listen_sock != -1)
+	{
+		close(spp->listen_sock);
+		spp->listen_sock = -1;
+	}
+
+	spp->httpd = NULL;
+
+	return true;
+}
+
+/*!
+ * \brief Stop accepting connections, so that another process may take over.
  *
- * \param[in] spp   SimplePost instance to act on
- * \param[out] file
- * \parblock
- * Name and path of the file on the filesystem
+ * \note Transfers which have already started continue, but no more files are
+ * served: requests on connections which are already open are refused, so
+ * clients retry them on new connections. The list of files stops changing,
+ * and the journal (if any) is committed and closed, so the other process may
+ * take over the files being served as well. Connections made in the meantime
+ * wait to be accepted by the other process, which should pass the listening
+ * socket to simplepost_bind_socket(). Then shut this server down with
+ * simplepost_drain(). If the other process fails to take over, start
+ * accepting connections again with simplepost_resume(). A server serving
+ * signed links must count their downloads in a file (see
+ * simplepost_set_sign_key()), which the other process should use too.
  *
- * The storage for this string will be dynamically allocated. You are
- * responsible for freeing it (unless it is NULL, in which case an error
- * occurred).
- * \endparblock
- * \param[in] uri   Uniform Resource Identifier to parse
+ * \param[in] spp SimplePost instance to act on
  *
- * \return the number of characters written to the output string. If the
- * return value is zero, either the URI does not specify a valid file, or
- * another (more serious) error occurred
+ * \return the socket the server was listening on, or -1 if an error occurred.
+ * The socket still belongs to this server. Do not close it.
  */
-static size_t __get_filename_from_uri(
-	simplepost_t spp,
-	char** file,
-	const char* uri)
+int simplepost_quiesce(simplepost_t spp)
 {
-	size_t file_length = 0; // Length of the file name and path
-	*file = NULL;           // Failsafe
+	#ifdef HAVE_MHD_QUIESCE_DAEMON
+	simplepost_file_t expired = NULL; // Files which reached their COUNT
+	int sock;                         // Socket the server was listening on
 
-	pthread_mutex_lock(&spp->files_lock);
+	pthread_mutex_lock(&spp->master_lock);
 
-	if(spp->files)
+	if(spp->httpd == NULL)
 	{
-		for(struct simplepost_serve* p = spp->files; p; p = p->next)
-		{
-			if(strcmp(uri, p->uri) == 0)
-			{
-				*file = (char*) malloc(sizeof(char) * (strlen(p->file) + 1));
-				if(*file == NULL) goto error;
+		impact(0, "%s: Server is not running\n", SP_HTTP_HEADER_NAMESPACE);
+		goto error;
+	}
 
-				strcpy(*file, p->file);
-				file_length = strlen(*file);
+	if(spp->listen_sock != -1)
+	{
+		impact(0, "%s: Server has already stopped accepting connections\n",
+			SP_HTTP_HEADER_NAMESPACE);
+		goto error;
+	}
 
-				if(p->count > 0 && --p->count == 0)
-				{
-					impact(2, "%s: FILE %s has reached its COUNT and will be removed\n",
-						SP_HTTP_HEADER_NAMESPACE,
-						p->file);
+	if(spp->httpd_retired)
+	{
+		impact(0, "%s: Server cannot stop accepting connections again until it is restarted\n",
+			SP_HTTP_HEADER_NAMESPACE);
+		goto error;
+	}
 
-					if(p == spp->files) spp->files = __simplepost_serve_remove(p, 1);
-					else __simplepost_serve_remove(p, 1);
-					--(spp->files_count);
-				}
+	if(spp->workers)
+	{
+		impact(0, "%s: Server cannot hand off its socket while worker processes share its port\n",
+			SP_HTTP_HEADER_NAMESPACE);
+		goto error;
+	}
 
-				goto error;
-			}
-		}
+	if(spp->sign_key && spp->signed_fd == -1)
+	{
+		impact(0, "%s: Server cannot hand off its files while it counts the downloads of signed links only in memory\n",
+			SP_HTTP_HEADER_NAMESPACE);
+		goto error;
 	}
 
-error:
+	sock = MHD_quiesce_daemon(spp->httpd);
+	if(sock < 0)
+	{
+		impact(0, "%s: Failed to stop accepting connections\n",
+			SP_HTTP_HEADER_NAMESPACE);
+		goto error;
+	}
+	spp->listen_sock = sock;
+
+	pthread_mutex_lock(&spp->files_lock);
+	__count_claimed_downloads(spp, &expired);
+	__atomic_store_n(&spp->quiesced, true, __ATOMIC_RELAXED);
 	pthread_mutex_unlock(&spp->files_lock);
-	return file_length;
+
+	for(simplepost_file_t f = expired; f; f = f->next)
+	{
+		if(f->file && f->uri) __publish_event(spp, SP_EVENT_FILE_EXPIRED, f->file, f->uri, 0, 0, 0);
+	}
+	simplepost_file_free(expired);
+
+	if(spp->journal) simplejournal_stop(spp->journal);
+
+	impact(1, "%s: Stopped accepting connections on socket %d\n",
+		SP_HTTP_HEADER_NAMESPACE,
+		sock);
+	pthread_mutex_unlock(&spp->master_lock);
+
+	return sock;
+
+error:
+	pthread_mutex_unlock(&spp->master_lock);
+	#else
+	impact(0, "%s: %s is too old to stop accepting connections without shutting down\n",
+		SP_HTTP_HEADER_NAMESPACE, SP_HTTP_HEADER_MICROHTTPD);
+	#endif // HAVE_MHD_QUIESCE_DAEMON
+
+	return -1;
 }
 
 /*!
- * \brief Panic! Cleanup the SimplePost instance after libmicrohttpd
- * encountered an unrecoverable error condition.
+ * \brief Start accepting connections again after simplepost_quiesce().
  *
- * \param[in] cls    SimplePost instance to act on
- * \param[in] file   C source file where the error occured
- * \param[in] line   Line of the C source file where the error occured
- * \param[in] reason Error message
+ * \note A new server is started on the same socket. The old one keeps sending
+ * the files it was already sending until the instance is shut down. If the
+ * files are journaled, the journal is compacted and reopened, since the other
+ * process may have written to it.
+ *
+ * \param[in] spp SimplePost instance to act on
+ *
+ * \return true if the server is accepting connections again, false if an
+ * error occurred
  */
-static void __panic(
-	void* cls,
-	const char* file,
-	unsigned int line,
-	const char* reason)
+bool simplepost_resume(simplepost_t spp)
 {
-	simplepost_t spp = (simplepost_t) cls; // Instance to act on
+	struct sockaddr_in source;             // Address and port the socket is bound to
+	socklen_t source_len = sizeof(source); // Length of the socket's address
+	struct MHD_Daemon* httpd;              // New server
 
-	impact(2, "%s:%u: PANIC!\n", file, line);
-	impact(0, "%s: %s: Emergency Shutdown: %s\n",
-		SP_HTTP_HEADER_NAMESPACE, SP_HTTP_HEADER_MICROHTTPD,
-		reason);
+	pthread_mutex_lock(&spp->master_lock);
 
-	simplepost_unbind(spp);
+	if(spp->listen_sock == -1)
+	{
+		impact(0, "%s: Server is already accepting connections\n",
+			SP_HTTP_HEADER_NAMESPACE);
+		goto error;
+	}
+
+	if(getsockname(spp->listen_sock, (struct sockaddr*) &source, &source_len) == -1)
+	{
+		impact(0, "%s: Cannot get the address of socket %d: %s\n",
+			SP_HTTP_HEADER_NAMESPACE,
+			spp->listen_sock, strerror(errno));
+		goto error;
+	}
+
+	// Count downloads again before any more connections are accepted.
+	pthread_mutex_lock(&spp->files_lock);
+	__atomic_store_n(&spp->quiesced, false, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&spp->files_lock);
+
+	if(spp->journal && simplejournal_start(spp->journal) == false)
+	{
+		impact(0, "%s: Changes to the files are no longer journaled\n",
+			SP_HTTP_HEADER_NAMESPACE);
+	}
+
+	httpd = __start_daemon(spp, 0, &source, spp->listen_sock);
+	if(httpd == NULL)
+	{
+		impact(0, "%s: Failed to accept connections on socket %d again\n",
+			SP_HTTP_HEADER_NAMESPACE,
+			spp->listen_sock);
+		goto error;
+	}
+
+	spp->httpd_retired = spp->httpd;
+	spp->httpd = httpd;
+	spp->listen_sock = -1;
+
+	impact(1, "%s: Accepting connections again\n", SP_HTTP_HEADER_NAMESPACE);
+	pthread_mutex_unlock(&spp->master_lock);
+
+	return true;
+
+error:
+	pthread_mutex_unlock(&spp->master_lock);
+
+	return false;
 }
 
 /*!
- * \brief Print error messages from libmicrohttpd.
+ * \brief Wait for the files being sent to finish, then shut down the server.
  *
- * \param[in] cls    SimplePost instance to act on
- * \param[in] format Format string
- * \param[in] ap     List of format arguments
+ * \note This is usually called after simplepost_quiesce(), once another
+ * process has taken over. Transfers which do not finish by the deadline are
+ * aborted.
+ *
+ * \param[in] spp     SimplePost instance to act on
+ * \param[in] timeout
+ * \parblock
+ * Maximum number of seconds to wait
+ *
+ * If the timeout is zero, wait for every transfer to finish, however long it
+ * takes.
+ * \endparblock
+ *
+ * \return true if every transfer finished, false if any were aborted
  */
-static void __log_microhttpd_messages(void* cls, const char* format, va_list ap)
+bool simplepost_drain(simplepost_t spp, unsigned int timeout)
 {
-	// Unused parameters
-	(void) cls;
+	struct timespec deadline; // Time to give up waiting
+	struct timespec now;      // Current time
+	size_t transfers;         // Number of files still being sent
 
-	char buffer[2048]; // libmicrohttpd error message
-	int length;        // Number of characters written to the buffer
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec += timeout;
 
-	length = vsprintf(buffer, format, ap);
-	if(length < 0)
+	for(;;)
 	{
-		impact(2, "%s:%d: BUG! Failed to process libmicrohttpd error message\n",
-			__PRETTY_FUNCTION__, __LINE__);
+		/* Every transfer which finished was started first, so read the
+		 * finished transfers first to avoid underflow.
+		 */
+		transfers = __atomic_load_n(&spp->downloads_completed, __ATOMIC_RELAXED);
+		transfers += __atomic_load_n(&spp->downloads_aborted, __ATOMIC_RELAXED);
+		transfers = __atomic_load_n(&spp->downloads_started, __ATOMIC_RELAXED) - transfers;
+		if(transfers == 0) break;
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if(timeout && now.tv_sec >= deadline.tv_sec) break;
+
+		usleep(SP_HTTP_SLEEP * 1000);
+	}
+
+	if(transfers)
+	{
+		impact(0, "%s: Aborting %zu transfers which did not finish within %u seconds\n",
+			SP_HTTP_HEADER_NAMESPACE,
+			transfers, timeout);
 	}
 	else
 	{
-		impact(0, "%s: %s: %s\n",
-			SP_HTTP_HEADER_NAMESPACE, SP_HTTP_HEADER_MICROHTTPD,
-			buffer);
+		impact(1, "%s: Every transfer has finished\n", SP_HTTP_HEADER_NAMESPACE);
 	}
+
+	if(spp->httpd) simplepost_unbind(spp);
+
+	return (transfers == 0);
 }
 
 /*!
- * \brief Process a request accepted by the server.
+ * \brief Don't return until the server is shut down.
+ *
+ * \note If the server has an idle timeout (see simplepost_set_idle_timeout()),
+ * this also returns once it has gone that long without any clients.
+ *
+ * \param[in] spp SimplePost instance to act on
+ */
+void simplepost_block(const simplepost_t spp)
+{
+	while(spp->httpd && __is_idle(spp) == false) usleep(SP_HTTP_SLEEP * 1000);
+}
+
+/*!
+ * \brief Don't return until the server has no more files to serve.
+ *
+ * \note Files in an index never run out, so if an index is loaded, this
+ * function does not return until the server is shut down (or has gone
+ * without any clients for its idle timeout, like simplepost_block()).
+ *
+ * \note This function wakes as soon as the last file is removed, whether it
+ * reached its COUNT, expired, or was purged.
+ *
+ * \param[in] spp SimplePost instance to act on
+ */
+void simplepost_block_files(const simplepost_t spp)
+{
+	struct timespec deadline; // Time to check on the server again
+
+	pthread_mutex_lock(&spp->files_lock);
+	while((spp->files_count > 0 || spp->index) && spp->httpd && __is_idle(spp) == false)
+	{
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_nsec += SP_HTTP_SLEEP * 1000000L;
+		deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+		deadline.tv_nsec %= 1000000000L;
+		pthread_cond_timedwait(&spp->files_cond, &spp->files_lock, &deadline);
+
+		pthread_mutex_unlock(&spp->files_lock);
+		__reap_shared_files(spp);
+		pthread_mutex_lock(&spp->files_lock);
+	}
+	pthread_mutex_unlock(&spp->files_lock);
+}
+
+/*!
+ * \brief Is the server running?
+ *
+ * \param[in] spp SimplePost instance to act on
+ *
+ * \retval true The server is alive!
+ * \retval false The server is not running.
+ */
+bool simplepost_is_alive(const simplepost_t spp)
+{
+	return (spp->httpd == NULL) ? false : true;
+}
+
+/*!
+ * \brief Add a file to the list of files being served.
+ *
+ * \note If and only if url != NULL the final status of this operation will be
+ * printed to STDOUT upon successful completion.
+ *
+ * \param[in] spp   SimplePost instance to act on
+ * \param[out] url
+ * \parblock
+ * Address of the file being served
  *
- * \param[in] cls            SimplePost instance to act on
- * \param[in] connection     Connection handle
- * \param[in] uri            Uniform Resource Identifier of the request
- * \param[in] method         HTTP method
- * \param[in] version        HTTP version
- * \param[in] data           Data sent by the client (excluding HEADERS)
- * \param[inout] data_size
+ * Although you probably need this information, it is generated in a
+ * predictable manner. Therefore this argument is technically optional; you
+ * may safely make it NULL.
+ *
+ * The storage for this string will be dynamically allocated. You are
+ * responsible for freeing it (unless it is NULL, in which case an error
+ * occurred).
+ * \endparblock
+ * \param[in] file  Name and path of the file to serve
+ * \param[in] uri
  * \parblock
- * Size of the client-provided data
+ * Uniform Resource Identifier of the file to serve
  *
- * Initially this must be the size of the data provided. This function will
- * update it to the number of bytes NOT processed.
+ * This argument is completely optional. If it is NULL, the name of the file
+ * will be used. For example, if file = "/usr/bin/simplepost", the default uri
+ * (if uri = NULL) would be "/simplepost". If you specify a uri, it must not
+ * already be in use, and it must start with a "/". See the HTTP/1.1
+ * specification (RFC 2616) for the requirements of valid URIs.
  * \endparblock
- * \param[out] state         Data preserved for future calls of this request
+ * \param[in] count
+ * \parblock
+ * Number of times the file should be served
  *
- * \retval MHD_NO will be returned if the socket must be closed due to a
- *         serious error we encountered while handling the request
- * \retval MHD_YES will be returned if the connection was handled successfully
+ * If the count is zero, the number of times will be unlimited.
+ * \endparblock
+ * \param[in] expires
+ * \parblock
+ * Time (seconds since the Epoch) to stop serving the file
+ *
+ * If this is zero, the file will be served until it reaches its COUNT or is
+ * purged. Files are removed within a second of their expiry time, and they
+ * are never served by this process after it.
+ * \endparblock
+ * \param[in] direct
+ * \parblock
+ * Should the file be read with O_DIRECT, bypassing the page cache?
+ *
+ * This is meant for huge files which would otherwise push everything else out
+ * of the page cache. Files at least as large as the threshold given to
+ * simplepost_set_direct_threshold() are read this way regardless.
+ * \endparblock
+ *
+ * \return the number of characters written to the url (excluding the NULL-
+ * terminating character)
  */
-static int __process_request(
-	void* cls,
-	struct MHD_Connection* connection,
+size_t simplepost_serve_file(
+	simplepost_t spp,
+	char** url,
+	const char* file,
 	const char* uri,
-	const char* method,
-	const char* version,
-	const char* data,
-	size_t* data_size,
-	void** state)
+	unsigned int count,
+	time_t expires,
+	bool direct)
 {
-	// Unused parameters
-	(void) data;
-
-	simplepost_t spp = (simplepost_t) cls; // Instance to act on
-	struct simplepost_state* spsp = NULL;  // Request state
-
-	impact(2, "%s: Request 0x%lx: method: %s\n",
-		SP_HTTP_HEADER_NAMESPACE, pthread_self(),
-		method);
-	impact(2, "%s: Request 0x%lx: URI: %s\n",
-		SP_HTTP_HEADER_NAMESPACE, pthread_self(),
-		uri);
-	impact(2, "%s: Request 0x%lx: version: %s\n",
-		SP_HTTP_HEADER_NAMESPACE, pthread_self(),
-		version);
+	struct simplepost_serve* this_file = NULL; // File to serve
+	bool is_file_new = false;                  // Are we adding a new file to serve?
+	char* new_uri = NULL;                      // URI of the new file (to publish after unlocking)
+	struct stat file_status;                   // Status of the file
+	bool preload = false;                      // Should the file be read into the page cache?
+	size_t url_length = 0;                     // Length of the URL
+	if(url) *url = NULL;                       // Failsafe
 
-	#ifdef DEBUG
-	if(*state)
+	if(file == NULL)
 	{
-		impact(0, "%s: Request 0x%lx: Request should be stateless\n",
-			SP_HTTP_HEADER_NAMESPACE, pthread_self());
-		goto finalize_request;
+		impact(2, "%s:%d: BUG! An input FILE is required\n",
+			__PRETTY_FUNCTION__, __LINE__);
+		return 0;
 	}
-	#endif // DEBUG
 
-	spsp = (struct simplepost_state*) malloc(sizeof(struct simplepost_state));
-	if(spsp == NULL)
-	{
-		impact(2, "%s: Request 0x%lx: %s: Failed to allocate memory for the request state\n",
-			SP_HTTP_HEADER_NAMESPACE, pthread_self(),
-			SP_MAIN_HEADER_MEMORY_ALLOC);
-		goto finalize_request;
-	}
-	*state = (void*) spsp;
+	if(__is_file_servable(file, &file_status) == false) return 0;
 
-	/* struct simplepost_state should probably gets its own initialization and
-	 * destruction methods. There is also probably a better way to implement
-	 * __response_prep_data() and __response_prep_file(), one that would allow
-	 * them to directly handle struct simplepost_state and alleviate this
-	 * function of more responsibility.
-	 *
-	 * I'm still undecided on exactly how much control this function should
-	 * delegate and how that interface should look. For now we are just going
-	 * to handle construction here and destruction in __finalize_request().
-	 */
-	spsp->response = NULL;
-	spsp->file = NULL;
-	spsp->file_length = 0;
-	spsp->data = NULL;
-	spsp->data_length = 0;
+	pthread_mutex_lock(&spp->files_lock);
 
-	/* We really don't care what data the client sent us. Nothing handled by
-	 * SimplePost actually requires the client to send additional data.
-	 */
-	*data_size = 0;
+	this_file = __insert_file(spp, file, uri, count, expires, direct, &is_file_new);
+	if(this_file == NULL) goto abort_insert;
 
-	if(strcmp(method, MHD_HTTP_METHOD_GET) == 0)
+	if(url)
 	{
-		struct stat file_status; // File status
-
-		spsp->file_length = __get_filename_from_uri(spp, &spsp->file, uri);
-		if(spsp->file_length == 0 || stat(spsp->file, &file_status) == -1)
-		{
-			impact(0, "%s: Request 0x%lx: Resource not found: %s\n",
-				SP_HTTP_HEADER_NAMESPACE, pthread_self(),
-				uri);
-			spsp->response = __response_prep_data(connection,
-				MHD_HTTP_NOT_FOUND,
-				strlen(SP_HTTP_RESPONSE_NOT_FOUND),
-				(void*) SP_HTTP_RESPONSE_NOT_FOUND);
-			goto finalize_request;
-		}
-
-		if(S_ISDIR(file_status.st_mode))
-		{
-			const char* append_index = "/index.html";
-			char* new_file = realloc(spsp->file, sizeof(char) * (spsp->file_length + strlen(append_index) + 1));
-			if(new_file)
-			{
-				spsp->file = new_file;
-				strcat(spsp->file, append_index);
-				if(stat(spsp->file, &file_status) == -1)
-				{
-					impact(2, "%s: Request 0x%lx: File not found: %s\n",
-						SP_HTTP_HEADER_NAMESPACE, pthread_self(),
-						spsp->file);
-					spsp->response = __response_prep_data(connection,
-						MHD_HTTP_NOT_FOUND,
-						strlen(SP_HTTP_RESPONSE_NOT_FOUND),
-						(void*) SP_HTTP_RESPONSE_NOT_FOUND);
-					goto finalize_request;
-				}
-			}
-		}
+		const char* address = __get_address(spp); // Address of the server
+		size_t url_size;                           // Size of the URL buffer
 
-		if(S_ISDIR(file_status.st_mode))
-		{
-			impact(0, "%s: Request 0x%lx: Directory not supported: %s\n",
-				SP_HTTP_HEADER_NAMESPACE, pthread_self(),
-				spsp->file);
-			spsp->response = __response_prep_data(connection,
-				MHD_HTTP_FORBIDDEN,
-				strlen(SP_HTTP_RESPONSE_FORBIDDEN),
-				(void*) SP_HTTP_RESPONSE_FORBIDDEN);
-			goto finalize_request;
-		}
+		if(address == NULL) goto cannot_insert_file;
 
-		size_t file_size = file_status.st_size;
-		size_t file_offset = 0;
-		if(__response_get_range(connection, &file_size, &file_offset) == false)
-		{
-			impact(0, "%s: Request 0x%lx: Invalid range header\n",
-				SP_HTTP_HEADER_NAMESPACE, pthread_self());
-			spsp->response = __response_prep_data(connection,
-				MHD_HTTP_BAD_REQUEST,
-				strlen(SP_HTTP_RESPONSE_BAD_REQUEST),
-				(void*) SP_HTTP_RESPONSE_BAD_REQUEST);
-			goto finalize_request;
-		}
+		url_size = strlen(address) + strlen(this_file->uri) + 50;
+		*url = (char*) malloc(sizeof(char) * url_size);
+		if(*url == NULL) goto cannot_insert_file;
 
-		impact(2, "%s: Request 0x%lx: Serving FILE %s\n",
-			SP_HTTP_HEADER_NAMESPACE, pthread_self(),
-			spsp->file);
-		spsp->response = __response_prep_file(connection,
-			MHD_HTTP_OK,
-			file_size,
-			file_offset,
-			spsp->file);
-	}
-	else
-	{
-		impact(2, "%s: Request 0x%lx: %s is not a supported HTTP method\n",
-			SP_HTTP_HEADER_NAMESPACE, pthread_self(),
-			method);
-		spsp->response = __response_prep_data(connection,
-			MHD_HTTP_METHOD_NOT_ALLOWED,
-			strlen(SP_HTTP_RESPONSE_NOT_ALLOWED),
-			(void*) SP_HTTP_RESPONSE_NOT_ALLOWED);
+		url_length = simplestr_get_url(*url, url_size,
+			file, address, spp->port, this_file->uri);
+		if(url_length == 0) goto cannot_insert_file;
 	}
 
-finalize_request:
-	if(spsp == NULL)
+	if(is_file_new)
 	{
-		impact(2, "%s: Request 0x%lx: Prematurely terminating response ...\n",
-			SP_HTTP_HEADER_NAMESPACE, pthread_self());
-		return MHD_NO;
+		new_uri = (char*) malloc(sizeof(char) * (strlen(this_file->uri) + 1));
+		if(new_uri) strcpy(new_uri, this_file->uri);
+		preload = (spp->preload && count != 1);
 	}
 
-	if(spsp->response)
+	pthread_mutex_unlock(&spp->files_lock);
+
+	if(new_uri)
 	{
-		impact(2, "%s: Request 0x%lx: Sending response ...\n",
-			SP_HTTP_HEADER_NAMESPACE, pthread_self());
-		return MHD_YES;
+		__publish_event(spp, SP_EVENT_FILE_ADDED, file, new_uri, 0, count, 0);
+		free(new_uri);
 	}
 
-	impact(2, "%s: Request 0x%lx: Terminating response ...\n",
-		SP_HTTP_HEADER_NAMESPACE, pthread_self());
+	if(preload) __preload_file(file);
 
-	if(spsp->file) free(spsp->file);
-	if(spsp->data) free(spsp->data);
-	free(spsp);
-	*state = spsp = NULL;
+	if(url_length) __print_serving(file, *url, count, expires);
 
-	return MHD_NO;
+	return url_length;
+
+cannot_insert_file:
+	impact(0, "%s: Cannot insert FILE: %s\n",
+		SP_HTTP_HEADER_NAMESPACE,
+		file);
+
+abort_insert:
+	if(url)
+	{
+		free(*url);
+		*url = NULL;
+	}
+	if(is_file_new) __remove_file(spp, this_file);
+	pthread_mutex_unlock(&spp->files_lock);
+
+	return 0;
 }
 
 /*!
- * \brief Cleanup the resources allocated for the request.
+ * \brief Add many files to the list of files being served at once.
  *
- * \param[in] cls        SimplePost instance to act on
- * \param[in] connection Connection handle
- * \param[in] state      Data preserved from the request handler
- * \param[in] toe        Reason the request was terminated
+ * \note This is much faster than calling simplepost_serve_file() for each
+ * file. The files are checked in parallel before the list of files is
+ * locked, so a slow filesystem never holds up requests for the files already
+ * being served. Then every file which passed is inserted while the list is
+ * locked once, so no request sees part of the batch without the rest. Files
+ * which cannot be served are skipped (with an error message).
+ *
+ * \param[in] spp     SimplePost instance to act on
+ * \param[in] files   Names and paths of the files to serve
+ * \param[in] uris
+ * \parblock
+ * Uniform Resource Identifiers of the files to serve
+ *
+ * This array, and any of its elements, may be NULL. See
+ * simplepost_serve_file() for how the default URI is chosen.
+ * \endparblock
+ * \param[in] counts
+ * \parblock
+ * Number of times each file should be served
+ *
+ * If this array is NULL, every file will be served an unlimited number of
+ * times.
+ * \endparblock
+ * \param[in] expires
+ * \parblock
+ * Time (seconds since the Epoch) to stop serving each file
+ *
+ * If this array is NULL, no file will expire. See simplepost_serve_file().
+ * \endparblock
+ * \param[out] results
+ * \parblock
+ * Whether or not each file is now being served
+ *
+ * This array is optional; you may safely make it NULL.
+ * \endparblock
+ * \param[in] n       Number of elements in each array
+ *
+ * \return the number of files now being served from the given arrays
  */
-void __finalize_request(
-	void* cls,
-	struct MHD_Connection* connection,
-	void** state,
-	enum MHD_RequestTerminationCode toe)
+size_t simplepost_serve_files(
+	simplepost_t spp,
+	const char* const* files,
+	const char* const* uris,
+	const unsigned int* counts,
+	const time_t* expires,
+	bool* results,
+	size_t n)
 {
-	// Unused parameters
-	(void) cls;
-	(void) connection;
-
-	struct simplepost_state* spsp = (struct simplepost_state*) *state; // Request to cleanup
-
-	#ifdef DEBUG
-	if(spsp == NULL)
-	{
-		impact(2, "%s: Request 0x%lx: Cannot cleanup stateless request\n",
-			SP_HTTP_HEADER_NAMESPACE, pthread_self());
-		return;
-	}
-	#endif // DEBUG
-
-	if(spsp->response)
-	{
-		MHD_destroy_response(spsp->response);
-	}
-	else
+	struct simplepost_validator validator; // Shared state of the threads checking the files
+	bool* is_served = results;             // Which of the files are (or may be) served?
+	char** served_uris = NULL;             // URIs of the files served
+	bool* is_file_new = NULL;              // Which of the files served are new?
+	size_t served = 0;                     // Number of files served
+	const char* address = NULL;            // Address of the server
+	bool preload;                          // Should the files be read into the page cache?
+
+	if(n == 0) return 0;
+
+	if(is_served == NULL) is_served = (bool*) malloc(sizeof(bool) * n);
+	served_uris = (char**) calloc(n, sizeof(char*));
+	is_file_new = (bool*) calloc(n, sizeof(bool));
+	if(is_served == NULL || served_uris == NULL || is_file_new == NULL)
 	{
-		impact(2, "%s:%d: BUG! __process_request() should have returned MHD_NO if it failed to queue a response!\n",
-			__PRETTY_FUNCTION__, __LINE__);
+		impact(0, "%s: %s: Failed to allocate memory for %zu files\n",
+			SP_HTTP_HEADER_NAMESPACE, SP_MAIN_HEADER_MEMORY_ALLOC,
+			n);
+		if(results) memset(results, 0, sizeof(bool) * n);
+		goto error;
 	}
 
-	#ifdef DEBUG
-	if(spsp->file == NULL && spsp->file_length)
-	{
-		impact(2, "%s:%d: BUG! simplepost_state::file should NEVER be NULL while simplepost_state::file_length is non-zero\n",
-			__PRETTY_FUNCTION__, __LINE__);
-	}
-	#endif // DEBUG
-	if(spsp->file) free(spsp->file);
+	validator.files = files;
+	validator.is_servable = is_served;
+	validator.sizes = NULL;
+	validator.mime_types = NULL;
+	validator.n = n;
+	validator.next = 0;
+	__check_files(&validator);
 
-	#ifdef DEBUG
-	if(spsp->data == NULL && spsp->data_length)
+	pthread_mutex_lock(&spp->files_lock);
+	for(size_t i = 0; i < n; ++i)
 	{
-		impact(2, "%s:%d: BUG! simplepost_state::data should NEVER be NULL while simplepost_state::data_length is non-zero\n",
-			__PRETTY_FUNCTION__, __LINE__);
+		struct simplepost_serve* this_file; // File to serve
+
+		if(is_served[i] == false) continue;
+
+		this_file = __insert_file(spp, files[i], uris ? uris[i] : NULL, counts ? counts[i] : 0, expires ? expires[i] : 0, false, &is_file_new[i]);
+		if(this_file == NULL)
+		{
+			is_served[i] = false;
+			continue;
+		}
+
+		served_uris[i] = (char*) malloc(sizeof(char) * (strlen(this_file->uri) + 1));
+		if(served_uris[i]) strcpy(served_uris[i], this_file->uri);
+		++served;
 	}
-	#endif // DEBUG
-	if(spsp->data) free(spsp->data);
+	preload = spp->preload;
+	pthread_mutex_unlock(&spp->files_lock);
 
-	#ifdef DEBUG
-	impact(2, "%s: Request 0x%lx: ", SP_HTTP_HEADER_NAMESPACE, pthread_self());
-	switch(toe)
-	{
-		case MHD_REQUEST_TERMINATED_COMPLETED_OK:
-			impact(2, "Successfully sent the response\n");
-			break;
+	// The server may not be bound yet, in which case there are no URLs to print.
+	if(served) address = __get_address(spp);
 
-		case MHD_REQUEST_TERMINATED_WITH_ERROR:
-			impact(2, "Error handling the connection\n");
-			break;
+	for(size_t i = 0; i < n; ++i)
+	{
+		unsigned int count = counts ? counts[i] : 0; // Number of times the file may be downloaded
+		char* url;                                   // Address of the file being served
+		size_t url_size;                             // Size of the URL buffer
 
-		case MHD_REQUEST_TERMINATED_TIMEOUT_REACHED:
-			impact(2, "No activity on the connection until the timeout was reached\n");
-			break;
+		if(served_uris[i] == NULL) continue;
 
-		case MHD_REQUEST_TERMINATED_DAEMON_SHUTDOWN:
-			impact(2, "Connection terminated because the server is shutting down\n");
-			break;
+		if(is_file_new[i])
+		{
+			__publish_event(spp, SP_EVENT_FILE_ADDED, files[i], served_uris[i], 0, count, 0);
+			if(preload && count != 1) __preload_file(files[i]);
+		}
 
-		case MHD_REQUEST_TERMINATED_READ_ERROR:
-			impact(2, "Connection died because the client did not send the expected data\n");
-			break;
+		if(address)
+		{
+			url_size = strlen(address) + strlen(served_uris[i]) + 50;
+			url = (char*) malloc(sizeof(char) * url_size);
+			if(url && simplestr_get_url(url, url_size, files[i], address, spp->port, served_uris[i]))
+			{
+				__print_serving(files[i], url, count, expires ? expires[i] : 0);
+			}
+			free(url);
+		}
 
-		case MHD_REQUEST_TERMINATED_CLIENT_ABORT:
-			impact(2, "The client terminated the connection by closing the socket for writing (TCP half-closed)\n");
-			break;
+		free(served_uris[i]);
+	}
 
-		default:
-			impact(2, "Invalid Termination Code: %d\n", toe);
-			break;
+	if(served < n)
+	{
+		impact(0, "%s: Only %zu of %zu files could be served\n",
+			SP_HTTP_HEADER_NAMESPACE,
+			served, n);
 	}
-	#endif // DEBUG
-}
 
-/*****************************************************************************
- *                            SimplePost Public                              *
- *****************************************************************************/
+error:
+	if(is_served != results) free(is_served);
+	free(served_uris);
+	free(is_file_new);
+
+	return served;
+}
 
 /*!
- * \brief Initialize a new SimplePost instance.
+ * \brief Remove a file from the list of files being served.
  *
- * \return a pointer to the new instance on success, or NULL if we failed to
- * allocate the requested memory
+ * \param[in] spp  SimplePost instance to act on
+ * \param[out] uri
+ * \parblock
+ * Uniform Resource Identifier (URI) or Uniform Resource Locator (URL) of the
+ * file to remove
+ * \endparblock
+ *
+ * \retval -1 Internal error
+ * \retval  0 The file was not being served
+ * \retval  1 The file was successfully removed from the list
  */
-simplepost_t simplepost_init()
+short simplepost_purge_file(simplepost_t spp, const char* uri)
 {
-	simplepost_t spp = (simplepost_t) malloc(sizeof(struct simplepost));
-	if(spp == NULL) return NULL;
+	if(uri == NULL)
+	{
+		impact(2, "%s:%d: BUG! An input URI is required\n",
+			__PRETTY_FUNCTION__, __LINE__);
+		return -1;
+	}
 
-	memset(spp, 0, sizeof(struct simplepost));
+	if(strncmp("http://", uri, 7) == 0)
+	{
+		unsigned short i = 0; // '/' count
+		while(i < 3)
+		{
+			if(*uri == '\0') return 0;
+			if(*uri++ == '/') ++i;
+		}
+	}
 
-	pthread_mutex_init(&spp->master_lock, NULL);
-	pthread_mutex_init(&spp->files_lock, NULL);
+	struct simplepost_serve* p; // File being served on the URI
 
-	return spp;
-}
+	pthread_mutex_lock(&spp->files_lock);
+	if(spp->quiesced)
+	{
+		pthread_mutex_unlock(&spp->files_lock);
+		impact(0, "%s: Cannot purge URI %s after the files have been handed off\n",
+			SP_HTTP_HEADER_NAMESPACE,
+			uri);
+		return -1;
+	}
 
-/*!
- * \brief Free the given SimplePost instance.
- *
- * \param[in] spp SimplePost instance to act on
- */
-void simplepost_free(simplepost_t spp)
-{
-	if(spp == NULL) return;
+	p = __find_file(spp, uri);
+	if(p)
+	{
+		impact(1, "%s: Removing URI %s from service ...\n",
+			SP_HTTP_HEADER_NAMESPACE,
+			uri);
 
-	if(spp->httpd) simplepost_unbind(spp);
-	if(spp->address) free(spp->address);
+		__journal_file(spp, SIMPLEJOURNAL_PURGE, NULL, p->uri, 0, 0);
+		__remove_file(spp, p);
 
-	if(spp->files) __simplepost_serve_free(spp->files);
+		pthread_mutex_unlock(&spp->files_lock);
+		return 1;
+	}
+	pthread_mutex_unlock(&spp->files_lock);
 
-	pthread_mutex_destroy(&spp->master_lock);
-	pthread_mutex_destroy(&spp->files_lock);
+	impact(0, "%s: Cannot purge nonexistent URI %s\n",
+		SP_HTTP_HEADER_NAMESPACE,
+		uri);
 
-	free(spp);
+	return 0;
 }
 
 /*!
- * \brief Start the web server on the specified port.
+ * \brief Remove every file served on a URI matching the given pattern from
+ * the list of files being served.
+ *
+ * \note The files are found with a radix trie of their URIs, so only the
+ * files sharing the literal prefix of the pattern (everything before its
+ * first wildcard) are looked at. Purging everything under a directory, like
+ * "/release-42/\*", takes time proportional to the number of files in it, no
+ * matter how many other files are being served.
  *
  * \param[in] spp     SimplePost instance to act on
- * \param[in] port
- * \parblock
- * Port to initialize the server on
- * 
- * If the port is 0, a port will be dynamically allocated.
- * \endparblock
- * \param[in] address
+ * \param[in] pattern
  * \parblock
- * Network address to bind the server to
+ * Shell wildcard pattern the URIs of the files must match (see fnmatch(3))
  *
- * If the address is NULL, the server will be bound to all local interfaces
- * (0.0.0.0 in netstat parlance).
+ * Unlike in a path name, "*" and "?" match "/" too. The leading "/" of the
+ * pattern is optional.
  * \endparblock
  *
- * \return the port the server is bound to. If the return value is 0, an error
- * occurred.
+ * \return the number of files removed from the list, or -1 if an error
+ * occurred (in which case no files were removed)
  */
-unsigned short simplepost_bind(
-	simplepost_t spp,
-	const char* address,
-	unsigned short port)
+ssize_t simplepost_purge_files(simplepost_t spp, const char* pattern)
 {
-	pthread_mutex_lock(&spp->master_lock);
+	struct simplepost_matches matches = {NULL, 0, 0}; // Files to remove
 
-	if(spp->httpd)
+	if(pattern == NULL)
 	{
-		impact(0, "%s: Server is already initialized\n",
-			SP_HTTP_HEADER_NAMESPACE);
-		goto error;
+		impact(2, "%s:%d: BUG! An input pattern is required\n",
+			__PRETTY_FUNCTION__, __LINE__);
+		return -1;
 	}
 
-	struct sockaddr_in source; // Source address and port the server should be bound to
-	memset(&source, 0, sizeof(source));
+	if(pattern[0] == '/') ++pattern;
 
-	source.sin_family = AF_INET;
-	source.sin_port = htons(port);
+	pthread_mutex_lock(&spp->files_lock);
+	if(spp->quiesced)
+	{
+		pthread_mutex_unlock(&spp->files_lock);
+		impact(0, "%s: Cannot purge URIs matching /%s after the files have been handed off\n",
+			SP_HTTP_HEADER_NAMESPACE,
+			pattern);
+		return -1;
+	}
 
-	if(address)
+	if(__match_files(spp, pattern, &__collect_file, &matches) == false)
 	{
-		struct in_addr sin_addr; // Source address in network byte order
+		pthread_mutex_unlock(&spp->files_lock);
+		impact(2, "%s: %s: Failed to allocate memory for the URIs matching /%s\n",
+			SP_HTTP_HEADER_NAMESPACE, SP_MAIN_HEADER_MEMORY_ALLOC,
+			pattern);
+		free(matches.files);
+		return -1;
+	}
 
-		if(inet_pton(AF_INET, address, (void*) &sin_addr) != 1)
-		{
-			impact(0, "%s: Invalid source address specified\n",
-				SP_HTTP_HEADER_NAMESPACE);
-			goto error;
-		}
-		source.sin_addr = sin_addr;
+	for(size_t i = 0; i < matches.count; ++i)
+	{
+		impact(2, "%s: Removing URI %s from service ...\n",
+			SP_HTTP_HEADER_NAMESPACE,
+			matches.files[i]->uri);
 
-		if(spp->address) free(spp->address);
-		spp->address = (char*) malloc(sizeof(char) * (strlen(address) + 1));
-		if(spp->address == NULL)
-		{
-			impact(0, "%s: %s: Failed to allocate memory for the source address\n",
-				SP_HTTP_HEADER_NAMESPACE, SP_MAIN_HEADER_MEMORY_ALLOC);
-			goto error;
-		}
-		strcpy(spp->address, address);
+		__journal_file(spp, SIMPLEJOURNAL_PURGE, NULL, matches.files[i]->uri, 0, 0);
+		__remove_file(spp, matches.files[i]);
 	}
-	else
-	{
-		source.sin_addr.s_addr = htonl(INADDR_ANY);
+	pthread_mutex_unlock(&spp->files_lock);
 
-		char* def_addr = NULL;    // Default source IP address as a string
-		size_t def_addr_size = 0; // Size (in bytes) of def_addr
+	free(matches.files);
 
-		if(__get_default_address(&def_addr, &def_addr_size) < 0)
-		{
-			impact(0, "%s: Failed to get the default source address that the server is bound to\n",
-				SP_HTTP_HEADER_NAMESPACE);
-			goto error;
-		}
+	impact(1, "%s: Removed %zu URIs matching /%s from service\n",
+		SP_HTTP_HEADER_NAMESPACE,
+		matches.count, pattern);
 
-		if(def_addr == NULL || def_addr_size == 0)
-		{
-			impact(0, "%s:%d: BUG! __get_default_address succeeded but did not return an address\n",
-				__PRETTY_FUNCTION__, __LINE__);
-			goto error;
-		}
+	return matches.count;
+}
 
-		if(spp->address) free(spp->address);
-		spp->address = def_addr;
+/*!
+ * \brief Write an index of files to serve.
+ *
+ * \note The index is an immutable table of the files, their URIs, sizes, and
+ * MIME types, with a perfect hash of the URIs. simplepost_load_index() maps it
+ * into memory, so even an index of millions of files is loaded instantly and
+ * shared with every other process serving it. The index is written to a
+ * temporary file and renamed over INDEX, so a running instance may keep
+ * serving the old index until it loads the new one.
+ *
+ * \note The files are checked, and their MIME types determined, in parallel.
+ *
+ * \param[in] index Name and path of the index to write
+ * \param[in] files Names and paths of the files to index
+ * \param[in] uris
+ * \parblock
+ * Uniform Resource Identifiers of the files to index
+ *
+ * This array, and any of its elements, may be NULL. See
+ * simplepost_serve_file() for how the default URI is chosen.
+ * \endparblock
+ * \param[in] n     Number of elements in each array
+ *
+ * \return true if the index was written, false if a file cannot be indexed or
+ * an error occurred
+ */
+bool simplepost_write_index(
+	const char* index,
+	const char* const* files,
+	const char* const* uris,
+	size_t n)
+{
+	struct simplepost_validator validator; // Shared state of the threads checking the files
+	char** entry_uris = NULL;              // URIs of the files
+	bool* is_indexable = NULL;             // Which of the files can be indexed?
+	char** mime_types = NULL;              // MIME types of the files
+	uint64_t* sizes = NULL;                // Sizes of the files
+	bool ok = false;                       // Was the index written?
+
+	if(n == 0 || n > SIMPLEINDEX_FILES_MAX)
+	{
+		impact(0, "%s: Cannot index %zu files\n",
+			SP_HTTP_HEADER_NAMESPACE,
+			n);
+		return false;
 	}
 
-	MHD_set_panic_func(&__panic, (void*) spp);
-	spp->httpd = MHD_start_daemon(MHD_USE_THREAD_PER_CONNECTION, port,
-		NULL, NULL,
-		&__process_request, (void*) spp,
-		MHD_OPTION_NOTIFY_COMPLETED, &__finalize_request, (void*) spp,
-		MHD_OPTION_CONNECTION_LIMIT, SP_HTTP_BACKLOG,
-		MHD_OPTION_SOCK_ADDR, &source,
-		MHD_OPTION_EXTERNAL_LOGGER, &__log_microhttpd_messages, (void*) spp,
-		MHD_OPTION_END);
-	if(spp->httpd == NULL)
+	entry_uris = (char**) calloc(n, sizeof(char*));
+	is_indexable = (bool*) malloc(sizeof(bool) * n);
+	mime_types = (char**) calloc(n, sizeof(char*));
+	sizes = (uint64_t*) malloc(sizeof(uint64_t) * n);
+	if(entry_uris == NULL || is_indexable == NULL || mime_types == NULL || sizes == NULL)
 	{
-		impact(0, "%s: Failed to initialize the server on port %u\n",
-			SP_HTTP_HEADER_NAMESPACE, port);
+		impact(0, "%s: %s: Failed to allocate memory to index %zu files\n",
+			SP_HTTP_HEADER_NAMESPACE, SP_MAIN_HEADER_MEMORY_ALLOC,
+			n);
 		goto error;
 	}
 
-	if(port == 0)
+	validator.files = files;
+	validator.is_servable = is_indexable;
+	validator.sizes = sizes;
+	validator.mime_types = mime_types;
+	validator.n = n;
+	validator.next = 0;
+	__check_files(&validator);
+
+	for(size_t i = 0; i < n; ++i)
 	{
-		socklen_t source_len = sizeof(source);  // Length of the socket's source address
-		const union MHD_DaemonInfo* httpd_sock; // Socket the server is listening on
+		const char* uri; // URI of the file
 
-		httpd_sock = MHD_get_daemon_info(spp->httpd, MHD_DAEMON_INFO_LISTEN_FD);
-		if(httpd_sock == NULL)
+		if(is_indexable[i] == false)
 		{
-			impact(0, "%s: Failed to get the socket the server is listening on\n",
-				SP_HTTP_HEADER_NAMESPACE);
+			impact(0, "%s: Cannot index FILE %s\n",
+				SP_HTTP_HEADER_NAMESPACE,
+				files[i] ? files[i] : "(null)");
 			goto error;
 		}
 
-		if(getsockname(httpd_sock->listen_fd, (struct sockaddr*) &source, &source_len) == -1)
+		uri = __choose_uri(files[i], uris ? uris[i] : NULL);
+		if(uri == NULL) goto error;
+
+		entry_uris[i] = (char*) malloc(sizeof(char) * (strlen(uri) + 2));
+		if(entry_uris[i] == NULL)
 		{
-			impact(0, "%s: Socket could not be allocated: %s\n",
-				SP_HTTP_HEADER_NAMESPACE,
-				strerror(errno));
+			impact(0, "%s: %s: Failed to allocate memory for URI %s\n",
+				SP_HTTP_HEADER_NAMESPACE, SP_MAIN_HEADER_MEMORY_ALLOC,
+				uri);
 			goto error;
 		}
+		entry_uris[i][0] = '/';
+		strcpy(entry_uris[i] + 1, (uri[0] == '/') ? uri + 1 : uri);
+	}
 
-		port = ntohs(source.sin_port);
+	ok = simpleindex_write(index, (const char* const*) entry_uris, files, (const char* const*) mime_types, sizes, n);
+	if(ok)
+	{
+		impact(1, "%s: Indexed %zu files in %s\n",
+			SP_HTTP_HEADER_NAMESPACE,
+			n, index);
 	}
 
-	spp->port = port;
+error:
+	for(size_t i = 0; entry_uris && i < n; ++i) free(entry_uris[i]);
+	for(size_t i = 0; mime_types && i < n; ++i) free(mime_types[i]);
+	free(entry_uris);
+	free(is_indexable);
+	free(mime_types);
+	free(sizes);
+
+	return ok;
+}
+
+/*!
+ * \brief Serve the files in an index.
+ *
+ * \note The index is mapped into memory, not read, so it is loaded in
+ * constant time and its pages are shared with every other process mapping it.
+ * Files in the index are served an unlimited number of times, alongside the
+ * files served with simplepost_serve_file(). If both have a file on the same
+ * URI, the latter is served. Files in the index cannot be purged, but an
+ * instance may load a new index at any time; the old one is unmapped.
+ *
+ * \param[in] spp   SimplePost instance to act on
+ * \param[in] index Name and path of the index (written by simplepost_write_index())
+ *
+ * \return true if the index was loaded, false if an error occurred (in which
+ * case the old index, if any, is still served)
+ */
+bool simplepost_load_index(simplepost_t spp, const char* index)
+{
+	simpleindex_t spip;      // Index being loaded
+	simpleindex_t old_index; // Index being replaced
+
+	spip = simpleindex_map(index);
+	if(spip == NULL) return false;
+
+	pthread_mutex_lock(&spp->files_lock);
+	old_index = spp->index;
+	spp->index = spip;
+	pthread_mutex_unlock(&spp->files_lock);
+
+	simpleindex_unmap(old_index);
 
-	impact(1, "%s: Bound HTTP server to ADDRESS %s listening on PORT %u with PID %d\n",
+	impact(1, "%s: Serving %zu files from the index %s\n",
 		SP_HTTP_HEADER_NAMESPACE,
-		spp->address, spp->port, getpid());
-	pthread_mutex_unlock(&spp->master_lock);
+		simpleindex_get_count(spip), index);
 
-	return port;
+	return true;
+}
 
-error:
-	if(spp->httpd)
-	{
-		MHD_stop_daemon(spp->httpd);
-		spp->httpd = NULL;
-	}
+/*!
+ * \brief Initialize a new SimplePost File instance.
+ *
+ * \return a pointer to the new instance will be returned on success, a NULL
+ * pointer if we failed to allocate the requested memory
+*/
+simplepost_file_t simplepost_file_init()
+{
+	simplepost_file_t spfp = (simplepost_file_t) malloc(sizeof(struct simplepost_file));
+	if(spfp == NULL) return NULL;
 
-	pthread_mutex_unlock(&spp->master_lock);
+	memset(spfp, 0, sizeof(struct simplepost_file));
 
-	return 0;
+	return spfp;
 }
 
 /*!
- * \brief Shut down the web server.
- *
- * \param[in] spp SimplePost instance to act on
+ * \brief Free the given SimplePost File instance.
  *
- * \retval true The server has been successfully killed.
- * \retval false The server is not running or could not be shut down.
+ * \param[in] spfp SimplePost File instance to act on
  */
-bool simplepost_unbind(simplepost_t spp)
+void simplepost_file_free(simplepost_file_t spfp)
 {
-	if(spp->httpd == NULL)
+	if(spfp == NULL) return;
+
+	if(spfp->prev) spfp->prev->next = NULL;
+
+	while(spfp)
 	{
-		impact(0, "%s: Server is not running\n", SP_HTTP_HEADER_NAMESPACE);
-		return false;
+		simplepost_file_t p = spfp;
+		spfp = spfp->next;
+
+		if(p->file) free(p->file);
+		if(p->url) free(p->url);
+		if(p->uri) free(p->uri);
+		free(p);
 	}
+}
 
-	impact(1, "%s: Shutting down ...\n", SP_HTTP_HEADER_NAMESPACE);
-	MHD_stop_daemon(spp->httpd);
+/*!
+ * \brief Get the address the server is bound to.
+ *
+ * \param[in] spp      SimplePost instance to act on
+ * \param[out] address
+ * \parblock
+ * Address of the server
+ *
+ * The storage for this string will be dynamically allocated. You are
+ * responsible for freeing it (unless it is NULL, in which case an error
+ * occurred).
+ * \endparblock
+ *
+ * \return the number of characters written to the address (excluding the NULL-
+ * terminating character)
+ */
+size_t simplepost_get_address(const simplepost_t spp, char** address)
+{
+	const char* server_address; // Address of the server
+	size_t address_length = 0;  // Length of the server address
+	*address = NULL;            // Failsafe
 
-	#ifdef DEBUG
-	impact(2, "%s: %p cleanup complete\n",
-		SP_HTTP_HEADER_NAMESPACE, spp->httpd);
-	#endif // DEBUG
+	if(spp->httpd == NULL) return 0;
 
-	spp->httpd = NULL;
+	server_address = __get_address(spp);
+	if(server_address == NULL) return 0;
 
-	return true;
+	address_length = strlen(server_address);
+	*address = (char*) malloc(sizeof(char) * (address_length + 1));
+	if(*address == NULL) return 0;
+
+	strcpy(*address, server_address);
+
+	return address_length;
 }
 
 /*!
- * \brief Don't return until the server is shut down.
+ * \brief Get the port the server is listening on.
  *
  * \param[in] spp SimplePost instance to act on
+ *
+ * \return the server's port number. If this number is zero, an error occurred
+ * or (more likely) the server is not running.
  */
-void simplepost_block(const simplepost_t spp)
+unsigned short simplepost_get_port(const simplepost_t spp)
 {
-	while(spp->httpd) usleep(SP_HTTP_SLEEP * 1000);
+	return spp->port;
 }
 
 /*!
- * \brief Don't return until the server has no more files to serve.
+ * \brief Open a cursor to list the files currently being served one page at
+ * a time.
+ *
+ * The listing is a snapshot of the files being served when the cursor is
+ * opened: every file that was being served at that point, and is still being
+ * served when the cursor reaches it, will be returned exactly once. Files
+ * inserted after the cursor was opened are never returned.
+ *
+ * \warning Every cursor MUST be freed with simplepost_cursor_free() before the
+ * SimplePost instance it was opened on is freed.
  *
  * \param[in] spp SimplePost instance to act on
+ *
+ * \return a new cursor on success, or NULL if we failed to allocate the
+ * requested memory
  */
-void simplepost_block_files(const simplepost_t spp)
+simplepost_cursor_t simplepost_cursor_init(simplepost_t spp)
 {
-	while(spp->files_count > 0) usleep(SP_HTTP_SLEEP * 1000);
+	simplepost_cursor_t spcp = (simplepost_cursor_t) malloc(sizeof(struct simplepost_cursor));
+	if(spcp == NULL) return NULL;
+
+	memset(spcp, 0, sizeof(struct simplepost_cursor));
+	spcp->spp = spp;
+
+	__reap_shared_files(spp);
+
+	pthread_mutex_lock(&spp->files_lock);
+	spcp->snapshot = spp->files_next_id;
+	pthread_mutex_unlock(&spp->files_lock);
+
+	return spcp;
 }
 
 /*!
- * \brief Is the server running?
- *
- * \param[in] spp SimplePost instance to act on
+ * \brief Free the given file listing cursor.
  *
- * \retval true The server is alive!
- * \retval false The server is not running.
+ * \param[in] spcp Cursor to act on
  */
-bool simplepost_is_alive(const simplepost_t spp)
+void simplepost_cursor_free(simplepost_cursor_t spcp)
 {
-	return (spp->httpd == NULL) ? false : true;
+	if(spcp == NULL) return;
+
+	if(spcp->position)
+	{
+		pthread_mutex_lock(&spcp->spp->files_lock);
+		__release_file(spcp->spp, spcp->position);
+		pthread_mutex_unlock(&spcp->spp->files_lock);
+	}
+
+	free(spcp);
 }
 
 /*!
- * \brief Add a file to the list of files being served.
- *
- * \note If and only if url != NULL the final status of this operation will be
- * printed to STDOUT upon successful completion.
- *
- * \param[in] spp   SimplePost instance to act on
- * \param[out] url
- * \parblock
- * Address of the file being served
+ * \brief Get the next page of files from a listing cursor.
  *
- * Although you probably need this information, it is generated in a
- * predictable manner. Therefore this argument is technically optional; you
- * may safely make it NULL.
+ * \note The files lock is only held while the file names and URIs of this
+ * page are copied. The URLs are built after it has been released, so HTTP
+ * requests are never kept waiting on more than one page of a listing.
  *
- * The storage for this string will be dynamically allocated. You are
- * responsible for freeing it (unless it is NULL, in which case an error
- * occurred).
- * \endparblock
- * \param[in] file  Name and path of the file to serve
- * \param[in] uri
+ * \param[in] spcp   Cursor to act on
+ * \param[out] files
  * \parblock
- * Uniform Resource Identifier of the file to serve
+ * Next page of files
  *
- * This argument is completely optional. If it is NULL, the name of the file
- * will be used. For example, if file = "/usr/bin/simplepost", the default uri
- * (if uri = NULL) would be "/simplepost". If you specify a uri, it must not
- * already be in use, and it must start with a "/". See the HTTP/1.1
- * specification (RFC 2616) for the requirements of valid URIs.
+ * The storage for this list will be dynamically allocated. You are
+ * responsible for freeing it (unless it is NULL, in which case there are no
+ * more files or an error occurred).
  * \endparblock
- * \param[in] count
+ * \param[in] max
  * \parblock
- * Number of times the file should be served
+ * Maximum number of files to return
  *
- * If the count is zero, the number of times will be unlimited.
+ * If this is zero or larger than the internal page size, the internal page
+ * size will be used instead.
  * \endparblock
  *
- * \return the number of characters written to the url (excluding the NULL-
- * terminating character)
+ * \return the number of files in the page, zero if the listing is complete,
+ * or -1 if an error occurred
  */
-size_t simplepost_serve_file(
-	simplepost_t spp,
-	char** url,
-	const char* file,
-	const char* uri,
-	unsigned int count)
+ssize_t simplepost_get_files_page(simplepost_cursor_t spcp, simplepost_file_t* files, size_t max)
 {
-	struct stat file_status;                   // Status of the input file
-	struct simplepost_serve* this_file = NULL; // File to serve
-	bool is_file_new = false;                  // Are we adding a new file to serve?
-	size_t url_length = 0;                     // Length of the URL
-	if(url) *url = NULL;                       // Failsafe
+	simplepost_t spp = spcp->spp;                       // SimplePost instance being listed
+	struct simplepost_serve* p;                         // Current element of the list
+	struct simplepost_serve* last = NULL;               // Last element visited on this page
+	struct simplepost_file_list list = {NULL, NULL, 0}; // Files in this page
+	*files = NULL;                                      // Failsafe
 
-	pthread_mutex_lock(&spp->files_lock);
+	if(spcp->done) return 0;
+	if(max == 0 || max > SP_HTTP_FILES_PAGE) max = SP_HTTP_FILES_PAGE;
 
-	if(file == NULL)
-	{
-		impact(2, "%s:%d: BUG! An input FILE is required\n",
-			__PRETTY_FUNCTION__, __LINE__);
-		goto abort_insert;
-	}
+	pthread_mutex_lock(&spp->files_lock);
 
-	if(stat(file, &file_status) == -1)
+	p = spcp->position ? spcp->position->next : spp->files;
+	for(; p && p->id < spcp->snapshot && list.count < max; p = p->next)
 	{
-		impact(0, "%s: Cannot serve nonexistent FILE: %s\n",
-			SP_HTTP_HEADER_NAMESPACE,
-			file);
-		goto abort_insert;
-	}
+		last = p;
+		if(p->removed) continue;
 
-	if(!(S_ISREG(file_status.st_mode) || S_ISLNK(file_status.st_mode)))
-	{
-		impact(0, "%s: FILE not supported: %s\n",
-			SP_HTTP_HEADER_NAMESPACE,
-			file);
-		goto abort_insert;
+		if(__copy_file(p, &list) == false) goto abort_page;
 	}
 
-	#if (defined SP_HTTP_FILES_MAX) && (SP_HTTP_FILES_MAX > 0)
-	if(spp->files_count == SP_HTTP_FILES_MAX)
-	{
-		impact(0, "%s: Cannot serve more than %zu files simultaneously\n",
-			SP_HTTP_HEADER_NAMESPACE,
-			(size_t) SP_HTTP_FILES_MAX);
-		goto abort_insert;
-	}
-	#else
-	#warning "SP_HTTP_FILES_MAX not set - simplepost::files_count may overflow!"
-	#endif
+	if(p == NULL || p->id >= spcp->snapshot) spcp->done = true;
 
-	if(uri)
-	{
-		if(uri[0] != '/')
-		{
-			impact(0, "%s: Invalid URI: %s\n",
-				SP_HTTP_HEADER_NAMESPACE,
-				uri);
-			goto abort_insert;
-		}
-		else if(uri[1] == '\0' || strstr(uri, "//"))
-		{
-			impact(0, "%s: Missing path in URI: %s\n",
-				SP_HTTP_HEADER_NAMESPACE,
-				uri);
-			goto abort_insert;
-		}
-	}
-	else
+	if(last)
 	{
-		uri = file;
-		if(strchr(uri, '/'))
-		{
-			while(*uri != '\0') ++uri;
-			while(*uri != '/') --uri;
-		}
+		++(last->pins);
+		if(spcp->position) __release_file(spp, spcp->position);
+		spcp->position = last;
 	}
-	if(uri == NULL || uri[0] == '\0')
+	if(spcp->done && spcp->position)
 	{
-		impact(0, "%s:%d: BUG! No URI to insert FILE %s\n",
-			__PRETTY_FUNCTION__, __LINE__,
-			file);
-		goto abort_insert;
+		__release_file(spp, spcp->position);
+		spcp->position = NULL;
 	}
 
-	if(spp->files)
-	{
-		for(this_file = spp->files; this_file->next; this_file = this_file->next)
-		{
-			if(__does_uri_match(this_file->uri, uri)) break;
-		}
-		if(this_file == NULL)
-		{
-			impact(0, "%s:%d: BUG! No last file?\n",
-				__PRETTY_FUNCTION__, __LINE__);
-			goto abort_insert;
-		}
-		else if(__does_uri_match(this_file->uri, uri) == false)
-		{
-			this_file = __simplepost_serve_insert_after(this_file, NULL);
-			++(spp->files_count);
-			is_file_new = true;
-		}
-		else if(this_file->file && strcmp(this_file->file, file) != 0)
-		{
-			impact(0, "%s: URI %s is already in use serving FILE %s, not %s\n",
-				SP_HTTP_HEADER_NAMESPACE,
-				this_file->uri, this_file->file, file);
-			goto abort_insert;
-		}
-	}
-	else
-	{
-		this_file = spp->files = __simplepost_serve_init();
-		++(spp->files_count);
-		is_file_new = true;
-	}
-	if(this_file == NULL) goto cannot_insert_file;
+	pthread_mutex_unlock(&spp->files_lock);
+
+	if(__set_file_urls(spp, list.head) == false) goto abort_urls;
+
+	*files = list.head;
+
+	return list.count;
 
-	if(this_file->uri == NULL)
+abort_page:
+	pthread_mutex_unlock(&spp->files_lock);
+
+abort_urls:
+	simplepost_file_free(list.head);
+
+	return -1;
+}
+
+/*!
+ * \brief Get a list of the files currently being served.
+ *
+ * \note The list is assembled one page at a time from a listing cursor. See
+ * simplepost_cursor_init() for the consistency guarantees, and use the cursor
+ * directly if you do not need the whole list in memory at once.
+ *
+ * \param[in] spp    SimplePost instance to act on
+ * \param[out] files
+ * \parblock
+ * List of files we are currently hosting
+ *
+ * This argument may be NULL.
+ *
+ * The storage for this string will be dynamically allocated. You are
+ * responsible for freeing it (unless it is NULL, in which case an error
+ * occurred).
+ * \endparblock
+ *
+ * \return the number of files currently being served (or, more accurately,
+ * unique URIs)
+ */
+size_t simplepost_get_files(simplepost_t spp, simplepost_file_t* files)
+{
+	simplepost_cursor_t cursor; // Cursor to list the files with
+	simplepost_file_t page;     // Current page of files
+	simplepost_file_t tail;     // Last file in the *files list
+	ssize_t page_count;         // Number of files in the current page
+	size_t files_count = 0;     // Number of unique URIs
+
+	if(files == NULL) return spp->files_count;
+	tail = *files = NULL;
+
+	cursor = simplepost_cursor_init(spp);
+	if(cursor == NULL) return 0;
+
+	while((page_count = simplepost_get_files_page(cursor, &page, 0)) > 0)
 	{
-		if(uri[0] == '/')
+		if(tail == NULL)
 		{
-			this_file->uri = (char*) malloc(sizeof(char) * (strlen(uri) + 1));
-			if(this_file->uri == NULL) goto cannot_insert_file;
-			strcpy(this_file->uri, uri);
+			*files = page;
 		}
 		else
 		{
-			this_file->uri = (char*) malloc(sizeof(char) * (strlen(uri) + 2));
-			if(this_file->uri == NULL) goto cannot_insert_file;
-			this_file->uri[0] = '/';
-			this_file->uri[1] = '\0';
-			strcat(this_file->uri, uri);
+			tail->next = page;
+			page->prev = tail;
 		}
+
+		for(tail = page; tail->next; tail = tail->next);
+		files_count += (size_t) page_count;
 	}
 
-	if(url)
+	simplepost_cursor_free(cursor);
+
+	if(page_count < 0)
 	{
-		size_t url_size; // Size of the URL buffer
+		simplepost_file_free(*files);
+		*files = NULL;
+		return 0;
+	}
 
-		url_size = strlen(spp->address) + strlen(uri) + 50;
-		*url = (char*) malloc(sizeof(char) * url_size);
-		if(*url == NULL) goto cannot_insert_file;
+	return files_count;
+}
 
-		url_length = simplestr_get_url(*url, url_size,
-			file, spp->address, spp->port, this_file->uri);
-		if(url_length == 0) goto cannot_insert_file;
-	}
+/*!
+ * \brief Get a list of the files served on URIs matching the given pattern.
+ *
+ * \note Like simplepost_purge_files(), this only looks at the files sharing
+ * the literal prefix of the pattern. Unlike a listing cursor, the files lock
+ * is held while every matching file is copied, so prefer a cursor for
+ * listing all of the files of a large server.
+ *
+ * \param[in] spp     SimplePost instance to act on
+ * \param[in] pattern
+ * \parblock
+ * Shell wildcard pattern the URIs of the files must match
+ *
+ * See simplepost_purge_files() for its syntax.
+ * \endparblock
+ * \param[out] files
+ * \parblock
+ * List of the matching files, in the byte order of their URIs
+ *
+ * The storage for this list will be dynamically allocated. You are
+ * responsible for freeing it (unless it is NULL, in which case no file
+ * matches or an error occurred).
+ * \endparblock
+ *
+ * \return the number of files in the list, or -1 if an error occurred
+ */
+ssize_t simplepost_find_files(simplepost_t spp, const char* pattern, simplepost_file_t* files)
+{
+	struct simplepost_file_list list = {NULL, NULL, 0}; // Matching files
+	bool is_listed;                                     // Were all of the matching files copied?
+	*files = NULL;                                      // Failsafe
 
-	if(this_file->file == NULL)
+	if(pattern == NULL)
 	{
-		this_file->file = (char*) malloc(sizeof(char) * (strlen(file) + 1));
-		if(this_file->file == NULL) goto cannot_insert_file;
-		strcpy(this_file->file, file);
+		impact(2, "%s:%d: BUG! An input pattern is required\n",
+			__PRETTY_FUNCTION__, __LINE__);
+		return -1;
 	}
 
-	if(is_file_new == false)
-	{
-		impact(2, "%s: Changing URI %s COUNT from %u to %u\n",
-			SP_HTTP_HEADER_NAMESPACE,
-			this_file->uri, this_file->count, count);
-	}
-	this_file->count = count;
+	if(pattern[0] == '/') ++pattern;
+
+	__reap_shared_files(spp);
 
+	pthread_mutex_lock(&spp->files_lock);
+	is_listed = __match_files(spp, pattern, &__copy_file, &list);
 	pthread_mutex_unlock(&spp->files_lock);
 
-	if(url_length)
+	if(is_listed == false || __set_file_urls(spp, list.head) == false)
 	{
-		char count_buf[1024]; // COUNT string of the file being served
-
-		if(simplestr_count_to_str(count_buf, sizeof(count_buf)/sizeof(count_buf[0]), count) == 0)
-		{
-			impact(1, "%s: Serving %s on %s\n",
-				SP_HTTP_HEADER_NAMESPACE,
-				file, *url);
-		}
-		else
-		{
-			impact(1, "%s: Serving %s on %s %s\n",
-				SP_HTTP_HEADER_NAMESPACE,
-				file, *url, count_buf);
-		}
+		simplepost_file_free(list.head);
+		return -1;
 	}
 
-	return url_length;
+	*files = list.head;
 
-cannot_insert_file:
-	impact(0, "%s: Cannot insert FILE: %s\n",
-		SP_HTTP_HEADER_NAMESPACE,
-		file);
+	return list.count;
+}
 
-abort_insert:
-	if(url)
+/*!
+ * \brief Subscribe to the events published by the server.
+ *
+ * \note Events are queued for each subscriber independently. The server never
+ * waits for a subscriber: if its queue is full when an event is published,
+ * the event is dropped, and the number of events dropped is reported with the
+ * next event it receives (see simplepost_event::dropped).
+ *
+ * \warning Every subscriber MUST be unsubscribed with simplepost_unsubscribe()
+ * before the SimplePost instance it subscribed to is freed.
+ *
+ * \param[in] spp   SimplePost instance to act on
+ * \param[in] depth
+ * \parblock
+ * Maximum number of events to queue for this subscriber
+ *
+ * If the depth is zero, a reasonable default will be used.
+ * \endparblock
+ *
+ * \return a new subscriber on success, or NULL if we failed to allocate the
+ * requested memory
+ */
+simplepost_subscriber_t simplepost_subscribe(simplepost_t spp, size_t depth)
+{
+	simplepost_subscriber_t spsp = (simplepost_subscriber_t) malloc(sizeof(struct simplepost_subscriber));
+	if(spsp == NULL) return NULL;
+
+	memset(spsp, 0, sizeof(struct simplepost_subscriber));
+	spsp->spp = spp;
+	spsp->depth = (depth == 0) ? SP_HTTP_EVENTS_DEPTH : depth;
+	spsp->mask = SP_EVENT_ALL;
+
+	spsp->events = (simplepost_event_t*) malloc(sizeof(simplepost_event_t) * spsp->depth);
+	if(spsp->events == NULL)
 	{
-		free(*url);
-		*url = NULL;
+		free(spsp);
+		return NULL;
 	}
-	if(is_file_new)
+
+	pthread_cond_init(&spsp->ready, NULL);
+
+	pthread_mutex_lock(&spp->events_lock);
+	spsp->next = spp->subscribers;
+	if(spsp->next) spsp->next->prev = spsp;
+	spp->subscribers = spsp;
+	pthread_mutex_unlock(&spp->events_lock);
+
+	return spsp;
+}
+
+/*!
+ * \brief Stop receiving events and free the given subscriber.
+ *
+ * \param[in] spsp Subscriber to act on
+ */
+void simplepost_unsubscribe(simplepost_subscriber_t spsp)
+{
+	if(spsp == NULL) return;
+
+	pthread_mutex_lock(&spsp->spp->events_lock);
+	if(spsp->prev) spsp->prev->next = spsp->next;
+	else spsp->spp->subscribers = spsp->next;
+	if(spsp->next) spsp->next->prev = spsp->prev;
+	pthread_mutex_unlock(&spsp->spp->events_lock);
+
+	for(size_t i = 0; i < spsp->length; ++i)
 	{
-		__simplepost_serve_remove(this_file, 1);
-		--(spp->files_count);
+		simplepost_event_free(spsp->events[(spsp->head + i) % spsp->depth]);
 	}
-	pthread_mutex_unlock(&spp->files_lock);
 
-	return 0;
+	pthread_cond_destroy(&spsp->ready);
+	free(spsp->events);
+	free(spsp);
 }
 
 /*!
- * \brief Remove a file from the list of files being served.
+ * \brief Get the next event queued for the given subscriber.
  *
- * \param[in] spp  SimplePost instance to act on
- * \param[out] uri
+ * \param[in] spsp    Subscriber to act on
+ * \param[out] event
  * \parblock
- * Uniform Resource Identifier (URI) or Uniform Resource Locator (URL) of the
- * file to remove
+ * Next event
+ *
+ * The storage for this event will be dynamically allocated. You are
+ * responsible for freeing it with simplepost_event_free() (unless it is NULL,
+ * in which case no event was received).
  * \endparblock
+ * \param[in] timeout Maximum number of milliseconds to wait for an event
  *
  * \retval -1 Internal error
- * \retval  0 The file was not being served
- * \retval  1 The file was successfully removed from the list
+ * \retval  0 No event was published before the timeout expired
+ * \retval  1 The next event was received
  */
-short simplepost_purge_file(simplepost_t spp, const char* uri)
+short simplepost_get_event(simplepost_subscriber_t spsp, simplepost_event_t* event, unsigned int timeout)
 {
-	if(uri == NULL)
+	simplepost_t spp = spsp->spp; // SimplePost instance we are subscribed to
+	struct timespec deadline;     // Absolute time to stop waiting for an event
+	*event = NULL;                // Failsafe
+
+	if(clock_gettime(CLOCK_REALTIME, &deadline) == -1) return -1;
+	deadline.tv_sec += timeout / 1000;
+	deadline.tv_nsec += (long) (timeout % 1000) * 1000000L;
+	if(deadline.tv_nsec >= 1000000000L)
 	{
-		impact(2, "%s:%d: BUG! An input URI is required\n",
-			__PRETTY_FUNCTION__, __LINE__);
-		return -1;
+		++deadline.tv_sec;
+		deadline.tv_nsec -= 1000000000L;
 	}
 
-	if(strncmp("http://", uri, 7) == 0)
+	pthread_mutex_lock(&spp->events_lock);
+	while(spsp->length == 0)
 	{
-		unsigned short i = 0; // '/' count
-		while(i < 3)
-		{
-			if(*uri == '\0') return 0;
-			if(*uri++ == '/') ++i;
-		}
+		if(pthread_cond_timedwait(&spsp->ready, &spp->events_lock, &deadline) != 0) break;
 	}
 
-	pthread_mutex_lock(&spp->files_lock);
-	for(struct simplepost_serve* p = spp->files; p; p = p->next)
+	if(spsp->length)
 	{
-		if(p->uri && strcmp(p->uri, uri) == 0)
-		{
-			impact(1, "%s: Removing URI %s from service ...\n",
-				SP_HTTP_HEADER_NAMESPACE,
-				uri);
-
-			if(p == spp->files) spp->files = __simplepost_serve_remove(p, 1);
-			else __simplepost_serve_remove(p, 1);
-			--(spp->files_count);
-
-			pthread_mutex_unlock(&spp->files_lock);
-			return 1;
-		}
+		*event = spsp->events[spsp->head];
+		spsp->head = (spsp->head + 1) % spsp->depth;
+		--(spsp->length);
 	}
-	pthread_mutex_unlock(&spp->files_lock);
-
-	impact(0, "%s: Cannot purge nonexistent URI %s\n",
-		SP_HTTP_HEADER_NAMESPACE,
-		uri);
+	pthread_mutex_unlock(&spp->events_lock);
 
-	return 0;
+	return (*event) ? 1 : 0;
 }
 
 /*!
- * \brief Initialize a new SimplePost File instance.
+ * \brief Free the given SimplePost event.
  *
- * \return a pointer to the new instance will be returned on success, a NULL
- * pointer if we failed to allocate the requested memory
-*/
-simplepost_file_t simplepost_file_init()
+ * \param[in] spep Event to act on
+ */
+void simplepost_event_free(simplepost_event_t spep)
 {
-	simplepost_file_t spfp = (simplepost_file_t) malloc(sizeof(struct simplepost_file));
-	if(spfp == NULL) return NULL;
-
-	memset(spfp, 0, sizeof(struct simplepost_file));
+	if(spep == NULL) return;
 
-	return spfp;
+	if(spep->file) free(spep->file);
+	if(spep->uri) free(spep->uri);
+	free(spep);
 }
 
 /*!
- * \brief Free the given SimplePost File instance.
+ * \brief Get the name of the given event type.
  *
- * \param[in] spfp SimplePost File instance to act on
+ * \param[in] type Event type
+ *
+ * \return a static string naming the event type, or NULL if the type is not
+ * valid
  */
-void simplepost_file_free(simplepost_file_t spfp)
+const char* simplepost_event_name(enum simplepost_event_type type)
 {
-	if(spfp == NULL) return;
-
-	if(spfp->prev) spfp->prev->next = NULL;
-
-	while(spfp)
-	{
-		simplepost_file_t p = spfp;
-		spfp = spfp->next;
+	if(type < SP_EVENT_FILE_ADDED || type > SP_EVENT_FILE_EXPIRED) return NULL;
 
-		if(p->file) free(p->file);
-		if(p->url) free(p->url);
-		free(p);
-	}
+	return __event_names[type];
 }
 
 /*!
- * \brief Get the address the server is bound to.
+ * \brief Register a function to call when events are published.
+ *
+ * \note An inline callback runs on whichever thread published the event,
+ * which is usually one of the web server's request threads, so the client is
+ * kept waiting until it returns. It should be quick. An executor callback
+ * runs on a thread of its own, fed by a queue just like a subscriber (see
+ * simplepost_subscribe()), so a slow callback will miss events rather than
+ * slow down the server.
+ *
+ * \note The event passed to the callback (including its strings) is only
+ * valid until the callback returns. Inline callbacks must not modify it.
+ *
+ * \warning An inline callback MUST NOT add or remove callbacks with
+ * simplepost_add_callback() or simplepost_remove_callback(). Doing so will
+ * deadlock.
+ *
+ * \warning Every callback MUST be removed with simplepost_remove_callback()
+ * before the SimplePost instance it is registered with is freed.
  *
  * \param[in] spp      SimplePost instance to act on
- * \param[out] address
+ * \param[in] events
  * \parblock
- * Address of the server
+ * Types of events to run the callback for
  *
- * The storage for this string will be dynamically allocated. You are
- * responsible for freeing it (unless it is NULL, in which case an error
- * occurred).
+ * Combine the types with SP_EVENT_MASK(), or use SP_EVENT_ALL.
  * \endparblock
+ * \param[in] callback Function to call with each event
+ * \param[in] arg      Argument to pass to the callback function
+ * \param[in] dispatch Thread to run the callback on
  *
- * \return the number of characters written to the address (excluding the NULL-
- * terminating character)
+ * \return a new callback handle on success, or NULL if we failed to allocate
+ * the requested memory or start the executor thread
  */
-size_t simplepost_get_address(const simplepost_t spp, char** address)
+simplepost_callback_t simplepost_add_callback(
+	simplepost_t spp,
+	unsigned int events,
+	void (*callback) (simplepost_event_t, void*),
+	void* arg,
+	enum simplepost_dispatch dispatch)
 {
-	size_t address_length = 0; // Length of the server address
-	*address = NULL;           // Failsafe
+	simplepost_callback_t spcp = (simplepost_callback_t) malloc(sizeof(struct simplepost_callback));
+	if(spcp == NULL) return NULL;
 
-	if(spp->address == NULL || spp->httpd == NULL) return 0;
+	memset(spcp, 0, sizeof(struct simplepost_callback));
+	spcp->spp = spp;
+	spcp->mask = events;
+	spcp->callback = callback;
+	spcp->arg = arg;
+	spcp->dispatch = dispatch;
 
-	address_length = strlen(spp->address);
-	*address = (char*) malloc(sizeof(char) * (address_length + 1));
-	if(*address == NULL) return 0;
+	if(dispatch == SP_DISPATCH_EXECUTOR)
+	{
+		spcp->subscriber = simplepost_subscribe(spp, 0);
+		if(spcp->subscriber == NULL) goto error;
 
-	strcpy(*address, spp->address);
+		pthread_mutex_lock(&spp->events_lock);
+		spcp->subscriber->mask = events;
+		spcp->running = true;
+		pthread_mutex_unlock(&spp->events_lock);
 
-	return address_length;
+		if(pthread_create(&spcp->executor, NULL, &__run_executor, (void*) spcp) != 0)
+		{
+			impact(0, "%s: Failed to start the event callback executor\n",
+				SP_HTTP_HEADER_NAMESPACE);
+			simplepost_unsubscribe(spcp->subscriber);
+			goto error;
+		}
+	}
+	else
+	{
+		pthread_rwlock_wrlock(&spp->callbacks_lock);
+		spcp->next = spp->callbacks;
+		if(spcp->next) spcp->next->prev = spcp;
+		spp->callbacks = spcp;
+		__atomic_add_fetch(&spp->callbacks_count, 1, __ATOMIC_RELAXED);
+		pthread_rwlock_unlock(&spp->callbacks_lock);
+	}
+
+	return spcp;
+
+error:
+	free(spcp);
+	return NULL;
 }
 
 /*!
- * \brief Get the port the server is listening on.
+ * \brief Stop calling the given callback and free it.
  *
- * \param[in] spp SimplePost instance to act on
+ * \note Once this function returns, the callback is no longer running and
+ * will never be called again. An executor callback is first handed every
+ * event already queued for it.
  *
- * \return the server's port number. If this number is zero, an error occurred
- * or (more likely) the server is not running.
+ * \param[in] spcp Callback to act on
  */
-unsigned short simplepost_get_port(const simplepost_t spp)
+void simplepost_remove_callback(simplepost_callback_t spcp)
 {
-	return spp->port;
+	if(spcp == NULL) return;
+
+	simplepost_t spp = spcp->spp; // SimplePost instance the callback is registered with
+
+	if(spcp->dispatch == SP_DISPATCH_EXECUTOR)
+	{
+		pthread_mutex_lock(&spp->events_lock);
+		spcp->running = false;
+		pthread_cond_signal(&spcp->subscriber->ready);
+		pthread_mutex_unlock(&spp->events_lock);
+
+		pthread_join(spcp->executor, NULL);
+		simplepost_unsubscribe(spcp->subscriber);
+	}
+	else
+	{
+		pthread_rwlock_wrlock(&spp->callbacks_lock);
+		if(spcp->prev) spcp->prev->next = spcp->next;
+		else spp->callbacks = spcp->next;
+		if(spcp->next) spcp->next->prev = spcp->prev;
+		__atomic_sub_fetch(&spp->callbacks_count, 1, __ATOMIC_RELAXED);
+		pthread_rwlock_unlock(&spp->callbacks_lock);
+	}
+
+	free(spcp);
 }
 
 /*!
- * \brief Get a list of the files currently being served.
- *
- * \param[in] spp    SimplePost instance to act on
- * \param[out] files
- * \parblock
- * List of files we are currently hosting
+ * \brief Get the current status of the server.
  *
- * This argument may be NULL.
- *
- * The storage for this string will be dynamically allocated. You are
- * responsible for freeing it (unless it is NULL, in which case an error
- * occurred).
- * \endparblock
+ * \note None of the statistics are gathered by walking the list of files, so
+ * this function is cheap enough to call as often as you like.
  *
- * \return the number of files currently being served (or, more accurately,
- * unique URIs)
+ * \param[in] spp     SimplePost instance to act on
+ * \param[out] status Status of the server
  */
-size_t simplepost_get_files(simplepost_t spp, simplepost_file_t* files)
+void simplepost_get_status(simplepost_t spp, simplepost_status_t status)
 {
-	simplepost_file_t tail; // Last file in the *files list
-	size_t files_count = 0; // Number of unique URIs
+	struct timespec now; // Current time (CLOCK_MONOTONIC)
 
-	if(files == NULL) return spp->files_count;
-	tail = *files = NULL;
+	memset(status, 0, sizeof(struct simplepost_status));
+
+	__reap_shared_files(spp);
 
 	pthread_mutex_lock(&spp->files_lock);
-	for(const struct simplepost_serve* p = spp->files; p; p = p->next)
-	{
-		if(tail == NULL)
-		{
-			tail = *files = simplepost_file_init();
-			if(tail == NULL) goto abort_count;
-		}
-		else
-		{
-			simplepost_file_t prev = tail;
+	status->files = spp->files_count;
+	status->files_indexed = spp->index ? simpleindex_get_count(spp->index) : 0;
+	status->files_unlimited = spp->files_unlimited;
+	status->downloads_remaining = spp->files_remaining;
+	pthread_mutex_unlock(&spp->files_lock);
 
-			tail = simplepost_file_init();
-			if(tail == NULL) goto abort_count;
+	status->connections = __atomic_load_n(&spp->connections, __ATOMIC_RELAXED);
+	status->downloads_started = __atomic_load_n(&spp->downloads_started, __ATOMIC_RELAXED);
+	status->downloads_completed = __atomic_load_n(&spp->downloads_completed, __ATOMIC_RELAXED);
+	status->downloads_aborted = __atomic_load_n(&spp->downloads_aborted, __ATOMIC_RELAXED);
+	status->bytes_sent = __atomic_load_n(&spp->bytes_sent, __ATOMIC_RELAXED);
+	status->mime_hits = __atomic_load_n(&spp->mime_hits, __ATOMIC_RELAXED);
+	status->mime_misses = __atomic_load_n(&spp->mime_misses, __ATOMIC_RELAXED);
+	status->lookups_pending = __atomic_load_n(&spp->lookups_pending, __ATOMIC_RELAXED);
+	status->lookups = __atomic_load_n(&spp->lookups, __ATOMIC_RELAXED);
+	status->lookup_time = __atomic_load_n(&spp->lookup_time, __ATOMIC_RELAXED);
+	status->lookup_time_max = __atomic_load_n(&spp->lookup_time_max, __ATOMIC_RELAXED);
+
+	if(spp->httpd && clock_gettime(CLOCK_MONOTONIC, &now) == 0)
+	{
+		status->uptime = (unsigned long) (now.tv_sec - spp->start_time.tv_sec);
+	}
+}
 
-			tail->prev = prev;
-			prev->next = tail;
-		}
+/*!
+ * \brief Find out how much of a file is in the page cache.
+ *
+ * \note The page cache is shared by every process on the system, so this
+ * does not depend on which SimplePost instance (if any) is serving the file.
+ * The file is mapped SP_HTTP_RESIDENCY_CHUNK bytes at a time, but never read.
+ *
+ * \param[in] file      Name and path of the file
+ * \param[out] resident Number of bytes of the file in the page cache
+ * \param[out] size     Size of the file (in bytes)
+ *
+ * \return true if the residency of the file was determined, false if the file
+ * could not be opened or this system cannot tell
+ */
+bool simplepost_get_residency(const char* file, uint64_t* resident, uint64_t* size)
+{
+	#ifdef HAVE_MINCORE
+	long page_size = sysconf(_SC_PAGESIZE); // Size of each page of memory
+	unsigned char* vec = NULL;              // Residency of each page in the chunk
+	struct stat file_status;                // Status of the file
+	int fd;                                 // File descriptor
+	bool ret = false;                       // Return value
 
-		if(p->file == NULL) goto abort_count;
-		tail->file = (char*) malloc(sizeof(char) * (strlen(p->file) + 1));
-		if(tail->file == NULL) goto abort_count;
-		strcpy(tail->file, p->file);
+	*resident = 0;
+	*size = 0;
 
-		if(p->uri == NULL) goto abort_count;
-		tail->url = (char*) malloc(sizeof(char) * (strlen(spp->address) + strlen(p->uri) + 50));
-		if(tail->url == NULL) goto abort_count;
-		if(spp->port == 80) sprintf(tail->url, "http://%s%s", spp->address, p->uri);
-		else sprintf(tail->url, "http://%s:%u%s", spp->address, spp->port, p->uri);
+	if(page_size <= 0) return false;
 
-		tail->count = p->count;
+	fd = open(file, O_RDONLY);
+	if(fd == -1) return false;
 
-		++files_count;
-	}
-	pthread_mutex_unlock(&spp->files_lock);
+	if(fstat(fd, &file_status) == -1) goto error;
+	*size = (uint64_t) file_status.st_size;
 
-	return files_count;
+	vec = (unsigned char*) malloc(SP_HTTP_RESIDENCY_CHUNK / page_size);
+	if(vec == NULL) goto error;
 
-abort_count:
-	if(*files)
+	for(uint64_t offset = 0; offset < *size; offset += SP_HTTP_RESIDENCY_CHUNK)
 	{
-		simplepost_file_free(*files);
-		*files = NULL;
+		size_t length = SP_HTTP_RESIDENCY_CHUNK; // Bytes in this chunk
+		size_t pages;                            // Pages in this chunk
+		void* map;                               // Chunk of the file
+
+		if(*size - offset < length) length = (size_t) (*size - offset);
+		pages = (length + page_size - 1) / page_size;
+
+		map = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, (off_t) offset);
+		if(map == MAP_FAILED) goto error;
+
+		if(mincore(map, length, vec) == -1)
+		{
+			munmap(map, length);
+			goto error;
+		}
+		munmap(map, length);
+
+		for(size_t i = 0; i < pages; ++i)
+		{
+			if(vec[i] & 1) *resident += (uint64_t) page_size;
+		}
 	}
-	pthread_mutex_unlock(&spp->files_lock);
 
-	return 0;
+	// The last page is only partially used by the file.
+	if(*resident > *size) *resident = *size;
+	ret = true;
+
+error:
+	if(vec) free(vec);
+	close(fd);
+
+	return ret;
+	#else
+	// Unused parameters
+	(void) file;
+	(void) resident;
+	(void) size;
+
+	return false;
+	#endif // HAVE_MINCORE
 }
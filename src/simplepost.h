@@ -24,6 +24,7 @@
 
 #include <sys/types.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 /*!
  * \brief SimplePost files type
@@ -36,9 +37,15 @@ typedef struct simplepost_file
 	/// Uniform Resource Locator assigned to the file
 	char* url;
 
+	/// Uniform Resource Identifier assigned to the file (may be NULL)
+	char* uri;
+
 	/// Number of times the file may be downloaded
 	unsigned int count;
 
+	/// Time (seconds since the Epoch) the file stops being served (0 = never)
+	time_t expires;
+
 
 	/// Next file in the doubly-linked list
 	struct simplepost_file* next;
@@ -47,11 +54,146 @@ typedef struct simplepost_file
 	struct simplepost_file* prev;
 } * simplepost_file_t;
 
+/*!
+ * \brief Types of events published by SimplePost
+ */
+enum simplepost_event_type
+{
+	/// A new file is being served
+	SP_EVENT_FILE_ADDED,
+
+	/// A client started downloading a file
+	SP_EVENT_DOWNLOAD_STARTED,
+
+	/// A client finished downloading a file
+	SP_EVENT_DOWNLOAD_COMPLETED,
+
+	/// A download was terminated before the whole file was sent
+	SP_EVENT_DOWNLOAD_ABORTED,
+
+	/// A file reached its COUNT or its expiry time and is no longer being served
+	SP_EVENT_FILE_EXPIRED
+};
+
+/// Bit mask selecting the given event type
+#define SP_EVENT_MASK(type) (1U << (type))
+
+/// Bit mask selecting every event type
+#define SP_EVENT_ALL        (SP_EVENT_MASK(SP_EVENT_FILE_EXPIRED + 1) - 1)
+
+/*!
+ * \brief SimplePost event type
+ */
+typedef struct simplepost_event
+{
+	/// What happened
+	enum simplepost_event_type type;
+
+	/// Name and path of the file on the filesystem
+	char* file;
+
+	/// Uniform Resource Identifier assigned to the file
+	char* uri;
+
+	/// Number of bytes to send (download started) or sent (download completed or aborted)
+	size_t bytes;
+
+	/// Number of times the file may be downloaded (file added only)
+	unsigned int count;
+
+	/// libmicrohttpd's enum MHD_RequestTerminationCode for the request (download completed or aborted only)
+	int termination;
+
+	/// Number of events the subscriber missed immediately before this one
+	size_t dropped;
+} * simplepost_event_t;
+
+/*!
+ * \brief SimplePost status type
+ */
+typedef struct simplepost_status
+{
+	/// Number of files being served
+	size_t files;
+
+	/// Number of files being served from an index
+	size_t files_indexed;
+
+	/// Number of files which may be downloaded an unlimited number of times
+	size_t files_unlimited;
+
+	/// Number of downloads remaining for all of the other files
+	size_t downloads_remaining;
+
+	/// Number of downloads started since the server was initialized
+	size_t downloads_started;
+
+	/// Number of downloads completed since the server was initialized
+	size_t downloads_completed;
+
+	/// Number of downloads aborted since the server was initialized
+	size_t downloads_aborted;
+
+	/// Number of open client connections
+	size_t connections;
+
+	/// Number of bytes of files sent to clients
+	uint64_t bytes_sent;
+
+	/// Number of downloads whose MIME type was cached
+	size_t mime_hits;
+
+	/// Number of downloads whose MIME type had to be determined
+	size_t mime_misses;
+
+	/// Number of requests waiting for the file they asked for to be opened
+	size_t lookups_pending;
+
+	/// Number of files opened to be served
+	size_t lookups;
+
+	/// Number of microseconds spent opening files to be served
+	uint64_t lookup_time;
+
+	/// Longest time (in microseconds) opening a single file took
+	uint64_t lookup_time_max;
+
+	/// Number of seconds since the server was bound
+	unsigned long uptime;
+} * simplepost_status_t;
+
+/*!
+ * \brief SimplePost event subscriber type
+ */
+typedef struct simplepost_subscriber* simplepost_subscriber_t;
+
+/*!
+ * \brief Threads SimplePost may run an event callback on
+ */
+enum simplepost_dispatch
+{
+	/// Run the callback on the thread that published the event
+	SP_DISPATCH_INLINE,
+
+	/// Run the callback on a thread dedicated to it
+	SP_DISPATCH_EXECUTOR
+};
+
+/*!
+ * \brief SimplePost event callback type
+ */
+typedef struct simplepost_callback* simplepost_callback_t;
+
 /*!
  * \brief SimplePost master type
  */
 typedef struct simplepost* simplepost_t;
 
+/*!
+ * \brief SimplePost file listing cursor type
+ */
+typedef struct simplepost_cursor* simplepost_cursor_t;
+
 /*!
  * \page using_simplepost Using the SimplePost webserver
  *
@@ -75,7 +217,7 @@ typedef struct simplepost* simplepost_t;
  *     if(port == 0) goto generic_error;
  *
  *     char* url;
- *     if(simplepost_serve_file(spp, &url, "/usr/bin/simplepost", NULL, 5) == 0) goto generic_error;
+ *     if(simplepost_serve_file(spp, &url, "/usr/bin/simplepost", NULL, 5, 0, false) == 0) goto generic_error;
  *
  *     while(simplepost_is_alive(spp))
  *     {
@@ -95,19 +237,45 @@ typedef struct simplepost* simplepost_t;
  *     return 0;
  * }
  * \endcode
+ *
+ * Rather than polling simplepost_is_alive() or the list of files, your
+ * application may register a callback with simplepost_add_callback() to be
+ * told as soon as a download starts, finishes, or exhausts a file's COUNT.
  */
 
 simplepost_t simplepost_init();
 void simplepost_free(simplepost_t spp);
 
+void simplepost_set_connection_limit(simplepost_t spp, unsigned int limit);
+void simplepost_set_connection_timeout(simplepost_t spp, unsigned int timeout);
+void simplepost_set_workers(simplepost_t spp, unsigned int workers);
+void simplepost_set_idle_timeout(simplepost_t spp, unsigned int timeout);
+void simplepost_set_resume_grace(simplepost_t spp, unsigned int grace);
+bool simplepost_set_affinity(simplepost_t spp, const char* cpus, bool numa);
+bool simplepost_set_tcp_profile(simplepost_t spp, const char* profile);
+bool simplepost_set_preload(simplepost_t spp, bool preload);
+bool simplepost_set_watch(simplepost_t spp, bool watch, bool purge);
+bool simplepost_set_direct_threshold(simplepost_t spp, uint64_t size);
+bool simplepost_set_sign_key(simplepost_t spp, const char* key, size_t links, const char* table);
+bool simplepost_set_journal(simplepost_t spp, const char* journal);
+
+int simplepost_get_activated_socket(int domain);
 unsigned short simplepost_bind(simplepost_t spp, const char* address, unsigned short port);
+unsigned short simplepost_bind_socket(simplepost_t spp, int sock);
 bool simplepost_unbind(simplepost_t spp);
+int simplepost_quiesce(simplepost_t spp);
+bool simplepost_resume(simplepost_t spp);
+bool simplepost_drain(simplepost_t spp, unsigned int timeout);
 void simplepost_block(const simplepost_t spp);
 void simplepost_block_files(const simplepost_t spp);
 bool simplepost_is_alive(const simplepost_t spp);
 
-size_t simplepost_serve_file(simplepost_t spp, char** url, const char* file, const char* uri, unsigned int count);
+size_t simplepost_serve_file(simplepost_t spp, char** url, const char* file, const char* uri, unsigned int count, time_t expires, bool direct);
+size_t simplepost_serve_files(simplepost_t spp, const char* const* files, const char* const* uris, const unsigned int* counts, const time_t* expires, bool* results, size_t n);
 short simplepost_purge_file(simplepost_t spp, const char* uri);
+ssize_t simplepost_purge_files(simplepost_t spp, const char* pattern);
+bool simplepost_write_index(const char* index, const char* const* files, const char* const* uris, size_t n);
+bool simplepost_load_index(simplepost_t spp, const char* index);
 
 simplepost_file_t simplepost_file_init();
 void simplepost_file_free(simplepost_file_t sfp);
@@ -115,5 +283,22 @@ void simplepost_file_free(simplepost_file_t sfp);
 size_t simplepost_get_address(const simplepost_t spp, char** address);
 unsigned short simplepost_get_port(const simplepost_t spp);
 size_t simplepost_get_files(simplepost_t spp, simplepost_file_t* files);
+ssize_t simplepost_find_files(simplepost_t spp, const char* pattern, simplepost_file_t* files);
+
+simplepost_cursor_t simplepost_cursor_init(simplepost_t spp);
+void simplepost_cursor_free(simplepost_cursor_t spcp);
+ssize_t simplepost_get_files_page(simplepost_cursor_t spcp, simplepost_file_t* files, size_t max);
+
+simplepost_subscriber_t simplepost_subscribe(simplepost_t spp, size_t depth);
+void simplepost_unsubscribe(simplepost_subscriber_t spsp);
+short simplepost_get_event(simplepost_subscriber_t spsp, simplepost_event_t* event, unsigned int timeout);
+void simplepost_event_free(simplepost_event_t spep);
+const char* simplepost_event_name(enum simplepost_event_type type);
+
+simplepost_callback_t simplepost_add_callback(simplepost_t spp, unsigned int events, void (*callback) (simplepost_event_t, void*), void* arg, enum simplepost_dispatch dispatch);
+void simplepost_remove_callback(simplepost_callback_t spcp);
+
+void simplepost_get_status(simplepost_t spp, simplepost_status_t status);
+bool simplepost_get_residency(const char* file, uint64_t* resident, uint64_t* size);
 
 #endif // _SIMPLEPOST_H_
@@ -0,0 +1,340 @@
+/*
+ * SimplePost - A Simple HTTP Server
+ *
+ * Copyright (C) 2016 Karl Lenz.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have recieved a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ */
+
+#include "simplering.h"
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#if defined(HAVE_LINUX_IO_URING_H) && \
+    HAVE_DECL___NR_IO_URING_SETUP
+#define HAVE_IO_URING_SUPPORT
+#else
+#undef HAVE_IO_URING_SUPPORT
+#endif
+
+#ifdef HAVE_IO_URING_SUPPORT
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+/*!
+ * \brief io_uring instance reading a file into two registered buffers
+ *
+ * Each ring has both of its buffers registered, so the kernel pins them once
+ * rather than on every read, and reads need no helper threads. Only one read
+ * is in flight at a time, but any thread may wait for it.
+ */
+struct simplering
+{
+	/// File descriptor of the ring
+	int fd;
+
+	/// Buffers registered with the ring
+	char* buffers[2];
+
+	/// Size (in bytes) of each buffer
+	size_t size;
+
+	/// Is a read in flight whose completion has not been taken yet?
+	bool is_reading;
+
+	/// Submission queue ring mapped from the kernel
+	void* sq_ring;
+
+	/// Size (in bytes) of sq_ring
+	size_t sq_ring_size;
+
+	/// Completion queue ring mapped from the kernel
+	void* cq_ring;
+
+	/// Size (in bytes) of cq_ring
+	size_t cq_ring_size;
+
+	/// Submission queue entries mapped from the kernel
+	struct io_uring_sqe* sqes;
+
+	/// Size (in bytes) of sqes
+	size_t sqes_size;
+
+	/// Tail of the submission queue
+	unsigned int* sq_tail;
+
+	/// Mask to turn a submission queue position into an index
+	unsigned int sq_mask;
+
+	/// Indexes of the submission queue entries to submit
+	unsigned int* sq_array;
+
+	/// Head of the completion queue
+	unsigned int* cq_head;
+
+	/// Tail of the completion queue (written by the kernel)
+	unsigned int* cq_tail;
+
+	/// Mask to turn a completion queue position into an index
+	unsigned int cq_mask;
+
+	/// Completion queue entries
+	struct io_uring_cqe* cqes;
+};
+#endif // HAVE_IO_URING_SUPPORT
+
+/*!
+ * \brief Set up a ring to read into the given buffers.
+ *
+ * \param[in] buffers Buffers to register
+ * \param[in] size    Size (in bytes) of each buffer
+ *
+ * \return the ring, or NULL (with errno set) if it could not be set up. errno
+ * is ENOSYS or EPERM if io_uring is not available at all.
+ */
+simplering_t simplering_init(char* buffers[2], size_t size)
+{
+	#ifdef HAVE_IO_URING_SUPPORT
+	struct io_uring_params params; // Parameters of the ring
+	struct iovec iov[2];           // Buffers to register
+	simplering_t ring;             // Ring to set up
+	int error;                     // Error which stopped us
+
+	ring = (simplering_t) calloc(1, sizeof(struct simplering));
+	if(ring == NULL) return NULL;
+	memset(&params, 0, sizeof(params));
+
+	/* The response may be freed by another thread than the one which reads
+	 * for it, so any thread must be able to wait on the ring. That rules out
+	 * IORING_SETUP_SINGLE_ISSUER (and IORING_SETUP_DEFER_TASKRUN with it).
+	 */
+	ring->fd = (int) syscall(__NR_io_uring_setup, 2, &params);
+	if(ring->fd == -1)
+	{
+		error = errno;
+		free(ring);
+		errno = error;
+		return NULL;
+	}
+
+	ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+	ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	if(ring->sq_ring == MAP_FAILED)
+	{
+		ring->sq_ring = NULL;
+		goto error;
+	}
+
+	ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+	if(ring->cq_ring == MAP_FAILED)
+	{
+		ring->cq_ring = NULL;
+		goto error;
+	}
+
+	ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = (struct io_uring_sqe*) mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if(ring->sqes == MAP_FAILED)
+	{
+		ring->sqes = NULL;
+		goto error;
+	}
+
+	ring->sq_tail = (unsigned int*) ((char*) ring->sq_ring + params.sq_off.tail);
+	ring->sq_mask = *((unsigned int*) ((char*) ring->sq_ring + params.sq_off.ring_mask));
+	ring->sq_array = (unsigned int*) ((char*) ring->sq_ring + params.sq_off.array);
+	ring->cq_head = (unsigned int*) ((char*) ring->cq_ring + params.cq_off.head);
+	ring->cq_tail = (unsigned int*) ((char*) ring->cq_ring + params.cq_off.tail);
+	ring->cq_mask = *((unsigned int*) ((char*) ring->cq_ring + params.cq_off.ring_mask));
+	ring->cqes = (struct io_uring_cqe*) ((char*) ring->cq_ring + params.cq_off.cqes);
+
+	for(unsigned int i = 0; i < 2; ++i)
+	{
+		ring->buffers[i] = buffers[i];
+		iov[i].iov_base = buffers[i];
+		iov[i].iov_len = size;
+	}
+	ring->size = size;
+	if(syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_BUFFERS, iov, 2) == -1) goto error;
+
+	return ring;
+
+error:
+	error = errno;
+	simplering_free(ring);
+	errno = error;
+
+	return NULL;
+	#else
+	// Unused parameters
+	(void) buffers;
+	(void) size;
+
+	errno = ENOSYS;
+	return NULL;
+	#endif // HAVE_IO_URING_SUPPORT
+}
+
+/*!
+ * \brief Tear down a ring.
+ *
+ * \warning No read may be in flight, as the kernel may still be writing into
+ * its buffer. See simplering_is_reading().
+ *
+ * \param[in] ring Ring to tear down
+ */
+void simplering_free(simplering_t ring)
+{
+	if(ring == NULL) return;
+
+	#ifdef HAVE_IO_URING_SUPPORT
+	if(ring->sqes) munmap(ring->sqes, ring->sqes_size);
+	if(ring->cq_ring) munmap(ring->cq_ring, ring->cq_ring_size);
+	if(ring->sq_ring) munmap(ring->sq_ring, ring->sq_ring_size);
+	if(ring->fd != -1) close(ring->fd);
+	#endif // HAVE_IO_URING_SUPPORT
+
+	free(ring);
+}
+
+/*!
+ * \brief Submit a read into one of the buffers of a ring.
+ *
+ * \warning Only one read may be in flight at a time.
+ *
+ * \param[inout] ring Ring to submit the read to
+ * \param[in] fd      File descriptor to read from
+ * \param[in] index   Index of the buffer to read into (0 or 1)
+ * \param[in] offset  Number of bytes into the file to read from
+ *
+ * \return true if the read was submitted, false (with errno set) otherwise
+ */
+bool simplering_read(simplering_t ring, int fd, unsigned int index, uint64_t offset)
+{
+	#ifdef HAVE_IO_URING_SUPPORT
+	unsigned int tail = *(ring->sq_tail);                        // Position of the entry to fill
+	struct io_uring_sqe* sqe = &ring->sqes[tail & ring->sq_mask]; // Entry to fill
+	int submitted;                                               // Number of entries submitted
+
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	sqe->opcode = IORING_OP_READ_FIXED;
+	sqe->fd = fd;
+	sqe->addr = (uint64_t) (uintptr_t) ring->buffers[index];
+	sqe->len = (uint32_t) ring->size;
+	sqe->off = offset;
+	sqe->buf_index = (uint16_t) index;
+	ring->sq_array[tail & ring->sq_mask] = tail & ring->sq_mask;
+
+	// The kernel must see the entry before it sees the new tail.
+	__atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+	do submitted = (int) syscall(__NR_io_uring_enter, ring->fd, 1, 0, 0, NULL, 0);
+	while(submitted == -1 && errno == EINTR);
+	if(submitted != 1)
+	{
+		// Take the entry back, so the ring stays usable.
+		if(submitted == 0) errno = EAGAIN;
+		__atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+		return false;
+	}
+
+	ring->is_reading = true;
+
+	return true;
+	#else
+	// Unused parameters
+	(void) ring;
+	(void) fd;
+	(void) index;
+	(void) offset;
+
+	errno = ENOSYS;
+	return false;
+	#endif // HAVE_IO_URING_SUPPORT
+}
+
+/*!
+ * \brief Wait for the read in flight on a ring to finish.
+ *
+ * \param[inout] ring Ring to wait on
+ *
+ * \return the number of bytes read, or -1 (with errno set) if the read failed
+ * or could not be waited for. Use simplering_is_reading() to tell which.
+ */
+ssize_t simplering_wait(simplering_t ring)
+{
+	#ifdef HAVE_IO_URING_SUPPORT
+	unsigned int head = *(ring->cq_head); // Position of the next completion
+	int result;                           // Result of the read
+
+	while(__atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE) == head)
+	{
+		if(syscall(__NR_io_uring_enter, ring->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) == -1 &&
+			errno != EINTR)
+		{
+			return -1;
+		}
+	}
+
+	result = ring->cqes[head & ring->cq_mask].res;
+	__atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+	ring->is_reading = false;
+
+	if(result < 0)
+	{
+		errno = -result;
+		return -1;
+	}
+
+	return (ssize_t) result;
+	#else
+	// Unused parameters
+	(void) ring;
+
+	errno = ENOSYS;
+	return -1;
+	#endif // HAVE_IO_URING_SUPPORT
+}
+
+/*!
+ * \brief Is a read still in flight on a ring?
+ *
+ * \note A read has only finished once simplering_wait() has taken its
+ * completion. Until then the kernel may still be writing into its buffer.
+ *
+ * \param[in] ring Ring to check
+ *
+ * \retval true A read is in flight.
+ * \retval false No read is in flight.
+ */
+bool simplering_is_reading(const simplering_t ring)
+{
+	#ifdef HAVE_IO_URING_SUPPORT
+	return ring->is_reading;
+	#else
+	// Unused parameters
+	(void) ring;
+
+	return false;
+	#endif // HAVE_IO_URING_SUPPORT
+}
@@ -0,0 +1,42 @@
+/*
+ * SimplePost - A Simple HTTP Server
+ *
+ * Copyright (C) 2016 Karl Lenz.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have recieved a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ */
+
+#ifndef _SIMPLERING_H_
+#define _SIMPLERING_H_
+
+#include <sys/types.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+
+/*!
+ * \brief io_uring instance reading a file into two registered buffers
+ */
+typedef struct simplering* simplering_t;
+
+simplering_t simplering_init(char* buffers[2], size_t size);
+void simplering_free(simplering_t ring);
+
+bool simplering_read(simplering_t ring, int fd, unsigned int index, uint64_t offset);
+ssize_t simplering_wait(simplering_t ring);
+bool simplering_is_reading(const simplering_t ring);
+
+#endif // _SIMPLERING_H_
@@ -0,0 +1,576 @@
+/*
+ * SimplePost - A Simple HTTP Server
+ *
+ * Copyright (C) 2016 Karl Lenz.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have recieved a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ */
+
+#include "simpleshare.h"
+#include "config.h"
+
+#include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+/// Number of slots in the table (always a power of two)
+#define SP_SHARE_SLOTS   (1 << 20)
+
+/// Size (in bytes) of the strings in the table
+#define SP_SHARE_STRINGS (1 << 28)
+
+/// Number of words in the bitmap of the slots whose counts changed
+#define SP_SHARE_DIRTY   (SP_SHARE_SLOTS / 64)
+
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+
+/*!
+ * \brief States of a slot in the table
+ */
+enum simpleshare_state
+{
+	/// The slot has never held a file
+	SP_SHARE_EMPTY = 0,
+
+	/// The slot holds a file being served
+	SP_SHARE_LIVE = 1,
+
+	/// The slot held a file which is no longer served
+	SP_SHARE_DEAD = 2
+};
+
+/*!
+ * \brief File in the table
+ *
+ * Strings are referred to by their offset in simpleshare::strings.
+ */
+struct simpleshare_slot
+{
+	/// State of the slot (enum simpleshare_state)
+	uint32_t state;
+
+	/// Hash of the URI of the file (see __hash_uri())
+	uint32_t hash;
+
+	/// Number of times the file may still be downloaded (0 is unlimited; always use the __atomic builtins)
+	uint32_t count;
+
+	/// Uniform Resource Identifier assigned to the file
+	uint32_t uri;
+
+	/// Name and path of the file on the filesystem
+	uint32_t file;
+
+	/// MIME type of the file (UINT32_MAX until it is known)
+	uint32_t mime_type;
+
+	/// Should the file be read with O_DIRECT? (0 = no, 1 = yes)
+	uint32_t direct;
+
+	/// Downloads of the file reserved for clients (see simpleclaim_lock())
+	struct simpleclaim_list claims;
+};
+
+/*!
+ * \brief Table of files shared by the processes serving HTTP requests
+ *
+ * The table is mapped into memory shared with the worker processes, which
+ * count the downloads of files in it, so a COUNT is exact no matter which
+ * process serves the file. Only the process which forked the workers changes
+ * the files in it, mirroring its own list of files. The table is an open
+ * addressing hash of the files by URI. The slots and strings of files which
+ * are no longer served are only reclaimed when the table is cleared. Every
+ * download counted marks the slot of its file in a bitmap, and every word of
+ * the bitmap with a mark in a second, smaller one, so the process which
+ * forked the workers only looks at the files which were downloaded.
+ */
+struct simpleshare
+{
+	/// Lock for everything but the counts and the bitmaps (shared with the worker processes)
+	pthread_rwlock_t lock;
+
+	/// Number of slots which are not empty
+	uint32_t slots_used;
+
+	/// Number of bytes of strings used
+	uint32_t strings_used;
+
+	/// Words of dirty with a bit set (always use the __atomic builtins)
+	uint64_t dirty_words[SP_SHARE_DIRTY / 64];
+
+	/// Slots whose counts changed since they were last reaped (always use the __atomic builtins)
+	uint64_t dirty[SP_SHARE_DIRTY];
+
+	/// Slots of the hash
+	struct simpleshare_slot slots[SP_SHARE_SLOTS];
+
+	/// Terminated strings the slots refer to
+	char strings[SP_SHARE_STRINGS];
+};
+
+/*!
+ * \brief Hash the given URI.
+ *
+ * \note URIs are hashed without their leading "/".
+ *
+ * \param[in] uri Uniform Resource Identifier to hash
+ *
+ * \return 32-bit FNV-1a hash of the URI
+ */
+static uint32_t __hash_uri(const char* uri)
+{
+	uint32_t hash = 2166136261U; // FNV offset basis
+
+	if(uri[0] == '/') ++uri;
+	for(; *uri != '\0'; ++uri)
+	{
+		hash ^= (unsigned char) *uri;
+		hash *= 16777619U; // FNV prime
+	}
+
+	return hash;
+}
+
+/*!
+ * \brief Copy a string into a table.
+ *
+ * \warning The caller must hold the lock on the table for writing.
+ *
+ * \param[in] share Table to act on
+ * \param[in] str   String to copy
+ *
+ * \return the offset of the copy, or UINT32_MAX if the table is out of room
+ */
+static uint32_t __share_string(simpleshare_t share, const char* str)
+{
+	size_t size = strlen(str) + 1;         // Size of the string (including its terminator)
+	uint32_t offset = share->strings_used; // Offset of the copy
+
+	if(size > SP_SHARE_STRINGS - offset) return UINT32_MAX;
+
+	memcpy(share->strings + offset, str, size);
+	share->strings_used += size;
+
+	return offset;
+}
+
+/*!
+ * \brief Map a new table of files to share with worker processes.
+ *
+ * \note Pages of the table are only backed by memory once they are touched,
+ * so the table costs about as much memory as the files in it.
+ *
+ * \return the table, or NULL (with errno set) if it could not be mapped
+ */
+simpleshare_t simpleshare_map()
+{
+	struct simpleshare* share; // Table of files
+	pthread_rwlockattr_t attr; // Attributes of its lock
+
+	share = (struct simpleshare*) mmap(NULL, sizeof(struct simpleshare),
+		PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if(share == MAP_FAILED) return NULL;
+
+	pthread_rwlockattr_init(&attr);
+	pthread_rwlockattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+	pthread_rwlock_init(&share->lock, &attr);
+	pthread_rwlockattr_destroy(&attr);
+
+	return share;
+}
+
+/*!
+ * \brief Unmap a table of shared files.
+ *
+ * \param[in] share Table to unmap
+ */
+void simpleshare_unmap(simpleshare_t share)
+{
+	if(share == NULL) return;
+
+	pthread_rwlock_destroy(&share->lock);
+	munmap(share, sizeof(struct simpleshare));
+}
+
+/*!
+ * \brief Lock a table of shared files for reading.
+ *
+ * \note The counts may be changed with only this lock held.
+ *
+ * \param[in] share Table to lock
+ */
+void simpleshare_rdlock(simpleshare_t share)
+{
+	pthread_rwlock_rdlock(&share->lock);
+}
+
+/*!
+ * \brief Lock a table of shared files for writing.
+ *
+ * \param[in] share Table to lock
+ */
+void simpleshare_wrlock(simpleshare_t share)
+{
+	pthread_rwlock_wrlock(&share->lock);
+}
+
+/*!
+ * \brief Unlock a table of shared files.
+ *
+ * \param[in] share Table to unlock
+ */
+void simpleshare_unlock(simpleshare_t share)
+{
+	pthread_rwlock_unlock(&share->lock);
+}
+
+/*!
+ * \brief Remove every file from a table of shared files.
+ *
+ * \note This reclaims the slots and strings of the files which are no longer
+ * served. Slots marked for downloads not reaped yet stay marked.
+ *
+ * \warning The caller must hold the lock on the table for writing. Every
+ * string and list of reservations from the table is invalidated.
+ *
+ * \param[in] share Table to clear
+ */
+void simpleshare_clear(simpleshare_t share)
+{
+	// A new table is already empty.
+	if(share->slots_used) memset(share->slots, 0, sizeof(share->slots));
+	share->slots_used = 0;
+	share->strings_used = 0;
+}
+
+/*!
+ * \brief Put a file into a free slot of a table of shared files.
+ *
+ * \warning The caller must hold the lock on the table for writing, and make
+ * sure no other slot holds a file on the same URI.
+ *
+ * \param[in] share     Table to act on
+ * \param[in] uri       Uniform Resource Identifier assigned to the file
+ * \param[in] file      Name and path of the file
+ * \param[in] mime_type MIME type of the file (may be NULL)
+ * \param[in] count     Number of times the file may still be downloaded
+ * \param[in] is_direct Should the file be read with O_DIRECT?
+ *
+ * \return the slot of the file, or 0 if the table is out of room
+ */
+uint32_t simpleshare_put(
+	simpleshare_t share,
+	const char* uri,
+	const char* file,
+	const char* mime_type,
+	uint32_t count,
+	bool is_direct)
+{
+	uint32_t hash = __hash_uri(uri);          // Hash of the URI of the file
+	uint32_t i = hash & (SP_SHARE_SLOTS - 1); // Slot to put the file in
+	uint32_t uri_offset;                      // Offset of the URI
+	uint32_t file_offset;                     // Offset of the name and path of the file
+	uint32_t mime_offset = UINT32_MAX;        // Offset of the MIME type of the file
+
+	while(share->slots[i].state == SP_SHARE_LIVE) i = (i + 1) & (SP_SHARE_SLOTS - 1);
+
+	// Keep a quarter of the slots empty, so lookups stay short.
+	if(share->slots[i].state == SP_SHARE_EMPTY && share->slots_used >= SP_SHARE_SLOTS / 4 * 3) return 0;
+
+	uri_offset = __share_string(share, uri);
+	if(uri_offset == UINT32_MAX) return 0;
+	file_offset = __share_string(share, file);
+	if(file_offset == UINT32_MAX) return 0;
+	if(mime_type) mime_offset = __share_string(share, mime_type);
+
+	if(share->slots[i].state == SP_SHARE_EMPTY) ++(share->slots_used);
+
+	share->slots[i].hash = hash;
+	share->slots[i].uri = uri_offset;
+	share->slots[i].file = file_offset;
+	share->slots[i].mime_type = mime_offset;
+	share->slots[i].direct = is_direct;
+	memset(&share->slots[i].claims, 0, sizeof(struct simpleclaim_list));
+	__atomic_store_n(&share->slots[i].count, count, __ATOMIC_RELAXED);
+	share->slots[i].state = SP_SHARE_LIVE;
+
+	return i + 1;
+}
+
+/*!
+ * \brief Change the COUNT of a shared file, and how it is read.
+ *
+ * \warning The caller must hold the lock on the table for writing.
+ *
+ * \param[in] share     Table to act on
+ * \param[in] slot      Slot of the file
+ * \param[in] count     Number of times the file may still be downloaded
+ * \param[in] is_direct Should the file be read with O_DIRECT?
+ */
+void simpleshare_update(simpleshare_t share, uint32_t slot, uint32_t count, bool is_direct)
+{
+	__atomic_store_n(&share->slots[slot - 1].count, count, __ATOMIC_RELAXED);
+	share->slots[slot - 1].direct = is_direct;
+}
+
+/*!
+ * \brief Stop sharing a file.
+ *
+ * \note The slot and the strings of the file are only reclaimed once the
+ * table is cleared.
+ *
+ * \warning The caller must hold the lock on the table for writing, and free
+ * the downloads of the file reserved for clients.
+ *
+ * \param[in] share Table to act on
+ * \param[in] slot  Slot of the file
+ */
+void simpleshare_remove(simpleshare_t share, uint32_t slot)
+{
+	share->slots[slot - 1].state = SP_SHARE_DEAD;
+}
+
+/*!
+ * \brief Find the file shared on the given URI.
+ *
+ * \warning The caller must hold the lock on the table.
+ *
+ * \param[in] share Table to search
+ * \param[in] uri   Uniform Resource Identifier of the file (with or without its leading "/")
+ *
+ * \return the slot of the file, or 0 if no file is shared on the URI
+ */
+uint32_t simpleshare_find(const simpleshare_t share, const char* uri)
+{
+	uint32_t hash = __hash_uri(uri); // Hash of the URI
+
+	for(uint32_t i = hash & (SP_SHARE_SLOTS - 1); share->slots[i].state != SP_SHARE_EMPTY; i = (i + 1) & (SP_SHARE_SLOTS - 1))
+	{
+		const char* slot_uri = share->strings + share->slots[i].uri; // URI of the file in the slot
+
+		if(share->slots[i].state != SP_SHARE_LIVE || share->slots[i].hash != hash) continue;
+
+		if(slot_uri[0] == '/') ++slot_uri;
+		if(strcmp(slot_uri, (uri[0] == '/') ? uri + 1 : uri) == 0) return i + 1;
+	}
+
+	return 0;
+}
+
+/*!
+ * \brief Get the URI of a shared file.
+ *
+ * \warning The caller must hold the lock on the table, unless it is the only
+ * process which changes the files in it.
+ *
+ * \param[in] share Table to act on
+ * \param[in] slot  Slot of the file
+ *
+ * \return the URI of the file, or NULL if the slot holds no file being served
+ */
+const char* simpleshare_get_uri(const simpleshare_t share, uint32_t slot)
+{
+	if(share->slots[slot - 1].state != SP_SHARE_LIVE) return NULL;
+
+	return share->strings + share->slots[slot - 1].uri;
+}
+
+/*!
+ * \brief Get the name and path of a shared file.
+ *
+ * \warning The caller must hold the lock on the table.
+ *
+ * \param[in] share Table to act on
+ * \param[in] slot  Slot of the file
+ *
+ * \return the name and path of the file
+ */
+const char* simpleshare_get_file(const simpleshare_t share, uint32_t slot)
+{
+	return share->strings + share->slots[slot - 1].file;
+}
+
+/*!
+ * \brief Get the MIME type of a shared file.
+ *
+ * \warning The caller must hold the lock on the table.
+ *
+ * \param[in] share Table to act on
+ * \param[in] slot  Slot of the file
+ *
+ * \return the MIME type of the file, or NULL if it is not known
+ */
+const char* simpleshare_get_mime_type(const simpleshare_t share, uint32_t slot)
+{
+	if(share->slots[slot - 1].mime_type == UINT32_MAX) return NULL;
+
+	return share->strings + share->slots[slot - 1].mime_type;
+}
+
+/*!
+ * \brief Set the MIME type of a shared file.
+ *
+ * \note Any process serving HTTP requests may do this, so the MIME type of
+ * each file only has to be looked up once. If the table is out of room, the
+ * MIME type is simply not remembered.
+ *
+ * \warning The caller must hold the lock on the table for writing.
+ *
+ * \param[in] share     Table to act on
+ * \param[in] slot      Slot of the file
+ * \param[in] mime_type MIME type of the file (NULL to forget it)
+ */
+void simpleshare_set_mime_type(simpleshare_t share, uint32_t slot, const char* mime_type)
+{
+	share->slots[slot - 1].mime_type = mime_type ? __share_string(share, mime_type) : UINT32_MAX;
+}
+
+/*!
+ * \brief Determine whether a shared file should be read with O_DIRECT.
+ *
+ * \warning The caller must hold the lock on the table.
+ *
+ * \param[in] share Table to act on
+ * \param[in] slot  Slot of the file
+ *
+ * \return true if the file should be read with O_DIRECT, false if not
+ */
+bool simpleshare_is_direct(const simpleshare_t share, uint32_t slot)
+{
+	return (share->slots[slot - 1].direct != 0);
+}
+
+/*!
+ * \brief Get the downloads of a shared file reserved for clients.
+ *
+ * \warning The caller must hold the lock on the table, and the list may only
+ * be touched with the lock on the reservations held (see simpleclaim_lock()).
+ *
+ * \param[in] share Table to act on
+ * \param[in] slot  Slot of the file
+ *
+ * \return the list of reservations of the file
+ */
+struct simpleclaim_list* simpleshare_get_claims(simpleshare_t share, uint32_t slot)
+{
+	return &share->slots[slot - 1].claims;
+}
+
+/*!
+ * \brief Get the number of times a shared file may still be downloaded.
+ *
+ * \warning The caller must hold the lock on the table, unless it is the only
+ * process which changes the files in it.
+ *
+ * \param[in] share Table to act on
+ * \param[in] slot  Slot of the file
+ *
+ * \return the COUNT of the file (0 is unlimited), or SIMPLESHARE_EXPIRED if
+ * the file has been downloaded as many times as it may be
+ */
+uint32_t simpleshare_get_count(simpleshare_t share, uint32_t slot)
+{
+	return __atomic_load_n(&share->slots[slot - 1].count, __ATOMIC_RELAXED);
+}
+
+/*!
+ * \brief Count a download of a shared file.
+ *
+ * \note The slot of the file is marked, so simpleshare_reap() catches the
+ * list of files up with the download.
+ *
+ * \warning The caller must hold the lock on the table.
+ *
+ * \param[in] share    Table to act on
+ * \param[in] slot     Slot of the file
+ * \param[out] is_last Is this the last time the file may be downloaded?
+ *
+ * \return true if the download was counted (or the file may be downloaded an
+ * unlimited number of times), false if the file has already been downloaded
+ * as many times as it may be
+ */
+bool simpleshare_count_download(simpleshare_t share, uint32_t slot, bool* is_last)
+{
+	uint32_t* p = &share->slots[slot - 1].count; // COUNT of the file
+	uint32_t count;                              // Number of times the file may still be downloaded
+
+	// Other processes may be counting downloads of the same file.
+	count = __atomic_load_n(p, __ATOMIC_RELAXED);
+	do
+	{
+		if(count == SIMPLESHARE_EXPIRED) return false;
+		if(count == 0) break;
+	}
+	while(__atomic_compare_exchange_n(p, &count, (count == 1) ? SIMPLESHARE_EXPIRED : count - 1,
+		true, __ATOMIC_RELAXED, __ATOMIC_RELAXED) == false);
+
+	if(count > 0) simpleshare_mark(share, slot);
+	*is_last = (count == 1);
+
+	return true;
+}
+
+/*!
+ * \brief Mark a slot of a table of shared files, so simpleshare_reap() hands
+ * it over.
+ *
+ * \param[in] share Table to act on
+ * \param[in] slot  Slot to mark
+ */
+void simpleshare_mark(simpleshare_t share, uint32_t slot)
+{
+	uint32_t i = slot - 1; // Bit of the slot
+
+	// The word is marked first, so the reaper never clears the word mark before the slot mark.
+	__atomic_fetch_or(&share->dirty[i / 64], UINT64_C(1) << (i % 64), __ATOMIC_RELEASE);
+	__atomic_fetch_or(&share->dirty_words[i / 4096], UINT64_C(1) << (i / 64 % 64), __ATOMIC_RELEASE);
+}
+
+/*!
+ * \brief Hand over and unmark every slot marked since the last time.
+ *
+ * \note Only the slots marked are looked at, so the cost depends on the
+ * number of files downloaded in the meantime, not on the number of files
+ * being shared.
+ *
+ * \param[in] share Table to act on
+ * \param[in] reap  Function to call with each slot marked
+ * \param[in] arg   Argument to pass to the function
+ */
+void simpleshare_reap(simpleshare_t share, simpleshare_reap_t reap, void* arg)
+{
+	for(uint32_t i = 0; i < SP_SHARE_DIRTY / 64; ++i)
+	{
+		uint64_t words; // Words of the bitmap marked
+
+		if(__atomic_load_n(&share->dirty_words[i], __ATOMIC_RELAXED) == 0) continue;
+
+		words = __atomic_exchange_n(&share->dirty_words[i], 0, __ATOMIC_ACQUIRE);
+		for(; words; words &= words - 1)
+		{
+			uint32_t word = i * 64 + (uint32_t) __builtin_ctzll(words); // Word of the bitmap
+			uint64_t slots;                                             // Slots marked in the word
+
+			slots = __atomic_exchange_n(&share->dirty[word], 0, __ATOMIC_ACQUIRE);
+			for(; slots; slots &= slots - 1)
+			{
+				reap(word * 64 + (uint32_t) __builtin_ctzll(slots) + 1, arg);
+			}
+		}
+	}
+}
@@ -0,0 +1,81 @@
+/*
+ * SimplePost - A Simple HTTP Server
+ *
+ * Copyright (C) 2016 Karl Lenz.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have recieved a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ */
+
+#ifndef _SIMPLESHARE_H_
+#define _SIMPLESHARE_H_
+
+#include "simpleclaim.h"
+
+#include <sys/types.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+
+/// COUNT of a shared file which has been downloaded as many times as it may be
+#define SIMPLESHARE_EXPIRED UINT32_MAX
+
+/*!
+ * \brief Table of files shared by the processes serving HTTP requests
+ *
+ * Slots of the table are numbered from one, so zero may stand for no slot.
+ */
+typedef struct simpleshare* simpleshare_t;
+
+/*!
+ * \brief Function called by simpleshare_reap() for each slot marked
+ *
+ * \param[in] slot Slot marked
+ * \param[in] arg  Argument given to simpleshare_reap()
+ */
+typedef void (*simpleshare_reap_t)(uint32_t slot, void* arg);
+
+simpleshare_t simpleshare_map();
+void simpleshare_unmap(simpleshare_t share);
+
+void simpleshare_rdlock(simpleshare_t share);
+void simpleshare_wrlock(simpleshare_t share);
+void simpleshare_unlock(simpleshare_t share);
+
+void simpleshare_clear(simpleshare_t share);
+uint32_t simpleshare_put(
+	simpleshare_t share,
+	const char* uri,
+	const char* file,
+	const char* mime_type,
+	uint32_t count,
+	bool is_direct);
+void simpleshare_update(simpleshare_t share, uint32_t slot, uint32_t count, bool is_direct);
+void simpleshare_remove(simpleshare_t share, uint32_t slot);
+uint32_t simpleshare_find(const simpleshare_t share, const char* uri);
+
+const char* simpleshare_get_uri(const simpleshare_t share, uint32_t slot);
+const char* simpleshare_get_file(const simpleshare_t share, uint32_t slot);
+const char* simpleshare_get_mime_type(const simpleshare_t share, uint32_t slot);
+void simpleshare_set_mime_type(simpleshare_t share, uint32_t slot, const char* mime_type);
+bool simpleshare_is_direct(const simpleshare_t share, uint32_t slot);
+struct simpleclaim_list* simpleshare_get_claims(simpleshare_t share, uint32_t slot);
+
+uint32_t simpleshare_get_count(simpleshare_t share, uint32_t slot);
+bool simpleshare_count_download(simpleshare_t share, uint32_t slot, bool* is_last);
+void simpleshare_mark(simpleshare_t share, uint32_t slot);
+void simpleshare_reap(simpleshare_t share, simpleshare_reap_t reap, void* arg);
+
+#endif // _SIMPLESHARE_H_
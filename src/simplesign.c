@@ -0,0 +1,601 @@
+/*
+ * SimplePost - A Simple HTTP Server
+ *
+ * Copyright (C) 2016 Karl Lenz.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have recieved a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ */
+
+#include "simplesign.h"
+#include "impact.h"
+#include "config.h"
+
+#include <inttypes.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <errno.h>
+
+/// Signing namespace header
+#define SP_SIGN_HEADER_NAMESPACE "SimplePost::Sign"
+
+/// Size (in bytes) of a block of SHA-256
+#define SP_SIGN_BLOCK 64
+
+/// Device random link identifiers are read from
+#define SP_SIGN_RANDOM "/dev/urandom"
+
+/*!
+ * \brief State of a SHA-256 hash
+ */
+struct simplesign_sha256
+{
+	/// Intermediate hash value
+	uint32_t state[8];
+
+	/// Number of bytes hashed so far
+	uint64_t length;
+
+	/// Bytes waiting for a full block
+	unsigned char block[SP_SIGN_BLOCK];
+
+	/// Number of bytes in block
+	size_t block_used;
+};
+
+/*!
+ * \brief Key signed links are made and checked with
+ *
+ * HMAC hashes the key, padded two different ways, ahead of every message. The
+ * state of both hashes after the padded key is kept instead of the key, so
+ * checking a link hashes only the link and the inner digest.
+ */
+struct simplesign_key
+{
+	/// Hash of the key XORed with the inner pad
+	struct simplesign_sha256 inner;
+
+	/// Hash of the key XORed with the outer pad
+	struct simplesign_sha256 outer;
+};
+
+/// Round constants of SHA-256
+static const uint32_t __sha256_k[64] =
+{
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+/// Rotate a 32-bit word right
+#define SP_SIGN_ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+/*!
+ * \brief Overwrite memory holding (something derived from) a key.
+ *
+ * \param[out] buf  Memory to overwrite
+ * \param[in] size  Size (in bytes) of buf
+ */
+static void __wipe(void* buf, size_t size)
+{
+	// The compiler may not drop stores through a volatile pointer.
+	volatile unsigned char* p = (volatile unsigned char*) buf;
+	while(size--) *p++ = 0;
+}
+
+/*!
+ * \brief Start a SHA-256 hash.
+ *
+ * \param[out] ctx Hash to start
+ */
+static void __sha256_init(struct simplesign_sha256* ctx)
+{
+	ctx->state[0] = 0x6a09e667;
+	ctx->state[1] = 0xbb67ae85;
+	ctx->state[2] = 0x3c6ef372;
+	ctx->state[3] = 0xa54ff53a;
+	ctx->state[4] = 0x510e527f;
+	ctx->state[5] = 0x9b05688c;
+	ctx->state[6] = 0x1f83d9ab;
+	ctx->state[7] = 0x5be0cd19;
+	ctx->length = 0;
+	ctx->block_used = 0;
+}
+
+/*!
+ * \brief Hash a block into the state of SHA-256.
+ *
+ * \param[inout] state Intermediate hash value
+ * \param[in] block    Block of SP_SIGN_BLOCK bytes to hash
+ */
+static void __sha256_compress(uint32_t* state, const unsigned char* block)
+{
+	uint32_t w[64]; // Message schedule
+	uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+	uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+	for(size_t i = 0; i < 16; ++i)
+	{
+		w[i] = ((uint32_t) block[i * 4] << 24) | ((uint32_t) block[i * 4 + 1] << 16) |
+			((uint32_t) block[i * 4 + 2] << 8) | (uint32_t) block[i * 4 + 3];
+	}
+	for(size_t i = 16; i < 64; ++i)
+	{
+		uint32_t s0 = SP_SIGN_ROTR(w[i - 15], 7) ^ SP_SIGN_ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+		uint32_t s1 = SP_SIGN_ROTR(w[i - 2], 17) ^ SP_SIGN_ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+		w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+	}
+
+	for(size_t i = 0; i < 64; ++i)
+	{
+		uint32_t t1 = h + (SP_SIGN_ROTR(e, 6) ^ SP_SIGN_ROTR(e, 11) ^ SP_SIGN_ROTR(e, 25)) + ((e & f) ^ (~e & g)) + __sha256_k[i] + w[i];
+		uint32_t t2 = (SP_SIGN_ROTR(a, 2) ^ SP_SIGN_ROTR(a, 13) ^ SP_SIGN_ROTR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+		h = g;
+		g = f;
+		f = e;
+		e = d + t1;
+		d = c;
+		c = b;
+		b = a;
+		a = t1 + t2;
+	}
+
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+	state[4] += e;
+	state[5] += f;
+	state[6] += g;
+	state[7] += h;
+}
+
+/*!
+ * \brief Add data to a SHA-256 hash.
+ *
+ * \param[inout] ctx Hash to act on
+ * \param[in] data   Data to hash
+ * \param[in] size   Size (in bytes) of the data
+ */
+static void __sha256_update(struct simplesign_sha256* ctx, const void* data, size_t size)
+{
+	const unsigned char* p = (const unsigned char*) data; // Next byte to hash
+
+	ctx->length += size;
+
+	if(ctx->block_used)
+	{
+		size_t n = SP_SIGN_BLOCK - ctx->block_used; // Bytes needed to fill the block
+		if(n > size) n = size;
+
+		memcpy(ctx->block + ctx->block_used, p, n);
+		ctx->block_used += n;
+		p += n;
+		size -= n;
+
+		if(ctx->block_used < SP_SIGN_BLOCK) return;
+		__sha256_compress(ctx->state, ctx->block);
+		ctx->block_used = 0;
+	}
+
+	for(; size >= SP_SIGN_BLOCK; p += SP_SIGN_BLOCK, size -= SP_SIGN_BLOCK)
+	{
+		__sha256_compress(ctx->state, p);
+	}
+
+	memcpy(ctx->block, p, size);
+	ctx->block_used = size;
+}
+
+/*!
+ * \brief Finish a SHA-256 hash.
+ *
+ * \param[inout] ctx  Hash to finish (it must be started again to be reused)
+ * \param[out] digest Digest of SIMPLESIGN_SIZE bytes
+ */
+static void __sha256_final(struct simplesign_sha256* ctx, unsigned char* digest)
+{
+	uint64_t bits = ctx->length * 8; // Length of the message (in bits)
+
+	ctx->block[ctx->block_used++] = 0x80;
+	if(ctx->block_used > SP_SIGN_BLOCK - 8)
+	{
+		memset(ctx->block + ctx->block_used, 0, SP_SIGN_BLOCK - ctx->block_used);
+		__sha256_compress(ctx->state, ctx->block);
+		ctx->block_used = 0;
+	}
+	memset(ctx->block + ctx->block_used, 0, SP_SIGN_BLOCK - 8 - ctx->block_used);
+	for(size_t i = 0; i < 8; ++i) ctx->block[SP_SIGN_BLOCK - 1 - i] = (unsigned char) (bits >> (i * 8));
+	__sha256_compress(ctx->state, ctx->block);
+
+	for(size_t i = 0; i < 8; ++i)
+	{
+		digest[i * 4] = (unsigned char) (ctx->state[i] >> 24);
+		digest[i * 4 + 1] = (unsigned char) (ctx->state[i] >> 16);
+		digest[i * 4 + 2] = (unsigned char) (ctx->state[i] >> 8);
+		digest[i * 4 + 3] = (unsigned char) ctx->state[i];
+	}
+}
+
+/*!
+ * \brief Sign a link.
+ *
+ * The signature is the HMAC-SHA-256 of the URI, expiry time, COUNT, and
+ * identifier of the link, each on a line of its own (without a newline after
+ * the last one). The numbers are written the way simplesign_sign_uri() puts
+ * them in the link, which is the only way simplesign_check_uri() accepts them.
+ *
+ * \param[in] key        Key to sign the link with
+ * \param[in] uri        URI of the file the link is for
+ * \param[in] expires    Time (seconds since the Epoch) the link stops working
+ * \param[in] count      Number of times the link may be downloaded (0 = unlimited)
+ * \param[in] id         Identifier of the link
+ * \param[out] signature Signature of SIMPLESIGN_SIZE bytes
+ */
+static void __sign(
+	const simplesign_key_t key,
+	const char* uri,
+	time_t expires,
+	unsigned int count,
+	uint64_t id,
+	unsigned char* signature)
+{
+	struct simplesign_sha256 ctx;         // Hash being computed
+	unsigned char inner[SIMPLESIGN_SIZE]; // Digest of the inner hash
+	char fields[64];                      // Everything after the URI
+	int length;                           // Length of fields
+
+	length = snprintf(fields, sizeof(fields), "\n%lld\n%u\n%016" PRIx64, (long long) expires, count, id);
+
+	ctx = key->inner;
+	__sha256_update(&ctx, uri, strlen(uri));
+	__sha256_update(&ctx, fields, (size_t) length);
+	__sha256_final(&ctx, inner);
+
+	ctx = key->outer;
+	__sha256_update(&ctx, inner, sizeof(inner));
+	__sha256_final(&ctx, signature);
+}
+
+/*!
+ * \brief Parse a number from a signed link.
+ *
+ * \param[in] str   String to parse
+ * \param[in] max   Largest value accepted
+ * \param[out] value Number parsed
+ *
+ * \return true if the string is a decimal number no larger than max, written
+ * without a sign or leading zeros, false if not
+ */
+static bool __parse_number(const char* str, unsigned long long max, unsigned long long* value)
+{
+	*value = 0;
+
+	if(str == NULL || str[0] < '0' || str[0] > '9') return false;
+	if(str[0] == '0' && str[1] != '\0') return false;
+
+	for(const char* p = str; *p; ++p)
+	{
+		if(*p < '0' || *p > '9') return false;
+		if(*value > (max - (unsigned long long) (*p - '0')) / 10) return false;
+		*value = *value * 10 + (unsigned long long) (*p - '0');
+	}
+
+	return true;
+}
+
+/*!
+ * \brief Parse lowercase hexadecimal from a signed link.
+ *
+ * \param[in] str   String to parse
+ * \param[out] buf  Buffer to receive the bytes
+ * \param[in] size  Number of bytes the string must encode
+ *
+ * \return true if the string is exactly size bytes of lowercase hexadecimal,
+ * false if not
+ */
+static bool __parse_hex(const char* str, unsigned char* buf, size_t size)
+{
+	if(str == NULL) return false;
+
+	for(size_t i = 0; i < size * 2; ++i)
+	{
+		unsigned char nibble; // Value of the digit
+
+		if(str[i] >= '0' && str[i] <= '9') nibble = (unsigned char) (str[i] - '0');
+		else if(str[i] >= 'a' && str[i] <= 'f') nibble = (unsigned char) (str[i] - 'a' + 10);
+		else return false;
+
+		if(i % 2) buf[i / 2] |= nibble;
+		else buf[i / 2] = (unsigned char) (nibble << 4);
+	}
+
+	return str[size * 2] == '\0';
+}
+
+/*!
+ * \brief Read the key signed links are made and checked with.
+ *
+ * \note Every byte of the file is part of the key except a newline at its
+ * end, so a key may be random bytes or the text of random hexadecimal digits.
+ * Whoever can read the key can make links to every file on any instance using
+ * it, so it should be readable by nobody else.
+ *
+ * \param[in] file Name and path of the file holding the key
+ *
+ * \return the key, or NULL if it could not be read or is too short
+ */
+simplesign_key_t simplesign_key_init(const char* file)
+{
+	unsigned char buf[SIMPLESIGN_KEY_MAX + 1]; // Contents of the file
+	unsigned char pad[SP_SIGN_BLOCK];          // Key padded to a block
+	size_t length = 0;                         // Length of the key
+	simplesign_key_t key = NULL;               // Key to return
+	ssize_t n;                                 // Number of bytes read
+	int fd;                                    // File descriptor of the file
+
+	fd = open(file, O_RDONLY);
+	if(fd == -1)
+	{
+		impact(0, "%s: Cannot open the key %s: %s\n",
+			SP_SIGN_HEADER_NAMESPACE,
+			file, strerror(errno));
+		return NULL;
+	}
+
+	while(length < sizeof(buf) && (n = read(fd, buf + length, sizeof(buf) - length)) != 0)
+	{
+		if(n == -1)
+		{
+			if(errno == EINTR) continue;
+			impact(0, "%s: Cannot read the key %s: %s\n",
+				SP_SIGN_HEADER_NAMESPACE,
+				file, strerror(errno));
+			close(fd);
+			goto error;
+		}
+		length += (size_t) n;
+	}
+	close(fd);
+
+	if(length > SIMPLESIGN_KEY_MAX)
+	{
+		impact(0, "%s: The key %s is longer than %d bytes\n",
+			SP_SIGN_HEADER_NAMESPACE,
+			file, SIMPLESIGN_KEY_MAX);
+		goto error;
+	}
+
+	if(length && buf[length - 1] == '\n') --length;
+	if(length && buf[length - 1] == '\r') --length;
+	if(length < SIMPLESIGN_KEY_MIN)
+	{
+		impact(0, "%s: The key %s must be at least %d bytes long\n",
+			SP_SIGN_HEADER_NAMESPACE,
+			file, SIMPLESIGN_KEY_MIN);
+		goto error;
+	}
+
+	key = (simplesign_key_t) malloc(sizeof(struct simplesign_key));
+	if(key == NULL)
+	{
+		impact(0, "%s: %s: Failed to allocate memory for the key %s\n",
+			SP_SIGN_HEADER_NAMESPACE, SP_MAIN_HEADER_MEMORY_ALLOC,
+			file);
+		goto error;
+	}
+
+	// Keys longer than a block are hashed first, as HMAC requires.
+	memset(pad, 0, sizeof(pad));
+	if(length > SP_SIGN_BLOCK)
+	{
+		__sha256_init(&key->inner);
+		__sha256_update(&key->inner, buf, length);
+		__sha256_final(&key->inner, pad);
+	}
+	else
+	{
+		memcpy(pad, buf, length);
+	}
+
+	for(size_t i = 0; i < sizeof(pad); ++i) pad[i] ^= 0x36;
+	__sha256_init(&key->inner);
+	__sha256_update(&key->inner, pad, sizeof(pad));
+
+	for(size_t i = 0; i < sizeof(pad); ++i) pad[i] ^= 0x36 ^ 0x5c;
+	__sha256_init(&key->outer);
+	__sha256_update(&key->outer, pad, sizeof(pad));
+
+error:
+	__wipe(buf, sizeof(buf));
+	__wipe(pad, sizeof(pad));
+
+	return key;
+}
+
+/*!
+ * \brief Free a key.
+ *
+ * \param[in] key Key to free
+ */
+void simplesign_key_free(simplesign_key_t key)
+{
+	if(key == NULL) return;
+
+	__wipe(key, sizeof(struct simplesign_key));
+	free(key);
+}
+
+/*!
+ * \brief Get a random identifier for a new link.
+ *
+ * \note Links which are otherwise the same but for their identifiers are
+ * counted separately, so each recipient of a file should get a link with an
+ * identifier of its own.
+ *
+ * \param[out] id Identifier of the link
+ *
+ * \return true if the identifier was generated, false if not
+ */
+bool simplesign_get_id(uint64_t* id)
+{
+	size_t length = 0; // Number of bytes read
+	ssize_t n;         // Number of bytes read by the last read()
+	int fd;            // File descriptor of SP_SIGN_RANDOM
+
+	fd = open(SP_SIGN_RANDOM, O_RDONLY);
+	if(fd == -1)
+	{
+		impact(0, "%s: Cannot open %s: %s\n",
+			SP_SIGN_HEADER_NAMESPACE,
+			SP_SIGN_RANDOM, strerror(errno));
+		return false;
+	}
+
+	while(length < sizeof(*id))
+	{
+		n = read(fd, (unsigned char*) id + length, sizeof(*id) - length);
+		if(n == -1 && errno == EINTR) continue;
+		if(n <= 0)
+		{
+			impact(0, "%s: Cannot read %s: %s\n",
+				SP_SIGN_HEADER_NAMESPACE,
+				SP_SIGN_RANDOM, n ? strerror(errno) : "Unexpected end of file");
+			close(fd);
+			return false;
+		}
+		length += (size_t) n;
+	}
+	close(fd);
+
+	return true;
+}
+
+/*!
+ * \brief Make a signed link to a file.
+ *
+ * The link is the URI followed by a query string holding the expiry time,
+ * COUNT, identifier, and signature of the link:
+ *
+ *   URI?expires=EXPIRES&count=COUNT&id=ID&signature=SIGNATURE
+ *
+ * An instance with the same key serves the file on the URI to whoever
+ * requests the link, until it expires or has been downloaded COUNT times,
+ * without keeping any record of the link before it is first downloaded.
+ *
+ * \param[in] key     Key to sign the link with
+ * \param[out] buf    Buffer to receive the link
+ * \param[in] size    Size (in bytes) of buf
+ * \param[in] uri     URI of the file to link to
+ * \param[in] count   Number of times the link may be downloaded (0 = unlimited)
+ * \param[in] expires Time (seconds since the Epoch) the link stops working
+ * \param[in] id      Identifier of the link (see simplesign_get_id())
+ *
+ * \return the number of characters written to the buffer, excluding the NULL-
+ * terminating character. If there was an error, zero will be returned instead.
+ */
+size_t simplesign_sign_uri(
+	const simplesign_key_t key,
+	char* buf,
+	size_t size,
+	const char* uri,
+	unsigned int count,
+	time_t expires,
+	uint64_t id)
+{
+	unsigned char signature[SIMPLESIGN_SIZE]; // Signature of the link
+	int ret;                                  // snprintf() return code
+	size_t len;                               // Length of the string written to the buffer
+
+	if(key == NULL || buf == NULL || uri == NULL || uri[0] != '/' || expires <= 0) return 0;
+
+	// The query string starts at the first "?" or "#" of the link.
+	if(strpbrk(uri, "?#")) return 0;
+
+	__sign(key, uri, expires, count, id, signature);
+
+	ret = snprintf(buf, size, "%s?expires=%lld&count=%u&id=%016" PRIx64 "&signature=",
+		uri, (long long) expires, count, id);
+	if(ret <= 0 || (size_t) ret + SIMPLESIGN_SIZE * 2 >= size) return 0;
+	len = (size_t) ret;
+
+	for(size_t i = 0; i < SIMPLESIGN_SIZE; ++i)
+	{
+		len += (size_t) sprintf(buf + len, "%02x", signature[i]);
+	}
+
+	return len;
+}
+
+/*!
+ * \brief Check the signature of a link.
+ *
+ * \note This function only checks that the link was signed with the key. Its
+ * caller decides whether the link has expired or been downloaded too often.
+ *
+ * \param[in] key       Key the link must be signed with
+ * \param[in] uri       URI the link is for
+ * \param[in] expires   Expiry time given in the link
+ * \param[in] count     COUNT given in the link
+ * \param[in] id        Identifier given in the link
+ * \param[in] signature Signature given in the link
+ * \param[out] link     Expiry time, COUNT, and signature of the link
+ *
+ * \return true if the link was signed with the key, false if any part of it is
+ * missing, malformed, or was changed
+ */
+bool simplesign_check_uri(
+	const simplesign_key_t key,
+	const char* uri,
+	const char* expires,
+	const char* count,
+	const char* id,
+	const char* signature,
+	struct simplesign_link* link)
+{
+	unsigned char given[SIMPLESIGN_SIZE]; // Signature given in the link
+	unsigned char id_bytes[8];            // Identifier given in the link
+	unsigned long long expires_value;     // Expiry time given in the link
+	unsigned long long count_value;       // COUNT given in the link
+	uint64_t id_value = 0;                // Identifier given in the link
+	unsigned char diff = 0;               // Bits in which the signatures differ
+
+	if(key == NULL || uri == NULL) return false;
+	if(__parse_number(expires, LLONG_MAX, &expires_value) == false || expires_value == 0) return false;
+	if(__parse_number(count, UINT_MAX, &count_value) == false) return false;
+	if(__parse_hex(id, id_bytes, sizeof(id_bytes)) == false) return false;
+	if(__parse_hex(signature, given, sizeof(given)) == false) return false;
+	if((time_t) expires_value <= 0) return false;
+
+	for(size_t i = 0; i < sizeof(id_bytes); ++i) id_value = (id_value << 8) | id_bytes[i];
+
+	link->expires = (time_t) expires_value;
+	link->count = (unsigned int) count_value;
+	__sign(key, uri, link->expires, link->count, id_value, link->signature);
+
+	// Compare every byte, so the time taken says nothing about the signature.
+	for(size_t i = 0; i < SIMPLESIGN_SIZE; ++i) diff |= given[i] ^ link->signature[i];
+
+	return diff == 0;
+}
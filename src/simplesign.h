@@ -0,0 +1,84 @@
+/*
+ * SimplePost - A Simple HTTP Server
+ *
+ * Copyright (C) 2016 Karl Lenz.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have recieved a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ */
+
+#ifndef _SIMPLESIGN_H_
+#define _SIMPLESIGN_H_
+
+#include <sys/types.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+
+/// Size (in bytes) of a signature
+#define SIMPLESIGN_SIZE 32
+
+/// Fewest bytes a key may have
+#define SIMPLESIGN_KEY_MIN 16
+
+/// Most bytes a key file may have
+#define SIMPLESIGN_KEY_MAX 4096
+
+
+/*!
+ * \brief Key signed links are made and checked with
+ */
+typedef struct simplesign_key* simplesign_key_t;
+
+/*!
+ * \brief Signed link which has been checked
+ */
+struct simplesign_link
+{
+	/// Time (seconds since the Epoch) the link stops working
+	time_t expires;
+
+	/// Number of times the link may be downloaded (0 = unlimited)
+	unsigned int count;
+
+	/// Signature of the link, which identifies it
+	unsigned char signature[SIMPLESIGN_SIZE];
+};
+
+simplesign_key_t simplesign_key_init(const char* file);
+void simplesign_key_free(simplesign_key_t key);
+
+bool simplesign_get_id(uint64_t* id);
+
+size_t simplesign_sign_uri(
+	const simplesign_key_t key,
+	char* buf,
+	size_t size,
+	const char* uri,
+	unsigned int count,
+	time_t expires,
+	uint64_t id);
+
+bool simplesign_check_uri(
+	const simplesign_key_t key,
+	const char* uri,
+	const char* expires,
+	const char* count,
+	const char* id,
+	const char* signature,
+	struct simplesign_link* link);
+
+#endif // _SIMPLESIGN_H_
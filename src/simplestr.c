@@ -23,6 +23,7 @@
 
 #include <string.h>
 #include <stdio.h>
+#include <time.h>
 
 /*!
  * \brief Convert the COUNT to a string.
@@ -61,6 +62,32 @@ size_t simplestr_count_to_str(char* buf, size_t size, unsigned int count)
 	return 0;
 }
 
+/*!
+ * \brief Convert the expiry time of a file to a string.
+ *
+ * \param[out] buf     Buffer to receive the expiry string
+ * \param[in] size     Size (in bytes) of buf
+ * \param[in] expires  Time (seconds since the Epoch) the file expires
+ *
+ * \return the number of characters written to the buffer, excluding the NULL-
+ * terminating character. If there was an error, or the file never expires
+ * (expires = 0), zero will be returned instead.
+ */
+size_t simplestr_expiry_to_str(char* buf, size_t size, time_t expires)
+{
+	struct tm tm; // Expiry time in the local time zone
+	size_t len;   // Length of the string written to the buffer
+
+	if(buf == NULL || expires == 0 || size <= 6) return 0;
+	if(localtime_r(&expires, &tm) == NULL) return 0;
+
+	strcpy(buf, "until ");
+	len = strftime(buf + 6, size - 6, "%Y-%m-%d %H:%M:%S %Z", &tm);
+	if(len == 0) return 0;
+
+	return len + 6;
+}
+
 /*!
  * \brief Construct a URI from the given FILE or URI.
  *
@@ -168,7 +195,7 @@ size_t simplestr_get_url(
  * This function creates a nicely formatted string to print the given
  * parameters to the console. This string is not really useful for parsing or
  * doing anything automated, just nice output. It will be in the format of,
- * "Serving FILE on URL COUNT times".
+ * "Serving FILE on URL COUNT times [until EXPIRES]".
  *
  * \param[out] buf    Buffer to receive the URI string
  * \param[in] size    Size (in bytes) of buf
@@ -177,6 +204,7 @@ size_t simplestr_get_url(
  * \param[in] port    PORT to convert
  * \param[in] uri     Optional URI to convert
  * \param[in] count   COUNT to convert
+ * \param[in] expires Optional expiry time to convert (0 = never)
  *
  * \return the number of characters written to the buffer, excluding the NULL-
  * terminating character. If there was an error, zero will be returned instead.
@@ -188,11 +216,12 @@ size_t simplestr_get_serving_str(
 	const char* address,
 	unsigned short port,
 	const char* uri,
-	unsigned int count)
+	unsigned int count,
+	time_t expires)
 {
 	if(buf == NULL || file == NULL || address == NULL || port == 0) return 0;
 
-	size_t ret;     // simplestr_get_url() or simplestr_count_to_str() return code
+	size_t ret;     // simplestr_get_url(), simplestr_count_to_str(), or simplestr_expiry_to_str() return code
 	size_t len = 0; // Length of the string written to the buffer
 
 	len += 8;
@@ -219,5 +248,16 @@ size_t simplestr_get_serving_str(
 	if(ret == 0) return 0;
 	len += ret;
 
+	if(expires)
+	{
+		++len;
+		if(size <= len) return 0;
+		strcat(buf, " ");
+
+		ret = simplestr_expiry_to_str(buf + len, size - len, expires);
+		if(ret == 0) return 0;
+		len += ret;
+	}
+
 	return len;
 }
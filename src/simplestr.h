@@ -25,6 +25,7 @@
 #include <sys/types.h>
 
 size_t simplestr_count_to_str(char* buf, size_t size, unsigned int count);
+size_t simplestr_expiry_to_str(char* buf, size_t size, time_t expires);
 
 size_t simplestr_get_uri(
 	char* buf,
@@ -47,6 +48,7 @@ size_t simplestr_get_serving_str(
 	const char* address,
 	unsigned short port,
 	const char* uri,
-	unsigned int count);
+	unsigned int count,
+	time_t expires);
 
 #endif // _SIMPLESTR_H_
@@ -0,0 +1,313 @@
+/*
+ * SimplePost - A Simple HTTP Server
+ *
+ * Copyright (C) 2016 Karl Lenz.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have recieved a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ */
+
+#include "simpletimer.h"
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/// Number of bits of the expiry time each level of the timing wheel covers
+#define SP_TIMER_BITS   6
+
+/// Number of slots in each level of the timing wheel
+#define SP_TIMER_SLOTS  (1 << SP_TIMER_BITS)
+
+/// Number of levels in the timing wheel (together they cover 2^24 seconds, about 194 days)
+#define SP_TIMER_LEVELS 4
+
+/*!
+ * \brief Timer queued in a timing wheel
+ */
+struct simpletimer
+{
+	/// Data the timer was added with
+	void* data;
+
+	/// Time (seconds since the Epoch) the timer expires
+	time_t expires;
+
+	/// Next timer in the same slot of the wheel
+	struct simpletimer* next;
+
+	/// Pointer to this timer in the slot or in the previous timer (NULL if it is not queued)
+	struct simpletimer** pprev;
+};
+
+/*!
+ * \brief Hierarchical timing wheel with one-second ticks
+ *
+ * Each level has SP_TIMER_SLOTS slots, and each slot of a level spans as many
+ * seconds as the whole level below it. Timers are queued in the lowest level
+ * whose span reaches them.
+ */
+struct simpletimer_wheel
+{
+	/// Slots of each level, each holding a list of timers
+	struct simpletimer* slots[SP_TIMER_LEVELS][SP_TIMER_SLOTS];
+
+	/// Last second (since the Epoch) the wheel has expired the timers of
+	time_t time;
+
+	/// Number of timers added to the wheel
+	size_t count;
+};
+
+/*!
+ * \brief Queue a timer in a timing wheel.
+ *
+ * \note The level of the wheel is chosen by how far away the expiry time is,
+ * and the slot within it by the expiry time itself, so queueing a timer takes
+ * the same time however many others there are. A timer further away than the
+ * whole wheel reaches is queued as far away as it can be, and queued again
+ * once the wheel gets there.
+ *
+ * \param[inout] wheel Wheel to queue the timer in
+ * \param[in] timer    Timer to queue (which must not already be queued)
+ * \param[in] now      Next second the wheel will expire the timers of
+ */
+static void __queue(simpletimer_wheel_t wheel, simpletimer_t timer, time_t now)
+{
+	const time_t reach = ((time_t) 1 << (SP_TIMER_BITS * SP_TIMER_LEVELS)) - 1; // Furthest the wheel reaches
+	time_t when = timer->expires; // Second to expire the timer in
+	unsigned int level = 0;       // Level of the wheel to queue the timer in
+	simpletimer_t* slot;          // Slot to queue the timer in
+
+	if(when < now) when = now;
+	if(when - now > reach) when = now + reach;
+	while(level < SP_TIMER_LEVELS - 1 && when - now >= ((time_t) 1 << (SP_TIMER_BITS * (level + 1)))) ++level;
+
+	slot = &wheel->slots[level][(when >> (SP_TIMER_BITS * level)) & (SP_TIMER_SLOTS - 1)];
+	timer->next = *slot;
+	if(timer->next) timer->next->pprev = &timer->next;
+	timer->pprev = slot;
+	*slot = timer;
+}
+
+/*!
+ * \brief Take a timer out of the slot it is queued in.
+ *
+ * \param[inout] timer Timer to unqueue (nothing happens if it is not queued)
+ */
+static void __unqueue(simpletimer_t timer)
+{
+	if(timer->pprev == NULL) return;
+
+	*(timer->pprev) = timer->next;
+	if(timer->next) timer->next->pprev = timer->pprev;
+
+	timer->next = NULL;
+	timer->pprev = NULL;
+}
+
+/*!
+ * \brief Create an empty timing wheel.
+ *
+ * \return an empty timing wheel, or NULL if we failed to allocate one
+ */
+simpletimer_wheel_t simpletimer_wheel_init()
+{
+	return (simpletimer_wheel_t) calloc(1, sizeof(struct simpletimer_wheel));
+}
+
+/*!
+ * \brief Free a timing wheel and every timer still in it.
+ *
+ * \param[in] wheel Wheel to free
+ */
+void simpletimer_wheel_free(simpletimer_wheel_t wheel)
+{
+	if(wheel == NULL) return;
+
+	for(unsigned int level = 0; level < SP_TIMER_LEVELS; ++level)
+	{
+		for(unsigned int slot = 0; slot < SP_TIMER_SLOTS; ++slot)
+		{
+			simpletimer_t p = wheel->slots[level][slot]; // Timer to free
+
+			while(p)
+			{
+				simpletimer_t next = p->next; // Next timer in the slot
+				free(p);
+				p = next;
+			}
+		}
+	}
+
+	free(wheel);
+}
+
+/*!
+ * \brief Add a timer to a timing wheel.
+ *
+ * \note A wheel stands still while it is empty, so the first timer added to
+ * it catches it up to the current second first.
+ *
+ * \param[inout] wheel Wheel to add the timer to
+ * \param[in] data     Data to pass to the function called when it expires
+ * \param[in] expires  Time (seconds since the Epoch) the timer expires
+ *
+ * \return the timer, or NULL if we failed to allocate one
+ */
+simpletimer_t simpletimer_add(simpletimer_wheel_t wheel, void* data, time_t expires)
+{
+	simpletimer_t timer; // Timer to add
+
+	timer = (simpletimer_t) calloc(1, sizeof(struct simpletimer));
+	if(timer == NULL) return NULL;
+
+	timer->data = data;
+	timer->expires = expires;
+
+	if(wheel->count++ == 0) wheel->time = time(NULL) - 1;
+	__queue(wheel, timer, wheel->time + 1);
+
+	return timer;
+}
+
+/*!
+ * \brief Remove a timer from a timing wheel and free it.
+ *
+ * \param[inout] wheel Wheel the timer was added to
+ * \param[in] timer    Timer to remove
+ */
+void simpletimer_remove(simpletimer_wheel_t wheel, simpletimer_t timer)
+{
+	__unqueue(timer);
+	--(wheel->count);
+	free(timer);
+}
+
+/*!
+ * \brief Change the time a timer expires.
+ *
+ * \note A time which has already passed expires the timer the next time the
+ * wheel advances.
+ *
+ * \param[inout] wheel Wheel the timer was added to
+ * \param[inout] timer Timer to change
+ * \param[in] expires  Time (seconds since the Epoch) the timer expires
+ */
+void simpletimer_set_expiry(simpletimer_wheel_t wheel, simpletimer_t timer, time_t expires)
+{
+	__unqueue(timer);
+	timer->expires = expires;
+	__queue(wheel, timer, wheel->time + 1);
+}
+
+/*!
+ * \brief Get the time a timer expires.
+ *
+ * \param[in] timer Timer to look at
+ *
+ * \return the time (seconds since the Epoch) the timer expires
+ */
+time_t simpletimer_get_expiry(const simpletimer_t timer)
+{
+	return timer->expires;
+}
+
+/*!
+ * \brief Get the number of timers in a timing wheel.
+ *
+ * \param[in] wheel Wheel to look at
+ *
+ * \return the number of timers added to the wheel and not yet removed
+ */
+size_t simpletimer_count(const simpletimer_wheel_t wheel)
+{
+	return wheel->count;
+}
+
+/*!
+ * \brief Advance a timing wheel to the given second, expiring every timer
+ * due by then.
+ *
+ * \note Every second, only the timers in one slot of the first level of the
+ * wheel are looked at. Once every SP_TIMER_SLOTS seconds, the timers in the
+ * next slot of the level above are spread over the level below (and so on up
+ * the levels). A timer is therefore moved at most once per level before it is
+ * due, and the timers which are not due are never looked at, so advancing the
+ * wheel costs the same however many timers it holds.
+ *
+ * \warning The timer given to expire is no longer queued. The function must
+ * either remove it with simpletimer_remove() or queue it again with
+ * simpletimer_set_expiry(). It may not remove any other timer.
+ *
+ * \param[inout] wheel Wheel to advance
+ * \param[in] now      Current time (seconds since the Epoch)
+ * \param[in] expire   Function to call for each timer which expires
+ * \param[in] arg      Argument to pass to expire
+ */
+void simpletimer_advance(simpletimer_wheel_t wheel, time_t now, simpletimer_expire_t expire, void* arg)
+{
+	while(wheel->time < now)
+	{
+		time_t second = wheel->time + 1; // Second to expire the timers of
+		simpletimer_t p;                 // Timer in the slot of that second
+
+		// There is nothing to expire in an empty wheel, so skip straight to now.
+		if(wheel->count == 0)
+		{
+			wheel->time = now;
+			break;
+		}
+
+		/* Timers are measured from the second being expired, so those due
+		 * in it land in the slot of the first level about to be expired.
+		 */
+		for(unsigned int level = SP_TIMER_LEVELS - 1; level > 0; --level)
+		{
+			size_t slot = (second >> (SP_TIMER_BITS * level)) & (SP_TIMER_SLOTS - 1); // Slot to spread
+
+			if((second & (((time_t) 1 << (SP_TIMER_BITS * level)) - 1)) != 0) continue;
+
+			p = wheel->slots[level][slot];
+			wheel->slots[level][slot] = NULL;
+			while(p)
+			{
+				simpletimer_t next = p->next; // Next timer in the slot
+
+				p->pprev = NULL;
+				__queue(wheel, p, second);
+				p = next;
+			}
+		}
+
+		p = wheel->slots[0][second & (SP_TIMER_SLOTS - 1)];
+		wheel->slots[0][second & (SP_TIMER_SLOTS - 1)] = NULL;
+		wheel->time = second;
+
+		while(p)
+		{
+			simpletimer_t next = p->next; // Next timer in the slot
+
+			p->next = NULL;
+			p->pprev = NULL;
+
+			// Timers further away than the wheel reaches come around more than once.
+			if(p->expires > second) __queue(wheel, p, second + 1);
+			else expire(p, p->data, arg);
+
+			p = next;
+		}
+	}
+}
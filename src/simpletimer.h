@@ -0,0 +1,60 @@
+/*
+ * SimplePost - A Simple HTTP Server
+ *
+ * Copyright (C) 2016 Karl Lenz.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have recieved a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ */
+
+#ifndef _SIMPLETIMER_H_
+#define _SIMPLETIMER_H_
+
+#include <sys/types.h>
+#include <stdbool.h>
+#include <time.h>
+
+
+/*!
+ * \brief Hierarchical timing wheel with one-second ticks
+ */
+typedef struct simpletimer_wheel* simpletimer_wheel_t;
+
+/*!
+ * \brief Timer queued in a timing wheel
+ */
+typedef struct simpletimer* simpletimer_t;
+
+/*!
+ * \brief Function called for each timer which expires
+ *
+ * \param[in] timer Timer which expired
+ * \param[in] data  Data the timer was added with
+ * \param[in] arg   Argument given to simpletimer_advance()
+ */
+typedef void (*simpletimer_expire_t)(simpletimer_t timer, void* data, void* arg);
+
+simpletimer_wheel_t simpletimer_wheel_init();
+void simpletimer_wheel_free(simpletimer_wheel_t wheel);
+
+simpletimer_t simpletimer_add(simpletimer_wheel_t wheel, void* data, time_t expires);
+void simpletimer_remove(simpletimer_wheel_t wheel, simpletimer_t timer);
+void simpletimer_set_expiry(simpletimer_wheel_t wheel, simpletimer_t timer, time_t expires);
+time_t simpletimer_get_expiry(const simpletimer_t timer);
+size_t simpletimer_count(const simpletimer_wheel_t wheel);
+
+void simpletimer_advance(simpletimer_wheel_t wheel, time_t now, simpletimer_expire_t expire, void* arg);
+
+#endif // _SIMPLETIMER_H_
@@ -0,0 +1,409 @@
+/*
+ * SimplePost - A Simple HTTP Server
+ *
+ * Copyright (C) 2016 Karl Lenz.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have recieved a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ */
+
+#include "simpletrie.h"
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*!
+ * \brief Node of a radix trie (the trie itself is its root node)
+ *
+ * Each node adds its label to the key of its parent, so the key of a node is
+ * the concatenation of the labels from the root down to it. A node other than
+ * the root which holds no value is merged with its child as soon as it has
+ * only one, so the trie has fewer than twice as many nodes as there are
+ * values in it.
+ */
+struct simpletrie
+{
+	/// Value of the key ending at this node (NULL if there is none)
+	void* value;
+
+	/// Parent of this node (NULL for the root)
+	struct simpletrie* parent;
+
+	/// First child of this node (children are sorted by the first byte of their labels)
+	struct simpletrie* child;
+
+	/// Next child of the parent of this node
+	struct simpletrie* sibling;
+
+	/// Number of bytes in the label
+	size_t length;
+
+	/// Bytes this node adds to the key of its parent (not terminated)
+	char label[];
+};
+
+/*!
+ * \brief Initialize a node of a radix trie.
+ *
+ * \param[in] label  Bytes the node adds to the key of its parent
+ * \param[in] length Number of bytes in the label
+ *
+ * \return a new node on success, or NULL if we failed to allocate the
+ * requested memory
+ */
+static struct simpletrie* __node_init(const char* label, size_t length)
+{
+	struct simpletrie* node; // New node
+
+	node = (struct simpletrie*) malloc(sizeof(struct simpletrie) + length);
+	if(node == NULL) return NULL;
+
+	memset(node, 0, sizeof(struct simpletrie));
+	if(length) memcpy(node->label, label, length);
+	node->length = length;
+
+	return node;
+}
+
+/*!
+ * \brief Find the child of a node of a radix trie whose label starts with the
+ * given byte.
+ *
+ * \param[in] node  Node to search the children of
+ * \param[in] c     First byte of the label of the child
+ * \param[out] pp
+ * \parblock
+ * Link to the child in the list of children, or the link it would be
+ * inserted at if there is no such child
+ *
+ * This argument may be NULL.
+ * \endparblock
+ *
+ * \return the child, or NULL if there is none
+ */
+static struct simpletrie* __find_child(
+	struct simpletrie* node,
+	char c,
+	struct simpletrie*** pp)
+{
+	struct simpletrie** p = &node->child; // Link to the current child
+
+	while(*p && (unsigned char) (*p)->label[0] < (unsigned char) c) p = &(*p)->sibling;
+	if(pp) *pp = p;
+
+	return (*p && (*p)->label[0] == c) ? *p : NULL;
+}
+
+/*!
+ * \brief Find the highest node of a radix trie whose key starts with the
+ * given prefix.
+ *
+ * \note Every value in the subtree of that node, and no other value, was
+ * inserted with a key starting with the prefix.
+ *
+ * \param[in] trie   Trie to search
+ * \param[in] prefix Beginning of the keys
+ * \param[in] length Number of bytes in the prefix
+ *
+ * \return the node, or NULL if no key starts with the prefix
+ */
+static struct simpletrie* __find_prefix(struct simpletrie* trie, const char* prefix, size_t length)
+{
+	struct simpletrie* node = trie; // Node whose key is the part of the prefix matched so far
+
+	while(length > 0)
+	{
+		struct simpletrie* child; // Child continuing the prefix
+		size_t i = 1;             // Number of bytes of the label matched
+
+		child = __find_child(node, *prefix, NULL);
+		if(child == NULL) return NULL;
+
+		while(i < child->length && i < length && prefix[i] == child->label[i]) ++i;
+		if(i == length) return child;
+		if(i < child->length) return NULL;
+
+		node = child;
+		prefix += i;
+		length -= i;
+	}
+
+	return node;
+}
+
+/*!
+ * \brief Get the node after the given one in a preorder walk of a subtree of
+ * a radix trie.
+ *
+ * \param[in] node Current node of the walk
+ * \param[in] top  Root of the subtree being walked
+ *
+ * \return the next node, or NULL if the walk is complete
+ */
+static struct simpletrie* __next(struct simpletrie* node, const struct simpletrie* top)
+{
+	if(node->child) return node->child;
+
+	for(; node != top; node = node->parent)
+	{
+		if(node->sibling) return node->sibling;
+	}
+
+	return NULL;
+}
+
+/*!
+ * \brief Create an empty radix trie.
+ *
+ * \return an empty radix trie, or NULL if we failed to allocate one
+ */
+simpletrie_t simpletrie_init()
+{
+	return __node_init(NULL, 0);
+}
+
+/*!
+ * \brief Free a radix trie.
+ *
+ * \note The values still in the trie are not freed.
+ *
+ * \param[in] trie Trie to free
+ */
+void simpletrie_free(simpletrie_t trie)
+{
+	struct simpletrie* node = trie; // Node being freed
+
+	while(node)
+	{
+		struct simpletrie* parent; // Parent of the node being freed
+
+		if(node->child)
+		{
+			node = node->child;
+			continue;
+		}
+
+		parent = node->parent;
+		if(parent) parent->child = node->sibling;
+		free(node);
+		node = parent;
+	}
+}
+
+/*!
+ * \brief Insert a value into a radix trie.
+ *
+ * \note A value already inserted with the same key is replaced.
+ *
+ * \param[in] trie  Trie to insert into
+ * \param[in] key   Key of the value
+ * \param[in] value Value to insert (which must not be NULL)
+ *
+ * \retval true the value was inserted
+ * \retval false we failed to allocate the requested memory (in which case the
+ * trie is left untouched)
+ */
+bool simpletrie_insert(simpletrie_t trie, const char* key, void* value)
+{
+	struct simpletrie* node; // Node whose key is the part of the key placed so far
+
+	for(node = trie; *key != '\0';)
+	{
+		struct simpletrie** pp;         // Link to the child in the list of children
+		struct simpletrie* child;       // Child continuing the key
+		struct simpletrie* split;       // Node the child is split into
+		struct simpletrie* leaf = NULL; // Node holding the rest of the key after the split
+		size_t i = 1;                   // Number of bytes of the label matched
+
+		child = __find_child(node, *key, &pp);
+		if(child == NULL)
+		{
+			child = __node_init(key, strlen(key));
+			if(child == NULL) return false;
+
+			child->value = value;
+			child->parent = node;
+			child->sibling = *pp;
+			*pp = child;
+
+			return true;
+		}
+
+		while(i < child->length && key[i] == child->label[i]) ++i;
+		if(i == child->length)
+		{
+			node = child;
+			key += i;
+			continue;
+		}
+
+		/* The key ends in the middle of the label of the child, or they part
+		 * ways there. Either way, the child is split at that point, and both
+		 * nodes are allocated before anything is changed.
+		 */
+		split = __node_init(child->label, i);
+		if(split == NULL) return false;
+
+		if(key[i] == '\0')
+		{
+			split->value = value;
+		}
+		else
+		{
+			leaf = __node_init(key + i, strlen(key + i));
+			if(leaf == NULL)
+			{
+				free(split);
+				return false;
+			}
+
+			leaf->value = value;
+			leaf->parent = split;
+		}
+
+		split->parent = node;
+		split->sibling = child->sibling;
+		*pp = split;
+
+		memmove(child->label, child->label + i, child->length - i);
+		child->length -= i;
+		child->parent = split;
+		child->sibling = NULL;
+
+		if(leaf && (unsigned char) leaf->label[0] < (unsigned char) child->label[0])
+		{
+			split->child = leaf;
+			leaf->sibling = child;
+		}
+		else
+		{
+			split->child = child;
+			child->sibling = leaf;
+		}
+
+		return true;
+	}
+
+	node->value = value;
+
+	return true;
+}
+
+/*!
+ * \brief Merge a node of a radix trie which holds no value with its only
+ * child.
+ *
+ * \note If we fail to allocate the merged node, the two nodes are kept. The
+ * trie is still correct; it just has one more node than it needs.
+ *
+ * \param[in] node Node to merge (which must not be the root)
+ */
+static void __merge(struct simpletrie* node)
+{
+	struct simpletrie* child = node->child; // Only child of the node
+	struct simpletrie* merged;              // Node replacing both of them
+	struct simpletrie** pp;                 // Link to the node in the list of children of its parent
+
+	merged = (struct simpletrie*) malloc(sizeof(struct simpletrie) + node->length + child->length);
+	if(merged == NULL) return;
+
+	memcpy(merged->label, node->label, node->length);
+	memcpy(merged->label + node->length, child->label, child->length);
+	merged->length = node->length + child->length;
+	merged->value = child->value;
+	merged->parent = node->parent;
+	merged->sibling = node->sibling;
+	merged->child = child->child;
+	for(struct simpletrie* p = merged->child; p; p = p->sibling) p->parent = merged;
+
+	__find_child(node->parent, node->label[0], &pp);
+	*pp = merged;
+
+	free(child);
+	free(node);
+}
+
+/*!
+ * \brief Remove a value from a radix trie.
+ *
+ * \note It is not an error if the value is not in the trie, or if another
+ * value has since been inserted with the same key (which is left in place).
+ *
+ * \param[in] trie  Trie to remove from
+ * \param[in] key   Key the value was inserted with
+ * \param[in] value Value to remove
+ */
+void simpletrie_remove(simpletrie_t trie, const char* key, const void* value)
+{
+	struct simpletrie* node; // Node holding the value
+
+	node = __find_prefix(trie, key, strlen(key));
+	if(node == NULL || node->value != value) return;
+
+	node->value = NULL;
+	if(node->parent == NULL) return;
+
+	if(node->child == NULL)
+	{
+		struct simpletrie* parent = node->parent; // Parent of the node
+		struct simpletrie** pp;                   // Link to the node in the list of children of its parent
+
+		__find_child(parent, node->label[0], &pp);
+		*pp = node->sibling;
+		free(node);
+
+		node = parent;
+	}
+
+	if(node->parent && node->value == NULL && node->child && node->child->sibling == NULL) __merge(node);
+}
+
+/*!
+ * \brief Call a function with each value in a radix trie whose key starts
+ * with the given prefix.
+ *
+ * \note Only the subtree under the prefix is walked, so the cost is
+ * proportional to the number of keys sharing the prefix, not to the number of
+ * keys in the trie. Values are found in the order of their keys.
+ *
+ * \warning The function must not insert values into, or remove them from, the
+ * trie.
+ *
+ * \param[in] trie     Trie to walk
+ * \param[in] prefix   Beginning of the keys
+ * \param[in] length   Number of bytes in the prefix
+ * \param[in] callback
+ * \parblock
+ * Function to call with each value
+ *
+ * If the function returns false, the walk will be aborted.
+ * \endparblock
+ * \param[in] arg      Argument to pass to the function
+ *
+ * \retval true every value was handed to the function
+ * \retval false the walk was aborted
+ */
+bool simpletrie_walk(simpletrie_t trie, const char* prefix, size_t length, simpletrie_walk_t callback, void* arg)
+{
+	struct simpletrie* top = __find_prefix(trie, prefix, length); // Root of the subtree to walk
+
+	for(struct simpletrie* node = top; node; node = __next(node, top))
+	{
+		if(node->value && callback(node->value, arg) == false) return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,53 @@
+/*
+ * SimplePost - A Simple HTTP Server
+ *
+ * Copyright (C) 2016 Karl Lenz.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have recieved a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ */
+
+#ifndef _SIMPLETRIE_H_
+#define _SIMPLETRIE_H_
+
+#include <sys/types.h>
+#include <stdbool.h>
+
+
+/*!
+ * \brief Radix trie mapping strings to values
+ */
+typedef struct simpletrie* simpletrie_t;
+
+/*!
+ * \brief Function called for each value found by simpletrie_walk()
+ *
+ * \param[in] value Value found
+ * \param[in] arg   Argument given to simpletrie_walk()
+ *
+ * \retval true continue the walk
+ * \retval false abort the walk
+ */
+typedef bool (*simpletrie_walk_t)(void* value, void* arg);
+
+simpletrie_t simpletrie_init();
+void simpletrie_free(simpletrie_t trie);
+
+bool simpletrie_insert(simpletrie_t trie, const char* key, void* value);
+void simpletrie_remove(simpletrie_t trie, const char* key, const void* value);
+
+bool simpletrie_walk(simpletrie_t trie, const char* prefix, size_t length, simpletrie_walk_t callback, void* arg);
+
+#endif // _SIMPLETRIE_H_
@@ -0,0 +1,597 @@
+/*
+ * SimplePost - A Simple HTTP Server
+ *
+ * Copyright (C) 2016 Karl Lenz.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have recieved a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ */
+
+// Needed for pipe2()
+#define _GNU_SOURCE
+
+#include "simplewatch.h"
+#include "impact.h"
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#if defined(HAVE_SYS_INOTIFY_H) && \
+    defined(HAVE_INOTIFY_INIT1)
+#define HAVE_INOTIFY_SUPPORT
+#else
+#undef HAVE_INOTIFY_SUPPORT
+#endif
+
+#ifdef HAVE_INOTIFY_SUPPORT
+#include <sys/inotify.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#endif // HAVE_INOTIFY_SUPPORT
+
+/// Watch namespace header
+#define SP_WATCH_HEADER_NAMESPACE "SimplePost::Watch"
+
+/// Milliseconds a watched file must go without changing before it is checked
+#define SP_WATCH_DELAY     250
+
+/// Most milliseconds a watched file which keeps changing goes without being checked
+#define SP_WATCH_DELAY_MAX 2000
+
+/// Events of a watched directory which may mean a file in it has changed
+#define SP_WATCH_EVENTS    (IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+#ifdef HAVE_INOTIFY_SUPPORT
+/*!
+ * \brief Watch on a directory holding files being watched
+ *
+ * Every file in the same directory shares one inotify watch, so the number of
+ * watches (which the system limits) grows with the number of directories
+ * rather than the number of files.
+ */
+struct simplewatch_dir
+{
+	/// Files being watched in the directory
+	struct simplewatch_file* files;
+
+	/// Next directory in simplewatch::dirs
+	struct simplewatch_dir* next;
+
+	/// Pointer to this directory in simplewatch::dirs or in the previous directory
+	struct simplewatch_dir** pprev;
+
+	/// Watch descriptor returned by inotify_add_watch() (-1 once the kernel has removed the watch)
+	int wd;
+
+	/// Has a file in the directory changed since the files were last checked?
+	bool is_changed;
+
+	/// Name and path of the directory
+	char dir[];
+};
+
+/*!
+ * \brief File being watched for changes
+ */
+struct simplewatch_file
+{
+	/// Data the file was added with
+	void* data;
+
+	/// Name of the file in its directory
+	const char* name;
+
+	/// Directory of the file
+	struct simplewatch_dir* dir;
+
+	/// Next file in the same directory
+	struct simplewatch_file* next;
+
+	/// Pointer to this file in the directory or in the previous file
+	struct simplewatch_file** pprev;
+
+	/// Has the file changed since it was last checked?
+	bool is_changed;
+};
+
+/*!
+ * \brief Thread watching the directories of files for changes with inotify
+ */
+struct simplewatch
+{
+	/// inotify instance watching the directories
+	int fd;
+
+	/// Pipe closed to tell the thread to exit
+	int pipe[2];
+
+	/// Directories being watched (with the lock)
+	struct simplewatch_dir* dirs;
+
+	/// Lock the caller holds around every call into the watcher
+	pthread_mutex_t* lock;
+
+	/// Function to call once files have changed and stopped changing
+	simplewatch_notify_t notify;
+
+	/// Argument to pass to the function
+	void* arg;
+
+	/// Thread waiting for changes
+	pthread_t thread;
+};
+
+/*!
+ * \brief Flag every file in a watched directory as changed.
+ *
+ * \warning The caller must hold the lock of the watcher.
+ *
+ * \param[in] dir Directory to act on
+ *
+ * \return true if any file was flagged, false if none is watched in it
+ */
+static bool __change_dir(struct simplewatch_dir* dir)
+{
+	for(struct simplewatch_file* p = dir->files; p; p = p->next) p->is_changed = true;
+	if(dir->files) dir->is_changed = true;
+
+	return dir->is_changed;
+}
+
+/*!
+ * \brief Flag the files an inotify event may have changed.
+ *
+ * \note The files are only checked once they stop changing (see __run()), so
+ * a file written in many small pieces is checked once.
+ *
+ * \warning The caller must hold the lock of the watcher.
+ *
+ * \param[in] watch Watcher to act on
+ * \param[in] event Event read from simplewatch::fd
+ *
+ * \return true if any file was flagged, false if the event concerns none of
+ * the files being watched
+ */
+static bool __note_event(simplewatch_t watch, const struct inotify_event* event)
+{
+	struct simplewatch_dir* dir; // Directory the event was reported on
+	bool is_changed = false;     // Was any file flagged?
+
+	// Events were lost, so any file may have changed.
+	if(event->mask & IN_Q_OVERFLOW)
+	{
+		impact(1, "%s: Too many files changed at once; checking every file being watched\n",
+			SP_WATCH_HEADER_NAMESPACE);
+		for(dir = watch->dirs; dir; dir = dir->next) is_changed |= __change_dir(dir);
+		return is_changed;
+	}
+
+	for(dir = watch->dirs; dir && dir->wd != event->wd; dir = dir->next);
+	if(dir == NULL) return false;
+
+	// The directory itself is gone, and every file in it with it.
+	if(event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))
+	{
+		if(event->mask & IN_IGNORED) dir->wd = -1;
+		return __change_dir(dir);
+	}
+
+	if(event->len == 0) return false;
+
+	for(struct simplewatch_file* p = dir->files; p; p = p->next)
+	{
+		if(strcmp(p->name, event->name) == 0)
+		{
+			p->is_changed = true;
+			is_changed = true;
+		}
+	}
+	if(is_changed) dir->is_changed = true;
+
+	return is_changed;
+}
+
+/*!
+ * \brief Watch the directories for changes until told to exit.
+ *
+ * \note Changes are coalesced: the watcher is notified once the files have
+ * gone SP_WATCH_DELAY milliseconds without changing, or SP_WATCH_DELAY_MAX
+ * milliseconds after they first changed if they keep changing.
+ *
+ * \param[in] p Watcher to act on (simplewatch_t)
+ *
+ * \return NULL
+ */
+static void* __run(void* p)
+{
+	simplewatch_t watch = (simplewatch_t) p; // Properly cast watcher handle
+	struct pollfd fds[2];                    // inotify instance and the exit pipe
+	struct timespec first;                   // Time the first unchecked change was noted
+	struct timespec last;                    // Time the last unchecked change was noted
+	struct timespec now;                     // Current time
+	bool is_pending = false;                 // Are there changes left to check?
+
+	// Buffer of events, aligned as the events in it must be
+	char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+	fds[0].fd = watch->fd;
+	fds[0].events = POLLIN;
+	fds[1].fd = watch->pipe[0];
+	fds[1].events = POLLIN;
+
+	for(;;)
+	{
+		int timeout = -1; // Milliseconds to wait for events
+
+		if(is_pending)
+		{
+			long quiet; // Milliseconds until the files have been quiet long enough
+			long most;  // Milliseconds until the first change has waited long enough
+
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			quiet = SP_WATCH_DELAY - ((now.tv_sec - last.tv_sec) * 1000 + (now.tv_nsec - last.tv_nsec) / 1000000);
+			most = SP_WATCH_DELAY_MAX - ((now.tv_sec - first.tv_sec) * 1000 + (now.tv_nsec - first.tv_nsec) / 1000000);
+			if(quiet <= 0 || most <= 0)
+			{
+				watch->notify(watch->arg);
+				is_pending = false;
+				continue;
+			}
+			timeout = (int) ((quiet < most) ? quiet : most);
+		}
+
+		if(poll(fds, 2, timeout) == -1)
+		{
+			if(errno == EINTR) continue;
+
+			impact(0, "%s: Stopped watching the files for changes: %s\n",
+				SP_WATCH_HEADER_NAMESPACE,
+				strerror(errno));
+			break;
+		}
+
+		// The pipe is closed when we should exit.
+		if(fds[1].revents) break;
+
+		if(fds[0].revents & POLLIN)
+		{
+			ssize_t length = read(watch->fd, events, sizeof(events)); // Number of bytes of events read
+			bool is_changed = false;                                   // Did any file change?
+
+			if(length <= 0) continue;
+
+			pthread_mutex_lock(watch->lock);
+			for(char* e = events; e < events + length; )
+			{
+				const struct inotify_event* event = (const struct inotify_event*) e; // Event to note
+
+				is_changed |= __note_event(watch, event);
+				e += sizeof(struct inotify_event) + event->len;
+			}
+			pthread_mutex_unlock(watch->lock);
+
+			if(is_changed)
+			{
+				clock_gettime(CLOCK_MONOTONIC, &last);
+				if(is_pending == false) first = last;
+				is_pending = true;
+			}
+		}
+	}
+
+	return NULL;
+}
+#endif // HAVE_INOTIFY_SUPPORT
+
+/*!
+ * \brief Start a thread watching files for changes.
+ *
+ * \note No file is watched until it is added with simplewatch_add().
+ *
+ * \param[in] lock
+ * \parblock
+ * Lock the caller holds around every call into the watcher but this one and
+ * simplewatch_free()
+ *
+ * The thread takes it while it notes the files which changed.
+ * \endparblock
+ * \param[in] notify Function to call once files have changed and stopped changing
+ * \param[in] arg    Argument to pass to the function
+ *
+ * \return the watcher, or NULL (with errno set) if it could not be started.
+ * errno is ENOSYS if inotify is not supported on this system.
+ */
+simplewatch_t simplewatch_init(pthread_mutex_t* lock, simplewatch_notify_t notify, void* arg)
+{
+	#ifdef HAVE_INOTIFY_SUPPORT
+	simplewatch_t watch; // Watcher to start
+	int err;             // Error starting the thread
+
+	watch = (simplewatch_t) calloc(1, sizeof(struct simplewatch));
+	if(watch == NULL) return NULL;
+
+	watch->lock = lock;
+	watch->notify = notify;
+	watch->arg = arg;
+
+	watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if(watch->fd == -1)
+	{
+		free(watch);
+		return NULL;
+	}
+
+	if(pipe2(watch->pipe, O_CLOEXEC) == -1)
+	{
+		err = errno;
+		close(watch->fd);
+		free(watch);
+		errno = err;
+		return NULL;
+	}
+
+	err = pthread_create(&watch->thread, NULL, __run, watch);
+	if(err != 0)
+	{
+		close(watch->pipe[0]);
+		close(watch->pipe[1]);
+		close(watch->fd);
+		free(watch);
+		errno = err;
+		return NULL;
+	}
+
+	return watch;
+	#else
+	// Unused parameters
+	(void) lock;
+	(void) notify;
+	(void) arg;
+
+	errno = ENOSYS;
+	return NULL;
+	#endif // HAVE_INOTIFY_SUPPORT
+}
+
+/*!
+ * \brief Stop a watcher, and free it along with every file still in it.
+ *
+ * \warning The caller must not hold the lock of the watcher, and must forget
+ * the files it added, none of which may be removed from the watcher anymore.
+ *
+ * \param[in] watch Watcher to free
+ */
+void simplewatch_free(simplewatch_t watch)
+{
+	#ifdef HAVE_INOTIFY_SUPPORT
+	if(watch == NULL) return;
+
+	// The thread exits once the write end of its pipe is closed.
+	close(watch->pipe[1]);
+	pthread_join(watch->thread, NULL);
+	close(watch->pipe[0]);
+
+	while(watch->dirs)
+	{
+		struct simplewatch_dir* dir = watch->dirs; // Directory to free
+
+		while(dir->files)
+		{
+			struct simplewatch_file* p = dir->files; // File to free
+
+			dir->files = p->next;
+			free(p);
+		}
+		watch->dirs = dir->next;
+		free(dir);
+	}
+
+	// Closing the instance removes every watch on it.
+	close(watch->fd);
+	free(watch);
+	#else
+	// Unused parameters
+	(void) watch;
+	#endif // HAVE_INOTIFY_SUPPORT
+}
+
+/*!
+ * \brief Start watching a file for changes.
+ *
+ * \note The file shares the watch on its directory with every other file
+ * watched in it.
+ *
+ * \warning The caller must hold the lock of the watcher.
+ *
+ * \param[in] watch Watcher to act on
+ * \param[in] file  Name and path of the file (which must outlive the file in the watcher)
+ * \param[in] data  Data to hand to the function given to simplewatch_check() when the file changes
+ *
+ * \return the file, or NULL if the directory of the file cannot be watched
+ */
+simplewatch_file_t simplewatch_add(simplewatch_t watch, const char* file, void* data)
+{
+	#ifdef HAVE_INOTIFY_SUPPORT
+	const char* name = strrchr(file, '/'); // Name of the file in its directory
+	size_t dir_length;                     // Length of the name of the directory
+	struct simplewatch_file* p;            // File to add
+	struct simplewatch_dir* dir;           // Directory of the file
+	struct simplewatch_dir* same;          // Directory with the same descriptor
+	int wd;                                // Watch descriptor of the directory
+
+	if(name == NULL) dir_length = 0;
+	else if(name == file) dir_length = 1;
+	else dir_length = (size_t) (name - file);
+
+	p = (struct simplewatch_file*) malloc(sizeof(struct simplewatch_file));
+	if(p == NULL)
+	{
+		impact(0, "%s: %s: Failed to allocate memory to watch FILE %s\n",
+			SP_WATCH_HEADER_NAMESPACE, SP_MAIN_HEADER_MEMORY_ALLOC,
+			file);
+		return NULL;
+	}
+
+	for(dir = watch->dirs; dir; dir = dir->next)
+	{
+		if(dir_length == 0 && strcmp(dir->dir, ".") == 0) break;
+		if(dir_length && strncmp(dir->dir, file, dir_length) == 0 && dir->dir[dir_length] == '\0') break;
+	}
+
+	if(dir == NULL)
+	{
+		dir = (struct simplewatch_dir*) malloc(sizeof(struct simplewatch_dir) + (dir_length ? dir_length : 1) + 1);
+		if(dir == NULL)
+		{
+			impact(0, "%s: %s: Failed to allocate memory to watch FILE %s\n",
+				SP_WATCH_HEADER_NAMESPACE, SP_MAIN_HEADER_MEMORY_ALLOC,
+				file);
+			free(p);
+			return NULL;
+		}
+
+		if(dir_length) memcpy(dir->dir, file, dir_length);
+		else dir->dir[dir_length++] = '.';
+		dir->dir[dir_length] = '\0';
+
+		wd = inotify_add_watch(watch->fd, dir->dir, SP_WATCH_EVENTS);
+		if(wd == -1)
+		{
+			impact(0, "%s: Cannot watch DIRECTORY %s for changes: %s\n",
+				SP_WATCH_HEADER_NAMESPACE,
+				dir->dir, strerror(errno));
+			free(dir);
+			free(p);
+			return NULL;
+		}
+
+		/* Different names of the same directory (through symbolic links, say)
+		 * get the same watch descriptor, so they must share one watch.
+		 */
+		for(same = watch->dirs; same && same->wd != wd; same = same->next);
+		if(same)
+		{
+			free(dir);
+			dir = same;
+		}
+		else
+		{
+			dir->files = NULL;
+			dir->wd = wd;
+			dir->is_changed = false;
+			dir->next = watch->dirs;
+			if(dir->next) dir->next->pprev = &dir->next;
+			dir->pprev = &watch->dirs;
+			watch->dirs = dir;
+		}
+	}
+
+	p->data = data;
+	p->name = name ? name + 1 : file;
+	p->dir = dir;
+	p->is_changed = false;
+	p->next = dir->files;
+	if(p->next) p->next->pprev = &p->next;
+	p->pprev = &dir->files;
+	dir->files = p;
+
+	return p;
+	#else
+	// Unused parameters
+	(void) watch;
+	(void) file;
+	(void) data;
+
+	return NULL;
+	#endif // HAVE_INOTIFY_SUPPORT
+}
+
+/*!
+ * \brief Stop watching a file for changes.
+ *
+ * \note The watch on the directory of the file is removed along with the last
+ * file watched in it.
+ *
+ * \warning The caller must hold the lock of the watcher.
+ *
+ * \param[in] watch Watcher to act on
+ * \param[in] file  File to stop watching
+ */
+void simplewatch_remove(simplewatch_t watch, simplewatch_file_t file)
+{
+	#ifdef HAVE_INOTIFY_SUPPORT
+	struct simplewatch_dir* dir = file->dir; // Directory of the file
+
+	*(file->pprev) = file->next;
+	if(file->next) file->next->pprev = file->pprev;
+	free(file);
+
+	if(dir->files == NULL)
+	{
+		if(dir->wd != -1) inotify_rm_watch(watch->fd, dir->wd);
+		*(dir->pprev) = dir->next;
+		if(dir->next) dir->next->pprev = dir->pprev;
+		free(dir);
+	}
+	#else
+	// Unused parameters
+	(void) watch;
+	(void) file;
+	#endif // HAVE_INOTIFY_SUPPORT
+}
+
+/*!
+ * \brief Call a function with each file which has changed since the files
+ * were last checked.
+ *
+ * \warning The caller must hold the lock of the watcher.
+ *
+ * \param[in] watch   Watcher to act on
+ * \param[in] changed Function to call with each file which changed
+ * \param[in] arg     Argument to pass to the function
+ */
+void simplewatch_check(simplewatch_t watch, simplewatch_changed_t changed, void* arg)
+{
+	#ifdef HAVE_INOTIFY_SUPPORT
+	struct simplewatch_dir* dir;  // Directory being checked
+	struct simplewatch_dir* next; // Next directory in the list
+
+	for(dir = watch->dirs; dir; dir = next)
+	{
+		next = dir->next;
+		if(dir->is_changed == false) continue;
+		dir->is_changed = false;
+
+		// Removing the last file in the directory frees the directory.
+		for(struct simplewatch_file* p = dir->files, * p_next; p; p = p_next)
+		{
+			p_next = p->next;
+			if(p->is_changed == false) continue;
+			p->is_changed = false;
+
+			changed(p, p->data, arg);
+		}
+	}
+	#else
+	// Unused parameters
+	(void) watch;
+	(void) changed;
+	(void) arg;
+	#endif // HAVE_INOTIFY_SUPPORT
+}
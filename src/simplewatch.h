@@ -0,0 +1,71 @@
+/*
+ * SimplePost - A Simple HTTP Server
+ *
+ * Copyright (C) 2016 Karl Lenz.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have recieved a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ */
+
+#ifndef _SIMPLEWATCH_H_
+#define _SIMPLEWATCH_H_
+
+#include <sys/types.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+
+/*!
+ * \brief Thread watching the directories of files for changes with inotify
+ */
+typedef struct simplewatch* simplewatch_t;
+
+/*!
+ * \brief File being watched for changes
+ */
+typedef struct simplewatch_file* simplewatch_file_t;
+
+/*!
+ * \brief Function the watch thread calls once files have changed and stopped
+ * changing
+ *
+ * The function is called without the lock of the watcher held, and should
+ * take it and call simplewatch_check().
+ *
+ * \param[in] arg Argument given to simplewatch_init()
+ */
+typedef void (*simplewatch_notify_t)(void* arg);
+
+/*!
+ * \brief Function called by simplewatch_check() for each file which changed
+ *
+ * The function may remove the file it is called with from the watcher, but
+ * no other file.
+ *
+ * \param[in] file File which changed
+ * \param[in] data Data the file was added with
+ * \param[in] arg  Argument given to simplewatch_check()
+ */
+typedef void (*simplewatch_changed_t)(simplewatch_file_t file, void* data, void* arg);
+
+simplewatch_t simplewatch_init(pthread_mutex_t* lock, simplewatch_notify_t notify, void* arg);
+void simplewatch_free(simplewatch_t watch);
+
+simplewatch_file_t simplewatch_add(simplewatch_t watch, const char* file, void* data);
+void simplewatch_remove(simplewatch_t watch, simplewatch_file_t file);
+
+void simplewatch_check(simplewatch_t watch, simplewatch_changed_t changed, void* arg);
+
+#endif // _SIMPLEWATCH_H_
@@ -0,0 +1,106 @@
+#!/bin/sh
+#
+# SimplePost - A Simple HTTP Server
+#
+# Copyright (C) 2016 Karl Lenz.  All rights reserved.
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public
+# License as published by the Free Software Foundation; either
+# version 2 of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# General Public License for more details.
+#
+# You should have recieved a copy of the GNU General Public
+# License along with this program; if not, write to the
+# Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+# Boston, MA 021110-1307, USA.
+#
+
+#
+# Check that requests do not allocate memory once the server is warm.
+#
+# Request state and its buffers are kept in a pool and reused, so after the
+# first requests have filled it, serving a file or a not-found response
+# should not call the allocator from simplepost itself.
+# The allocations are counted by allocount.so, preloaded into the server;
+# those made by libmicrohttpd and libc are not counted.
+#
+# Environment:
+#   SIMPLEPOST  simplepost binary (default ../src/simplepost)
+#   SPLOAD      load generator (default ./spload)
+#   ALLOCOUNT   allocation counter (default ./allocount.so)
+#   REQUESTS    number of requests to count per client (default 200)
+#   PORT        port to serve on (default 18095)
+#
+
+SIMPLEPOST=${SIMPLEPOST:-../src/simplepost}
+SPLOAD=${SPLOAD:-./spload}
+ALLOCOUNT=${ALLOCOUNT:-./allocount.so}
+REQUESTS=${REQUESTS:-200}
+PORT=${PORT:-18095}
+
+[ -f "$ALLOCOUNT" ] || exit 77
+case "$ALLOCOUNT" in
+	/*) ;;
+	*) ALLOCOUNT=$PWD/$ALLOCOUNT ;;
+esac
+
+dir=$(mktemp -d) || exit 1
+pid=
+trap '[ -n "$pid" ] && kill -KILL $pid 2>/dev/null; rm -rf "$dir"' EXIT INT TERM
+
+fail()
+{
+	echo "$0: $*" >&2
+	exit 1
+}
+
+# Print the number of allocations counted so far.
+allocations()
+{
+	od -An -t u8 "$dir/count" | tr -d ' '
+}
+
+echo small > "$dir/small"
+head -c 1048576 /dev/zero > "$dir/large" || exit 1
+
+ALLOCOUNT_FILE="$dir/count" LD_PRELOAD="$ALLOCOUNT" \
+	"$SIMPLEPOST" -q -i 127.0.0.1 -p $PORT "$dir/small" "$dir/large" &
+pid=$!
+
+tries=0
+until "$SPLOAD" -n 1 127.0.0.1 $PORT /small >/dev/null 2>&1
+do
+	tries=$((tries + 1))
+	[ $tries -ge 50 ] && fail "simplepost did not start"
+	sleep 0.1
+done
+
+# The counter only works with glibc.
+[ -s "$dir/count" ] && [ "$(allocations)" -gt 0 ] || exit 77
+
+# Fill the pool with as many request states as the clients below need.
+for uri in /small /large /missing
+do
+	"$SPLOAD" -c 8 -n 10 127.0.0.1 $PORT $uri >/dev/null
+done
+sleep 0.5
+
+for load in "1 /small" "1 /large" "1 /missing" "8 /small" "8 /large"
+do
+	set -- $load
+	before=$(allocations)
+	"$SPLOAD" -c $1 -n $REQUESTS 127.0.0.1 $PORT $2 >/dev/null
+	[ $? -gt 1 ] && fail "cannot request $2"
+	sleep 0.5
+	after=$(allocations)
+
+	[ $after -eq $before ] ||
+		fail "$1 clients made $(($1 * REQUESTS)) requests for $2 with $((after - before)) allocations"
+done
+
+exit 0
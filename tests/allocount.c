@@ -0,0 +1,168 @@
+/*
+ * SimplePost - A Simple HTTP Server
+ *
+ * Copyright (C) 2016 Karl Lenz.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have recieved a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ */
+
+/*
+ * Count the memory allocations a program makes itself.
+ *
+ * Preload this library with LD_PRELOAD and name a file in ALLOCOUNT_FILE. The
+ * number of calls to malloc(), calloc(), realloc() and posix_memalign() made
+ * from the code of the main executable is kept in the file as a 64-bit
+ * integer in host byte order, updated as they happen. Calls made by shared
+ * libraries, such as libmicrohttpd, are not counted, and neither are the
+ * allocations libc makes on behalf of the program (such as in fopen()).
+ *
+ * The file is mapped shared, so the allocations of forked worker processes
+ * are counted too.
+ *
+ * This needs glibc, which exports the allocator under the __libc_ names.
+ */
+
+#define _GNU_SOURCE // dl_iterate_phdr()
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <link.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/// Most executable segments of the main executable we keep track of
+#define ALLOCOUNT_SEGMENTS 8
+
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t nmemb, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+extern void* __libc_memalign(size_t alignment, size_t size);
+
+/// Start and end of each executable segment of the main executable
+static uintptr_t segments[ALLOCOUNT_SEGMENTS][2];
+
+/// Number of executable segments of the main executable
+static size_t segments_count = 0;
+
+/// Number of allocations made by the main executable (NULL until we are loaded)
+static uint64_t* count = NULL;
+
+/*!
+ * \brief Find the executable segments of the main executable.
+ *
+ * \param[in] info Object to look at
+ * \param[in] size Size of info
+ * \param[in] data Unused
+ *
+ * \return 1 to stop after the main executable, which is always listed first
+ */
+static int __find_segments(struct dl_phdr_info* info, size_t size, void* data)
+{
+	// Unused parameters
+	(void) size;
+	(void) data;
+
+	for(ElfW(Half) i = 0; i < info->dlpi_phnum && segments_count < ALLOCOUNT_SEGMENTS; ++i)
+	{
+		const ElfW(Phdr)* phdr = &info->dlpi_phdr[i]; // Segment to look at
+
+		if(phdr->p_type != PT_LOAD || (phdr->p_flags & PF_X) == 0) continue;
+		segments[segments_count][0] = info->dlpi_addr + phdr->p_vaddr;
+		segments[segments_count][1] = info->dlpi_addr + phdr->p_vaddr + phdr->p_memsz;
+		++segments_count;
+	}
+
+	return 1;
+}
+
+/*!
+ * \brief Map the file to count allocations in, once we are loaded.
+ */
+static void __attribute__((constructor)) __allocount_init()
+{
+	const char* name = getenv("ALLOCOUNT_FILE"); // File to count allocations in
+	void* map;                                    // Mapping of the file
+	int fd;                                       // File to count allocations in
+
+	if(name == NULL) return;
+
+	fd = open(name, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	if(fd == -1) return;
+	if(ftruncate(fd, sizeof(uint64_t)) == -1)
+	{
+		close(fd);
+		return;
+	}
+	map = mmap(NULL, sizeof(uint64_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED) return;
+
+	dl_iterate_phdr(&__find_segments, NULL);
+	count = (uint64_t*) map;
+}
+
+/*!
+ * \brief Count an allocation if it was made by the main executable.
+ *
+ * \param[in] caller Return address of the allocation
+ */
+static void __count(const void* caller)
+{
+	uintptr_t address = (uintptr_t) caller; // Return address of the allocation
+
+	if(count == NULL) return;
+	for(size_t i = 0; i < segments_count; ++i)
+	{
+		if(address >= segments[i][0] && address < segments[i][1])
+		{
+			__atomic_fetch_add(count, 1, __ATOMIC_RELAXED);
+			return;
+		}
+	}
+}
+
+void* malloc(size_t size)
+{
+	__count(__builtin_return_address(0));
+	return __libc_malloc(size);
+}
+
+void* calloc(size_t nmemb, size_t size)
+{
+	__count(__builtin_return_address(0));
+	return __libc_calloc(nmemb, size);
+}
+
+void* realloc(void* ptr, size_t size)
+{
+	__count(__builtin_return_address(0));
+	return __libc_realloc(ptr, size);
+}
+
+int posix_memalign(void** memptr, size_t alignment, size_t size)
+{
+	void* ptr; // New allocation
+
+	__count(__builtin_return_address(0));
+	if(alignment < sizeof(void*) || (alignment & (alignment - 1)) != 0) return EINVAL;
+	ptr = __libc_memalign(alignment, size);
+	if(ptr == NULL && size) return ENOMEM;
+	*memptr = ptr;
+	return 0;
+}
@@ -0,0 +1,96 @@
+#!/bin/sh
+#
+# SimplePost - A Simple HTTP Server
+#
+# Copyright (C) 2016 Karl Lenz.  All rights reserved.
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public
+# License as published by the Free Software Foundation; either
+# version 2 of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# General Public License for more details.
+#
+# You should have recieved a copy of the GNU General Public
+# License along with this program; if not, write to the
+# Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+# Boston, MA 021110-1307, USA.
+#
+
+#
+# Compare the --tcp-profile settings over the loopback interface.
+#
+# Each profile is measured with two loads: CLIENTS clients requesting a small
+# file as fast as they can, and SLOW clients each downloading a 2 MiB file
+# read at RATE bytes per second, which stands in for a slow network. On
+# loopback the differences are small; the profiles are meant for real links,
+# so compare the results on the network the server will be used on too.
+#
+# Usage: bench-tcp.sh [PROFILE]...
+#
+# Environment:
+#   SIMPLEPOST  simplepost binary (default ../src/simplepost)
+#   SPLOAD      load generator (default ./spload)
+#   ADDRESS     address to serve on (default 127.0.0.1)
+#   CLIENTS     number of clients requesting the small file (default 8)
+#   SLOW        number of clients downloading the large file (default 16)
+#   RATE        bytes per second each of them reads (default 4194304)
+#   DURATION    seconds to request the small file for (default 5)
+#   PORT        port to serve on, plus the number of the profile (default 18100)
+#
+
+SIMPLEPOST=${SIMPLEPOST:-../src/simplepost}
+SPLOAD=${SPLOAD:-./spload}
+ADDRESS=${ADDRESS:-127.0.0.1}
+CLIENTS=${CLIENTS:-8}
+SLOW=${SLOW:-16}
+RATE=${RATE:-4194304}
+DURATION=${DURATION:-5}
+PORT=${PORT:-18100}
+[ $# -gt 0 ] || set -- default lan-bulk many-small wan-high-latency
+
+dir=$(mktemp -d) || exit 1
+pid=
+trap '[ -n "$pid" ] && kill -KILL $pid 2>/dev/null; rm -rf "$dir"' EXIT INT TERM
+
+echo small > "$dir/small"
+head -c 2097152 /dev/zero > "$dir/large" || exit 1
+
+port=$PORT
+for profile in "$@"
+do
+	# Use a new port, as sockets of the last server may linger in TIME_WAIT.
+	port=$((port + 1))
+	if [ "$profile" = default ]
+	then
+		"$SIMPLEPOST" -q -i $ADDRESS -p $port "$dir/small" "$dir/large" &
+	else
+		"$SIMPLEPOST" -q -i $ADDRESS -p $port --tcp-profile=$profile "$dir/small" "$dir/large" &
+	fi
+	pid=$!
+
+	# Wait for the server to start listening.
+	tries=0
+	until "$SPLOAD" -n 1 $ADDRESS $port /small >/dev/null 2>&1
+	do
+		tries=$((tries + 1))
+		if [ $tries -ge 50 ]
+		then
+			echo "$0: simplepost did not start with --tcp-profile=$profile" >&2
+			exit 1
+		fi
+		sleep 0.1
+	done
+
+	printf '%-17s small: ' $profile
+	"$SPLOAD" -c $CLIENTS -t $DURATION $ADDRESS $port /small
+	printf '%-17s large: ' $profile
+	"$SPLOAD" -c $SLOW -n 1 -r $RATE $ADDRESS $port /large
+
+	kill -KILL $pid
+	wait $pid 2>/dev/null
+	pid=
+done
@@ -0,0 +1,92 @@
+#!/bin/sh
+#
+# SimplePost - A Simple HTTP Server
+#
+# Copyright (C) 2016 Karl Lenz.  All rights reserved.
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public
+# License as published by the Free Software Foundation; either
+# version 2 of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# General Public License for more details.
+#
+# You should have recieved a copy of the GNU General Public
+# License along with this program; if not, write to the
+# Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+# Boston, MA 021110-1307, USA.
+#
+
+#
+# Measure how requests for counted files scale with --workers.
+#
+# FILES small files are served with a large COUNT, so that every download
+# changes the count of a slot in the table the workers share, and the server
+# has to reap those changes while the clients run. The benchmark is run with
+# 1, 2, 4, ... up to WORKERS workers (default: the number of CPUs).
+#
+# Usage: bench-workers.sh [WORKERS]
+#
+# Environment:
+#   SIMPLEPOST  simplepost binary (default ../src/simplepost)
+#   SPLOAD      load generator (default ./spload)
+#   FILES       number of files to serve (default 1000)
+#   CLIENTS     number of clients making requests at once (default 64)
+#   DURATION    seconds to make requests for with each WORKERS (default 5)
+#   PORT        port to serve on, plus the WORKERS (default 18080)
+#
+
+SIMPLEPOST=${SIMPLEPOST:-../src/simplepost}
+SPLOAD=${SPLOAD:-./spload}
+FILES=${FILES:-1000}
+CLIENTS=${CLIENTS:-64}
+DURATION=${DURATION:-5}
+PORT=${PORT:-18080}
+WORKERS=${1:-$(getconf _NPROCESSORS_ONLN 2>/dev/null || echo 4)}
+
+dir=$(mktemp -d) || exit 1
+pid=
+trap '[ -n "$pid" ] && kill -KILL $pid 2>/dev/null; rm -rf "$dir"' EXIT INT TERM
+
+set --
+i=0
+while [ $i -lt $FILES ]
+do
+	echo "file $i" > "$dir/f$i"
+	set -- "$@" -c 1000000000 "$dir/f$i"
+	i=$((i + 1))
+done
+
+n=1
+while [ $n -le $WORKERS ]
+do
+	# Use a new port, as the workers of the last server may still be exiting.
+	port=$((PORT + n))
+	"$SIMPLEPOST" -q -i 127.0.0.1 -p $port --workers=$n "$@" &
+	pid=$!
+
+	# Wait for the server to start listening.
+	tries=0
+	until "$SPLOAD" -n 1 127.0.0.1 $port /f0 >/dev/null 2>&1
+	do
+		tries=$((tries + 1))
+		if [ $tries -ge 50 ]
+		then
+			echo "$0: simplepost did not start with --workers=$n" >&2
+			exit 1
+		fi
+		sleep 0.1
+	done
+
+	printf 'workers=%-4s ' $n
+	"$SPLOAD" -c $CLIENTS -t $DURATION 127.0.0.1 $port /f$((FILES / 2))
+
+	kill -KILL $pid
+	wait $pid 2>/dev/null
+	pid=
+
+	[ $n -lt $WORKERS ] && [ $((n * 2)) -gt $WORKERS ] && n=$WORKERS || n=$((n * 2))
+done
@@ -0,0 +1,103 @@
+#!/bin/sh
+#
+# SimplePost - A Simple HTTP Server
+#
+# Copyright (C) 2016 Karl Lenz.  All rights reserved.
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public
+# License as published by the Free Software Foundation; either
+# version 2 of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# General Public License for more details.
+#
+# You should have recieved a copy of the GNU General Public
+# License along with this program; if not, write to the
+# Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+# Boston, MA 021110-1307, USA.
+#
+
+#
+# Hand off a server in the middle of a large download.
+#
+# The download must finish on the old server with every byte intact, the new
+# server must answer requests as soon as it has taken over, and the old server
+# must exit once the download has finished.
+#
+# Environment:
+#   SIMPLEPOST  simplepost binary (default ../src/simplepost)
+#   PORT        port to serve on (default 18090)
+#
+
+SIMPLEPOST=${SIMPLEPOST:-../src/simplepost}
+PORT=${PORT:-18090}
+
+command -v curl >/dev/null 2>&1 || exit 77
+
+dir=$(mktemp -d) || exit 1
+old=
+new=
+trap 'kill -KILL $old $new 2>/dev/null; rm -rf "$dir"' EXIT INT TERM
+
+fail()
+{
+	echo "$0: $*" >&2
+	exit 1
+}
+
+# 64 MiB read at 16 MiB/s takes long enough to hand off in the middle.
+head -c 67108864 /dev/urandom > "$dir/large" || exit 1
+url=http://127.0.0.1:$PORT/large
+
+"$SIMPLEPOST" -q -i 127.0.0.1 -p $PORT "$dir/large" &
+old=$!
+
+tries=0
+until curl -sf -r 0-0 -o /dev/null $url
+do
+	tries=$((tries + 1))
+	[ $tries -ge 50 ] && fail "simplepost did not start"
+	sleep 0.1
+done
+
+curl -sf --limit-rate 16M -o "$dir/received" $url &
+download=$!
+sleep 1
+
+received=$(wc -c < "$dir/received")
+[ "$received" -gt 0 ] && [ "$received" -lt 67108864 ] ||
+	fail "the download was not in progress at the handoff ($received bytes)"
+
+"$SIMPLEPOST" -q --pid=$old --handoff &
+new=$!
+
+# The new server should answer while the old one finishes the download.
+tries=0
+until [ "$(curl -s -r 0-0 -o /dev/null -w '%{http_code}' $url)" = 206 ] &&
+	kill -0 $old 2>/dev/null
+do
+	tries=$((tries + 1))
+	[ $tries -ge 50 ] && fail "the new server did not take over"
+	sleep 0.1
+done
+
+wait $download || fail "the download failed during the handoff"
+cmp "$dir/large" "$dir/received" || fail "the download was corrupted by the handoff"
+
+tries=0
+while kill -0 $old 2>/dev/null
+do
+	tries=$((tries + 1))
+	[ $tries -ge 50 ] && fail "the old server did not exit after the download"
+	sleep 0.1
+done
+wait $old || fail "the old server exited with an error"
+old=
+
+curl -sf -o "$dir/again" $url || fail "the new server did not serve the file"
+cmp "$dir/large" "$dir/again" || fail "the new server served the wrong bytes"
+
+exit 0
@@ -0,0 +1,340 @@
+/*
+ * SimplePost - A Simple HTTP Server
+ *
+ * Copyright (C) 2016 Karl Lenz.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have recieved a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ */
+
+/*
+ * Load generator for the benchmarks in this directory.
+ *
+ * Each client repeatedly connects to the server, requests the URI (one
+ * request per connection, as most download clients do), and reads the whole
+ * response. Clients may read slowly, to stand in for a slow network without
+ * netem. A summary of every request made is printed at the end.
+ */
+
+#define _GNU_SOURCE // strcasestr()
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+/// Size (in bytes) of the buffer each client reads into
+#define SPLOAD_BUFFER 65536
+
+/*!
+ * \brief Settings shared by every client
+ */
+struct spload_args
+{
+	/// Address of the server
+	struct addrinfo* server;
+
+	/// Request to send
+	char request[4096];
+
+	/// Length of the request
+	size_t request_length;
+
+	/// Number of bytes each client reads per second (0 = as fast as it can)
+	uint64_t rate;
+
+	/// Time (CLOCK_MONOTONIC) to stop making requests
+	struct timespec deadline;
+
+	/// Number of requests each client makes (0 = until the deadline)
+	unsigned long requests;
+};
+
+/*!
+ * \brief Results of one client
+ */
+struct spload_result
+{
+	/// Settings shared by every client
+	const struct spload_args* args;
+
+	/// Thread of the client
+	pthread_t thread;
+
+	/// Number of responses with a 2xx status read in full
+	unsigned long ok;
+
+	/// Number of requests which failed or got another status
+	unsigned long failed;
+
+	/// Number of bytes of responses read
+	uint64_t bytes;
+
+	/// Sum of the time (in seconds) every request took
+	double latency;
+
+	/// Longest time (in seconds) a request took
+	double latency_max;
+};
+
+/*!
+ * \brief Get the number of seconds between two times.
+ *
+ * \param[in] from Earlier time
+ * \param[in] to   Later time
+ *
+ * \return the number of seconds from from to to
+ */
+static double __elapsed(const struct timespec* from, const struct timespec* to)
+{
+	return (double) (to->tv_sec - from->tv_sec) + (double) (to->tv_nsec - from->tv_nsec) / 1e9;
+}
+
+/*!
+ * \brief Make one request and read the whole response.
+ *
+ * \param[in] args   Settings shared by every client
+ * \param[in] buffer Buffer to read into (SPLOAD_BUFFER bytes)
+ * \param[out] bytes Number of bytes read
+ *
+ * \return true if the response had a 2xx status and was read in full
+ */
+static bool __request(const struct spload_args* args, char* buffer, uint64_t* bytes)
+{
+	struct timespec start;        // Time the response started arriving
+	struct timespec now;          // Current time
+	unsigned int status = 0;      // Status of the response
+	uint64_t length = UINT64_MAX; // Length of the body, from Content-Length
+	uint64_t header = 0;          // Length of the header (0 until it has been read)
+	ssize_t n;                    // Number of bytes read at once
+	int sock;                     // Connection to the server
+	bool ok = false;              // Was the response read in full?
+
+	*bytes = 0;
+
+	sock = socket(args->server->ai_family, SOCK_STREAM, 0);
+	if(sock == -1) return false;
+	if(connect(sock, args->server->ai_addr, args->server->ai_addrlen) == -1 ||
+		send(sock, args->request, args->request_length, MSG_NOSIGNAL) != (ssize_t) args->request_length)
+	{
+		close(sock);
+		return false;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while((n = recv(sock, buffer, header ? SPLOAD_BUFFER : SPLOAD_BUFFER - 1, 0)) > 0)
+	{
+		*bytes += (uint64_t) n;
+
+		if(header == 0)
+		{
+			const char* end;    // End of the header
+			const char* field;  // Content-Length field
+
+			// The header of every response we expect fits in the first read.
+			buffer[n] = '\0';
+			end = strstr(buffer, "\r\n\r\n");
+			if(end == NULL || sscanf(buffer, "HTTP/%*u.%*u %u", &status) != 1) break;
+			header = (uint64_t) (end + 4 - buffer);
+
+			field = strcasestr(buffer, "\r\nContent-Length:");
+			if(field && field < end) length = strtoull(field + 17, NULL, 10);
+		}
+
+		if(length != UINT64_MAX && *bytes >= header + length)
+		{
+			ok = (status >= 200 && status < 300);
+			break;
+		}
+
+		// Read no faster than the rate, as a slow network would.
+		if(args->rate)
+		{
+			double due = (double) *bytes / (double) args->rate; // Time the bytes read so far should have taken
+
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			if(due > __elapsed(&start, &now)) usleep((useconds_t) ((due - __elapsed(&start, &now)) * 1e6));
+		}
+	}
+
+	// Without a Content-Length, the body ends with the connection.
+	if(n == 0 && length == UINT64_MAX && header) ok = (status >= 200 && status < 300);
+
+	close(sock);
+
+	return ok;
+}
+
+/*!
+ * \brief Make requests until the deadline or the number of requests is reached.
+ *
+ * \param[inout] cls Results of the client (struct spload_result*)
+ *
+ * \return NULL
+ */
+static void* __client(void* cls)
+{
+	struct spload_result* result = (struct spload_result*) cls; // Results of the client
+	const struct spload_args* args = result->args;              // Settings shared by every client
+	char* buffer;                                               // Buffer to read into
+	struct timespec start;                                      // Time the request was made
+	struct timespec now;                                        // Current time
+	uint64_t bytes;                                             // Number of bytes read in one request
+
+	buffer = (char*) malloc(SPLOAD_BUFFER);
+	if(buffer == NULL) return NULL;
+
+	for(unsigned long i = 0; args->requests == 0 || i < args->requests; ++i)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		if(args->requests == 0 && __elapsed(&start, &args->deadline) <= 0) break;
+
+		if(__request(args, buffer, &bytes)) ++(result->ok);
+		else ++(result->failed);
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		result->bytes += bytes;
+		result->latency += __elapsed(&start, &now);
+		if(__elapsed(&start, &now) > result->latency_max) result->latency_max = __elapsed(&start, &now);
+	}
+
+	free(buffer);
+
+	return NULL;
+}
+
+/*!
+ * \brief Print how to use this program.
+ *
+ * \param[in] name Name of this program
+ */
+static void __usage(const char* name)
+{
+	fprintf(stderr, "Usage: %s [-c CLIENTS] [-t SECONDS | -n REQUESTS] [-r BYTES] HOST PORT URI\n", name);
+	fprintf(stderr, "  -c CLIENTS  number of clients making requests at once (default 1)\n");
+	fprintf(stderr, "  -t SECONDS  make requests for SECONDS (default 5)\n");
+	fprintf(stderr, "  -n REQUESTS make REQUESTS requests per client instead\n");
+	fprintf(stderr, "  -r BYTES    read no more than BYTES per second per client\n");
+}
+
+int main(int argc, char* argv[])
+{
+	struct spload_args args;          // Settings shared by every client
+	struct spload_result* results;    // Results of each client
+	struct addrinfo hints;            // Kind of address to look up
+	struct timespec start;            // Time the first request was made
+	struct timespec end;              // Time the last request finished
+	unsigned int clients = 1;         // Number of clients
+	double seconds = 5;               // Number of seconds to make requests for
+	unsigned long ok = 0;             // Number of responses read in full
+	unsigned long failed = 0;         // Number of requests which failed
+	uint64_t bytes = 0;               // Number of bytes read
+	double latency = 0;               // Sum of the time every request took
+	double latency_max = 0;           // Longest time a request took
+	double elapsed;                   // Number of seconds the clients ran for
+	int opt;                          // Option being parsed
+	int error;                        // Error looking up the server
+
+	memset(&args, 0, sizeof(args));
+	while((opt = getopt(argc, argv, "c:t:n:r:")) != -1)
+	{
+		switch(opt)
+		{
+			case 'c': clients = (unsigned int) strtoul(optarg, NULL, 10); break;
+			case 't': seconds = strtod(optarg, NULL); break;
+			case 'n': args.requests = strtoul(optarg, NULL, 10); break;
+			case 'r': args.rate = strtoull(optarg, NULL, 10); break;
+			default: __usage(argv[0]); return 2;
+		}
+	}
+	if(argc - optind != 3 || clients == 0)
+	{
+		__usage(argv[0]);
+		return 2;
+	}
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	error = getaddrinfo(argv[optind], argv[optind + 1], &hints, &args.server);
+	if(error != 0)
+	{
+		fprintf(stderr, "%s: %s: %s\n", argv[0], argv[optind], gai_strerror(error));
+		return 2;
+	}
+
+	args.request_length = (size_t) snprintf(args.request, sizeof(args.request),
+		"GET %s HTTP/1.1\r\nHost: %s:%s\r\nConnection: close\r\n\r\n",
+		argv[optind + 2], argv[optind], argv[optind + 1]);
+	if(args.request_length >= sizeof(args.request))
+	{
+		fprintf(stderr, "%s: The URI is too long\n", argv[0]);
+		return 2;
+	}
+
+	results = (struct spload_result*) calloc(clients, sizeof(struct spload_result));
+	if(results == NULL) return 2;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	args.deadline = start;
+	args.deadline.tv_sec += (time_t) seconds;
+	args.deadline.tv_nsec += (long) ((seconds - (double) (time_t) seconds) * 1e9);
+	if(args.deadline.tv_nsec >= 1000000000L)
+	{
+		++(args.deadline.tv_sec);
+		args.deadline.tv_nsec -= 1000000000L;
+	}
+
+	for(unsigned int i = 0; i < clients; ++i)
+	{
+		results[i].args = &args;
+		if(pthread_create(&results[i].thread, NULL, &__client, &results[i]) != 0)
+		{
+			fprintf(stderr, "%s: Cannot start client %u: %s\n", argv[0], i, strerror(errno));
+			return 2;
+		}
+	}
+	for(unsigned int i = 0; i < clients; ++i)
+	{
+		pthread_join(results[i].thread, NULL);
+		ok += results[i].ok;
+		failed += results[i].failed;
+		bytes += results[i].bytes;
+		latency += results[i].latency;
+		if(results[i].latency_max > latency_max) latency_max = results[i].latency_max;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	elapsed = __elapsed(&start, &end);
+
+	printf("clients=%u requests=%lu failed=%lu seconds=%.2f req/s=%.0f MiB/s=%.1f latency_ms=%.1f max_ms=%.1f\n",
+		clients, ok + failed, failed, elapsed,
+		(double) (ok + failed) / elapsed,
+		(double) bytes / elapsed / 1048576.0,
+		(ok + failed) ? latency / (double) (ok + failed) * 1000.0 : 0.0,
+		latency_max * 1000.0);
+
+	freeaddrinfo(args.server);
+	free(results);
+
+	return failed ? 1 : 0;
+}